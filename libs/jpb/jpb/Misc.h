@@ -1,8 +1,5 @@
 #pragma once
 
-#include <windows.h>
-#include <fcntl.h>
-#include <io.h>
 #include <iostream>
 
 inline float lerp(float start, float end, float t)
@@ -10,6 +7,12 @@ inline float lerp(float start, float end, float t)
   return start + ((end - start) * t);
 }
 
+#ifdef _WIN32
+
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+
 static const int MAX_CONSOLE_LINES = 500;
 
 void redirectIOToConsole()
@@ -60,3 +63,5 @@ void redirectIOToConsole()
   // point to console as well
   std::ios::sync_with_stdio();
 }
+
+#endif
@@ -1,11 +1,15 @@
 #include <xmmintrin.h>
 #include <string>
 #include <map>
+#include <algorithm>
 #include "Noise.h"
 #include "SimpleParser.h"
 #include "Profiler.h"
 #include "Misc.h"
 
+using std::min;
+using std::max;
+
 bool GenData::operator==(const GenData& genData) const
 {
   if(noiseParams.frequency == genData.noiseParams.frequency &&
@@ -129,8 +133,9 @@ Noise::perlin(Vec2f point, real32 frequency)
   return lerp(upX, downX, ty) * sqr2;
 }
 
-#define m(a, index) ((a).m128_f32[(3 - index)])
-#define mi(a, index) ((a).m128i_i32[(3 - index)])
+// Lane access without the MSVC only m128_f32 members
+#define m(a, index) (((float*)&(a))[(3 - index)])
+#define mi(a, index) (((int32*)&(a))[(3 - index)])
 
 Vec4f
 Noise::perlinFast(const Vec2f points[], real32 frequency)
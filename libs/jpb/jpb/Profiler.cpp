@@ -1,4 +1,22 @@
+#if defined(_WIN64) || defined(_WIN32)
 #include <windows.h>
+#include <intrin.h>
+#else
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define JPB_HAS_RDTSC
+#endif
+#endif
+#if defined(_M_X64) || defined(_M_IX86)
+#define JPB_HAS_RDTSC
+#endif
+#include <stdio.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <thread>
 #include <iomanip>
 #include <iostream>
 #include "Profiler.h"
@@ -45,13 +63,13 @@ ProfilerEntry::endFrame()
 }
 
 void
-ProfilerBase::start(std::string region)
+ProfilerBase::start(const std::string& region)
 {
   profilerEntries[region].start(getCurrentTime(), getCurrentCycleCount());
 }
 
 void
-ProfilerBase::end(std::string region)
+ProfilerBase::end(const std::string& region)
 {
   profilerEntries[region].end(getCurrentTime(), getCurrentCycleCount());
 }
@@ -109,11 +127,13 @@ ProfilerBase::endFrame()
 }
 
 
-#if defined(_WIN64) || defined(_WIN32)
-
 Profiler::Profiler()
 {
+#if defined(_WIN64) || defined(_WIN32)
   QueryPerformanceFrequency((LARGE_INTEGER*) &counterFrequency);
+#else
+  counterFrequency = 1000000000;
+#endif
 }
 
 void
@@ -126,15 +146,208 @@ double
 Profiler::getCurrentTime() const
 {
   int64 performanceCounter;
+#if defined(_WIN64) || defined(_WIN32)
   QueryPerformanceCounter((LARGE_INTEGER*)&performanceCounter);
+#else
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  performanceCounter = (int64)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
   return performanceCounter / (double) counterFrequency;
 }
 
 uint64
 Profiler::getCurrentCycleCount() const
 {
+#ifdef JPB_HAS_RDTSC
   uint64 cycleCount = __rdtsc();
   return cycleCount;
+#else
+  return (uint64)(getCurrentTime() * 1e9);
+#endif
+}
+
+std::atomic<bool> Trace::enabled(false);
+
+// Buffers of every thread that recorded something, they outlive their threads so that
+// finished workers still show up in the trace
+static std::mutex traceBuffersMutex;
+static std::vector<std::unique_ptr<TraceBuffer>> traceBuffers;
+static thread_local TraceBuffer* threadTraceBuffer = NULL;
+// Kept until the thread records something, threads that never do don't get a buffer
+static thread_local const char* threadName = NULL;
+
+// Pairs of timestamp and steady clock nanoseconds, the timestamp rate comes from two of them
+static uint64 startTimestamp;
+static uint64 startNanoseconds;
+
+static uint64
+getNanoseconds()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static TraceBuffer*
+getThreadTraceBuffer()
+{
+  if(!threadTraceBuffer)
+  {
+    std::lock_guard<std::mutex> lock(traceBuffersMutex);
+    traceBuffers.push_back(std::unique_ptr<TraceBuffer>(new TraceBuffer((uint32)traceBuffers.size())));
+    threadTraceBuffer = traceBuffers.back().get();
+    if(threadName) threadTraceBuffer->threadName = threadName;
+  }
+  return threadTraceBuffer;
+}
+
+void
+TraceBuffer::copyEvents(std::vector<Event>* result) const
+{
+  uint64 end = writeIndex.load(std::memory_order_acquire);
+  uint64 start = end > capacity ? end - capacity : 0;
+
+  std::vector<Event> copied;
+  copied.reserve(end - start);
+  for(uint64 index = start; index < end; index++)
+  {
+    const TraceEvent& event = events[index & (capacity - 1)];
+    copied.push_back({ event.zone.load(std::memory_order_relaxed), event.timestamp.load(std::memory_order_relaxed),
+		       (TRACE_PHASE)event.phase.load(std::memory_order_relaxed) });
+  }
+
+  // Slots the owner got to while copying, including the one it may be writing now, can mix
+  // two events
+  uint64 newEnd = writeIndex.load(std::memory_order_acquire);
+  uint64 firstValid = newEnd + 1 > capacity ? newEnd + 1 - capacity : 0;
+  for(uint64 index = std::max(start, firstValid); index < end; index++)
+  {
+    result->push_back(copied[index - start]);
+  }
+}
+
+void
+Trace::setEnabled(bool enabled)
+{
+  if(enabled && !startNanoseconds)
+  {
+    startTimestamp = getTimestamp();
+    startNanoseconds = getNanoseconds();
+  }
+  Trace::enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void
+Trace::setThreadName(const char* name)
+{
+  threadName = name;
+  if(threadTraceBuffer)
+  {
+    std::lock_guard<std::mutex> lock(traceBuffersMutex);
+    threadTraceBuffer->threadName = name;
+  }
 }
 
+void
+Trace::record(const ProfileZone* zone, TRACE_PHASE phase)
+{
+  getThreadTraceBuffer()->push(zone, phase, getTimestamp());
+}
+
+uint64
+Trace::getTimestamp()
+{
+#ifdef JPB_HAS_RDTSC
+  return __rdtsc();
+#else
+  return getNanoseconds();
 #endif
+}
+
+// Names come from string literals in the code, only quotes and backslashes need escaping
+static void
+writeJsonString(FILE* file, const char* text)
+{
+  fputc('"', file);
+  for(const char* c = text; *c; c++)
+  {
+    if(*c == '"' || *c == '\\') fputc('\\', file);
+    fputc(*c, file);
+  }
+  fputc('"', file);
+}
+
+bool
+Trace::writeChromeTrace(const std::string& path)
+{
+  if(!startNanoseconds) return false;
+
+  // Rate of the timestamps, measured over the whole recording
+  uint64 nanoseconds = getNanoseconds();
+  if(nanoseconds - startNanoseconds < 10000000)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    nanoseconds = getNanoseconds();
+  }
+  real64 microsecondsPerTick = (nanoseconds - startNanoseconds) * 0.001 / (real64)(getTimestamp() - startTimestamp);
+  uint64 exportTimestamp = getTimestamp();
+
+  FILE* file = fopen(path.c_str(), "w");
+  if(!file) return false;
+
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  bool first = true;
+
+  std::lock_guard<std::mutex> lock(traceBuffersMutex);
+  std::vector<TraceBuffer::Event> events;
+  for(auto it = traceBuffers.begin(); it != traceBuffers.end(); it++)
+  {
+    const TraceBuffer& buffer = **it;
+    if(!buffer.threadName.empty())
+    {
+      fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+	      first ? "" : ",\n", buffer.threadIndex);
+      writeJsonString(file, buffer.threadName.c_str());
+      fprintf(file, "}}");
+      first = false;
+    }
+
+    events.clear();
+    buffer.copyEvents(&events);
+
+    // Ends whose begin got overwritten are dropped, zones still open are closed at the end
+    std::vector<const ProfileZone*> openZones;
+    for(auto event = events.begin(); event != events.end(); event++)
+    {
+      if(event->phase == TP_END)
+      {
+	if(openZones.empty()) continue;
+	openZones.pop_back();
+      }
+      else
+      {
+	openZones.push_back(event->zone);
+      }
+
+      real64 time = (real64)(int64)(event->timestamp - startTimestamp) * microsecondsPerTick;
+      fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+      writeJsonString(file, event->zone->name);
+      fprintf(file, ",\"cat\":\"zone\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+	      event->phase == TP_BEGIN ? "B" : "E", time, buffer.threadIndex);
+      first = false;
+    }
+
+    real64 endTime = (real64)(int64)(exportTimestamp - startTimestamp) * microsecondsPerTick;
+    while(!openZones.empty())
+    {
+      fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+      writeJsonString(file, openZones.back()->name);
+      fprintf(file, ",\"cat\":\"zone\",\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}", endTime, buffer.threadIndex);
+      openZones.pop_back();
+      first = false;
+    }
+  }
+
+  fprintf(file, "\n]}\n");
+  return fclose(file) == 0;
+}
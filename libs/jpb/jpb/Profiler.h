@@ -2,6 +2,8 @@
 
 #include <unordered_map>
 #include <string>
+#include <vector>
+#include <atomic>
 #include <assert.h>
 
 #include "jpb.h"
@@ -73,8 +75,8 @@ class DllExport ProfilerBase {
 public:
   virtual void startFrame() = 0;
 
-  void start(std::string region);
-  void end(std::string region);
+  void start(const std::string& region);
+  void end(const std::string& region);
 
   void showData() const;
   void endFrame();
@@ -86,8 +88,6 @@ private:
   uint64 framesElapsed = 0;
 };
 
-#if defined(_WIN64) || defined(_WIN32)
-
 class DllExport Profiler : public ProfilerBase, public Singleton<Profiler> {
 public:
   Profiler();
@@ -98,7 +98,117 @@ public:
   uint64 getCurrentCycleCount() const;
 
 private:
+  // QueryPerformanceCounter ticks per second, CLOCK_MONOTONIC is in nanoseconds elsewhere
   int64 counterFrequency;
 };
 
+// Zone profiler for code that runs often or on many threads, the one above hashes the region
+// name on every call. Every PROFILE_ZONE call site has a constant initialized ProfileZone,
+// its address is the zone id, so entering a zone looks nothing up. Threads write begin and end
+// events into their own ring buffer, the oldest events get overwritten once it's full.
+//
+//   void Game::render()
+//   {
+//     PROFILE_ZONE("Game::render");
+//     ...
+//   }
+//
+// Nothing is recorded until Trace::setEnabled(true), then writeChromeTrace saves what the
+// buffers hold for chrome://tracing or ui.perfetto.dev. Defining JPB_NO_PROFILE compiles the
+// zones out.
+
+struct ProfileZone {
+  const char* name;
+  const char* file;
+  uint32 line;
+};
+
+enum TRACE_PHASE {
+  TP_BEGIN,
+  TP_END
+};
+
+// Written by the owning thread only, exported from any thread. Fields are atomics so a
+// slot can be read while it gets overwritten, the export drops slots that might have been.
+struct TraceEvent {
+  std::atomic<const ProfileZone*> zone;
+  std::atomic<uint64> timestamp;
+  std::atomic<uint32> phase;
+};
+
+class DllExport TraceBuffer {
+public:
+  static const uint32 capacity = 1 << 16;
+
+  TraceBuffer(uint32 threadIndex) : threadIndex(threadIndex), writeIndex(0) {}
+
+  void push(const ProfileZone* zone, TRACE_PHASE phase, uint64 timestamp)
+  {
+    uint64 index = writeIndex.load(std::memory_order_relaxed);
+    TraceEvent& event = events[index & (capacity - 1)];
+    event.zone.store(zone, std::memory_order_relaxed);
+    event.timestamp.store(timestamp, std::memory_order_relaxed);
+    event.phase.store(phase, std::memory_order_relaxed);
+    writeIndex.store(index + 1, std::memory_order_release);
+  }
+
+  struct Event {
+    const ProfileZone* zone;
+    uint64 timestamp;
+    TRACE_PHASE phase;
+  };
+  // Events still in the ring, oldest first
+  void copyEvents(std::vector<Event>* result) const;
+
+  uint32 threadIndex;
+  std::string threadName;
+private:
+  TraceEvent events[capacity];
+  std::atomic<uint64> writeIndex;
+};
+
+class DllExport Trace {
+public:
+  static void setEnabled(bool enabled);
+  static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+  // Shows up as the thread name in the trace, call it from the thread itself. The name has
+  // to stay valid, string literals are what it's meant for.
+  static void setThreadName(const char* name);
+
+  static void record(const ProfileZone* zone, TRACE_PHASE phase);
+
+  // Time stamp counter where there is one, the monotonic clock elsewhere
+  static uint64 getTimestamp();
+
+  // Chrome trace event format, false when the file can't be written
+  static bool writeChromeTrace(const std::string& path);
+private:
+  static std::atomic<bool> enabled;
+};
+
+class ScopedZone {
+public:
+  ScopedZone(const ProfileZone* zone) : zone(Trace::isEnabled() ? zone : NULL)
+  {
+    if(this->zone) Trace::record(zone, TP_BEGIN);
+  }
+  ~ScopedZone()
+  {
+    // Zones entered before tracing got turned off still get their end
+    if(zone) Trace::record(zone, TP_END);
+  }
+private:
+  const ProfileZone* zone;
+};
+
+#define JPB_CONCAT_(a, b) a##b
+#define JPB_CONCAT(a, b) JPB_CONCAT_(a, b)
+
+#ifdef JPB_NO_PROFILE
+#define PROFILE_ZONE(name)
+#else
+#define PROFILE_ZONE(name)						\
+  static const ProfileZone JPB_CONCAT(profileZone, __LINE__) = { name, __FILE__, __LINE__ }; \
+  ScopedZone JPB_CONCAT(scopedZone, __LINE__)(&JPB_CONCAT(profileZone, __LINE__))
 #endif
@@ -1,5 +1,6 @@
 #include "SimpleParser.h"
 #include <algorithm>
+#include <cmath>
 #include <assert.h>
 #include <string>
 #include "Types.h"
@@ -5,7 +5,7 @@
 #include <unordered_map>
 
 #include "jpb.h"
-#include "types.h"
+#include "Types.h"
 
 // #define DEBUG_PARSER
 
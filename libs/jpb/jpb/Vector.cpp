@@ -1,6 +1,6 @@
 // Definitions
 template <typename T>
-Vec2<T> Vec2<T>::operator+(Vec2<T>& vector) const
+Vec2<T> Vec2<T>::operator+(const Vec2<T>& vector) const
 {
   return Vec2<T>(x + vector.x, y + vector.y);
 }
@@ -164,7 +164,7 @@ void Vec2<T>::showData() const
 // Vec3
 
 template <typename T>
-Vec3<T> Vec3<T>::operator+(Vec3<T>& vector) const
+Vec3<T> Vec3<T>::operator+(const Vec3<T>& vector) const
 {
   return Vec3<T>(x + vector.x, y + vector.y, z + vector.z);
 }
@@ -8,6 +8,8 @@
 
 #else
 
+#include <cmath>
+
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
@@ -16,7 +18,7 @@
 
 // This thing is only temporary for debug stuff
 #include <iostream>
-#include "types.h"
+#include "Types.h"
 
 enum CARDINAL_DIRECTION{
   CD_UP,
@@ -33,7 +35,7 @@ public:
 
   Vec2<T>(const T x=0, const T y=0) : x(x), y(y) {}
 
-  Vec2<T> operator+(Vec2<T>& vector) const ;
+  Vec2<T> operator+(const Vec2<T>& vector) const ;
   Vec2<T> operator-(const Vec2<T>& vector) const ;
   Vec2<T> operator*(const float scalar) const ;
   Vec2<T> operator/(const float scalar) const ;
@@ -76,7 +78,7 @@ public:
 
   Vec3<T>(const T x=0, const T y=0, const T z=0) : x(x), y(y), z(z) {}
 
-  Vec3<T> operator+(Vec3<T>& vector) const ;
+  Vec3<T> operator+(const Vec3<T>& vector) const ;
   Vec3<T> operator-(const Vec3<T>& vector) const ;
   Vec3<T> operator-() const
   {
@@ -107,11 +109,8 @@ public:
   static Vec3<T> lerp(const Vec3<T>& v1, const Vec3<T>& v2, float t);
   static Vec3<real32> cross(const Vec3<T>& v1, const Vec3<T>& v2);
 
-  static Vec3<T> rotateAround(const Vec3<T> src, real32 angle, Vec3& orbital)
-  {
-    Mat3 rotMat = Mat3::createRotationMatrix(angle, orbital);
-    return rotMat * src;
-  }
+  // Defined after Mat3
+  static Vec3<T> rotateAround(const Vec3<T>& src, real32 angle, const Vec3<T>& orbital);
 
   void rotateAroundX(float radAngle);
   void rotateAroundY(float radAngle);
@@ -231,6 +230,13 @@ public:
 
 };
 
+template <typename T>
+Vec3<T> Vec3<T>::rotateAround(const Vec3<T>& src, real32 angle, const Vec3<T>& orbital)
+{
+  Mat3 rotMat = Mat3::createRotationMatrix(angle, orbital);
+  return rotMat * src;
+}
+
 class Mat4 {
 public:
   Mat4()
@@ -0,0 +1,318 @@
+#include "AssetCache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <mutex>
+
+#include "MeshLod.h"
+
+// Out of line, the chains are incomplete in the header
+AssetCache::AssetCache()
+{
+}
+
+AssetCache::~AssetCache()
+{
+}
+
+const Mesh*
+AssetCache::getMesh(const std::string& name)
+{
+  {
+    std::shared_lock<std::shared_timed_mutex> lock(mutex);
+    auto it = meshes.find(name);
+    if(it != meshes.end()) return it->second.get();
+  }
+
+  // Loading holds the exclusive lock, every asset is loaded once only
+  std::unique_lock<std::shared_timed_mutex> lock(mutex);
+  auto it = meshes.find(name);
+  if(it != meshes.end()) return it->second.get();
+
+  std::unique_ptr<Mesh> mesh(new Mesh());
+  if(!loadMesh(name, mesh.get())) mesh.reset();
+
+  const Mesh* result = mesh.get();
+  meshes[name] = std::move(mesh);
+  return result;
+}
+
+const TextureBuffer*
+AssetCache::getTexture(const std::string& name)
+{
+  {
+    std::shared_lock<std::shared_timed_mutex> lock(mutex);
+    auto it = textures.find(name);
+    if(it != textures.end()) return it->second ? &it->second->buffer : NULL;
+  }
+
+  std::unique_lock<std::shared_timed_mutex> lock(mutex);
+  auto it = textures.find(name);
+  if(it != textures.end()) return it->second ? &it->second->buffer : NULL;
+
+  std::unique_ptr<Texture> texture(new Texture());
+  if(!loadTexture(name, texture.get())) texture.reset();
+
+  const TextureBuffer* result = texture ? &texture->buffer : NULL;
+  textures[name] = std::move(texture);
+  return result;
+}
+
+const LodChain*
+AssetCache::getLodChain(const std::string& name)
+{
+  {
+    std::shared_lock<std::shared_timed_mutex> lock(mutex);
+    auto it = lodChains.find(name);
+    if(it != lodChains.end()) return it->second.get();
+  }
+
+  // Takes the lock itself
+  const Mesh* mesh = getMesh(name);
+
+  // Simplifying takes long, it runs without the lock so other lookups aren't held up. Threads
+  // asking for the same chain at once build it each, the first one inserted is kept.
+  std::unique_ptr<LodChain> lodChain;
+  if(mesh) lodChain.reset(new LodChain(LodChain::build(*mesh)));
+
+  std::unique_lock<std::shared_timed_mutex> lock(mutex);
+  auto inserted = lodChains.emplace(name, std::move(lodChain));
+  return inserted.first->second.get();
+}
+
+uint32
+AssetCache::getMeshCount() const
+{
+  std::shared_lock<std::shared_timed_mutex> lock(mutex);
+  return (uint32)meshes.size();
+}
+
+uint32
+AssetCache::getTextureCount() const
+{
+  std::shared_lock<std::shared_timed_mutex> lock(mutex);
+  return (uint32)textures.size();
+}
+
+bool
+AssetCache::loadMesh(const std::string& name, Mesh* mesh)
+{
+  if(name == "builtin:cube") createCube(mesh);
+  else if(name == "builtin:plane") createPlane(mesh);
+  else if(name == "builtin:sphere") createSphere(mesh);
+  else if(!loadObj(name, mesh)) return false;
+
+  MeshHelper::calculateNormals(mesh->vertices, mesh->triangleIndices);
+  return true;
+}
+
+bool
+AssetCache::loadTexture(const std::string& name, Texture* texture)
+{
+  if(name == "builtin:checker") createChecker(texture);
+  else if(!loadPpm(name, texture)) return false;
+
+  texture->buffer.pixelData = texture->pixels.data();
+  texture->buffer.pitch = texture->buffer.dimensions.x * sizeof(uint32);
+  return true;
+}
+
+// Positions, texture coordinates and polygonal faces, normals are recalculated. Corners sharing
+// position and uv become one vertex. Obj is right handed with uv starting at the bottom, so z
+// and v get flipped.
+bool
+AssetCache::loadObj(const std::string& path, Mesh* mesh)
+{
+  FILE* file = fopen(path.c_str(), "r");
+  if(!file) return false;
+
+  std::vector<Vec3f> positions;
+  std::vector<Vec2f> uvs;
+  std::unordered_map<uint64, uint32> cornerVertices;
+  char line[1024];
+
+  while(fgets(line, sizeof(line), file))
+  {
+    if(!strncmp(line, "v ", 2))
+    {
+      Vec3f position;
+      sscanf(line + 2, "%f %f %f", &position.x, &position.y, &position.z);
+      position.z = -position.z;
+      positions.push_back(position);
+    }
+    else if(!strncmp(line, "vt ", 3))
+    {
+      Vec2f uv;
+      sscanf(line + 3, "%f %f", &uv.x, &uv.y);
+      uv.y = 1.0f - uv.y;
+      uvs.push_back(uv);
+    }
+    else if(!strncmp(line, "f ", 2))
+    {
+      std::vector<uint32> face;
+      char* corner = strtok(line + 2, " \t\r\n");
+
+      for(; corner; corner = strtok(NULL, " \t\r\n"))
+      {
+	// v, v/vt, v/vt/vn or v//vn, negative indices count from the end
+	int32 positionIndex = atoi(corner);
+	char* slash = strchr(corner, '/');
+	int32 uvIndex = (slash && slash[1] != '/') ? atoi(slash + 1) : 0;
+
+	positionIndex = positionIndex < 0 ? (int32)positions.size() + positionIndex : positionIndex - 1;
+	uvIndex = uvIndex < 0 ? (int32)uvs.size() + uvIndex : uvIndex - 1;
+	if(positionIndex < 0 || positionIndex >= (int32)positions.size() || uvIndex >= (int32)uvs.size())
+	{
+	  fclose(file);
+	  return false;
+	}
+
+	uint64 key = (uint64)positionIndex << 32 | (uint32)(uvIndex + 1);
+	auto it = cornerVertices.find(key);
+	if(it == cornerVertices.end())
+	{
+	  MappedVertex vertex = { positions[positionIndex], uvIndex >= 0 ? uvs[uvIndex] : Vec2f(), Vec3f() };
+	  mesh->vertices.push_back(vertex);
+	  it = cornerVertices.insert(std::make_pair(key, (uint32)mesh->vertices.size() - 1)).first;
+	}
+	face.push_back(it->second);
+      }
+
+      // Fan, flipping z turned counter clockwise faces into the clockwise ones we draw
+      for(uint32 i = 2; i < face.size(); i++)
+      {
+	IndexedTriangle triangle = {{ face[0], face[i - 1], face[i] }};
+	mesh->triangleIndices.push_back(triangle);
+      }
+    }
+  }
+
+  fclose(file);
+  return !mesh->triangleIndices.empty();
+}
+
+bool
+AssetCache::loadPpm(const std::string& path, Texture* texture)
+{
+  FILE* file = fopen(path.c_str(), "rb");
+  if(!file) return false;
+
+  int32 width = 0;
+  int32 height = 0;
+  int32 maxValue = 0;
+  if(fscanf(file, "P6 %d %d %d", &width, &height, &maxValue) != 3 || maxValue != 255 ||
+     width <= 0 || height <= 0 || fgetc(file) == EOF)
+  {
+    fclose(file);
+    return false;
+  }
+
+  std::vector<uint8> rgb(width * height * 3);
+  bool complete = fread(rgb.data(), 1, rgb.size(), file) == rgb.size();
+  fclose(file);
+  if(!complete) return false;
+
+  texture->pixels.resize(width * height);
+  texture->buffer.dimensions = Vec2i(width, height);
+
+  for(int32 i = 0; i < width * height; i++)
+  {
+    texture->pixels[i] = packColor(rgb[i * 3], rgb[i * 3 + 1], rgb[i * 3 + 2]);
+  }
+
+  return true;
+}
+
+void
+AssetCache::createCube(Mesh* mesh)
+{
+  // Unit cube around the origin, every face has its own vertices for flat normals and uvs
+  static const real32 halfSize = 0.5f;
+  Vec3f faceRotations[6] = {
+    Vec3f(0, 0, 0), Vec3f(0, 90.0f, 0), Vec3f(0, 180.0f, 0),
+    Vec3f(0, 270.0f, 0), Vec3f(90.0f, 0, 0), Vec3f(-90.0f, 0, 0)
+  };
+
+  for(uint32 i = 0; i < 6; i++)
+  {
+    MappedVertices face = {
+      { Vec3f(-halfSize, halfSize, -halfSize), Vec2f(0, 0), Vec3f() },
+      { Vec3f(halfSize, halfSize, -halfSize), Vec2f(1.0f, 0), Vec3f() },
+      { Vec3f(-halfSize, -halfSize, -halfSize), Vec2f(0, 1.0f), Vec3f() },
+      { Vec3f(halfSize, -halfSize, -halfSize), Vec2f(1.0f, 1.0f), Vec3f() }
+    };
+    MeshHelper::rotateVertices(face, faceRotations[i]);
+
+    uint32 base = i * 4;
+    mesh->vertices.insert(mesh->vertices.end(), face.begin(), face.end());
+    mesh->triangleIndices.push_back({{ base, base + 1, base + 2 }});
+    mesh->triangleIndices.push_back({{ base + 1, base + 3, base + 2 }});
+  }
+}
+
+void
+AssetCache::createPlane(Mesh* mesh)
+{
+  // Two by two units at y = 0 facing up, texture repeats four times
+  mesh->vertices = {
+    { Vec3f(-1.0f, 1.0f, 0), Vec2f(0, 0), Vec3f() },
+    { Vec3f(1.0f, 1.0f, 0), Vec2f(4.0f, 0), Vec3f() },
+    { Vec3f(-1.0f, -1.0f, 0), Vec2f(0, 4.0f), Vec3f() },
+    { Vec3f(1.0f, -1.0f, 0), Vec2f(4.0f, 4.0f), Vec3f() }
+  };
+  MeshHelper::rotateVertices(mesh->vertices, Vec3f(90.0f, 0, 0));
+  mesh->triangleIndices = {{0, 1, 2}, {1, 3, 2}};
+}
+
+void
+AssetCache::createSphere(Mesh* mesh)
+{
+  // Unit diameter, rings from the top down and segments around y. The seam and the poles get
+  // a vertex per uv, the texture wraps twice around and once from pole to pole.
+  static const uint32 segmentCount = 32;
+  static const uint32 ringCount = 16;
+  static const real32 radius = 0.5f;
+
+  for(uint32 ring = 0; ring <= ringCount; ring++)
+  {
+    real32 v = (real32)ring / ringCount;
+    real32 polar = v * (real32)M_PI;
+    for(uint32 segment = 0; segment <= segmentCount; segment++)
+    {
+      real32 u = (real32)segment / segmentCount;
+      real32 azimuth = u * 2.0f * (real32)M_PI;
+      Vec3f position(sinf(polar) * cosf(azimuth), cosf(polar), sinf(polar) * sinf(azimuth));
+      mesh->vertices.push_back({ position * radius, Vec2f(u * 2.0f, v), Vec3f() });
+    }
+  }
+
+  // Same winding as the cube, clockwise seen from outside
+  uint32 rowLength = segmentCount + 1;
+  for(uint32 ring = 0; ring < ringCount; ring++)
+  {
+    for(uint32 segment = 0; segment < segmentCount; segment++)
+    {
+      uint32 index = ring * rowLength + segment;
+      if(ring != 0) mesh->triangleIndices.push_back({{ index, index + 1, index + rowLength }});
+      if(ring != ringCount - 1) mesh->triangleIndices.push_back({{ index + 1, index + rowLength + 1, index + rowLength }});
+    }
+  }
+}
+
+void
+AssetCache::createChecker(Texture* texture)
+{
+  Vec2i dimensions(16, 16);
+  texture->pixels.resize(dimensions.x * dimensions.y);
+  texture->buffer.dimensions = dimensions;
+
+  for(int32 y = 0; y < dimensions.y; y++)
+  {
+    for(int32 x = 0; x < dimensions.x; x++)
+    {
+      bool dark = ((x / 4) + (y / 4)) & 1;
+      texture->pixels[y * dimensions.x + x] = dark ? packColor(60, 70, 90) : packColor(220, 200, 160);
+    }
+  }
+}
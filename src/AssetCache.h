@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <shared_mutex>
+
+#include "RenderPrimitives.h"
+
+struct Mesh {
+  MappedVertices vertices;
+  TriangleIndices triangleIndices;
+};
+
+struct LodChain;
+
+// Meshes and textures shared by every renderer. Assets are loaded on first use and never
+// change or move afterwards, so the returned pointers can be read from any thread while the
+// cache lives. Lookups of loaded assets only take a shared lock.
+//
+// Names starting with "builtin:" are generated (cube, plane, sphere, checker), anything else
+// is a path to a Wavefront .obj mesh or a binary .ppm texture.
+class AssetCache {
+public:
+  AssetCache();
+  ~AssetCache();
+
+  // NULL when the asset can't be loaded, failures are remembered as well
+  const Mesh* getMesh(const std::string& name);
+  const TextureBuffer* getTexture(const std::string& name);
+  // Levels of detail of a mesh, simplified on first use
+  const LodChain* getLodChain(const std::string& name);
+
+  uint32 getMeshCount() const;
+  uint32 getTextureCount() const;
+private:
+  struct Texture {
+    std::vector<uint32> pixels;
+    TextureBuffer buffer;
+  };
+
+  mutable std::shared_timed_mutex mutex;
+  std::unordered_map<std::string, std::unique_ptr<Mesh>> meshes;
+  std::unordered_map<std::string, std::unique_ptr<Texture>> textures;
+  std::unordered_map<std::string, std::unique_ptr<LodChain>> lodChains;
+
+  static bool loadMesh(const std::string& name, Mesh* mesh);
+  static bool loadTexture(const std::string& name, Texture* texture);
+
+  static bool loadObj(const std::string& path, Mesh* mesh);
+  static bool loadPpm(const std::string& path, Texture* texture);
+
+  static void createCube(Mesh* mesh);
+  static void createPlane(Mesh* mesh);
+  static void createSphere(Mesh* mesh);
+  static void createChecker(Texture* texture);
+};
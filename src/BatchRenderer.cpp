@@ -0,0 +1,125 @@
+#include "BatchRenderer.h"
+#include "Platform.h"
+#include <stdio.h>
+#include <sstream>
+#include <memory>
+#include <jpb/Profiler.h>
+
+bool
+BatchJob::parse(const std::string& line, BatchJob* job)
+{
+  std::istringstream stream(line);
+  std::string dimensions;
+
+  if(!(stream >> job->outputPath) || job->outputPath[0] == '#') return false;
+  if(!(stream >> dimensions) || sscanf(dimensions.c_str(), "%dx%d", &job->dimensions.x, &job->dimensions.y) != 2)
+  {
+    return false;
+  }
+  if(job->dimensions.x <= 0 || job->dimensions.y <= 0) return false;
+
+  if(!(stream >> job->cameraPosition.x >> job->cameraPosition.y >> job->cameraPosition.z >>
+       job->cameraRotX >> job->cameraRotY))
+  {
+    return false;
+  }
+
+  job->items.clear();
+  std::string item;
+  while(stream >> item)
+  {
+    size_t separator = item.find('=');
+    BatchItem batchItem;
+    batchItem.mesh = item.substr(0, separator);
+    if(separator != std::string::npos) batchItem.texture = item.substr(separator + 1);
+    job->items.push_back(batchItem);
+  }
+
+  return !job->items.empty();
+}
+
+BatchRenderer::BatchRenderer(AssetCache* assets, uint32 threadCount) :
+  assets(assets), queue(threadCount ? threadCount : Platform::getCoreCount())
+{
+  for(uint32 i = 0; i < queue.getWorkerCount(); i++)
+  {
+    threads.push_back(std::thread(&BatchRenderer::workerLoop, this, i));
+  }
+}
+
+BatchRenderer::~BatchRenderer()
+{
+  finish();
+}
+
+void
+BatchRenderer::submit(BatchJob&& job)
+{
+  queue.push(nextWorker++, std::move(job));
+}
+
+void
+BatchRenderer::finish()
+{
+  queue.close();
+
+  for(auto it = threads.begin(); it != threads.end(); it++)
+  {
+    if(it->joinable()) it->join();
+  }
+}
+
+void
+BatchRenderer::workerLoop(uint32 workerIndex)
+{
+  // Made on the first job, then resized, so a worker holds one framebuffer of the largest size
+  std::unique_ptr<OffscreenRenderer> renderer;
+  BatchJob job;
+  Trace::setThreadName("Batch worker");
+
+  while(queue.pop(workerIndex, &job))
+  {
+    if(!renderer)
+    {
+      renderer.reset(new OffscreenRenderer(job.dimensions));
+    }
+
+    PROFILE_ZONE("Batch job");
+    uint64 start = Platform::getTicks();
+    bool succeeded = renderJob(renderer.get(), job) && renderer->writePPM(job.outputPath);
+    real32 frameMs = (real32)Platform::ticksToMs(Platform::getTicks() - start);
+
+    std::lock_guard<std::mutex> lock(resultMutex);
+    if(resultFunction)
+    {
+      BatchResult result = { job.index, &job.outputPath, succeeded, frameMs };
+      resultFunction(result);
+    }
+  }
+}
+
+bool
+BatchRenderer::renderJob(OffscreenRenderer* renderer, const BatchJob& job)
+{
+  Scene scene;
+  scene.clearColor = packColor(120, 120, 120);
+  scene.directionalLight = Vec3f(-0.5f, -1.0f, 0.3f);
+
+  for(auto it = job.items.begin(); it != job.items.end(); it++)
+  {
+    const Mesh* mesh = assets->getMesh(it->mesh);
+    const TextureBuffer* texture = it->texture.empty() ? NULL : assets->getTexture(it->texture);
+    if(!mesh || (!it->texture.empty() && !texture)) return false;
+
+    Material material = { texture, packColor(200, 200, 200, 255), PS_DEFAULT, NULL };
+    if(!texture) material.pipelineState &= ~PS_TEXTURED;
+
+    scene.items.push_back({ &mesh->vertices, &mesh->triangleIndices, material });
+  }
+
+  FPSCamera camera(job.cameraPosition, job.cameraRotX, job.cameraRotY);
+
+  renderer->resize(job.dimensions);
+  renderer->renderFrame(scene, &camera);
+  return true;
+}
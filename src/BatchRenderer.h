@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <jpb/Vector.h>
+
+#include "AssetCache.h"
+#include "OffscreenRenderer.h"
+#include "WorkStealingQueue.h"
+
+struct BatchItem {
+  std::string mesh;
+  // Empty draws the mesh untextured
+  std::string texture;
+};
+
+// One frame, read from a manifest line:
+//   output widthxheight x y z rotX rotY mesh[=texture] ...
+struct BatchJob {
+  uint32 index;
+  std::string outputPath;
+  Vec2i dimensions;
+  Vec3f cameraPosition;
+  real32 cameraRotX;
+  real32 cameraRotY;
+  std::vector<BatchItem> items;
+
+  // False when the line is malformed, blank lines and # comments give false as well
+  static bool parse(const std::string& line, BatchJob* job);
+};
+
+struct BatchResult {
+  uint32 index;
+  const std::string* outputPath;
+  bool succeeded;
+  // Rendering and writing the file
+  real32 frameMs;
+};
+
+typedef std::function<void(const BatchResult& result)> ResultFunction;
+
+// Renders independent frames on a set of threads, each with its own renderer and nothing
+// else, meshes and textures come from the shared cache. Jobs can be submitted while earlier
+// ones render, results are handed out as frames finish and written to disk.
+class BatchRenderer {
+public:
+  // Zero means one thread per hardware core.
+  BatchRenderer(AssetCache* assets, uint32 threadCount = 0);
+  ~BatchRenderer();
+
+  uint32 getThreadCount() const { return (uint32)threads.size(); }
+
+  // Called from the worker threads, one call at a time.
+  void setResultFunction(const ResultFunction& resultFunction) { this->resultFunction = resultFunction; }
+
+  void submit(BatchJob&& job);
+  // Blocks until every submitted job is done, no submits after it.
+  void finish();
+private:
+  AssetCache* assets;
+  WorkStealingQueue<BatchJob> queue;
+  std::vector<std::thread> threads;
+  uint32 nextWorker = 0;
+
+  std::mutex resultMutex;
+  ResultFunction resultFunction;
+
+  void workerLoop(uint32 workerIndex);
+  bool renderJob(OffscreenRenderer* renderer, const BatchJob& job);
+};
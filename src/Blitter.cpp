@@ -0,0 +1,258 @@
+#include "Blitter.h"
+#include <string.h>
+#include <algorithm>
+
+struct BlitSurface {
+  uint8* pixels;
+  int32 pitch;
+  Vec2i dimensions;
+  PIXEL_FORMAT format;
+
+  uint32* getRow(int32 y) const { return (uint32*)(pixels + pitch * y); }
+};
+
+template <PIXEL_FORMAT Format>
+static inline __m128i
+blendColors4(__m128i dstColors, __m128i srcColors)
+{
+  // Alpha of 255 has to become full weight of 256
+  __m128i alpha = _mm_and_si128(srcColors, _mm_set1_epi32(0xFF));
+  alpha = _mm_add_epi32(alpha, _mm_srli_epi32(alpha, 7));
+
+  __m128i weightLo, weightHi;
+  spreadLanes(alpha, &weightLo, &weightHi);
+
+  return lerpColors(dstColors, PixelFormat<Format>::fromColors(srcColors), weightLo, weightHi);
+}
+
+template <PIXEL_FORMAT Format>
+static void
+blendRow(uint32* dst, const Color32* src, int32 count)
+{
+  __m128i alphaMask = _mm_set1_epi32(0xFF);
+  __m128i zero = _mm_setzero_si128();
+
+  int32 i = 0;
+  for(; i + 4 <= count; i += 4)
+  {
+    __m128i srcColors = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i alpha = _mm_and_si128(srcColors, alphaMask);
+
+    // Sprites are mostly fully transparent or fully opaque
+    int32 transparentMask = _mm_movemask_epi8(_mm_cmpeq_epi32(alpha, zero));
+    if(transparentMask == 0xFFFF) continue;
+
+    int32 opaqueMask = _mm_movemask_epi8(_mm_cmpeq_epi32(alpha, alphaMask));
+    if(opaqueMask == 0xFFFF)
+    {
+      _mm_storeu_si128((__m128i*)(dst + i), PixelFormat<Format>::fromColors(srcColors));
+      continue;
+    }
+
+    __m128i dstColors = _mm_loadu_si128((const __m128i*)(dst + i));
+    _mm_storeu_si128((__m128i*)(dst + i), blendColors4<Format>(dstColors, srcColors));
+  }
+
+  if(i < count)
+  {
+    uint32 dstTail[4] = {};
+    Color32 srcTail[4] = {};
+    int32 tailCount = count - i;
+
+    memcpy(dstTail, dst + i, tailCount * sizeof(uint32));
+    memcpy(srcTail, src + i, tailCount * sizeof(uint32));
+
+    __m128i result = blendColors4<Format>(_mm_loadu_si128((__m128i*)dstTail), _mm_loadu_si128((__m128i*)srcTail));
+    _mm_storeu_si128((__m128i*)dstTail, result);
+
+    memcpy(dst + i, dstTail, tailCount * sizeof(uint32));
+  }
+}
+
+template <PIXEL_FORMAT Format>
+static void
+colorKeyRow(uint32* dst, const Color32* src, int32 count, Color32 colorKey)
+{
+  __m128i keys = _mm_set1_epi32(colorKey);
+
+  int32 i = 0;
+  for(; i + 4 <= count; i += 4)
+  {
+    __m128i srcColors = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i isKey = _mm_cmpeq_epi32(srcColors, keys);
+
+    int32 keyMask = _mm_movemask_epi8(isKey);
+    if(keyMask == 0xFFFF) continue;
+
+    __m128i nativeColors = PixelFormat<Format>::fromColors(srcColors);
+    if(keyMask == 0)
+    {
+      _mm_storeu_si128((__m128i*)(dst + i), nativeColors);
+      continue;
+    }
+
+    __m128i dstColors = _mm_loadu_si128((const __m128i*)(dst + i));
+    __m128i result = _mm_or_si128(_mm_and_si128(isKey, dstColors), _mm_andnot_si128(isKey, nativeColors));
+    _mm_storeu_si128((__m128i*)(dst + i), result);
+  }
+
+  for(; i < count; i++)
+  {
+    if(src[i] != colorKey) dst[i] = PixelFormat<Format>::fromColor(src[i]);
+  }
+}
+
+template <PIXEL_FORMAT Format>
+static void
+copyRow(uint32* dst, const Color32* src, int32 count)
+{
+  if(Format == PF_RGBA8888)
+  {
+    memcpy(dst, src, count * sizeof(uint32));
+    return;
+  }
+
+  int32 i = 0;
+  for(; i + 4 <= count; i += 4)
+  {
+    __m128i srcColors = _mm_loadu_si128((const __m128i*)(src + i));
+    _mm_storeu_si128((__m128i*)(dst + i), PixelFormat<Format>::fromColors(srcColors));
+  }
+
+  for(; i < count; i++)
+  {
+    dst[i] = PixelFormat<Format>::fromColor(src[i]);
+  }
+}
+
+template <PIXEL_FORMAT Format>
+static void
+blitRows(const BlitSurface& dst, const TextureBuffer* src, const IntRect& srcRect, const Vec2i& dstPosition,
+	 BLIT_MODE mode, Color32 colorKey)
+{
+  for(int32 y = 0; y < srcRect.height; y++)
+  {
+    uint32* dstRow = dst.getRow(dstPosition.y + y) + dstPosition.x;
+    const Color32* srcRow = src->getRow(srcRect.top + y) + srcRect.left;
+
+    switch(mode)
+    {
+    case BM_ALPHA: blendRow<Format>(dstRow, srcRow, srcRect.width); break;
+    case BM_COLOR_KEY: colorKeyRow<Format>(dstRow, srcRow, srcRect.width, colorKey); break;
+    case BM_OPAQUE:
+    default: copyRow<Format>(dstRow, srcRow, srcRect.width); break;
+    }
+  }
+}
+
+static void
+blitToSurface(const BlitSurface& dst, const BlitCommand& command, const IntRect& dstClip)
+{
+  const TextureBuffer* src = command.src;
+  IntRect srcRect = command.srcRect;
+  Vec2i dstPosition = command.dstPosition;
+
+  if(srcRect.width == 0 || srcRect.height == 0)
+  {
+    srcRect = IntRect(0, 0, src->dimensions.x, src->dimensions.y);
+  }
+
+  // Clipping against the source texture first, then against the destination clip
+  int32 left = std::max(srcRect.left, 0);
+  int32 top = std::max(srcRect.top, 0);
+  int32 right = std::min(srcRect.left + srcRect.width, src->dimensions.x);
+  int32 bottom = std::min(srcRect.top + srcRect.height, src->dimensions.y);
+
+  dstPosition.x += left - srcRect.left;
+  dstPosition.y += top - srcRect.top;
+
+  int32 clipLeft = std::max(dstClip.left, 0);
+  int32 clipTop = std::max(dstClip.top, 0);
+  int32 clipRight = std::min(dstClip.left + dstClip.width, dst.dimensions.x);
+  int32 clipBottom = std::min(dstClip.top + dstClip.height, dst.dimensions.y);
+
+  if(dstPosition.x < clipLeft)
+  {
+    left += clipLeft - dstPosition.x;
+    dstPosition.x = clipLeft;
+  }
+
+  if(dstPosition.y < clipTop)
+  {
+    top += clipTop - dstPosition.y;
+    dstPosition.y = clipTop;
+  }
+
+  right = std::min(right, left + (clipRight - dstPosition.x));
+  bottom = std::min(bottom, top + (clipBottom - dstPosition.y));
+
+  if(right <= left || bottom <= top) return;
+
+  IntRect clippedRect(left, top, right - left, bottom - top);
+
+  switch(dst.format)
+  {
+  case PF_ARGB8888:
+    blitRows<PF_ARGB8888>(dst, src, clippedRect, dstPosition, command.mode, command.colorKey);
+    break;
+  case PF_RGBA8888:
+  default:
+    blitRows<PF_RGBA8888>(dst, src, clippedRect, dstPosition, command.mode, command.colorKey);
+    break;
+  }
+}
+
+static BlitSurface
+getSurface(Framebuffer* framebuffer)
+{
+  BlitSurface surface = { framebuffer->pixelData, framebuffer->pitch, framebuffer->dimensions, framebuffer->format };
+  return surface;
+}
+
+void
+Blitter::blit(Framebuffer* dst, const BlitCommand& command)
+{
+  blit(dst, command, IntRect(0, 0, dst->dimensions.x, dst->dimensions.y));
+}
+
+void
+Blitter::blit(Framebuffer* dst, const BlitCommand& command, const IntRect& dstClip)
+{
+  blitToSurface(getSurface(dst), command, dstClip);
+}
+
+void
+Blitter::blit(TextureBuffer* dst, const BlitCommand& command)
+{
+  BlitSurface surface = { (uint8*)dst->pixelData, dst->dimensions.x * (int32)sizeof(uint32),
+			  dst->dimensions, PF_RGBA8888 };
+  blitToSurface(surface, command, IntRect(0, 0, dst->dimensions.x, dst->dimensions.y));
+}
+
+void
+Blitter::blitBatch(Framebuffer* dst, const BlitCommands& commands, WorkerPool* workerPool)
+{
+  BlitSurface surface = getSurface(dst);
+
+  uint32 threadCount = workerPool ? workerPool->getThreadCount() : 1;
+  uint32 bandCount = std::min((uint32)dst->dimensions.y, threadCount * 2);
+  int32 bandHeight = bandCount ? (dst->dimensions.y + bandCount - 1) / bandCount : 0;
+
+  auto blitBand = [&](uint32 bandIndex)
+  {
+    IntRect band(0, bandIndex * bandHeight, dst->dimensions.x, bandHeight);
+    for(auto it = commands.begin(); it != commands.end(); it++)
+    {
+      blitToSurface(surface, *it, band);
+    }
+  };
+
+  if(workerPool)
+  {
+    workerPool->parallelFor(bandCount, blitBand);
+  }
+  else
+  {
+    for(uint32 i = 0; i < bandCount; i++) blitBand(i);
+  }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <jpb/Rect.h>
+
+#include "RenderPrimitives.h"
+#include "Framebuffer.h"
+#include "WorkerPool.h"
+
+enum BLIT_MODE {
+  BM_OPAQUE,
+  // Uses alpha of the source texels
+  BM_ALPHA,
+  // Skips source texels equal to the color key
+  BM_COLOR_KEY
+};
+
+struct BlitCommand {
+  const TextureBuffer* src;
+  // Part of the source texture, width or height of zero means whole texture
+  IntRect srcRect;
+  Vec2i dstPosition;
+  BLIT_MODE mode;
+  Color32 colorKey;
+};
+
+typedef std::vector<BlitCommand> BlitCommands;
+
+// Copies texture rectangles onto framebuffers or other textures. Rectangles are clipped
+// against both buffers and an optional destination clip rectangle, rows are processed
+// four pixels at a time.
+class Blitter {
+public:
+  static void blit(Framebuffer* dst, const BlitCommand& command);
+  static void blit(Framebuffer* dst, const BlitCommand& command, const IntRect& dstClip);
+  static void blit(TextureBuffer* dst, const BlitCommand& command);
+
+  // Destination is split in horizontal bands, each band runs all the commands in order,
+  // so overlapping blended quads come out the same as when drawn one after another.
+  static void blitBatch(Framebuffer* dst, const BlitCommands& commands, WorkerPool* workerPool = NULL);
+};
@@ -0,0 +1,559 @@
+#include "BoundingVolumeHierarchy.h"
+#include <math.h>
+#include <algorithm>
+#include <functional>
+#include <jpb/Profiler.h>
+
+#include "Camera.h"
+
+FRUSTUM_TEST
+Frustum::test(const BoundingBox& box) const
+{
+  Vec3f center = box.getCenter();
+  Vec3f halfSize = box.getSize() * 0.5f;
+  FRUSTUM_TEST result = FT_INSIDE;
+
+  for(int32 i = 0; i < 5; i++)
+  {
+    const Plane& plane = planes[i];
+    real32 distance = plane.getDistance(center);
+    real32 radius = fabsf(plane.normal.x) * halfSize.x + fabsf(plane.normal.y) * halfSize.y +
+      fabsf(plane.normal.z) * halfSize.z;
+
+    if(distance < -radius) return FT_OUTSIDE;
+    if(distance < radius) result = FT_INTERSECTING;
+  }
+
+  return result;
+}
+
+Frustum
+Frustum::fromCamera(const Camera* camera, const Vec2i& viewDimensions, real32 nearZ)
+{
+  real32 dfc = camera->getDfc();
+  real32 aspectRatio = (real32)viewDimensions.x / viewDimensions.y;
+
+  // Camera space first, sides go through the eye like the clipper's
+  Plane viewPlanes[5] = {
+    { Vec3f(0, 0, 1.0f), -nearZ },
+    { Vec3f::normalize(Vec3f(dfc, 0, 1.0f)), 0 },
+    { Vec3f::normalize(Vec3f(-dfc, 0, 1.0f)), 0 },
+    { Vec3f::normalize(Vec3f(0, dfc * aspectRatio, 1.0f)), 0 },
+    { Vec3f::normalize(Vec3f(0, -dfc * aspectRatio, 1.0f)), 0 }
+  };
+
+  // Distance of a world point is n . (Rp + t) + d, so the world normal is R transposed times n
+  Transform3D toCamera = Transform3D::fromCamera(camera);
+  Frustum result;
+  for(int32 i = 0; i < 5; i++)
+  {
+    const Vec3f& normal = viewPlanes[i].normal;
+    result.planes[i].normal = toCamera.rows[0] * normal.x + toCamera.rows[1] * normal.y + toCamera.rows[2] * normal.z;
+    result.planes[i].distance = Vec3f::dotProduct(normal, toCamera.translation) + viewPlanes[i].distance;
+  }
+
+  return result;
+}
+
+Ray
+Ray::fromPixel(const Camera* camera, const Vec2i& viewDimensions, const Vec2f& pixel)
+{
+  // Inverse of the projection in MappedPolygon::toScreenSpace at z = 1
+  real32 dfc = camera->getDfc();
+  real32 aspectRatio = (real32)viewDimensions.x / viewDimensions.y;
+  real32 halfResX = viewDimensions.x * 0.5f;
+  real32 halfResY = viewDimensions.y * 0.5f;
+  Vec3f direction((pixel.x - halfResX) / (halfResX * dfc), -(pixel.y - halfResY) / (halfResY * dfc * aspectRatio), 1.0f);
+
+  Transform3D toWorld = Transform3D::fromCamera(camera).getInverse();
+  Ray result;
+  result.origin = toWorld.translation;
+  result.direction = Vec3f::normalize(toWorld.transformDirection(direction));
+  return result;
+}
+
+void
+BvhStats::add(const BvhStats& stats)
+{
+  queries += stats.queries;
+  nodesVisited += stats.nodesVisited;
+  subtreesAccepted += stats.subtreesAccepted;
+  subtreesRejected += stats.subtreesRejected;
+  objectsTested += stats.objectsTested;
+  objectsFound += stats.objectsFound;
+}
+
+static real32
+getSurfaceArea(const BoundingBox& box)
+{
+  if(box.isEmpty()) return 0;
+  Vec3f size = box.getSize();
+  return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+// Entry distance of the ray into the box when it hits it before maxDistance
+static bool
+intersectRay(const BoundingBox& box, const Vec3f& origin, const Vec3f& inverseDirection, real32 maxDistance,
+	     real32* distance)
+{
+  real32 nearT = 0;
+  real32 farT = maxDistance;
+  const real32* minimum = &box.minimum.x;
+  const real32* maximum = &box.maximum.x;
+  const real32* start = &origin.x;
+  const real32* inverse = &inverseDirection.x;
+
+  for(int32 axis = 0; axis < 3; axis++)
+  {
+    real32 t1 = (minimum[axis] - start[axis]) * inverse[axis];
+    real32 t2 = (maximum[axis] - start[axis]) * inverse[axis];
+    // Rays along a face give NaN, comparisons with it keep the other value
+    nearT = std::max(nearT, std::min(t1, t2));
+    farT = std::min(farT, std::max(t1, t2));
+  }
+
+  *distance = nearT;
+  return nearT <= farT;
+}
+
+static bool
+overlaps(const BoundingBox& a, const BoundingBox& b)
+{
+  return a.minimum.x <= b.maximum.x && a.maximum.x >= b.minimum.x &&
+    a.minimum.y <= b.maximum.y && a.maximum.y >= b.minimum.y &&
+    a.minimum.z <= b.maximum.z && a.maximum.z >= b.minimum.z;
+}
+
+static bool
+contains(const BoundingBox& box, const Vec3f& point)
+{
+  return point.x >= box.minimum.x && point.x <= box.maximum.x &&
+    point.y >= box.minimum.y && point.y <= box.maximum.y &&
+    point.z >= box.minimum.z && point.z <= box.maximum.z;
+}
+
+void
+BoundingVolumeHierarchy::build(const std::vector<BoundingBox>& boxes, WorkerPool* workerPool)
+{
+  PROFILE_ZONE("BoundingVolumeHierarchy::build");
+  this->boxes = boxes;
+  uint32 objectCount = boxes.size();
+
+  centers.resize(objectCount);
+  objectIndices.resize(objectCount);
+  for(uint32 i = 0; i < objectCount; i++)
+  {
+    centers[i] = boxes[i].getCenter();
+    objectIndices[i] = i;
+  }
+
+  nodes.clear();
+  if(!objectCount)
+  {
+    linkNodes();
+    return;
+  }
+  // Nodes get their bounds from the split that made them
+  BoundingBox bounds;
+  for(uint32 i = 0; i < objectCount; i++) bounds.add(boxes[i]);
+  nodes.push_back({ bounds, 0, objectCount, 0 });
+
+  static const uint32 minParallelObjects = 4096;
+  if(!workerPool || workerPool->getThreadCount() < 2 || objectCount < minParallelObjects)
+  {
+    buildSubtree(&nodes, 0);
+    linkNodes();
+    return;
+  }
+
+  // Largest subtree gets split until there are a few for every worker
+  static const uint32 minSubtreeObjects = 256;
+  uint32 subtreeTarget = workerPool->getThreadCount() * 4;
+  std::vector<uint32> subtrees(1, 0);
+  while(subtrees.size() < subtreeTarget)
+  {
+    auto largest = std::max_element(subtrees.begin(), subtrees.end(), [&](uint32 a, uint32 b)
+    {
+      return nodes[a].count < nodes[b].count;
+    });
+    if(nodes[*largest].count < minSubtreeObjects) break;
+
+    uint32 index = *largest;
+    subtrees.erase(largest);
+    if(split(&nodes, index))
+    {
+      subtrees.push_back(nodes[index].left);
+      subtrees.push_back(nodes[index].left + 1);
+    }
+  }
+
+  // Every subtree gets its own nodes, its root is local node 0
+  std::vector<std::vector<Node>> subtreeNodes(subtrees.size());
+  workerPool->parallelFor(subtrees.size(), [&](uint32 i)
+  {
+    subtreeNodes[i].push_back(nodes[subtrees[i]]);
+    buildSubtree(&subtreeNodes[i], 0);
+  });
+
+  // Roots go into the slots of the top, children are appended and moved by the offset
+  for(uint32 i = 0; i < subtrees.size(); i++)
+  {
+    const std::vector<Node>& local = subtreeNodes[i];
+    uint32 base = nodes.size() - 1;
+    for(uint32 j = 0; j < local.size(); j++)
+    {
+      Node node = local[j];
+      if(node.left) node.left += base;
+      if(j == 0) nodes[subtrees[i]] = node;
+      else nodes.push_back(node);
+    }
+  }
+
+  linkNodes();
+}
+
+void
+BoundingVolumeHierarchy::linkNodes()
+{
+  parents.assign(nodes.size(), noObject);
+  objectLeaves.resize(boxes.size());
+  nodeMoved.assign(nodes.size(), false);
+  movedNodes.clear();
+
+  for(uint32 i = 0; i < nodes.size(); i++)
+  {
+    const Node& node = nodes[i];
+    if(node.left)
+    {
+      parents[node.left] = i;
+      parents[node.left + 1] = i;
+      continue;
+    }
+    for(uint32 j = node.first; j < node.first + node.count; j++) objectLeaves[objectIndices[j]] = i;
+  }
+}
+
+void
+BoundingVolumeHierarchy::buildSubtree(std::vector<Node>* nodes, uint32 root)
+{
+  std::vector<uint32> stack(1, root);
+  while(!stack.empty())
+  {
+    uint32 index = stack.back();
+    stack.pop_back();
+    if(split(nodes, index))
+    {
+      stack.push_back((*nodes)[index].left);
+      stack.push_back((*nodes)[index].left + 1);
+    }
+  }
+}
+
+bool
+BoundingVolumeHierarchy::split(std::vector<Node>* nodes, uint32 index)
+{
+  uint32 first = (*nodes)[index].first;
+  uint32 count = (*nodes)[index].count;
+  BoundingBox bounds = (*nodes)[index].bounds;
+  uint32* objects = objectIndices.data() + first;
+  (*nodes)[index].left = 0;
+  if(count <= 1) return false;
+
+  BoundingBox centerBounds;
+  for(uint32 i = 0; i < count; i++) centerBounds.add(centers[objects[i]]);
+
+  struct Bin {
+    BoundingBox bounds;
+    uint32 count = 0;
+  };
+
+  // All three axes in one pass over the objects
+  Vec3f centerSize = centerBounds.getSize();
+  real32 scales[3];
+  Bin bins[3][binCount];
+  for(int32 axis = 0; axis < 3; axis++)
+  {
+    real32 extent = (&centerSize.x)[axis];
+    scales[axis] = extent > 0 ? binCount / extent : 0;
+  }
+  for(uint32 i = 0; i < count; i++)
+  {
+    uint32 object = objects[i];
+    for(int32 axis = 0; axis < 3; axis++)
+    {
+      real32 offset = (&centers[object].x)[axis] - (&centerBounds.minimum.x)[axis];
+      Bin& bin = bins[axis][std::min((uint32)(offset * scales[axis]), binCount - 1)];
+      bin.count++;
+      bin.bounds.add(boxes[object]);
+    }
+  }
+
+  // Cost of a split is the chance to visit a child times its objects, relative to the parent
+  real32 leafCost = (real32)count;
+  real32 bestCost = FLT_MAX;
+  int32 bestAxis = -1;
+  uint32 bestBin = 0;
+  BoundingBox bestLeft, bestRight;
+  real32 parentArea = std::max(getSurfaceArea(bounds), FLT_MIN);
+
+  for(int32 axis = 0; axis < 3; axis++)
+  {
+    if(scales[axis] == 0) continue;
+
+    // Bounds and counts left of every split, then summed up from the right
+    BoundingBox leftBounds[binCount - 1];
+    uint32 leftCount[binCount - 1];
+    BoundingBox left;
+    uint32 leftObjects = 0;
+    for(uint32 i = 0; i < binCount - 1; i++)
+    {
+      left.add(bins[axis][i].bounds);
+      leftObjects += bins[axis][i].count;
+      leftBounds[i] = left;
+      leftCount[i] = leftObjects;
+    }
+
+    BoundingBox right;
+    uint32 rightObjects = 0;
+    for(uint32 i = binCount - 1; i > 0; i--)
+    {
+      right.add(bins[axis][i].bounds);
+      rightObjects += bins[axis][i].count;
+      if(!leftCount[i - 1] || !rightObjects) continue;
+
+      real32 cost = 1.0f + (getSurfaceArea(leftBounds[i - 1]) * leftCount[i - 1] + getSurfaceArea(right) * rightObjects) /
+	parentArea;
+      if(cost < bestCost)
+      {
+	bestCost = cost;
+	bestAxis = axis;
+	bestBin = i;
+	bestLeft = leftBounds[i - 1];
+	bestRight = right;
+      }
+    }
+  }
+
+  uint32* middle;
+  if(bestAxis >= 0 && (bestCost < leafCost || count > maxLeafObjects))
+  {
+    real32 minimum = (&centerBounds.minimum.x)[bestAxis];
+    real32 scale = scales[bestAxis];
+    middle = std::partition(objects, objects + count, [&](uint32 object)
+    {
+      return std::min((uint32)(((&centers[object].x)[bestAxis] - minimum) * scale), binCount - 1) < bestBin;
+    });
+  }
+  else if(count > maxLeafObjects)
+  {
+    // Centers all in one place, any split is as good
+    middle = objects + count / 2;
+    for(uint32* object = objects; object != middle; object++) bestLeft.add(boxes[*object]);
+    for(uint32* object = middle; object != objects + count; object++) bestRight.add(boxes[*object]);
+  }
+  else
+  {
+    return false;
+  }
+
+  uint32 leftCount = middle - objects;
+  uint32 left = nodes->size();
+  (*nodes)[index].left = left;
+  nodes->push_back({ bestLeft, first, leftCount, 0 });
+  nodes->push_back({ bestRight, first + leftCount, count - leftCount, 0 });
+  return true;
+}
+
+void
+BoundingVolumeHierarchy::refit(const std::vector<BoundingBox>& boxes)
+{
+  PROFILE_ZONE("BoundingVolumeHierarchy::refit");
+  this->boxes = boxes;
+  for(uint32 index : movedNodes) nodeMoved[index] = false;
+  movedNodes.clear();
+
+  // Children always come after their parent
+  for(uint32 i = nodes.size(); i-- > 0;) refitNode(i);
+}
+
+void
+BoundingVolumeHierarchy::moveObject(uint32 object, const BoundingBox& box)
+{
+  boxes[object] = box;
+  for(uint32 index = objectLeaves[object]; index != noObject && !nodeMoved[index]; index = parents[index])
+  {
+    nodeMoved[index] = true;
+    movedNodes.push_back(index);
+  }
+}
+
+void
+BoundingVolumeHierarchy::refit()
+{
+  PROFILE_ZONE("BoundingVolumeHierarchy::refit");
+  std::sort(movedNodes.begin(), movedNodes.end(), std::greater<uint32>());
+  for(uint32 index : movedNodes)
+  {
+    nodeMoved[index] = false;
+    refitNode(index);
+  }
+  movedNodes.clear();
+}
+
+void
+BoundingVolumeHierarchy::refitNode(uint32 index)
+{
+  Node& node = nodes[index];
+  BoundingBox bounds;
+  if(node.left)
+  {
+    bounds = nodes[node.left].bounds;
+    bounds.add(nodes[node.left + 1].bounds);
+  }
+  else
+  {
+    for(uint32 i = node.first; i < node.first + node.count; i++) bounds.add(boxes[objectIndices[i]]);
+  }
+  node.bounds = bounds;
+}
+
+void
+BoundingVolumeHierarchy::appendObjects(const Node& node, std::vector<uint32>* result, BvhStats* stats) const
+{
+  result->insert(result->end(), objectIndices.begin() + node.first, objectIndices.begin() + node.first + node.count);
+  if(stats) stats->objectsFound += node.count;
+}
+
+template <typename NodeTest, typename ObjectTest>
+void
+BoundingVolumeHierarchy::query(const NodeTest& nodeTest, const ObjectTest& objectTest, std::vector<uint32>* result,
+			       BvhStats* stats) const
+{
+  BvhStats counts;
+  counts.queries = 1;
+
+  uint32 stack[64];
+  uint32 stackSize = 0;
+  if(!nodes.empty()) stack[stackSize++] = 0;
+
+  while(stackSize)
+  {
+    const Node& node = nodes[stack[--stackSize]];
+    counts.nodesVisited++;
+
+    FRUSTUM_TEST test = nodeTest(node.bounds);
+    if(test == FT_OUTSIDE)
+    {
+      counts.subtreesRejected++;
+    }
+    else if(test == FT_INSIDE)
+    {
+      counts.subtreesAccepted++;
+      appendObjects(node, result, &counts);
+    }
+    else if(node.left && stackSize + 2 <= 64)
+    {
+      stack[stackSize++] = node.left + 1;
+      stack[stackSize++] = node.left;
+    }
+    else
+    {
+      for(uint32 i = node.first; i < node.first + node.count; i++)
+      {
+	counts.objectsTested++;
+	uint32 object = objectIndices[i];
+	if(!objectTest(boxes[object])) continue;
+	result->push_back(object);
+	counts.objectsFound++;
+      }
+    }
+  }
+
+  if(stats) stats->add(counts);
+}
+
+void
+BoundingVolumeHierarchy::queryFrustum(const Frustum& frustum, std::vector<uint32>* result, BvhStats* stats) const
+{
+  PROFILE_ZONE("BoundingVolumeHierarchy::queryFrustum");
+  query([&](const BoundingBox& bounds) { return frustum.test(bounds); },
+	[&](const BoundingBox& box) { return frustum.test(box) != FT_OUTSIDE; }, result, stats);
+}
+
+void
+BoundingVolumeHierarchy::queryBox(const BoundingBox& box, std::vector<uint32>* result, BvhStats* stats) const
+{
+  query([&](const BoundingBox& bounds)
+  {
+    if(!overlaps(bounds, box)) return FT_OUTSIDE;
+    return contains(box, bounds.minimum) && contains(box, bounds.maximum) ? FT_INSIDE : FT_INTERSECTING;
+  }, [&](const BoundingBox& objectBox) { return overlaps(objectBox, box); }, result, stats);
+}
+
+void
+BoundingVolumeHierarchy::queryPoint(const Vec3f& point, std::vector<uint32>* result, BvhStats* stats) const
+{
+  query([&](const BoundingBox& bounds) { return contains(bounds, point) ? FT_INTERSECTING : FT_OUTSIDE; },
+	[&](const BoundingBox& box) { return contains(box, point); }, result, stats);
+}
+
+uint32
+BoundingVolumeHierarchy::queryRay(const Ray& ray, real32* distance, BvhStats* stats) const
+{
+  BvhStats counts;
+  counts.queries = 1;
+  Vec3f inverseDirection(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+
+  uint32 closest = noObject;
+  real32 closestDistance = FLT_MAX;
+  real32 entry;
+
+  uint32 stack[64];
+  uint32 stackSize = 0;
+  if(!nodes.empty() && intersectRay(nodes[0].bounds, ray.origin, inverseDirection, closestDistance, &entry))
+  {
+    stack[stackSize++] = 0;
+  }
+
+  while(stackSize)
+  {
+    const Node& node = nodes[stack[--stackSize]];
+    counts.nodesVisited++;
+
+    // Leaves and nodes too deep for the stack test their objects directly
+    if(!node.left || stackSize + 2 > 64)
+    {
+      for(uint32 i = node.first; i < node.first + node.count; i++)
+      {
+	counts.objectsTested++;
+	uint32 object = objectIndices[i];
+	if(intersectRay(boxes[object], ray.origin, inverseDirection, closestDistance, &entry))
+	{
+	  closest = object;
+	  closestDistance = entry;
+	}
+      }
+      continue;
+    }
+
+    // Nearer child goes on top, the farther one is skipped when a closer hit was found before
+    real32 entries[2];
+    bool hits[2];
+    for(uint32 i = 0; i < 2; i++)
+    {
+      hits[i] = intersectRay(nodes[node.left + i].bounds, ray.origin, inverseDirection, closestDistance, &entries[i]);
+      if(!hits[i]) counts.subtreesRejected++;
+    }
+
+    uint32 nearChild = hits[1] && (!hits[0] || entries[1] < entries[0]) ? 1 : 0;
+    uint32 farChild = 1 - nearChild;
+    if(hits[farChild]) stack[stackSize++] = node.left + farChild;
+    if(hits[nearChild]) stack[stackSize++] = node.left + nearChild;
+  }
+
+  if(closest != noObject) counts.objectsFound = 1;
+  if(stats) stats->add(counts);
+
+  *distance = closestDistance;
+  return closest;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <vector>
+#include <jpb/Vector.h>
+
+#include "Transform.h"
+#include "WorkerPool.h"
+
+class Camera;
+
+// Points with a positive distance are in front of the plane
+struct Plane {
+  Vec3f normal;
+  real32 distance;
+
+  real32 getDistance(const Vec3f& point) const { return Vec3f::dotProduct(normal, point) + distance; }
+};
+
+enum FRUSTUM_TEST {
+  FT_OUTSIDE,
+  FT_INTERSECTING,
+  FT_INSIDE
+};
+
+// What a camera sees in world space, the near plane and the four sides. There is no far plane,
+// the renderer doesn't have one either.
+struct Frustum {
+  Plane planes[5];
+
+  FRUSTUM_TEST test(const BoundingBox& box) const;
+
+  static Frustum fromCamera(const Camera* camera, const Vec2i& viewDimensions, real32 nearZ);
+};
+
+struct Ray {
+  Vec3f origin;
+  // Unit length
+  Vec3f direction;
+
+  // Through a pixel of the view, in world space
+  static Ray fromPixel(const Camera* camera, const Vec2i& viewDimensions, const Vec2f& pixel);
+};
+
+// Cost of queries, summed over the queries it's passed to
+struct BvhStats {
+  uint32 queries = 0;
+  uint32 nodesVisited = 0;
+  // Subtrees taken or skipped by one test of their bounds
+  uint32 subtreesAccepted = 0;
+  uint32 subtreesRejected = 0;
+  uint32 objectsTested = 0;
+  uint32 objectsFound = 0;
+
+  void add(const BvhStats& stats);
+};
+
+// Binary tree of boxes over objects, split by the surface area heuristic over binned
+// centers. Objects are the indices of the boxes it was built from. Objects below any node
+// are one range of the object order, so subtrees completely inside a query get taken
+// without visiting them.
+class BoundingVolumeHierarchy {
+public:
+  static const uint32 noObject = ~0u;
+
+  // With a worker pool the top of the tree is split on the calling thread and the subtrees
+  // below are built by the workers
+  void build(const std::vector<BoundingBox>& boxes, WorkerPool* workerPool = NULL);
+  // Boxes of the same objects after they moved. The tree keeps its shape and only its bounds
+  // are recomputed, queries get slower when objects move far from where they were built.
+  void refit(const std::vector<BoundingBox>& boxes);
+  // Same for a few objects, refit without boxes recomputes only the nodes above moved ones
+  void moveObject(uint32 object, const BoundingBox& box);
+  void refit();
+
+  // Objects found get appended to result, stats get the traversal cost added when given
+  void queryFrustum(const Frustum& frustum, std::vector<uint32>* result, BvhStats* stats = NULL) const;
+  void queryBox(const BoundingBox& box, std::vector<uint32>* result, BvhStats* stats = NULL) const;
+  void queryPoint(const Vec3f& point, std::vector<uint32>* result, BvhStats* stats = NULL) const;
+  // Object with the closest box the ray hits, noObject when there's none. Distance is
+  // along the ray, 0 when it starts inside of the box.
+  uint32 queryRay(const Ray& ray, real32* distance, BvhStats* stats = NULL) const;
+
+  uint32 getNodeCount() const { return (uint32)nodes.size(); }
+  uint32 getObjectCount() const { return (uint32)boxes.size(); }
+  const BoundingBox& getObjectBounds(uint32 object) const { return boxes[object]; }
+private:
+  static const uint32 maxLeafObjects = 4;
+  static const uint32 binCount = 16;
+
+  struct Node {
+    BoundingBox bounds;
+    // Objects below the node are objectIndices[first] to objectIndices[first + count - 1]
+    uint32 first;
+    uint32 count;
+    // Children are left and left + 1, the root is nobody's child so 0 marks leaves
+    uint32 left;
+  };
+
+  std::vector<Node> nodes;
+  std::vector<uint32> objectIndices;
+  std::vector<BoundingBox> boxes;
+  std::vector<Vec3f> centers;
+
+  // Parent of every node and leaf of every object, for refits of moved objects
+  std::vector<uint32> parents;
+  std::vector<uint32> objectLeaves;
+  std::vector<bool> nodeMoved;
+  std::vector<uint32> movedNodes;
+
+  // Leaf or two children appended to nodes, false for leaves
+  bool split(std::vector<Node>* nodes, uint32 index);
+  void buildSubtree(std::vector<Node>* nodes, uint32 root);
+  void linkNodes();
+  void refitNode(uint32 index);
+  void appendObjects(const Node& node, std::vector<uint32>* result, BvhStats* stats) const;
+
+  template <typename NodeTest, typename ObjectTest>
+  void query(const NodeTest& nodeTest, const ObjectTest& objectTest, std::vector<uint32>* result,
+	     BvhStats* stats) const;
+};
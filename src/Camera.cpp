@@ -1,5 +1,4 @@
 #include "Camera.h"
-#include <SDL.h>
 
 real32
 Camera::getDfc() const
@@ -11,35 +10,17 @@ Camera::getDfc() const
 }
 
 void
-FPSCamera::handleInput(const Input& input, real32 lastDelta)
+FPSCamera::move(real32 forward, real32 right)
 {
-  static const real32 rotationSpeed = 0.01f;
-
-  if(input.isKeyDown(SDLK_8)) rotY += 0.001f * lastDelta;
-  if(input.isKeyDown(SDLK_9)) rotY -= 0.001f * lastDelta;
-
-
-  if(input.isButtonDown(SDL_BUTTON_LEFT))
-  {
-    Vec2i mouseDelta = input.getMouseDelta();
-
-    rotY += rotationSpeed * lastDelta * -mouseDelta.x;
-    rotX += rotationSpeed * lastDelta * -mouseDelta.y;
-  }
-
   Vec3f lookVector(0, 0, 1.0f);
   lookVector.rotateAroundXDeg(rotX);
   lookVector.rotateAroundYDeg(-rotY);
 
-  if(input.isKeyDown(SDLK_w)) position += lookVector * 0.001f * lastDelta;
-  if(input.isKeyDown(SDLK_s)) position -= lookVector * 0.001f * lastDelta;
-
   Vec3f upVector(0, 1.0f, 0);
   Vec3f rightVector = Vec3f::cross(upVector, lookVector);
 
-  if(input.isKeyDown(SDLK_d)) position += rightVector * 0.001f * lastDelta;
-  if(input.isKeyDown(SDLK_a)) position -= rightVector * 0.001f * lastDelta;
-
+  position += lookVector * forward;
+  position += rightVector * right;
 }
 
 void
@@ -1,7 +1,6 @@
 #pragma once
 #include <jpb/Vector.h>
 #include "RenderPrimitives.h"
-#include "main.h"
 
 class Camera {
 public:
@@ -26,7 +25,11 @@ public:
   FPSCamera(const Vec3f& initialPosition = Vec3f(), real32 rotX = 0, real32 rotY = 0) :
     Camera(initialPosition), rotY(rotY), rotX(rotX) {}
 
-  void handleInput(const Input& input, real32 lastDelta);
+  // Degrees, x tilts the view down and y turns it right
+  void setRotation(real32 rotX, real32 rotY) { this->rotX = rotX; this->rotY = rotY; }
+  void rotate(real32 deltaX, real32 deltaY) { rotX += deltaX; rotY += deltaY; }
+  // Along the look direction and to the right of it on the ground plane
+  void move(real32 forward, real32 right);
   
   void castVertices(MappedVertices& vertices) const;
   void castVertices(Vertices& vertices) const;
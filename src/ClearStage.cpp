@@ -0,0 +1,85 @@
+#include "ClearStage.h"
+#include <chrono>
+#include <algorithm>
+#include <jpb/Profiler.h>
+
+void
+ClearStage::streamFill(uint32* dst, uint32 count, uint32 value)
+{
+  uint32* end = dst + count;
+
+  // Streaming stores need 16 byte alignment
+  while(dst < end && ((uintptr_t)dst & 15))
+  {
+    *dst++ = value;
+  }
+
+  __m128i values = _mm_set1_epi32(value);
+  for(; dst + 4 <= end; dst += 4)
+  {
+    _mm_stream_si128((__m128i*)dst, values);
+  }
+
+  while(dst < end)
+  {
+    *dst++ = value;
+  }
+}
+
+void
+ClearStage::clear(Framebuffer* framebuffer, DepthBuffer* depthBuffer, Color32 color)
+{
+  PROFILE_ZONE("ClearStage::clear");
+  auto startTime = std::chrono::high_resolution_clock::now();
+
+  bool clearDepth = depthBuffer && depthBuffer->beginFrame();
+  int32 depthHeight = clearDepth ? depthBuffer->getDimensions().y : 0;
+  uint32 nativeColor = framebuffer->toNative(color);
+
+  int32 width = framebuffer->dimensions.x;
+  int32 height = framebuffer->dimensions.y;
+
+  // Few bands per thread so that uneven threads still finish close to each other
+  uint32 threadCount = workerPool ? workerPool->getThreadCount() : 1;
+  uint32 bandCount = std::min((uint32)height, threadCount * 4);
+  int32 bandHeight = bandCount ? (height + bandCount - 1) / bandCount : 0;
+
+  auto clearBand = [&](uint32 bandIndex)
+  {
+    PROFILE_ZONE("Clear band");
+    int32 startY = bandIndex * bandHeight;
+    int32 endY = std::min(startY + bandHeight, height);
+
+    for(int32 y = startY; y < endY; y++)
+    {
+      streamFill(framebuffer->getRow(y), width, nativeColor);
+
+      if(y < depthHeight)
+      {
+	streamFill(depthBuffer->getRow(y), depthBuffer->getPitch(), DepthBuffer::clearValue);
+      }
+    }
+
+    // Streaming stores have to be visible before anything is drawn on top
+    _mm_sfence();
+  };
+
+  if(workerPool)
+  {
+    workerPool->parallelFor(bandCount, clearBand);
+  }
+  else
+  {
+    for(uint32 i = 0; i < bandCount; i++) clearBand(i);
+  }
+
+  auto endTime = std::chrono::high_resolution_clock::now();
+
+  lastStats.depthCleared = clearDepth;
+  lastStats.bytesWritten = (uint64)width * height * sizeof(uint32);
+  if(clearDepth)
+  {
+    lastStats.bytesWritten += (uint64)depthBuffer->getPitch() * std::min(height, depthHeight) * sizeof(uint32);
+  }
+  lastStats.timeMs = std::chrono::duration<real32, std::milli>(endTime - startTime).count();
+}
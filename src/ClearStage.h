@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Framebuffer.h"
+#include "DepthBuffer.h"
+#include "WorkerPool.h"
+
+struct ClearStats {
+  uint64 bytesWritten;
+  real32 timeMs;
+  bool depthCleared;
+
+  // Gigabytes per second
+  real32 getBandwidth() const { return timeMs > 0 ? (bytesWritten / (timeMs * 0.001f)) * 1e-9f : 0; }
+};
+
+// Clears color and depth in a single pass over the rows, rows are split between
+// the workers and written with streaming stores so that they don't go through the cache.
+// Depth is skipped on frames where the depth buffer doesn't need it (see DCM_FRAME_TAGGED).
+class ClearStage {
+public:
+  void setWorkerPool(WorkerPool* workerPool) { this->workerPool = workerPool; }
+
+  // Depth buffer can be NULL
+  void clear(Framebuffer* framebuffer, DepthBuffer* depthBuffer, Color32 color);
+
+  const ClearStats& getLastStats() const { return lastStats; }
+private:
+  WorkerPool* workerPool = NULL;
+  ClearStats lastStats = {};
+
+  static void streamFill(uint32* dst, uint32 count, uint32 value);
+};
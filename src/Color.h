@@ -0,0 +1,145 @@
+#pragma once
+
+#include <emmintrin.h>
+#include <jpb/Types.h>
+#include <jpb/Vector.h>
+
+// Colors are packed as R << 24 | G << 16 | B << 8 | A, same as SDL_PIXELFORMAT_RGBA8888.
+// Wide colors keep every channel in a 16 bit lane, in memory order A, B, G, R.
+typedef uint32 Color32;
+
+inline Color32
+packColor(uint32 r, uint32 g, uint32 b, uint32 a = 0)
+{
+  return r << 24 | g << 16 | b << 8 | a;
+}
+
+// Float colors are in 0..255 range, only meant for the api boundary.
+inline Color32
+packColor(const Vec3f& color)
+{
+  return packColor((uint8)color.x, (uint8)color.y, (uint8)color.z);
+}
+
+inline Vec3f
+unpackColor(Color32 color)
+{
+  return Vec3f(uint8(color >> 24), uint8(color >> 16), uint8(color >> 8));
+}
+
+// Scales every color channel by light in 8.8 fixed point, 256 being full intensity.
+inline Color32
+modulateColor(Color32 color, uint32 light)
+{
+  uint32 redBlue = (((color >> 8) & 0x00FF00FF) * light) & 0xFF00FF00;
+  uint32 greenAlpha = ((color & 0x00FF00FF) * light >> 8) & 0x00FF00FF;
+  return redBlue | (greenAlpha & 0x00FF0000) | (color & 0xFF);
+}
+
+// a * (256 - weight) + b * weight per channel, works for any channel order
+inline Color32
+lerpColor(Color32 a, Color32 b, uint32 weight)
+{
+  uint32 inverseWeight = 256 - weight;
+  uint32 evenChannels = (((a & 0x00FF00FF) * inverseWeight + (b & 0x00FF00FF) * weight) >> 8) & 0x00FF00FF;
+  uint32 oddChannels = (((a >> 8) & 0x00FF00FF) * inverseWeight + ((b >> 8) & 0x00FF00FF) * weight) & 0xFF00FF00;
+  return evenChannels | oddChannels;
+}
+
+inline void
+unpackColors(__m128i packed, __m128i* lo, __m128i* hi)
+{
+  __m128i zero = _mm_setzero_si128();
+  *lo = _mm_unpacklo_epi8(packed, zero);
+  *hi = _mm_unpackhi_epi8(packed, zero);
+}
+
+// Takes two wide colors holding whole channel values.
+inline __m128i
+packColors(__m128i lo, __m128i hi)
+{
+  return _mm_packus_epi16(lo, hi);
+}
+
+// Copies four 32 bit values so that all channels of every pixel get the value of that pixel.
+inline void
+spreadLanes(__m128i values, __m128i* lo, __m128i* hi)
+{
+  __m128i packed = _mm_packs_epi32(values, values);
+  __m128i doubled = _mm_unpacklo_epi16(packed, packed);
+
+  *lo = _mm_unpacklo_epi32(doubled, doubled);
+  *hi = _mm_unpackhi_epi32(doubled, doubled);
+}
+
+// Light in 0..1 range to 8.8 fixed point, clamped so that products fit 16 bit lanes.
+inline __m128i
+lightToFixed(__m128 light)
+{
+  light = _mm_min_ps(_mm_max_ps(light, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+  return _mm_cvtps_epi32(_mm_mul_ps(light, _mm_set1_ps(256.0f)));
+}
+
+inline __m128i
+modulateColors(__m128i colors, __m128i lightLo, __m128i lightHi)
+{
+  __m128i colorLo, colorHi;
+  unpackColors(colors, &colorLo, &colorHi);
+
+  colorLo = _mm_srli_epi16(_mm_mullo_epi16(colorLo, lightLo), 8);
+  colorHi = _mm_srli_epi16(_mm_mullo_epi16(colorHi, lightHi), 8);
+
+  return packColors(colorLo, colorHi);
+}
+
+// Same light intensity for all channels of a pixel.
+inline __m128i
+modulateColors(__m128i colors, __m128 light)
+{
+  __m128i lightLo, lightHi;
+  spreadLanes(lightToFixed(light), &lightLo, &lightHi);
+  return modulateColors(colors, lightLo, lightHi);
+}
+
+// Colored light, alpha is left untouched.
+inline __m128i
+modulateColors(__m128i colors, __m128 red, __m128 green, __m128 blue)
+{
+  __m128i alpha = _mm_set1_epi32(256);
+  __m128i redFixed = lightToFixed(red);
+  __m128i greenFixed = lightToFixed(green);
+  __m128i blueFixed = lightToFixed(blue);
+
+  __m128i alphaBlueLo = _mm_unpacklo_epi32(alpha, blueFixed);
+  __m128i alphaBlueHi = _mm_unpackhi_epi32(alpha, blueFixed);
+  __m128i greenRedLo = _mm_unpacklo_epi32(greenFixed, redFixed);
+  __m128i greenRedHi = _mm_unpackhi_epi32(greenFixed, redFixed);
+
+  __m128i lightLo = _mm_packs_epi32(_mm_unpacklo_epi64(alphaBlueLo, greenRedLo),
+				    _mm_unpackhi_epi64(alphaBlueLo, greenRedLo));
+  __m128i lightHi = _mm_packs_epi32(_mm_unpacklo_epi64(alphaBlueHi, greenRedHi),
+				    _mm_unpackhi_epi64(alphaBlueHi, greenRedHi));
+
+  return modulateColors(colors, lightLo, lightHi);
+}
+
+// a * (256 - weight) + b * weight per channel, weights are wide 0..256 values
+inline __m128i
+lerpColors(__m128i a, __m128i b, __m128i weightLo, __m128i weightHi)
+{
+  __m128i aLo, aHi, bLo, bHi;
+  unpackColors(a, &aLo, &aHi);
+  unpackColors(b, &bLo, &bHi);
+
+  __m128i full = _mm_set1_epi16(256);
+  __m128i lo = _mm_add_epi16(_mm_mullo_epi16(aLo, _mm_sub_epi16(full, weightLo)), _mm_mullo_epi16(bLo, weightLo));
+  __m128i hi = _mm_add_epi16(_mm_mullo_epi16(aHi, _mm_sub_epi16(full, weightHi)), _mm_mullo_epi16(bHi, weightHi));
+
+  return packColors(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+}
+
+inline __m128i
+addColorsSaturated(__m128i a, __m128i b)
+{
+  return _mm_adds_epu8(a, b);
+}
@@ -0,0 +1,112 @@
+#include "DebugView.h"
+#include <algorithm>
+#include <string.h>
+
+void
+DebugView::begin(const Vec2i& dimensions)
+{
+  if(this->dimensions != dimensions)
+  {
+    this->dimensions = dimensions;
+    tileCount = Vec2i((dimensions.x + tileSize - 1) >> tileShift, (dimensions.y + tileSize - 1) >> tileShift);
+    counts.resize(dimensions.x * dimensions.y);
+    tileTicks = std::vector<std::atomic<uint64>>(tileCount.x * tileCount.y);
+  }
+
+  if(isCounting())
+  {
+    memset(counts.data(), 0, counts.size() * sizeof(uint32));
+  }
+  else if(mode == DV_TILE_COST)
+  {
+    for(auto it = tileTicks.begin(); it != tileTicks.end(); it++) it->store(0, std::memory_order_relaxed);
+  }
+}
+
+void
+DebugView::addSpanTicks(int32 y, int32 startX, int32 endX, uint64 ticks)
+{
+  int32 pixelCount = endX - startX + 1;
+  if(pixelCount <= 0) return;
+
+  std::atomic<uint64>* tileRow = tileTicks.data() + (y >> tileShift) * tileCount.x;
+  for(int32 tileX = startX >> tileShift; tileX <= endX >> tileShift; tileX++)
+  {
+    int32 tileStart = std::max(startX, tileX << tileShift);
+    int32 tileEnd = std::min(endX, ((tileX + 1) << tileShift) - 1);
+    tileRow[tileX].fetch_add(ticks * (tileEnd - tileStart + 1) / pixelCount, std::memory_order_relaxed);
+  }
+}
+
+void
+DebugView::resolve(Framebuffer* framebuffer) const
+{
+  if(mode == DV_NONE || framebuffer->dimensions != dimensions) return;
+
+  if(isCounting())
+  {
+    Color32 palette[maxCount + 1];
+    for(uint32 i = 0; i <= maxCount; i++)
+    {
+      palette[i] = framebuffer->toNative(getHeatColor((real32)i / maxCount));
+    }
+
+    for(int32 y = 0; y < dimensions.y; y++)
+    {
+      const uint32* src = counts.data() + y * dimensions.x;
+      uint32* dst = framebuffer->getRow(y);
+      for(int32 x = 0; x < dimensions.x; x++)
+      {
+	dst[x] = palette[std::min(src[x], maxCount)];
+      }
+    }
+  }
+  else if(mode == DV_TILE_COST)
+  {
+    uint64 maxTicks = 1;
+    for(auto it = tileTicks.begin(); it != tileTicks.end(); it++)
+    {
+      maxTicks = std::max(maxTicks, it->load(std::memory_order_relaxed));
+    }
+
+    for(int32 tileY = 0; tileY < tileCount.y; tileY++)
+    {
+      for(int32 tileX = 0; tileX < tileCount.x; tileX++)
+      {
+	uint64 ticks = tileTicks[tileY * tileCount.x + tileX].load(std::memory_order_relaxed);
+	Color32 color = getHeatColor((real32)ticks / maxTicks);
+
+	int32 startX = tileX << tileShift;
+	int32 endX = std::min(startX + tileSize, dimensions.x) - 1;
+	int32 startY = tileY << tileShift;
+	int32 endY = std::min(startY + tileSize, dimensions.y);
+	for(int32 y = startY; y < endY; y++)
+	{
+	  framebuffer->fillSpan(y, startX, endX, color);
+	}
+      }
+    }
+  }
+}
+
+const char*
+DebugView::getName(DEBUG_VIEW mode)
+{
+  static const char* names[DV_COUNT] = { "none", "overdraw", "depthfails", "tilecost" };
+  return names[mode];
+}
+
+Color32
+DebugView::getHeatColor(real32 t)
+{
+  static const Vec3f stops[] = {
+    Vec3f(0, 0, 0), Vec3f(0, 0, 255.0f), Vec3f(0, 255.0f, 0), Vec3f(255.0f, 255.0f, 0),
+    Vec3f(255.0f, 0, 0), Vec3f(255.0f, 255.0f, 255.0f)
+  };
+  static const int32 lastStop = sizeof(stops) / sizeof(stops[0]) - 1;
+
+  t = std::min(std::max(t, 0.0f), 1.0f) * lastStop;
+  int32 index = std::min((int32)t, lastStop - 1);
+  real32 f = t - index;
+  return packColor(stops[index] + (stops[index + 1] - stops[index]) * f);
+}
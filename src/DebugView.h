@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <jpb/Vector.h>
+
+#include "Framebuffer.h"
+
+enum DEBUG_VIEW {
+  DV_NONE,
+  // How often every pixel got shaded
+  DV_OVERDRAW,
+  // How often every pixel failed the depth test
+  DV_DEPTH_FAILS,
+  // Time the span loops spent in every tile, relative to the slowest tile of the frame
+  DV_TILE_COST,
+  DV_COUNT
+};
+
+// Counters the span loops fill while a debug view is on, turned into a heatmap that replaces
+// the shaded image. Views drawn at the same time share it, pixels of different views never
+// overlap and tile times are added atomically.
+class DebugView {
+public:
+  static const int32 tileShift = 4;
+  static const int32 tileSize = 1 << tileShift;
+  // One color stop per count, counts at or above it are white
+  static const uint32 maxCount = 5;
+
+  void setMode(DEBUG_VIEW mode) { this->mode = mode; }
+  DEBUG_VIEW getMode() const { return mode; }
+  bool isCounting() const { return mode == DV_OVERDRAW || mode == DV_DEPTH_FAILS; }
+
+  // Clears the counters of a framebuffer, call before its frame is drawn
+  void begin(const Vec2i& dimensions);
+  // Overwrites the framebuffer with the heatmap of the mode
+  void resolve(Framebuffer* framebuffer) const;
+
+  uint32* getCountRow(int32 y) { return counts.data() + y * dimensions.x; }
+  // Time spent on the pixels startX to endX of row y, split between the tiles they cover
+  void addSpanTicks(int32 y, int32 startX, int32 endX, uint64 ticks);
+
+  static const char* getName(DEBUG_VIEW mode);
+  // Black over blue, green, yellow and red to white, t in 0..1
+  static Color32 getHeatColor(real32 t);
+private:
+  DEBUG_VIEW mode = DV_NONE;
+  Vec2i dimensions;
+  Vec2i tileCount;
+  std::vector<uint32> counts;
+  std::vector<std::atomic<uint64>> tileTicks;
+};
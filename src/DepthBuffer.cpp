@@ -0,0 +1,58 @@
+#include "DepthBuffer.h"
+#include <algorithm>
+
+void
+DepthBuffer::resize(const Vec2i& dimensions)
+{
+  this->dimensions = dimensions;
+
+  // Padding of four values at the end of every row, then rounding up to 16 bytes
+  pitch = (dimensions.x + 4 + 3) & ~3;
+  storage.resize(pitch * dimensions.y + 4);
+
+  uintptr_t address = (uintptr_t)storage.data();
+  data = (uint32*)((address + 15) & ~(uintptr_t)15);
+
+  clearPending = true;
+  clear();
+}
+
+void
+DepthBuffer::setClearMode(DEPTH_CLEAR_MODE clearMode)
+{
+  this->clearMode = clearMode;
+  frameTag = 0;
+  clearPending = true;
+}
+
+bool
+DepthBuffer::beginFrame()
+{
+  if(clearMode == DCM_CLEAR) return true;
+
+  // Cleared values carry tag 0xFF, so the first frame after a clear starts right below it
+  if(clearPending || frameTag == 0)
+  {
+    clearPending = false;
+    frameTag = 0xFE;
+    return true;
+  }
+
+  frameTag--;
+  return false;
+}
+
+uint32
+DepthBuffer::getDepthValue(real32 invZ) const
+{
+  real32 depth = 1.0f - nearZ * invZ;
+  depth = std::min(std::max(depth, 0.0f), 1.0f);
+
+  return frameTag << 24 | (uint32)(depth * (real32)0xFFFFFF);
+}
+
+void
+DepthBuffer::clear()
+{
+  std::fill(storage.begin(), storage.end(), clearValue);
+}
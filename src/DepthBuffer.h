@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <jpb/Vector.h>
+
+enum DEPTH_CLEAR_MODE {
+  // Every frame starts from a cleared buffer
+  DCM_CLEAR,
+  // Top byte of every value holds a frame tag that goes down each frame, so values
+  // left from older frames always lose the depth test and the buffer only has to be
+  // cleared when the tag runs out.
+  DCM_FRAME_TAGGED
+};
+
+// Depth is stored as tag << 24 | 24 bit depth, smaller values are closer.
+class DepthBuffer {
+public:
+  static const uint32 clearValue = 0xFFFFFFFF;
+
+  void resize(const Vec2i& dimensions);
+  const Vec2i& getDimensions() const { return dimensions; }
+
+  // Rows are 16 byte aligned and padded, so that four values can always be read
+  // starting at any pixel of the row.
+  uint32* getRow(int32 y) { return data + pitch * y; }
+  const uint32* getRow(int32 y) const { return data + pitch * y; }
+  uint32 getPitch() const { return pitch; }
+
+  void setClearMode(DEPTH_CLEAR_MODE clearMode);
+  DEPTH_CLEAR_MODE getClearMode() const { return clearMode; }
+
+  // Advances the frame, returns true when buffer has to be cleared before drawing.
+  bool beginFrame();
+  uint32 getFrameTag() const { return frameTag; }
+
+  // Depth is quantized from 1/z, everything closer than nearZ gets 0
+  real32 getNearZ() const { return nearZ; }
+  void setNearZ(real32 nearZ) { this->nearZ = nearZ; }
+
+  uint32 getDepthValue(real32 invZ) const;
+
+  void clear();
+private:
+  std::vector<uint32> storage;
+  uint32* data = NULL;
+  uint32 pitch = 0;
+  Vec2i dimensions;
+
+  DEPTH_CLEAR_MODE clearMode = DCM_CLEAR;
+  uint32 frameTag = 0;
+  bool clearPending = true;
+
+  real32 nearZ = 0.5f;
+};
@@ -0,0 +1,192 @@
+#include "FramePipeline.h"
+#include <stdio.h>
+#include <math.h>
+#include <jpb/Profiler.h>
+
+FramePipeline::FramePipeline(Game* game, Platform* platform, const Vec2i& resolution)
+  : game(game), platform(platform)
+{
+  PIXEL_FORMAT format = platform->getPixelFormat();
+  PipelineFrame* slots = frames.getSlots();
+  for(uint32 i = 0; i < frames.getSlotCount(); i++)
+  {
+    PipelineFrame& frame = slots[i];
+    frame.pixels.resize(resolution.x * resolution.y);
+    frame.framebuffer = {};
+    frame.framebuffer.pixelData = (uint8*)frame.pixels.data();
+    frame.framebuffer.dimensions = resolution;
+    frame.framebuffer.pitch = resolution.x * sizeof(uint32);
+    frame.framebuffer.format = format;
+    frame.frameIndex = 0;
+  }
+
+  simulateThread = std::thread(&FramePipeline::simulateLoop, this);
+  renderThread = std::thread(&FramePipeline::renderLoop, this);
+}
+
+FramePipeline::~FramePipeline()
+{
+  stop();
+}
+
+void
+FramePipeline::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(stateMutex);
+    running = false;
+  }
+  stateChanged.notify_all();
+
+  if(simulateThread.joinable()) simulateThread.join();
+  if(renderThread.joinable()) renderThread.join();
+}
+
+void
+FramePipeline::simulateLoop()
+{
+  uint32 writeFrame = 0;
+  float lastDeltaMs = 2;
+  uint64 prevTicks = Platform::getTicks();
+  Trace::setThreadName("Simulate");
+
+  for(;;)
+  {
+    SimulatedFrame& simulated = simulatedFrames[writeFrame];
+
+    Input input;
+    {
+      std::lock_guard<std::mutex> lock(inputMutex);
+      input = sharedInput;
+      sharedInput.clear();
+    }
+
+    uint64 ticks = Platform::getTicks();
+    simulated.inputTicks = ticks;
+    game->simulate(input, lastDeltaMs, &simulated.state);
+    simulated.simulateMs = (real32)Platform::ticksToMs(Platform::getTicks() - ticks);
+
+    {
+      // The other state is free once render took the pending one and finished drawing it
+      PROFILE_ZONE("Wait for render");
+      std::unique_lock<std::mutex> lock(stateMutex);
+      stateChanged.wait(lock, [this] { return !running || (pendingFrame < 0 && !rendering); });
+      if(!running) return;
+
+      pendingFrame = writeFrame;
+    }
+    stateChanged.notify_all();
+    writeFrame ^= 1;
+
+    // Step length is the time between two samples of the input, waiting on render included
+    lastDeltaMs = (float)Platform::ticksToMs(ticks - prevTicks);
+    prevTicks = ticks;
+  }
+}
+
+void
+FramePipeline::renderLoop()
+{
+  uint64 frameIndex = 0;
+  Trace::setThreadName("Render");
+
+  for(;;)
+  {
+    int32 readFrame;
+    {
+      std::unique_lock<std::mutex> lock(stateMutex);
+      stateChanged.wait(lock, [this] { return !running || pendingFrame >= 0; });
+      if(!running) return;
+
+      readFrame = pendingFrame;
+      pendingFrame = -1;
+      rendering = true;
+    }
+    stateChanged.notify_all();
+
+    const SimulatedFrame& simulated = simulatedFrames[readFrame];
+    PipelineFrame& frame = frames.getWriteSlot();
+
+    uint64 ticks = Platform::getTicks();
+    game->render(&frame.framebuffer, simulated.state);
+    frame.renderMs = (real32)Platform::ticksToMs(Platform::getTicks() - ticks);
+    frame.clearStats = game->getClearStats();
+    frame.renderStats = game->getFrameStats();
+    frame.frameIndex = frameIndex++;
+    frame.inputTicks = simulated.inputTicks;
+    frame.simulateMs = simulated.simulateMs;
+
+    {
+      std::lock_guard<std::mutex> lock(stateMutex);
+      rendering = false;
+    }
+    stateChanged.notify_all();
+
+    frames.publish();
+    {
+      // Only to not lose the wakeup, the handoff itself doesn't need the lock
+      std::lock_guard<std::mutex> lock(presentMutex);
+    }
+    framePublished.notify_one();
+  }
+}
+
+void
+FramePipeline::run()
+{
+  static const real32 updatePeriod = 500;
+  real32 statusTime = 0;
+  uint64 prevTicks = Platform::getTicks();
+  bool statsRequested = false;
+  Trace::setThreadName("Present");
+
+  for(;;)
+  {
+    {
+      std::lock_guard<std::mutex> lock(inputMutex);
+      if(!platform->processEvents(&sharedInput)) break;
+      if(sharedInput.isKeyDown(SDLK_ESCAPE) || sharedInput.isKeyDown(SDLK_q)) break;
+      if(sharedInput.isKeyPressed(SDLK_i)) statsRequested = true;
+    }
+
+    if(!frames.acquire())
+    {
+      // Short timeout, events keep getting polled while render is busy
+      std::unique_lock<std::mutex> lock(presentMutex);
+      framePublished.wait_for(lock, std::chrono::milliseconds(4));
+      continue;
+    }
+
+    const PipelineFrame& frame = frames.getReadSlot();
+    {
+      PROFILE_ZONE("Present");
+      platform->presentFrame(frame.framebuffer);
+    }
+
+    if(dumpStats || statsRequested)
+    {
+      printf("frame %llu: ", (unsigned long long)frame.frameIndex);
+      frame.renderStats.print(stdout);
+      statsRequested = false;
+    }
+
+    uint64 ticks = Platform::getTicks();
+    real32 frameMs = (real32)Platform::ticksToMs(ticks - prevTicks);
+    prevTicks = ticks;
+
+    statusTime += frameMs;
+    if(statusTime > updatePeriod)
+    {
+      statusTime = fmodf(statusTime, updatePeriod);
+      char tempBuffer[255] = {};
+
+      real64 latencyMs = Platform::ticksToMs(ticks - frame.inputTicks);
+      sprintf(tempBuffer, "SoftRenderer %f ms/frame, %f fps, simulate %.2f ms, render %.2f ms, latency %.2f ms, clear %.3f ms%s",
+	      frameMs, 1000.0f/frameMs, frame.simulateMs, frame.renderMs, latencyMs, frame.clearStats.timeMs,
+	      frame.clearStats.depthCleared ? "" : " (depth skipped)");
+      platform->setStatus(tempBuffer);
+    }
+  }
+
+  stop();
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "main.h"
+#include "Game.h"
+#include "Platform.h"
+#include "TripleBuffer.h"
+
+// Frame finished by the render thread, in system memory so that it can be presented while
+// the next one is drawn
+struct PipelineFrame {
+  std::vector<uint32> pixels;
+  Framebuffer framebuffer;
+
+  uint64 frameIndex;
+  // When the input this frame was simulated from got sampled
+  uint64 inputTicks;
+  real32 simulateMs;
+  real32 renderMs;
+  ClearStats clearStats;
+  RenderStats renderStats;
+};
+
+// Runs the frame loop as three stages on three threads. Simulation of frame N+1 overlaps
+// rendering of frame N, finished frames go through a triple buffer to the thread that owns
+// the platform, which polls events and presents. Simulation waits until render is done
+// with the frame before the previous one, so a frame is never more than one step behind
+// the input it was simulated from.
+class FramePipeline {
+public:
+  FramePipeline(Game* game, Platform* platform, const Vec2i& resolution);
+  ~FramePipeline();
+
+  // Present loop, returns once the platform or the user asks to quit
+  void run();
+  // Prints the counters of every presented frame, otherwise only when 'i' is pressed
+  void setDumpStats(bool dumpStats) { this->dumpStats = dumpStats; }
+private:
+  struct SimulatedFrame {
+    FrameState state;
+    uint64 inputTicks;
+    real32 simulateMs;
+  };
+
+  Game* game;
+  Platform* platform;
+  bool dumpStats = false;
+
+  // Filled by the present thread, consumed by the simulation thread
+  std::mutex inputMutex;
+  Input sharedInput;
+
+  // Simulation writes one, render reads the other
+  SimulatedFrame simulatedFrames[2];
+  std::mutex stateMutex;
+  std::condition_variable stateChanged;
+  int32 pendingFrame = -1;
+  bool rendering = false;
+  bool running = true;
+
+  TripleBuffer<PipelineFrame> frames;
+  std::mutex presentMutex;
+  std::condition_variable framePublished;
+
+  std::thread simulateThread;
+  std::thread renderThread;
+
+  void simulateLoop();
+  void renderLoop();
+  void stop();
+};
@@ -0,0 +1,83 @@
+#include "Framebuffer.h"
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+
+template <PIXEL_FORMAT Format>
+static void
+convertSpan(uint32* dst, const Color32* src, int32 count)
+{
+  int32 i = 0;
+  for(; i + 4 <= count; i += 4)
+  {
+    __m128i colors = _mm_loadu_si128((const __m128i*)(src + i));
+    _mm_storeu_si128((__m128i*)(dst + i), PixelFormat<Format>::fromColors(colors));
+  }
+
+  for(; i < count; i++)
+  {
+    dst[i] = PixelFormat<Format>::fromColor(src[i]);
+  }
+}
+
+Color32
+Framebuffer::toNative(Color32 color) const
+{
+  switch(format)
+  {
+  case PF_ARGB8888: return PixelFormat<PF_ARGB8888>::fromColor(color);
+  case PF_RGBA8888:
+  default: return PixelFormat<PF_RGBA8888>::fromColor(color);
+  }
+}
+
+void
+Framebuffer::setPixel(int32 x, int32 y, Color32 color)
+{
+  if(x >= 0 && x < dimensions.x &&
+     y >= 0 && y < dimensions.y)
+  {
+    getRow(y)[x] = toNative(color);
+  }
+}
+
+void
+Framebuffer::fillSpan(int32 y, int32 startX, int32 endX, Color32 color)
+{
+  uint32* row = getRow(y);
+  std::fill(row + startX, row + endX + 1, toNative(color));
+}
+
+void
+Framebuffer::writeSpan(int32 y, int32 startX, const Color32* colors, int32 count)
+{
+  uint32* dst = getRow(y) + startX;
+
+  switch(format)
+  {
+  case PF_ARGB8888: convertSpan<PF_ARGB8888>(dst, colors, count); break;
+  case PF_RGBA8888:
+  default: memcpy(dst, colors, count * sizeof(uint32)); break;
+  }
+}
+
+void
+Framebuffer::fill(Color32 color)
+{
+  for(int32 y = 0; y < dimensions.y; y++)
+  {
+    fillSpan(y, 0, dimensions.x - 1, color);
+  }
+}
+
+Framebuffer
+Framebuffer::getView(const IntRect& rect)
+{
+  assert(rect.left >= 0 && rect.top >= 0 && rect.width >= 0 && rect.height >= 0 &&
+	 rect.left + rect.width <= dimensions.x && rect.top + rect.height <= dimensions.y);
+
+  Framebuffer view = *this;
+  view.pixelData = pixelData + pitch * rect.top + rect.left * sizeof(uint32);
+  view.dimensions = Vec2i(rect.width, rect.height);
+  return view;
+}
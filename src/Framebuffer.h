@@ -0,0 +1,82 @@
+#pragma once
+
+#include <emmintrin.h>
+#include <jpb/Vector.h>
+#include <jpb/Rect.h>
+
+#include "Color.h"
+
+// Native layouts of the presented surface, renderer works with Color32 internally.
+enum PIXEL_FORMAT {
+  PF_RGBA8888,
+  PF_ARGB8888
+};
+
+template <PIXEL_FORMAT Format>
+struct PixelFormat;
+
+template <>
+struct PixelFormat<PF_RGBA8888> {
+  static Color32 fromColor(Color32 color) { return color; }
+  static __m128i fromColors(__m128i colors) { return colors; }
+};
+
+template <>
+struct PixelFormat<PF_ARGB8888> {
+  static Color32 fromColor(Color32 color) { return color >> 8 | color << 24; }
+  static __m128i fromColors(__m128i colors)
+  {
+    return _mm_or_si128(_mm_srli_epi32(colors, 8), _mm_slli_epi32(colors, 24));
+  }
+};
+
+// Render target, pixels live wherever the platform hands them to us (locked texture,
+// offscreen memory), rows are pitch bytes apart.
+struct Framebuffer {
+  uint8* pixelData;
+  Vec2i dimensions;
+  int32 pitch;
+  PIXEL_FORMAT format;
+
+  uint32* getRow(int32 y) { return (uint32*)(pixelData + pitch * y); }
+  const uint32* getRow(int32 y) const { return (const uint32*)(pixelData + pitch * y); }
+
+  Color32 toNative(Color32 color) const;
+
+  // Bounds checked, meant for sparse writes only.
+  void setPixel(int32 x, int32 y, Color32 color);
+
+  // Spans are inclusive of both ends and have to lie inside of the buffer.
+  void fillSpan(int32 y, int32 startX, int32 endX, Color32 color);
+  void writeSpan(int32 y, int32 startX, const Color32* colors, int32 count);
+
+  void fill(Color32 color);
+
+  // Shares the pixels of rect, which has to lie inside of the buffer.
+  Framebuffer getView(const IntRect& rect);
+
+  template <PIXEL_FORMAT Format>
+  static void storeColors4(uint32* dst, __m128i colors, uint32 laneMask, int32 laneCount);
+};
+
+template <PIXEL_FORMAT Format>
+inline void
+Framebuffer::storeColors4(uint32* dst, __m128i colors, uint32 laneMask, int32 laneCount)
+{
+  colors = PixelFormat<Format>::fromColors(colors);
+
+  if(laneMask == 0xF)
+  {
+    _mm_storeu_si128((__m128i*)dst, colors);
+  }
+  else
+  {
+    uint32 laneColors[4];
+    _mm_storeu_si128((__m128i*)laneColors, colors);
+
+    for(int32 i = 0; i < laneCount; i++)
+    {
+      if(laneMask & (1 << i)) dst[i] = laneColors[i];
+    }
+  }
+}
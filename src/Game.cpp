@@ -1,7 +1,9 @@
-#include <iostream>
+#include <stdio.h>
 #include <algorithm>
 #include <jpb/Types.h>
+#include <jpb/Profiler.h>
 #include "Game.h"
+#include "Blitter.h"
 
 #define sign(a) (a > 0 ? 1 : -1)
 
@@ -31,25 +33,128 @@ Game::~Game()
 
 void Game::start(const Vec2i& screenResolution)
 {
+  this->screenResolution = screenResolution;
+
+  // Floor under the textured cube
+  real32 groundSize = 1.5f;
+  real32 groundTextureScale = 9.0f;
+  groundPlane = {
+    { Vec3f(-groundSize, groundSize, 0), Vec2f(0, 0), Vec3f() },
+    { Vec3f(groundSize, groundSize, 0), Vec2f(groundTextureScale, 0), Vec3f() },
+    { Vec3f(-groundSize, -groundSize, 0), Vec2f(0, groundTextureScale), Vec3f() },
+    { Vec3f(groundSize, -groundSize, 0), Vec2f(groundTextureScale, groundTextureScale), Vec3f() }
+  };
+  TriangleIndices groundIndices = {{0, 1, 2}, {1, 3, 2}};
+
+  MeshHelper::rotateVertices(groundPlane, Vec3f(90.0f, 0, 0));
+  MeshHelper::translateVertices(groundPlane, Vec3f(0, -0.75f, 0));
+  MeshHelper::calculateNormals(groundPlane, groundIndices);
+  shadowMap.addStaticCaster(MeshHelper::getPositions(groundPlane), groundIndices);
+
+  // Front side of the textured cube, the others are copies of it
+  real32 faceScale = 0.5f;
+  real32 faceTextureScale = 3.0f;
+  MappedVertices face = {
+    { Vec3f(-faceScale, faceScale, 0), Vec2f(0, 0), Vec3f() },
+    { Vec3f(faceScale, faceScale, 0), Vec2f(faceTextureScale, 0), Vec3f() },
+    { Vec3f(-faceScale, -faceScale, 0), Vec2f(0, faceTextureScale), Vec3f() },
+    { Vec3f(faceScale, -faceScale, 0), Vec2f(faceTextureScale, faceTextureScale), Vec3f() }
+  };
+  TriangleIndices faceIndices = {{0, 1, 2}, {1, 3, 2}};
+
+  MeshHelper::translateVertices(face, Vec3f(0, 0, -faceScale));
+  MeshHelper::calculateNormals(face, faceIndices);
+  cubeFace.set(face, faceIndices);
+
+  // Sides are children of the cube node, turning it turns all of them
+  Material faceMaterial = { &testTexture, packColor(255, 255, 255, 255), PS_DEFAULT, NULL };
+  Vec3f faceAngles[6] = {
+    Vec3f(0, 0, 0), Vec3f(0, 90.0f, 0), Vec3f(0, 180.0f, 0), Vec3f(0, 270.0f, 0),
+    Vec3f(90.0f, 0, 0), Vec3f(-90.0f, 0, 0)
+  };
+  cubeNode = sceneGraph.createNode();
+  for(int32 i = 0; i < 6; i++)
+  {
+    uint32 faceNode = sceneGraph.createNode(cubeNode);
+    sceneGraph.setRotation(faceNode, Quaternion::fromAngles(faceAngles[i]));
+    sceneGraph.setMesh(faceNode, &cubeFace, faceMaterial);
+  }
+
+  // Marble veins from turbulence bending a sine, computed per visible texel instead of
+  // a bitmap covering the whole floor. The parser has no operator precedence.
+  GenDataMap groundLayers;
+  groundLayers[0] = { NT_PERLIN, { 0.25f, 3, 2.0f, 0.5f, 0, 0 }, 1.0f };
+  groundLayers[1] = { NT_PERLIN, { 2.0f, 2, 2.0f, 0.5f, 1, 0 }, 0.15f };
+  groundMaterial.compile(groundLayers, "(abs(sin((x * 0.6) + (y * 0.3) + (Map0 * 4))) * 0.85) + Map1");
+  groundMaterial.setColors(packColor(70, 60, 55, 255), packColor(235, 230, 220, 255));
+  groundMaterial.setTexelsPerUnit(64);
+
   softRenderer.setZBufferSize(screenResolution);
+  clearStage.setWorkerPool(&workerPool);
+  multiView.setWorkerPool(&workerPool);
   camera.setPosition(Vec3f(2.0f, 2.0f, -2.0f));
 }
 
-void Game::update(TextureBuffer* screenBuffer, const Input& input, real32 lastDeltaMs)
+void Game::update(Framebuffer* screenBuffer, const Input& input, real32 lastDeltaMs)
 {
+  simulate(input, lastDeltaMs, &updateState);
+  render(screenBuffer, updateState);
+}
+
+void
+Game::simulate(const Input& input, float lastDeltaMs, FrameState* state)
+{
+  PROFILE_ZONE("Game::simulate");
   handleInput(input, lastDeltaMs);
-  fillScreen(screenBuffer);
 
-  static real32 localTime = 0;
   localTime += lastDeltaMs;
 
-  camera.handleInput(input, lastDeltaMs);
-  softRenderer.setCamera(&camera);
+  handleCameraInput(input, lastDeltaMs);
+  state->camera = camera;
 
   Vec3f directionalLight(-1.0f, 0, 0);
   directionalLight.rotateAroundZDeg(45.0f);// + sin(localTime * 0.005f) * 10.0f);
   directionalLight.rotateAroundYDeg(localTime * 0.0002f * 360);
-  softRenderer.setDirectionalLight(directionalLight);
+  state->directionalLight = directionalLight;
+  setupLights(state);
+
+  cubePosition.z = 0.6f; // + sin(localTime * 0.0025f) * 0.3f;
+  rotAngleY += lastDeltaMs * 0.10f;
+  state->cubePosition = cubePosition;
+  state->cubeRotX = rotAngleX;
+  state->cubeRotY = rotAngleY;
+
+  state->proceduralGround = proceduralGround;
+  state->wireframeOverlay = wireframeOverlay;
+  state->viewLayout = viewLayout;
+  state->depthClearMode = depthClearMode;
+  state->pcfMode = pcfMode;
+  state->debugView = debugViewMode;
+
+  static const real32 rotationSpeed = 0.001f;
+  sceneGraph.setRotation(cubeNode, Quaternion::fromAngles(Vec3f(0, localTime * rotationSpeed, 0)));
+  sceneGraph.update();
+  state->drawList = sceneGraph.getDrawList();
+}
+
+void
+Game::render(Framebuffer* screenBuffer, const FrameState& state)
+{
+  PROFILE_ZONE("Game::render");
+  DepthBuffer* depthBuffer = softRenderer.getDepthBuffer();
+  if(depthBuffer->getClearMode() != state.depthClearMode) depthBuffer->setClearMode(state.depthClearMode);
+  softRenderer.setWireframeOverlay(state.wireframeOverlay);
+  shadowMap.setPcfMode(state.pcfMode);
+
+  fillScreen(screenBuffer);
+
+  renderCamera = state.camera;
+  softRenderer.setCamera(&renderCamera);
+
+  softRenderer.setDirectionalLight(state.directionalLight);
+  shadowMap.setLight(state.shadowLight);
+  softRenderer.setLights(state.lights);
+  softRenderer.prepareLights(screenBuffer->dimensions);
 
   if(0)
   {
@@ -111,7 +216,7 @@ void Game::update(TextureBuffer* screenBuffer, const Input& input, real32 lastDe
 	// Vec3f(-0.2 * testScale, 0.1 * testScale, 0),
       };
 
-    MeshHelper::rotateVertices(vertices, Vec3f(rotAngleX * 0.01f, rotAngleY * 0.01f, 0));
+    MeshHelper::rotateVertices(vertices, Vec3f(state.cubeRotX * 0.01f, state.cubeRotY * 0.01f, 0));
     MeshHelper::translateVertices(vertices, Vec3f(0, 0, testDistance));
 
     TriangleIndices triangleIndices = {{0, 1, 2}, {1,3,2}}; //, {4, 0, 2}};
@@ -123,78 +228,93 @@ void Game::update(TextureBuffer* screenBuffer, const Input& input, real32 lastDe
 
     // Cube Rendering
     // -----------------------
-    cubePosition.z = 0.6f; // + sin(localTime * 0.0025f) * 0.3f;
-    rotAngleY += lastDeltaMs * 0.10f;
-    Cube cube(cubePosition, 0.2f);
-    softRenderer.drawCubeInPerspective(screenBuffer, cube, rotAngleX, rotAngleY);
+    Cube cube(state.cubePosition, 0.2f);
+    softRenderer.drawCubeInPerspective(screenBuffer, cube, state.cubeRotX, state.cubeRotY);
   }
 
-  // TextureBuffer::blitTexture(screenBuffer, &testTexture, Vec2i(200, 200));
-
-  if(1)
-  {
-    real32 testScale = 0.5f;
-    real32 testDistance = sin(localTime * 0.005f) * 0.2f + 1.0f;
-    static real32 rotationValue = 0;
-
-    // if(input.keysDown[SDLK_a])
-    //   rotationValue = sin(localTime * 0.002f) * 3.0f;
-
-    Vec3f v1 = Vec3f(-testScale, testScale, 0);
-    Vec3f v2 = Vec3f(testScale, testScale, 0);
+  // Blitter::blit(screenBuffer, { &testTexture, IntRect(), Vec2i(200, 200), BM_OPAQUE, 0 });
 
-    Vec3f v3 = Vec3f(-testScale, -testScale, 0);
-    Vec3f v4 = Vec3f(testScale, -testScale, 0);
-
-    real32 textureScale = 3.0f;
-    Vec2f textOffset(0, 0);
-    TriangleIndices triangleIndices = {{0, 1, 2}, {1, 3, 2}};
-    static const real32 rotationSpeed = 0.001f;
+  TriangleIndices triangleIndices = {{0, 1, 2}, {1, 3, 2}};
 
+  // Ground is a static caster, its shadow map layer stays cached while the cube moves
+  shadowMap.beginFrame();
+  const SceneDrawList& drawList = state.drawList;
+  for(auto batch = drawList.batches.begin(); batch != drawList.batches.end(); batch++)
+  {
+    for(uint32 i = batch->first; i < batch->first + batch->count; i++)
     {
-      MappedVertices baseFace = {
-	{ v1, Vec2f(textOffset.x, textOffset.y), Vec3f() },
-	{ v2, Vec2f(textOffset.x + 1.0f * textureScale, textOffset.y), Vec3f() },
-	{ v3, Vec2f(textOffset.x + 0, 1.0f * textureScale + textOffset.y), Vec3f() },
-	{ v4, Vec2f(textOffset.x + 1.0f * textureScale, 1.0f * textureScale + textOffset.y), Vec3f() }
-      };
-
-      // Translating to the center
-      MeshHelper::translateVertices(baseFace, Vec3f(0, 0, -testScale));
-
-      MappedVertices frontFace = baseFace;
-      MeshHelper::rotateVertices(frontFace, Vec3f(0, localTime * rotationSpeed, 0));
-      MeshHelper::calculateNormals(frontFace, triangleIndices);
-      softRenderer.drawMappedTriangles3D(screenBuffer, frontFace, triangleIndices, &testTexture);
+      shadowMap.drawCaster(MeshHelper::getPositions(batch->mesh->getVertices(drawList.transforms[i])),
+			   batch->mesh->getTriangleIndices());
+    }
+  }
 
-      MeshHelper::rotateVertices(frontFace, Vec3f(0, 90.0f, 0));
-      MeshHelper::calculateNormals(frontFace, triangleIndices);
-      softRenderer.drawMappedTriangles3D(screenBuffer, frontFace, triangleIndices, &testTexture);
+  SceneItems items;
+  Material groundMaterialState = { &testTexture, packColor(255, 255, 255, 255), PS_DEFAULT, NULL };
+  if(state.proceduralGround)
+  {
+    groundMaterialState = { NULL, packColor(255, 255, 255, 255), PS_DEFAULT | PS_PROCEDURAL, &groundMaterial };
+  }
+  items.push_back({ &groundPlane, &triangleIndices, groundMaterialState });
+  drawList.appendItems(&items);
 
-      MeshHelper::rotateVertices(frontFace, Vec3f(0, 90.0f, 0));
-      MeshHelper::calculateNormals(frontFace, triangleIndices);
-      softRenderer.drawMappedTriangles3D(screenBuffer, frontFace, triangleIndices, &testTexture);
+  debugView.setMode(state.debugView);
+  bool debugging = state.debugView != DV_NONE;
+  if(debugging) debugView.begin(screenBuffer->dimensions);
+  softRenderer.setDebugView(debugging ? &debugView : NULL);
 
-      MeshHelper::rotateVertices(frontFace, Vec3f(0, 90.0f, 0));
-      MeshHelper::calculateNormals(frontFace, triangleIndices);
-      softRenderer.drawMappedTriangles3D(screenBuffer, frontFace, triangleIndices, &testTexture);
+  drawViews(screenBuffer, items, state.viewLayout);
 
-      frontFace = baseFace;
+  if(debugging) debugView.resolve(screenBuffer);
+  frameStats = RenderStats::collect();
+}
 
-      MeshHelper::rotateVertices(frontFace, Vec3f(90.0f, 0, 0));
-      MeshHelper::rotateVertices(frontFace, Vec3f(0, localTime * rotationSpeed, 0));
-      MeshHelper::calculateNormals(frontFace, triangleIndices);
-      softRenderer.drawMappedTriangles3D(screenBuffer, frontFace, triangleIndices, &testTexture);
+void
+Game::drawViews(Framebuffer* screenBuffer, const SceneItems& items, VIEW_LAYOUT viewLayout)
+{
+  Vec2i screen = screenBuffer->dimensions;
+  Color32 clearColor = packColor(120, 120, 120);
 
-      frontFace = baseFace;
-      MeshHelper::rotateVertices(frontFace, Vec3f(-90.0f, 0, 0));
-      MeshHelper::rotateVertices(frontFace, Vec3f(0, localTime * rotationSpeed, 0));
-      MeshHelper::calculateNormals(frontFace, triangleIndices);
-      softRenderer.drawMappedTriangles3D(screenBuffer, frontFace, triangleIndices, &testTexture);
+  if(viewLayout == VL_SINGLE || viewLayout == VL_PICTURE_IN_PICTURE)
+  {
+    for(auto it = items.begin(); it != items.end(); it++)
+    {
+      if(it->instancedMesh)
+      {
+	softRenderer.drawMeshInstanced(screenBuffer, *it->instancedMesh, it->instanceTransforms, it->instanceCount,
+				       it->material);
+      }
+      else
+      {
+	softRenderer.drawMappedTriangles3D(screenBuffer, *it->vertices, *it->triangleIndices, it->material);
+      }
     }
   }
 
-  softRenderer.clearZBuffer();
+  if(viewLayout == VL_SPLIT)
+  {
+    // Second player looks at the scene from the other side, scissor leaves a divider
+    int32 halfWidth = screen.x / 2;
+    View left = { &renderCamera, IntRect(0, 0, halfWidth, screen.y), IntRect(), clearColor };
+    View right = { &secondCamera, IntRect(halfWidth, 0, screen.x - halfWidth, screen.y),
+		   IntRect(halfWidth + 2, 0, screen.x - halfWidth - 2, screen.y), clearColor };
+    multiView.render(screenBuffer, { left, right }, items, softRenderer);
+  }
+  else if(viewLayout == VL_PICTURE_IN_PICTURE)
+  {
+    // Top down minimap above the player, drawn after the main view it covers
+    int32 mapSize = screen.y / 3;
+    minimapCamera.setPosition(renderCamera.getPosition() + Vec3f(0, 3.0f, 0));
+    minimapCamera.setRotation(90.0f, 0);
+    View minimap = { &minimapCamera, IntRect(screen.x - mapSize - 16, 16, mapSize, mapSize), IntRect(),
+		     packColor(30, 60, 30) };
+    multiView.render(screenBuffer, { minimap }, items, softRenderer);
+  }
+  else if(viewLayout == VL_CUBEMAP)
+  {
+    int32 faceSize = std::min(screen.x / 3, screen.y / 2);
+    Views views = MultiView::getCubemapViews(cubeCameras, renderCamera.getPosition(), Vec2i(0, 0), faceSize, clearColor);
+    multiView.render(screenBuffer, views, items, softRenderer);
+  }
 }
 
 void
@@ -247,34 +367,121 @@ Game::handleInput(const Input& input, float lastDeltaMs)
     rotAngleY -= lastDeltaMs * rotationSpeed;
   }
 
+  if(input.isKeyPressed(SDLK_z))
+  {
+    depthClearMode = depthClearMode == DCM_FRAME_TAGGED ? DCM_CLEAR : DCM_FRAME_TAGGED;
+  }
+
+  if(input.isKeyPressed(SDLK_l))
+  {
+    manyLights = !manyLights;
+  }
+
+  if(input.isKeyPressed(SDLK_p))
+  {
+    pcfMode = (PCF_MODE)((pcfMode + 1) % (PCF_3X3 + 1));
+  }
+
+  if(input.isKeyPressed(SDLK_o))
+  {
+    wireframeOverlay = !wireframeOverlay;
+  }
+
+  if(input.isKeyPressed(SDLK_g))
+  {
+    proceduralGround = !proceduralGround;
+  }
+
+  if(input.isKeyPressed(SDLK_c))
+  {
+    viewLayout = (VIEW_LAYOUT)((viewLayout + 1) % VL_COUNT);
+  }
+
+  if(input.isKeyPressed(SDLK_v))
+  {
+    debugViewMode = (DEBUG_VIEW)((debugViewMode + 1) % DV_COUNT);
+    printf("Debug view: %s\n", DebugView::getName(debugViewMode));
+  }
+
+  // Only the single view covers the whole screen, split layouts would need the view under the mouse
+  if(input.isButtonPressed(SDL_BUTTON_RIGHT) && viewLayout == VL_SINGLE)
+  {
+    Vec2i mousePosition = input.getMousePosition();
+    Ray ray = Ray::fromPixel(&camera, screenResolution, Vec2f(mousePosition.x + 0.5f, mousePosition.y + 0.5f));
+    real32 distance;
+    uint32 node = sceneGraph.pick(ray, &distance);
+    if(node == SceneGraph::noNode) printf("Picked nothing\n");
+    else printf("Picked node %u at distance %.3f\n", node, distance);
+  }
 }
 
 void
-Game::fillScreen(TextureBuffer* screenBuffer)
+Game::handleCameraInput(const Input& input, float lastDeltaMs)
 {
-  uint8* pixelData = (uint8*)screenBuffer->pixelData;
-  bool toggle = false;
+  static const real32 rotationSpeed = 0.01f;
+  static const real32 moveSpeed = 0.001f;
 
-  for(int y = 0; y < screenBuffer->dimensions.y; ++y)
+  if(input.isKeyDown(SDLK_8)) camera.rotate(0, 0.001f * lastDeltaMs);
+  if(input.isKeyDown(SDLK_9)) camera.rotate(0, -0.001f * lastDeltaMs);
+
+  if(input.isButtonDown(SDL_BUTTON_LEFT))
   {
-    uint8* row = pixelData + screenBuffer->pitch * y;
-    for(int x = 0; x < screenBuffer->dimensions.x; ++x)
-    {
-      uint32* pixelValue = (uint32*)(row + x * 4);
+    Vec2i mouseDelta = input.getMouseDelta();
+    camera.rotate(rotationSpeed * lastDeltaMs * -mouseDelta.y, rotationSpeed * lastDeltaMs * -mouseDelta.x);
+  }
 
-      uint32 redValue = ((y + (uint32)offset.y) * (uint32)screenBuffer->dimensions.x) % 255;
-      uint32 greenValue = (x + (uint32)offset.x) % 255;
-      uint32 blueValue = 0;
-      uint8 alphaValue = 0;
-      redValue = 120;
-      greenValue = 120;
-      blueValue = 120;
+  real32 forward = 0;
+  real32 right = 0;
+  if(input.isKeyDown(SDLK_w)) forward += moveSpeed * lastDeltaMs;
+  if(input.isKeyDown(SDLK_s)) forward -= moveSpeed * lastDeltaMs;
+  if(input.isKeyDown(SDLK_d)) right += moveSpeed * lastDeltaMs;
+  if(input.isKeyDown(SDLK_a)) right -= moveSpeed * lastDeltaMs;
+  camera.move(forward, right);
+}
 
-      *pixelValue = alphaValue | blueValue << 8 | greenValue << 16 | redValue << 24;
+void
+Game::setupLights(FrameState* state)
+{
+  Lights& lights = state->lights;
+  lights.clear();
+
+  // Colored lamps circling the textured cube
+  Vec3f lampColors[3] = { Vec3f(1.0f, 0.2f, 0.2f), Vec3f(0.2f, 1.0f, 0.2f), Vec3f(0.2f, 0.2f, 1.0f) };
+  for(int32 i = 0; i < 3; i++)
+  {
+    real32 angle = localTime * 0.001f + i * (2.0f * M_PI / 3.0f);
+    Vec3f position(cos(angle) * 0.9f, 0.3f, sin(angle) * 0.9f);
+    lights.push_back(Light::point(position, lampColors[i], 1.5f));
+  }
+
+  Light spotLight = Light::spot(Vec3f(0.3f, 1.8f, -0.2f), Vec3f(-0.15f, -1.0f, 0.1f), Vec3f(1.0f, 0.9f, 0.6f),
+				4.0f, 25.0f, 40.0f);
+  spotLight.shadowMap = &shadowMap;
+  state->shadowLight = spotLight;
+  lights.push_back(spotLight);
+
+  if(manyLights)
+  {
+    // Small lamps spread over a sphere around the scene, each reaches only a few tiles
+    for(int32 i = 0; i < 256; i++)
+    {
+      real32 height = 1.0f - (i + 0.5f) / 128.0f;
+      real32 ringRadius = sqrt(1.0f - height * height);
+      real32 angle = i * 2.39996f + localTime * 0.0005f;
+
+      Vec3f position(cos(angle) * ringRadius * 1.2f, height * 1.2f, sin(angle) * ringRadius * 1.2f);
+      Vec3f color((i & 1) ? 1.0f : 0.3f, (i & 2) ? 1.0f : 0.3f, (i & 4) ? 1.0f : 0.3f);
+      lights.push_back(Light::point(position, color, 0.35f));
     }
   }
 }
 
+void
+Game::fillScreen(Framebuffer* screenBuffer)
+{
+  clearStage.clear(screenBuffer, softRenderer.getDepthBuffer(), packColor(120, 120, 120));
+}
+
 void Game::cleanUp()
 {
 }
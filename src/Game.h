@@ -4,6 +4,42 @@
 #include <vector>
 #include "main.h"
 #include "SoftRenderer.h"
+#include "ClearStage.h"
+#include "WorkerPool.h"
+#include "ProceduralMaterial.h"
+#include "MultiView.h"
+#include "SceneGraph.h"
+
+enum VIEW_LAYOUT {
+  VL_SINGLE,
+  VL_SPLIT,
+  VL_PICTURE_IN_PICTURE,
+  VL_CUBEMAP,
+  VL_COUNT
+};
+
+// Everything render needs from one simulation step. It's a copy, so the next step can be
+// simulated while this one is drawn.
+struct FrameState {
+  FPSCamera camera;
+  Vec3f directionalLight;
+  Lights lights;
+  // Same light as in lights, the shadow map is drawn from it
+  Light shadowLight;
+
+  Vec3f cubePosition;
+  real32 cubeRotX;
+  real32 cubeRotY;
+  // Meshes placed by the scene graph, the sides of the textured cube
+  SceneDrawList drawList;
+
+  bool proceduralGround;
+  bool wireframeOverlay;
+  VIEW_LAYOUT viewLayout;
+  DEPTH_CLEAR_MODE depthClearMode;
+  PCF_MODE pcfMode;
+  DEBUG_VIEW debugView;
+};
 
 class Game {
 public:
@@ -12,21 +48,62 @@ public:
   ~Game();
 
   void start(const Vec2i& screenResolution);
-  void update(TextureBuffer* screenBuffer, const Input& input, float lastDeltaMs);
+  // Simulation and rendering of one frame on the calling thread
+  void update(Framebuffer* screenBuffer, const Input& input, float lastDeltaMs);
   void cleanUp();
+
+  // Simulate and render touch separate members, so they can run on two threads as long as
+  // render doesn't get a state that simulate is still writing.
+  void simulate(const Input& input, float lastDeltaMs, FrameState* state);
+  void render(Framebuffer* screenBuffer, const FrameState& state);
+
+  const ClearStats& getClearStats() const { return clearStage.getLastStats(); }
+  // Counters of the last rendered frame
+  const RenderStats& getFrameStats() const { return frameStats; }
 private:
 
+  WorkerPool workerPool;
+  ClearStage clearStage;
   SoftRenderer softRenderer;
   FPSCamera camera = FPSCamera(Vec3f(), 45.0f, 0);
+  // Copy of the simulated camera owned by render
+  FPSCamera renderCamera;
+  MultiView multiView;
+  FPSCamera secondCamera = FPSCamera(Vec3f(0, 1.5f, 2.5f), 30.0f, 180.0f);
+  FPSCamera minimapCamera = FPSCamera(Vec3f(), 90.0f, 0);
+  FPSCamera cubeCameras[CF_COUNT];
 
   Vec2f offset;
   TextureBuffer testTexture;
+  MappedVertices groundPlane;
+  // One side of the textured cube, drawn once per side
+  InstancedMesh cubeFace;
+  SceneGraph sceneGraph;
+  uint32 cubeNode;
+  ShadowMap shadowMap = ShadowMap(256);
+  ProceduralMaterial groundMaterial;
+  RenderStats frameStats;
+  DebugView debugView;
 
   real32 rotAngleX = 30.0f;
   real32 rotAngleY = 30.0f;
 
   Vec3f cubePosition = Vec3f(0.25f, 0, 2.0f);
+  bool manyLights = false;
+  bool proceduralGround = true;
+  bool wireframeOverlay = false;
+  VIEW_LAYOUT viewLayout = VL_SINGLE;
+  DEPTH_CLEAR_MODE depthClearMode = DCM_CLEAR;
+  PCF_MODE pcfMode = PCF_2X2;
+  DEBUG_VIEW debugViewMode = DV_NONE;
+
+  real32 localTime = 0;
+  FrameState updateState;
+  Vec2i screenResolution;
 
   void handleInput(const Input& input, float lastDeltaMs);
-  void fillScreen(TextureBuffer* screenBuffer);
+  void handleCameraInput(const Input& input, float lastDeltaMs);
+  void fillScreen(Framebuffer* screenBuffer);
+  void setupLights(FrameState* state);
+  void drawViews(Framebuffer* screenBuffer, const SceneItems& items, VIEW_LAYOUT viewLayout);
 };
@@ -0,0 +1,22 @@
+#include "HeadlessPlatform.h"
+#include <stdio.h>
+
+bool
+HeadlessPlatform::init(const Vec2i& resolution, const char* title)
+{
+  pixels.resize(resolution.x * resolution.y);
+
+  screenBuffer.pixelData = (uint8*)pixels.data();
+  screenBuffer.dimensions = resolution;
+  screenBuffer.pitch = resolution.x * sizeof(uint32);
+  screenBuffer.format = PF_RGBA8888;
+
+  printf("%s, headless %dx%d, %u frames\n", title, resolution.x, resolution.y, frameCount);
+  return true;
+}
+
+void
+HeadlessPlatform::setStatus(const char* status)
+{
+  printf("%s\n", status);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+
+#include "Platform.h"
+
+// No window and no input, frames go to memory and the loop quits after frameCount of them.
+// Runs the same frame loop as the window on machines without a display.
+class HeadlessPlatform : public Platform {
+public:
+  HeadlessPlatform(uint32 frameCount) : frameCount(frameCount) {}
+
+  bool init(const Vec2i& resolution, const char* title);
+  void shutdown() {}
+
+  bool processEvents(Input* input) { return framesPresented < frameCount; }
+
+  Framebuffer* beginFrame() { return &screenBuffer; }
+  void present() { framesPresented++; }
+
+  PIXEL_FORMAT getPixelFormat() const { return screenBuffer.format; }
+  // Nothing to show, only counted
+  void presentFrame(const Framebuffer& frame) { framesPresented++; }
+
+  // Printed to stdout
+  void setStatus(const char* status);
+
+  uint32 getFramesPresented() const { return framesPresented; }
+private:
+  uint32 frameCount;
+  uint32 framesPresented = 0;
+
+  std::vector<uint32> pixels;
+  Framebuffer screenBuffer = {};
+};
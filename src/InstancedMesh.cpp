@@ -0,0 +1,116 @@
+#include "InstancedMesh.h"
+#include <algorithm>
+#include <emmintrin.h>
+
+void
+InstancedMesh::set(const MappedVertices& vertices, const TriangleIndices& triangleIndices)
+{
+  this->triangleIndices = triangleIndices;
+  vertexCount = vertices.size();
+  uint32 paddedCount = (vertexCount + 3) & ~3;
+
+  for(int32 i = 0; i < 3; i++)
+  {
+    positions[i].assign(paddedCount, 0);
+    normals[i].assign(paddedCount, 0);
+  }
+  uvs.resize(vertexCount);
+
+  bounds = BoundingBox();
+  for(uint32 i = 0; i < vertexCount; i++)
+  {
+    const MappedVertex& vertex = vertices[i];
+    positions[0][i] = vertex.position.x;
+    positions[1][i] = vertex.position.y;
+    positions[2][i] = vertex.position.z;
+    normals[0][i] = vertex.normal.x;
+    normals[1][i] = vertex.normal.y;
+    normals[2][i] = vertex.normal.z;
+    uvs[i] = vertex.uv;
+    bounds.add(vertex.position);
+  }
+
+  facePlanes.resize(triangleIndices.size());
+  for(uint32 i = 0; i < triangleIndices.size(); i++)
+  {
+    const Vec3f& position = vertices[triangleIndices[i].indexes[0]].position;
+    facePlanes[i].normal = Vec3f::cross(vertices[triangleIndices[i].indexes[1]].position - position,
+					vertices[triangleIndices[i].indexes[2]].position - position);
+    facePlanes[i].distance = Vec3f::dotProduct(facePlanes[i].normal, position);
+  }
+
+  boundingCenter = vertexCount ? bounds.getCenter() : Vec3f();
+  boundingRadius = 0;
+  for(uint32 i = 0; i < vertexCount; i++)
+  {
+    boundingRadius = std::max(boundingRadius, (vertices[i].position - boundingCenter).getLength());
+  }
+}
+
+void
+InstancedMesh::transform(const Transform3D& transform, MappedVertices* result) const
+{
+  result->resize(vertexCount);
+  Transform3D normalTransform = transform.getNormalTransform();
+
+  __m128 m[3][3], n[3][3], t[3];
+  for(int32 row = 0; row < 3; row++)
+  {
+    const real32* matrixRow = &transform.rows[row].x;
+    const real32* normalRow = &normalTransform.rows[row].x;
+    for(int32 column = 0; column < 3; column++)
+    {
+      m[row][column] = _mm_set1_ps(matrixRow[column]);
+      n[row][column] = _mm_set1_ps(normalRow[column]);
+    }
+    t[row] = _mm_set1_ps((&transform.translation.x)[row]);
+  }
+
+  const __m128 tiny = _mm_set1_ps(1e-20f);
+  const __m128 one = _mm_set1_ps(1.0f);
+  MappedVertex* dst = result->data();
+
+  for(uint32 i = 0; i < vertexCount; i += 4)
+  {
+    __m128 px = _mm_loadu_ps(positions[0].data() + i);
+    __m128 py = _mm_loadu_ps(positions[1].data() + i);
+    __m128 pz = _mm_loadu_ps(positions[2].data() + i);
+    __m128 nx = _mm_loadu_ps(normals[0].data() + i);
+    __m128 ny = _mm_loadu_ps(normals[1].data() + i);
+    __m128 nz = _mm_loadu_ps(normals[2].data() + i);
+
+    alignas(16) real32 out[6][4];
+    for(int32 row = 0; row < 3; row++)
+    {
+      __m128 position = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[row][0], px), _mm_mul_ps(m[row][1], py)),
+				   _mm_add_ps(_mm_mul_ps(m[row][2], pz), t[row]));
+      _mm_store_ps(out[row], position);
+    }
+
+    __m128 tx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n[0][0], nx), _mm_mul_ps(n[0][1], ny)), _mm_mul_ps(n[0][2], nz));
+    __m128 ty = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n[1][0], nx), _mm_mul_ps(n[1][1], ny)), _mm_mul_ps(n[1][2], nz));
+    __m128 tz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n[2][0], nx), _mm_mul_ps(n[2][1], ny)), _mm_mul_ps(n[2][2], nz));
+    __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(ty, ty)), _mm_mul_ps(tz, tz));
+    __m128 inverseLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(lengthSquared, tiny)));
+    _mm_store_ps(out[3], _mm_mul_ps(tx, inverseLength));
+    _mm_store_ps(out[4], _mm_mul_ps(ty, inverseLength));
+    _mm_store_ps(out[5], _mm_mul_ps(tz, inverseLength));
+
+    uint32 laneCount = std::min(vertexCount - i, 4u);
+    for(uint32 lane = 0; lane < laneCount; lane++)
+    {
+      MappedVertex& vertex = dst[i + lane];
+      vertex.position = Vec3f(out[0][lane], out[1][lane], out[2][lane]);
+      vertex.uv = uvs[i + lane];
+      vertex.normal = Vec3f(out[3][lane], out[4][lane], out[5][lane]);
+    }
+  }
+}
+
+MappedVertices
+InstancedMesh::getVertices(const Transform3D& transform) const
+{
+  MappedVertices result;
+  this->transform(transform, &result);
+  return result;
+}
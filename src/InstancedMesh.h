@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <jpb/Vector.h>
+
+#include "RenderPrimitives.h"
+#include "Transform.h"
+
+// Plane of a triangle in mesh space, the normal follows the winding and isn't normalized.
+// Points p with dotProduct(normal, p) > distance see the front of the triangle.
+struct FacePlane {
+  Vec3f normal;
+  real32 distance;
+};
+
+typedef std::vector<FacePlane> FacePlanes;
+
+// Mesh kept once and drawn many times with a transform per copy. Positions and normals are
+// split into arrays padded to a multiple of four, so copies are transformed four vertices at
+// a time.
+class InstancedMesh {
+public:
+  InstancedMesh() {}
+  InstancedMesh(const MappedVertices& vertices, const TriangleIndices& triangleIndices) { set(vertices, triangleIndices); }
+
+  // Normals are taken as they are, calculate them before
+  void set(const MappedVertices& vertices, const TriangleIndices& triangleIndices);
+
+  uint32 getVertexCount() const { return vertexCount; }
+  const TriangleIndices& getTriangleIndices() const { return triangleIndices; }
+  // One per triangle, back faces of a copy are found against the eye moved into mesh space
+  const FacePlanes& getFacePlanes() const { return facePlanes; }
+  // Box and sphere around the vertices in mesh space
+  const BoundingBox& getBounds() const { return bounds; }
+  const Vec3f& getBoundingCenter() const { return boundingCenter; }
+  real32 getBoundingRadius() const { return boundingRadius; }
+
+  // Vertices of one copy, normals come out normalized. Result keeps its storage between calls.
+  void transform(const Transform3D& transform, MappedVertices* result) const;
+  MappedVertices getVertices(const Transform3D& transform) const;
+private:
+  uint32 vertexCount = 0;
+  std::vector<real32> positions[3];
+  std::vector<real32> normals[3];
+  Vertices2D uvs;
+  TriangleIndices triangleIndices;
+  FacePlanes facePlanes;
+
+  BoundingBox bounds;
+  Vec3f boundingCenter;
+  real32 boundingRadius = 0;
+};
@@ -0,0 +1,134 @@
+#include "Lighting.h"
+#include <math.h>
+
+Light
+Light::directional(const Vec3f& direction, const Vec3f& color)
+{
+  Light light = {};
+  light.type = LT_DIRECTIONAL;
+  light.direction = direction;
+  light.color = color;
+  return light;
+}
+
+Light
+Light::point(const Vec3f& position, const Vec3f& color, real32 range)
+{
+  Light light = {};
+  light.type = LT_POINT;
+  light.position = position;
+  light.color = color;
+  light.range = range;
+  return light;
+}
+
+Light
+Light::spot(const Vec3f& position, const Vec3f& direction, const Vec3f& color, real32 range,
+	    real32 innerAngleDeg, real32 outerAngleDeg)
+{
+  Light light = point(position, color, range);
+  light.type = LT_SPOT;
+  light.direction = direction;
+  light.innerCone = cosf(innerAngleDeg / 180.0f * M_PI);
+  light.outerCone = cosf(outerAngleDeg / 180.0f * M_PI);
+  return light;
+}
+
+bool
+LightGrid::getTileBounds(const Light& light, const Vec2i& screenDimensions, real32 dfc, real32 nearZ,
+			 Vec2i* minTile, Vec2i* maxTile) const
+{
+  const Vec3f& center = light.position;
+  real32 radius = light.range;
+
+  real32 maxZ = center.z + radius;
+  if(maxZ < nearZ) return false;
+  real32 minZ = std::max(center.z - radius, nearZ);
+
+  // x / z over the box around the sphere is extreme at one of its corners
+  real32 minX = std::min((center.x - radius) / minZ, (center.x - radius) / maxZ);
+  real32 maxX = std::max((center.x + radius) / minZ, (center.x + radius) / maxZ);
+  real32 minY = std::min((center.y - radius) / minZ, (center.y - radius) / maxZ);
+  real32 maxY = std::max((center.y + radius) / minZ, (center.y + radius) / maxZ);
+
+  real32 aspectRatio = (real32)screenDimensions.x / screenDimensions.y;
+  real32 halfResX = screenDimensions.x * 0.5f;
+  real32 halfResY = screenDimensions.y * 0.5f;
+
+  // Same transform as polygons going to screen space, y is flipped. Four pixel groups
+  // starting left of the bounds can still reach them.
+  real32 left = minX * dfc * halfResX + halfResX - 3.0f;
+  real32 right = maxX * dfc * halfResX + halfResX;
+  real32 top = -maxY * dfc * aspectRatio * halfResY + halfResY;
+  real32 bottom = -minY * dfc * aspectRatio * halfResY + halfResY;
+
+  if(right < 0 || bottom < 0 || left >= screenDimensions.x || top >= screenDimensions.y) return false;
+
+  minTile->x = std::max((int32)left, 0) >> tileShift;
+  minTile->y = std::max((int32)top, 0) >> tileShift;
+  maxTile->x = std::min((int32)right, screenDimensions.x - 1) >> tileShift;
+  maxTile->y = std::min((int32)bottom, screenDimensions.y - 1) >> tileShift;
+
+  return true;
+}
+
+void
+LightGrid::build(const Lights& viewLights, const Vec2i& screenDimensions, real32 dfc, real32 nearZ)
+{
+  lights = viewLights;
+  tileCount = Vec2i((screenDimensions.x + tileSize - 1) >> tileShift, (screenDimensions.y + tileSize - 1) >> tileShift);
+
+  uint32 totalTiles = tileCount.x * tileCount.y;
+  globalLights.clear();
+  tileOffsets.assign(totalTiles + 1, 0);
+
+  std::vector<Vec2i> tileBounds(lights.size() * 2);
+  std::vector<uint32> localLights;
+
+  // First pass counts lights per tile, second one fills the lists in place
+  for(uint32 i = 0; i < lights.size(); i++)
+  {
+    const Light& light = lights[i];
+
+    if(light.type == LT_DIRECTIONAL)
+    {
+      globalLights.push_back(i);
+      continue;
+    }
+
+    Vec2i& minTile = tileBounds[i * 2];
+    Vec2i& maxTile = tileBounds[i * 2 + 1];
+    if(!getTileBounds(light, screenDimensions, dfc, nearZ, &minTile, &maxTile)) continue;
+
+    localLights.push_back(i);
+    for(int32 y = minTile.y; y <= maxTile.y; y++)
+    {
+      for(int32 x = minTile.x; x <= maxTile.x; x++)
+      {
+	tileOffsets[y * tileCount.x + x + 1]++;
+      }
+    }
+  }
+
+  for(uint32 i = 0; i < totalTiles; i++)
+  {
+    tileOffsets[i + 1] += tileOffsets[i];
+  }
+
+  tileLightIndices.resize(tileOffsets[totalTiles]);
+  std::vector<uint32> fillOffsets(tileOffsets.begin(), tileOffsets.end() - 1);
+
+  for(auto it = localLights.begin(); it != localLights.end(); it++)
+  {
+    const Vec2i& minTile = tileBounds[*it * 2];
+    const Vec2i& maxTile = tileBounds[*it * 2 + 1];
+
+    for(int32 y = minTile.y; y <= maxTile.y; y++)
+    {
+      for(int32 x = minTile.x; x <= maxTile.x; x++)
+      {
+	tileLightIndices[fillOffsets[y * tileCount.x + x]++] = *it;
+      }
+    }
+  }
+}
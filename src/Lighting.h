@@ -0,0 +1,159 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <emmintrin.h>
+#include <jpb/Vector.h>
+
+#include "ShadowMap.h"
+
+enum LIGHT_TYPE {
+  LT_DIRECTIONAL,
+  LT_POINT,
+  LT_SPOT
+};
+
+struct Light {
+  LIGHT_TYPE type;
+  Vec3f position;
+  // Direction light travels in, used by directional and spot lights
+  Vec3f direction;
+  // Channels in 0..1 range
+  Vec3f color;
+  // Point and spot lights fade out completely at this distance
+  real32 range;
+  // Cosines of the cone half angles, full intensity inside the inner one
+  real32 innerCone;
+  real32 outerCone;
+  // Optional, only directional and spot lights cast shadows
+  ShadowMap* shadowMap;
+  // Filled by the renderer for lights moved to camera space
+  ShadowMap::LightBasis shadowBasis;
+
+  static Light directional(const Vec3f& direction, const Vec3f& color);
+  static Light point(const Vec3f& position, const Vec3f& color, real32 range);
+  static Light spot(const Vec3f& position, const Vec3f& direction, const Vec3f& color, real32 range,
+		    real32 innerAngleDeg, real32 outerAngleDeg);
+};
+
+typedef std::vector<Light> Lights;
+
+// Lights in camera space, split into screen tiles. Every tile keeps a list of the point
+// and spot lights whose bounding sphere covers it, directional lights reach every pixel.
+class LightGrid {
+public:
+  static const int32 tileShift = 4;
+  static const int32 tileSize = 1 << tileShift;
+
+  // Lights have to be in camera space already, dfc is the camera distance used for projection.
+  void build(const Lights& viewLights, const Vec2i& screenDimensions, real32 dfc, real32 nearZ);
+
+  const Lights& getLights() const { return lights; }
+  const Vec2i& getTileCount() const { return tileCount; }
+
+  // Tile lists are built for four pixel groups, so they also hold the lights reaching the
+  // three pixels right of the tile.
+  const uint32* getTileLights(int32 x, int32 y, uint32* count) const;
+  const std::vector<uint32>& getGlobalLights() const { return globalLights; }
+
+  // Adds diffuse light of the tile lights to red, green and blue. Position and normal are
+  // in camera space, normal is expected to be close to unit length.
+  void shade4(int32 x, int32 y, const __m128 position[3], const __m128 normal[3],
+	      __m128* red, __m128* green, __m128* blue) const;
+
+  uint32 getTileLightCount() const { return (uint32)tileLightIndices.size(); }
+private:
+  Lights lights;
+  Vec2i tileCount;
+
+  std::vector<uint32> globalLights;
+  // Lights of tile i are tileLightIndices[tileOffsets[i]] .. tileLightIndices[tileOffsets[i + 1]]
+  std::vector<uint32> tileOffsets;
+  std::vector<uint32> tileLightIndices;
+
+  bool getTileBounds(const Light& light, const Vec2i& screenDimensions, real32 dfc, real32 nearZ,
+		     Vec2i* minTile, Vec2i* maxTile) const;
+};
+
+inline const uint32*
+LightGrid::getTileLights(int32 x, int32 y, uint32* count) const
+{
+  uint32 tileIndex = (y >> tileShift) * tileCount.x + (x >> tileShift);
+  *count = tileOffsets[tileIndex + 1] - tileOffsets[tileIndex];
+  return tileLightIndices.data() + tileOffsets[tileIndex];
+}
+
+inline void
+LightGrid::shade4(int32 x, int32 y, const __m128 position[3], const __m128 normal[3],
+		  __m128* red, __m128* green, __m128* blue) const
+{
+  __m128 zero = _mm_setzero_ps();
+  __m128 one = _mm_set1_ps(1.0f);
+
+  for(auto it = globalLights.begin(); it != globalLights.end(); it++)
+  {
+    const Light& light = lights[*it];
+
+    // Normals are compared against reversed light direction
+    __m128 diffuse = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normal[0], _mm_set1_ps(-light.direction.x)),
+					   _mm_mul_ps(normal[1], _mm_set1_ps(-light.direction.y))),
+				_mm_mul_ps(normal[2], _mm_set1_ps(-light.direction.z)));
+    diffuse = _mm_max_ps(diffuse, zero);
+
+    if(light.shadowMap && _mm_movemask_ps(_mm_cmpgt_ps(diffuse, zero)))
+    {
+      diffuse = _mm_mul_ps(diffuse, light.shadowMap->getVisibility4(light.shadowBasis, position, diffuse));
+    }
+
+    *red = _mm_add_ps(*red, _mm_mul_ps(diffuse, _mm_set1_ps(light.color.x)));
+    *green = _mm_add_ps(*green, _mm_mul_ps(diffuse, _mm_set1_ps(light.color.y)));
+    *blue = _mm_add_ps(*blue, _mm_mul_ps(diffuse, _mm_set1_ps(light.color.z)));
+  }
+
+  uint32 lightCount;
+  const uint32* lightIndices = getTileLights(x, y, &lightCount);
+
+  for(uint32 i = 0; i < lightCount; i++)
+  {
+    const Light& light = lights[lightIndices[i]];
+
+    __m128 toLightX = _mm_sub_ps(_mm_set1_ps(light.position.x), position[0]);
+    __m128 toLightY = _mm_sub_ps(_mm_set1_ps(light.position.y), position[1]);
+    __m128 toLightZ = _mm_sub_ps(_mm_set1_ps(light.position.z), position[2]);
+
+    __m128 distanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(toLightX, toLightX), _mm_mul_ps(toLightY, toLightY)),
+				   _mm_mul_ps(toLightZ, toLightZ));
+    __m128 invDistance = _mm_rsqrt_ps(_mm_max_ps(distanceSq, _mm_set1_ps(1e-8f)));
+
+    // Falls off smoothly to zero at the range
+    __m128 falloff = _mm_sub_ps(one, _mm_mul_ps(distanceSq, _mm_set1_ps(1.0f / (light.range * light.range))));
+    falloff = _mm_max_ps(falloff, zero);
+    falloff = _mm_mul_ps(falloff, falloff);
+
+    __m128 cosIncidence = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normal[0], toLightX), _mm_mul_ps(normal[1], toLightY)),
+				     _mm_mul_ps(normal[2], toLightZ));
+    cosIncidence = _mm_max_ps(_mm_mul_ps(cosIncidence, invDistance), zero);
+    __m128 diffuse = _mm_mul_ps(cosIncidence, falloff);
+
+    if(light.type == LT_SPOT)
+    {
+      __m128 cosAngle = _mm_add_ps(_mm_add_ps(_mm_mul_ps(toLightX, _mm_set1_ps(-light.direction.x)),
+					      _mm_mul_ps(toLightY, _mm_set1_ps(-light.direction.y))),
+				   _mm_mul_ps(toLightZ, _mm_set1_ps(-light.direction.z)));
+      cosAngle = _mm_mul_ps(cosAngle, invDistance);
+
+      real32 coneDelta = std::max(light.innerCone - light.outerCone, 1e-4f);
+      __m128 cone = _mm_mul_ps(_mm_sub_ps(cosAngle, _mm_set1_ps(light.outerCone)), _mm_set1_ps(1.0f / coneDelta));
+      diffuse = _mm_mul_ps(diffuse, _mm_min_ps(_mm_max_ps(cone, zero), one));
+
+      if(light.shadowMap && _mm_movemask_ps(_mm_cmpgt_ps(diffuse, zero)))
+      {
+	diffuse = _mm_mul_ps(diffuse, light.shadowMap->getVisibility4(light.shadowBasis, position, cosIncidence));
+      }
+    }
+
+    *red = _mm_add_ps(*red, _mm_mul_ps(diffuse, _mm_set1_ps(light.color.x)));
+    *green = _mm_add_ps(*green, _mm_mul_ps(diffuse, _mm_set1_ps(light.color.y)));
+    *blue = _mm_add_ps(*blue, _mm_mul_ps(diffuse, _mm_set1_ps(light.color.z)));
+  }
+}
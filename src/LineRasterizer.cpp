@@ -0,0 +1,256 @@
+#include "LineRasterizer.h"
+#include <algorithm>
+
+enum OUT_CODE {
+  OC_INSIDE = 0,
+  OC_LEFT = 1,
+  OC_RIGHT = 2,
+  OC_TOP = 4,
+  OC_BOTTOM = 8
+};
+
+static inline uint32
+getOutCode(const Vec2f& point, const FloatRect& clipRect)
+{
+  uint32 code = OC_INSIDE;
+
+  if(point.x < clipRect.left) code |= OC_LEFT;
+  else if(point.x > clipRect.left + clipRect.width) code |= OC_RIGHT;
+
+  if(point.y < clipRect.top) code |= OC_TOP;
+  else if(point.y > clipRect.top + clipRect.height) code |= OC_BOTTOM;
+
+  return code;
+}
+
+static inline int32
+roundToInt(real32 value)
+{
+  return (int32)floorf(value + 0.5f);
+}
+
+bool
+LineRasterizer::clipLine(Vec2f& p1, Vec2f& p2, const FloatRect& clipRect)
+{
+  real32 minX = clipRect.left;
+  real32 maxX = clipRect.left + clipRect.width;
+  real32 minY = clipRect.top;
+  real32 maxY = clipRect.top + clipRect.height;
+
+  uint32 code1 = getOutCode(p1, clipRect);
+  uint32 code2 = getOutCode(p2, clipRect);
+
+  for(;;)
+  {
+    if(!(code1 | code2)) return true;
+    if(code1 & code2) return false;
+
+    uint32 outsideCode = code1 ? code1 : code2;
+    Vec2f delta = p2 - p1;
+    Vec2f point;
+
+    if(outsideCode & OC_BOTTOM)
+    {
+      point.x = p1.x + delta.x * (maxY - p1.y) / delta.y;
+      point.y = maxY;
+    }
+    else if(outsideCode & OC_TOP)
+    {
+      point.x = p1.x + delta.x * (minY - p1.y) / delta.y;
+      point.y = minY;
+    }
+    else if(outsideCode & OC_RIGHT)
+    {
+      point.y = p1.y + delta.y * (maxX - p1.x) / delta.x;
+      point.x = maxX;
+    }
+    else
+    {
+      point.y = p1.y + delta.y * (minX - p1.x) / delta.x;
+      point.x = minX;
+    }
+
+    if(outsideCode == code1)
+    {
+      p1 = point;
+      code1 = getOutCode(p1, clipRect);
+    }
+    else
+    {
+      p2 = point;
+      code2 = getOutCode(p2, clipRect);
+    }
+  }
+}
+
+IntRect
+LineRasterizer::getFullRect(const Framebuffer* framebuffer)
+{
+  return IntRect(0, 0, framebuffer->dimensions.x, framebuffer->dimensions.y);
+}
+
+void
+LineRasterizer::drawLine(Framebuffer* framebuffer, Vec2f p1, Vec2f p2, Color32 color)
+{
+  drawLine(framebuffer, p1, p2, color, getFullRect(framebuffer));
+}
+
+void
+LineRasterizer::drawLine(Framebuffer* framebuffer, Vec2f p1, Vec2f p2, Color32 color, const IntRect& clipRect)
+{
+  // Rounded endpoints have to stay inside, so the float rectangle is shrunk by half a pixel
+  FloatRect floatClip(clipRect.left, clipRect.top, clipRect.width - 1.0f, clipRect.height - 1.0f);
+  floatClip.left -= 0.49f;
+  floatClip.top -= 0.49f;
+  floatClip.width += 0.98f;
+  floatClip.height += 0.98f;
+
+  if(clipRect.width <= 0 || clipRect.height <= 0 || !clipLine(p1, p2, floatClip)) return;
+
+  int32 x1 = roundToInt(p1.x);
+  int32 y1 = roundToInt(p1.y);
+  int32 x2 = roundToInt(p2.x);
+  int32 y2 = roundToInt(p2.y);
+
+  int32 dx = abs(x2 - x1);
+  int32 dy = -abs(y2 - y1);
+
+  int32 stepX = x1 < x2 ? 1 : -1;
+  int32 stepY = y1 < y2 ? framebuffer->pitch / 4 : -framebuffer->pitch / 4;
+
+  uint32 nativeColor = framebuffer->toNative(color);
+  uint32* pixel = framebuffer->getRow(y1) + x1;
+
+  int32 error = dx + dy;
+  int32 pixelCount = std::max(dx, -dy) + 1;
+
+  for(int32 i = 0; i < pixelCount; i++)
+  {
+    *pixel = nativeColor;
+
+    int32 doubleError = error * 2;
+    if(doubleError >= dy)
+    {
+      error += dy;
+      pixel += stepX;
+    }
+    if(doubleError <= dx)
+    {
+      error += dx;
+      pixel += stepY;
+    }
+  }
+}
+
+void
+LineRasterizer::drawLineAntialiased(Framebuffer* framebuffer, Vec2f p1, Vec2f p2, Color32 color)
+{
+  drawLineAntialiased(framebuffer, p1, p2, color, getFullRect(framebuffer));
+}
+
+void
+LineRasterizer::drawLineAntialiased(Framebuffer* framebuffer, Vec2f p1, Vec2f p2, Color32 color,
+				    const IntRect& clipRect)
+{
+  // Every step touches two neighbouring pixels and the first step can start up to a pixel
+  // before the endpoint, so the line keeps one pixel away from all edges
+  FloatRect floatClip(clipRect.left + 1.0f, clipRect.top + 1.0f, clipRect.width - 3.0f, clipRect.height - 3.0f);
+  if(floatClip.width < 0 || floatClip.height < 0 || !clipLine(p1, p2, floatClip)) return;
+
+  uint32 nativeColor = framebuffer->toNative(color);
+  int32 pitch = framebuffer->pitch / 4;
+  uint32* pixels = framebuffer->getRow(0);
+
+  bool steep = fabsf(p2.y - p1.y) > fabsf(p2.x - p1.x);
+  if(steep)
+  {
+    std::swap(p1.x, p1.y);
+    std::swap(p2.x, p2.y);
+  }
+
+  if(p1.x > p2.x)
+  {
+    std::swap(p1, p2);
+  }
+
+  real32 dx = p2.x - p1.x;
+  real32 gradient = dx != 0 ? (p2.y - p1.y) / dx : 1.0f;
+
+  int32 startX = (int32)floorf(p1.x);
+  int32 endX = (int32)floorf(p2.x);
+  real32 intersectY = p1.y + gradient * (startX - p1.x);
+
+  // Major axis steps by one pixel, minor position splits coverage between two pixels
+  int32 majorStep = steep ? pitch : 1;
+  int32 minorStep = steep ? 1 : pitch;
+
+  for(int32 x = startX; x <= endX; x++)
+  {
+    int32 y = (int32)floorf(intersectY);
+    uint32 coverage = (uint32)((intersectY - y) * 256.0f);
+
+    uint32* pixel = pixels + x * majorStep + y * minorStep;
+    pixel[0] = lerpColor(pixel[0], nativeColor, 256 - coverage);
+    pixel[minorStep] = lerpColor(pixel[minorStep], nativeColor, coverage);
+
+    intersectY += gradient;
+  }
+}
+
+EdgeIndices
+LineRasterizer::getUniqueEdges(const TriangleIndices& triangleIndices)
+{
+  std::vector<uint64> edgeKeys;
+  edgeKeys.reserve(triangleIndices.size() * 3);
+
+  for(auto it = triangleIndices.begin(); it != triangleIndices.end(); it++)
+  {
+    for(int32 i = 0; i < 3; i++)
+    {
+      uint64 a = it->indexes[i];
+      uint64 b = it->indexes[(i + 1) % 3];
+      edgeKeys.push_back(a < b ? (a << 32 | b) : (b << 32 | a));
+    }
+  }
+
+  std::sort(edgeKeys.begin(), edgeKeys.end());
+  edgeKeys.erase(std::unique(edgeKeys.begin(), edgeKeys.end()), edgeKeys.end());
+
+  EdgeIndices edges(edgeKeys.size());
+  for(uint32 i = 0; i < edgeKeys.size(); i++)
+  {
+    edges[i].indexes[0] = (uint32)(edgeKeys[i] >> 32);
+    edges[i].indexes[1] = (uint32)edgeKeys[i];
+  }
+
+  return edges;
+}
+
+void
+LineRasterizer::drawEdges(Framebuffer* framebuffer, const Vertices2D& vertices, const EdgeIndices& edges,
+			  Color32 color, bool antialiased)
+{
+  IntRect fullRect = getFullRect(framebuffer);
+
+  for(auto it = edges.begin(); it != edges.end(); it++)
+  {
+    const Vec2f& p1 = vertices[it->indexes[0]];
+    const Vec2f& p2 = vertices[it->indexes[1]];
+
+    if(antialiased)
+    {
+      drawLineAntialiased(framebuffer, p1, p2, color, fullRect);
+    }
+    else
+    {
+      drawLine(framebuffer, p1, p2, color, fullRect);
+    }
+  }
+}
+
+void
+LineRasterizer::drawWireframe(Framebuffer* framebuffer, const Vertices2D& vertices,
+			      const TriangleIndices& triangleIndices, Color32 color, bool antialiased)
+{
+  drawEdges(framebuffer, vertices, getUniqueEdges(triangleIndices), color, antialiased);
+}
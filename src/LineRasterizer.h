@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include <jpb/Rect.h>
+
+#include "RenderPrimitives.h"
+#include "Framebuffer.h"
+
+struct IndexedEdge
+{
+  uint32 indexes[2];
+};
+
+typedef std::vector<IndexedEdge> EdgeIndices;
+
+// Integer line drawing, lines are clipped against the clip rectangle (whole framebuffer
+// by default) before stepping, so the inner loops write through row pointers without
+// any per pixel checks.
+class LineRasterizer {
+public:
+  // Cohen-Sutherland, clip rectangle is inclusive, returns false when nothing is left.
+  static bool clipLine(Vec2f& p1, Vec2f& p2, const FloatRect& clipRect);
+
+  // Bresenham
+  static void drawLine(Framebuffer* framebuffer, Vec2f p1, Vec2f p2, Color32 color);
+  static void drawLine(Framebuffer* framebuffer, Vec2f p1, Vec2f p2, Color32 color, const IntRect& clipRect);
+
+  // Xiaolin Wu, blends with what's already in the framebuffer
+  static void drawLineAntialiased(Framebuffer* framebuffer, Vec2f p1, Vec2f p2, Color32 color);
+  static void drawLineAntialiased(Framebuffer* framebuffer, Vec2f p1, Vec2f p2, Color32 color,
+				  const IntRect& clipRect);
+
+  // Every edge shared by several triangles comes out once, edges can be kept around
+  // for meshes that don't change topology.
+  static EdgeIndices getUniqueEdges(const TriangleIndices& triangleIndices);
+
+  static void drawEdges(Framebuffer* framebuffer, const Vertices2D& vertices, const EdgeIndices& edges,
+			Color32 color, bool antialiased = false);
+  static void drawWireframe(Framebuffer* framebuffer, const Vertices2D& vertices,
+			    const TriangleIndices& triangleIndices, Color32 color, bool antialiased = false);
+private:
+  static IntRect getFullRect(const Framebuffer* framebuffer);
+};
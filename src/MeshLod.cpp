@@ -0,0 +1,481 @@
+#include "MeshLod.h"
+#include <math.h>
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <jpb/Profiler.h>
+
+// Sum of squared distances to planes as a symmetric 4x4 matrix, the upper triangle row by row
+struct Quadric {
+  real64 m[10] = {};
+
+  void addPlane(const Vec3f& normal, real64 distance, real64 weight)
+  {
+    real64 a = normal.x, b = normal.y, c = normal.z, d = distance;
+    real64 terms[10] = { a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d };
+    for(int32 i = 0; i < 10; i++) m[i] += terms[i] * weight;
+  }
+
+  void add(const Quadric& quadric)
+  {
+    for(int32 i = 0; i < 10; i++) m[i] += quadric.m[i];
+  }
+
+  real64 evaluate(const Vec3f& point) const
+  {
+    real64 x = point.x, y = point.y, z = point.z;
+    return x * x * m[0] + 2 * x * y * m[1] + 2 * x * z * m[2] + 2 * x * m[3] + y * y * m[4] + 2 * y * z * m[5] +
+      2 * y * m[6] + z * z * m[7] + 2 * z * m[8] + m[9];
+  }
+};
+
+struct Collapse {
+  real64 cost;
+  uint32 from;
+  uint32 to;
+  // Stamps of both points when the cost was computed, anything collapsed into them since makes it stale
+  uint32 fromStamp;
+  uint32 toStamp;
+
+  bool operator>(const Collapse& collapse) const { return cost > collapse.cost; }
+};
+
+// Positions of the mesh welded into points, triangles point at vertices that point at points
+class Simplification {
+public:
+  Simplification(const Mesh& mesh);
+
+  real32 run(uint32 targetTriangleCount, real32 maxError);
+  void getResult(const Mesh& mesh, Mesh* result) const;
+private:
+  static const uint32 noVertex = ~0u;
+  // Planes on border edges weigh this much more than the triangles next to them
+  static constexpr real64 borderWeight = 10.0;
+
+  std::vector<uint32> vertexPoints;
+  std::vector<Vec3f> positions;
+  std::vector<Quadric> quadrics;
+  // Sum of the weights in the quadric, for turning its cost into a distance
+  std::vector<real64> weights;
+  std::vector<bool> pointAlive;
+  std::vector<uint32> stamps;
+  std::vector<std::vector<uint32>> pointTriangles;
+
+  std::vector<IndexedTriangle> triangles;
+  std::vector<bool> triangleAlive;
+  uint32 aliveCount = 0;
+
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> collapses;
+  std::vector<std::pair<uint32, uint32>> wedgeMap;
+  std::vector<uint32> fromNeighbors;
+  std::vector<uint32> toNeighbors;
+
+  bool hasPoint(const IndexedTriangle& triangle, uint32 point) const;
+  void push(uint32 from, uint32 to);
+  real32 getError(uint32 from, uint32 to, real64 cost) const;
+  void getNeighbors(uint32 point, std::vector<uint32>* neighbors) const;
+  bool canCollapse(uint32 from, uint32 to);
+  void collapse(uint32 from, uint32 to);
+};
+
+Simplification::Simplification(const Mesh& mesh)
+{
+  // Bit patterns of the coordinates, -0 and 0 are rare enough to stay apart
+  struct PositionHash {
+    size_t operator()(const Vec3f& position) const
+    {
+      const uint32* bits = (const uint32*)&position.x;
+      return (size_t)bits[0] * 73856093u ^ (size_t)bits[1] * 19349663u ^ (size_t)bits[2] * 83492791u;
+    }
+  };
+  struct PositionEqual {
+    bool operator()(const Vec3f& a, const Vec3f& b) const { return a.x == b.x && a.y == b.y && a.z == b.z; }
+  };
+
+  std::unordered_map<Vec3f, uint32, PositionHash, PositionEqual> pointIndices;
+  vertexPoints.resize(mesh.vertices.size());
+  for(uint32 i = 0; i < mesh.vertices.size(); i++)
+  {
+    const Vec3f& position = mesh.vertices[i].position;
+    auto inserted = pointIndices.insert(std::make_pair(position, (uint32)positions.size()));
+    if(inserted.second) positions.push_back(position);
+    vertexPoints[i] = inserted.first->second;
+  }
+
+  uint32 pointCount = positions.size();
+  quadrics.resize(pointCount);
+  weights.assign(pointCount, 0);
+  pointAlive.assign(pointCount, true);
+  stamps.assign(pointCount, 0);
+  pointTriangles.resize(pointCount);
+
+  triangles = mesh.triangleIndices;
+  triangleAlive.assign(triangles.size(), false);
+
+  // Triangles on every edge between two points, once per triangle, and the first of them
+  std::unordered_map<uint64, std::pair<uint32, uint32>> edges;
+  for(uint32 i = 0; i < triangles.size(); i++)
+  {
+    uint32 points[3];
+    for(int32 corner = 0; corner < 3; corner++) points[corner] = vertexPoints[triangles[i].indexes[corner]];
+    if(points[0] == points[1] || points[1] == points[2] || points[2] == points[0]) continue;
+
+    triangleAlive[i] = true;
+    aliveCount++;
+
+    Vec3f cross = Vec3f::cross(positions[points[1]] - positions[points[0]], positions[points[2]] - positions[points[0]]);
+    real32 length = cross.getLength();
+    if(length > 0)
+    {
+      // Area weighted, many small triangles don't outweigh a large one
+      Vec3f normal = cross * (1.0f / length);
+      real64 area = length * 0.5;
+      for(int32 corner = 0; corner < 3; corner++)
+      {
+	quadrics[points[corner]].addPlane(normal, -Vec3f::dotProduct(normal, positions[points[0]]), area);
+	weights[points[corner]] += area;
+      }
+    }
+
+    for(int32 corner = 0; corner < 3; corner++)
+    {
+      pointTriangles[points[corner]].push_back(i);
+
+      uint32 a = std::min(points[corner], points[(corner + 1) % 3]);
+      uint32 b = std::max(points[corner], points[(corner + 1) % 3]);
+      auto inserted = edges.insert(std::make_pair((uint64)a << 32 | b, std::make_pair(i, 0u)));
+      inserted.first->second.second++;
+    }
+  }
+
+  for(auto it = edges.begin(); it != edges.end(); it++)
+  {
+    uint32 a = (uint32)(it->first >> 32);
+    uint32 b = (uint32)it->first;
+
+    if(it->second.second == 1)
+    {
+      // Plane through the border edge standing on its triangle, moving along the border is free
+      const IndexedTriangle& triangle = triangles[it->second.first];
+      Vec3f p0 = positions[vertexPoints[triangle.indexes[0]]];
+      Vec3f p1 = positions[vertexPoints[triangle.indexes[1]]];
+      Vec3f p2 = positions[vertexPoints[triangle.indexes[2]]];
+      Vec3f edge = positions[b] - positions[a];
+      Vec3f normal = Vec3f::cross(edge, Vec3f::cross(p1 - p0, p2 - p0));
+      real32 length = normal.getLength();
+      if(length > 0)
+      {
+	normal = normal * (1.0f / length);
+	real64 weight = Vec3f::dotProduct(edge, edge) * borderWeight;
+	real64 distance = -Vec3f::dotProduct(normal, positions[a]);
+	quadrics[a].addPlane(normal, distance, weight);
+	quadrics[b].addPlane(normal, distance, weight);
+	weights[a] += weight;
+	weights[b] += weight;
+      }
+    }
+  }
+
+  for(auto it = edges.begin(); it != edges.end(); it++)
+  {
+    uint32 a = (uint32)(it->first >> 32);
+    uint32 b = (uint32)it->first;
+    push(a, b);
+    push(b, a);
+  }
+}
+
+bool
+Simplification::hasPoint(const IndexedTriangle& triangle, uint32 point) const
+{
+  return vertexPoints[triangle.indexes[0]] == point || vertexPoints[triangle.indexes[1]] == point ||
+    vertexPoints[triangle.indexes[2]] == point;
+}
+
+void
+Simplification::push(uint32 from, uint32 to)
+{
+  Quadric quadric = quadrics[from];
+  quadric.add(quadrics[to]);
+  collapses.push({ std::max(quadric.evaluate(positions[to]), 0.0), from, to, stamps[from], stamps[to] });
+}
+
+real32
+Simplification::getError(uint32 from, uint32 to, real64 cost) const
+{
+  real64 weight = weights[from] + weights[to];
+  return weight > 0 ? (real32)sqrt(cost / weight) : 0;
+}
+
+void
+Simplification::getNeighbors(uint32 point, std::vector<uint32>* neighbors) const
+{
+  neighbors->clear();
+  for(uint32 triangle : pointTriangles[point])
+  {
+    if(!triangleAlive[triangle]) continue;
+    for(int32 corner = 0; corner < 3; corner++)
+    {
+      uint32 neighbor = vertexPoints[triangles[triangle].indexes[corner]];
+      if(neighbor != point) neighbors->push_back(neighbor);
+    }
+  }
+  std::sort(neighbors->begin(), neighbors->end());
+  neighbors->erase(std::unique(neighbors->begin(), neighbors->end()), neighbors->end());
+}
+
+bool
+Simplification::canCollapse(uint32 from, uint32 to)
+{
+  // Every vertex of from has to go to a vertex of to it shares a triangle with, otherwise
+  // the collapse would pull a seam between uv islands or normals apart
+  wedgeMap.clear();
+  uint32 sharedCount = 0;
+  for(uint32 triangle : pointTriangles[from])
+  {
+    if(!triangleAlive[triangle] || !hasPoint(triangles[triangle], to)) continue;
+    sharedCount++;
+
+    uint32 fromVertex = noVertex, toVertex = noVertex;
+    for(int32 corner = 0; corner < 3; corner++)
+    {
+      uint32 vertex = triangles[triangle].indexes[corner];
+      if(vertexPoints[vertex] == from) fromVertex = vertex;
+      if(vertexPoints[vertex] == to) toVertex = vertex;
+    }
+    wedgeMap.push_back(std::make_pair(fromVertex, toVertex));
+  }
+  if(!sharedCount) return false;
+
+  for(uint32 triangle : pointTriangles[from])
+  {
+    if(!triangleAlive[triangle] || hasPoint(triangles[triangle], to)) continue;
+
+    const IndexedTriangle& corners = triangles[triangle];
+    Vec3f before[3], after[3];
+    for(int32 corner = 0; corner < 3; corner++)
+    {
+      uint32 vertex = corners.indexes[corner];
+      uint32 point = vertexPoints[vertex];
+      before[corner] = positions[point];
+      after[corner] = point == from ? positions[to] : positions[point];
+
+      if(point != from) continue;
+      bool mapped = false;
+      for(auto it = wedgeMap.begin(); it != wedgeMap.end() && !mapped; it++) mapped = it->first == vertex;
+      if(!mapped) return false;
+    }
+
+    // Triangles must not turn over or get close to it
+    Vec3f normalBefore = Vec3f::cross(before[1] - before[0], before[2] - before[0]);
+    Vec3f normalAfter = Vec3f::cross(after[1] - after[0], after[2] - after[0]);
+    real32 lengths = normalBefore.getLength() * normalAfter.getLength();
+    if(lengths <= 0 || Vec3f::dotProduct(normalBefore, normalAfter) < 0.2f * lengths) return false;
+  }
+
+  // Points next to both have to be the tips of the triangles on the edge, or the mesh folds
+  getNeighbors(from, &fromNeighbors);
+  getNeighbors(to, &toNeighbors);
+  uint32 commonCount = 0;
+  for(auto a = fromNeighbors.begin(), b = toNeighbors.begin(); a != fromNeighbors.end() && b != toNeighbors.end();)
+  {
+    if(*a < *b) a++;
+    else if(*b < *a) b++;
+    else
+    {
+      commonCount++;
+      a++;
+      b++;
+    }
+  }
+  return commonCount <= sharedCount;
+}
+
+void
+Simplification::collapse(uint32 from, uint32 to)
+{
+  quadrics[to].add(quadrics[from]);
+  weights[to] += weights[from];
+  pointAlive[from] = false;
+  stamps[to]++;
+
+  for(uint32 triangle : pointTriangles[from])
+  {
+    if(!triangleAlive[triangle]) continue;
+
+    IndexedTriangle& corners = triangles[triangle];
+    if(hasPoint(corners, to))
+    {
+      triangleAlive[triangle] = false;
+      aliveCount--;
+      continue;
+    }
+
+    for(int32 corner = 0; corner < 3; corner++)
+    {
+      for(auto it = wedgeMap.begin(); it != wedgeMap.end(); it++)
+      {
+	if(it->first == corners.indexes[corner]) corners.indexes[corner] = it->second;
+      }
+    }
+    pointTriangles[to].push_back(triangle);
+  }
+  pointTriangles[from].clear();
+
+  std::vector<uint32>& toTriangles = pointTriangles[to];
+  toTriangles.erase(std::remove_if(toTriangles.begin(), toTriangles.end(), [&](uint32 triangle)
+  {
+    return !triangleAlive[triangle];
+  }), toTriangles.end());
+
+  // Costs of the edges around to changed with its quadric
+  getNeighbors(to, &toNeighbors);
+  for(uint32 neighbor : toNeighbors)
+  {
+    push(neighbor, to);
+    push(to, neighbor);
+  }
+}
+
+real32
+Simplification::run(uint32 targetTriangleCount, real32 maxError)
+{
+  real32 reachedError = 0;
+  while(aliveCount > targetTriangleCount && !collapses.empty())
+  {
+    Collapse next = collapses.top();
+    collapses.pop();
+    if(!pointAlive[next.from] || !pointAlive[next.to]) continue;
+    if(stamps[next.from] != next.fromStamp || stamps[next.to] != next.toStamp) continue;
+
+    // Cheaper by cost isn't always cheaper by distance, later ones may still fit
+    real32 error = getError(next.from, next.to, next.cost);
+    if(error > maxError) continue;
+    if(!canCollapse(next.from, next.to)) continue;
+
+    collapse(next.from, next.to);
+    reachedError = std::max(reachedError, error);
+  }
+
+  return reachedError;
+}
+
+void
+Simplification::getResult(const Mesh& mesh, Mesh* result) const
+{
+  // Vertices still in use keep their order
+  std::vector<uint32> remap(mesh.vertices.size(), noVertex);
+  for(uint32 i = 0; i < triangles.size(); i++)
+  {
+    if(!triangleAlive[i]) continue;
+    for(int32 corner = 0; corner < 3; corner++) remap[triangles[i].indexes[corner]] = 0;
+  }
+
+  result->vertices.clear();
+  for(uint32 i = 0; i < remap.size(); i++)
+  {
+    if(remap[i] == noVertex) continue;
+    remap[i] = result->vertices.size();
+    result->vertices.push_back(mesh.vertices[i]);
+  }
+
+  result->triangleIndices.clear();
+  for(uint32 i = 0; i < triangles.size(); i++)
+  {
+    if(!triangleAlive[i]) continue;
+    const uint32* corners = triangles[i].indexes;
+    result->triangleIndices.push_back({{ remap[corners[0]], remap[corners[1]], remap[corners[2]] }});
+  }
+}
+
+real32
+MeshSimplifier::simplify(const Mesh& mesh, uint32 targetTriangleCount, real32 maxError, Mesh* result)
+{
+  PROFILE_ZONE("MeshSimplifier::simplify");
+  Simplification simplification(mesh);
+  real32 error = simplification.run(targetTriangleCount, maxError);
+  simplification.getResult(mesh, result);
+  return error;
+}
+
+real32
+LodChain::getMinProjectedRadius(uint32 level, real32 trianglesPerPixel) const
+{
+  // Budget is over the disc the bounding sphere covers on screen
+  real32 triangleCount = (real32)levels[level].mesh.triangleIndices.size();
+  return sqrtf(triangleCount / (trianglesPerPixel * (real32)M_PI));
+}
+
+uint32
+LodChain::select(real32 projectedRadius, uint32 current, real32 trianglesPerPixel, real32 hysteresis) const
+{
+  uint32 levelCount = levels.size();
+  uint32 target = levelCount - 1;
+  for(uint32 i = 0; i < levelCount; i++)
+  {
+    if(projectedRadius >= getMinProjectedRadius(i, trianglesPerPixel))
+    {
+      target = i;
+      break;
+    }
+  }
+  if(current >= levelCount) return target;
+
+  if(target < current)
+  {
+    // Finer levels only once the copy is clearly large enough for them
+    while(target < current && projectedRadius < getMinProjectedRadius(target, trianglesPerPixel) * (1.0f + hysteresis))
+    {
+      target++;
+    }
+  }
+  else if(target > current && projectedRadius >= getMinProjectedRadius(current, trianglesPerPixel) * (1.0f - hysteresis))
+  {
+    target = current;
+  }
+
+  return target;
+}
+
+real32
+LodChain::getProjectedRadius(const Transform3D& transform, const Transform3D& toCamera, real32 dfc,
+			     real32 halfWidth) const
+{
+  real32 radius = boundingRadius * transform.getMaxScale();
+  real32 z = toCamera.transformPoint(transform.transformPoint(boundingCenter)).z;
+  if(z <= radius) return FLT_MAX;
+  return radius * dfc * halfWidth / z;
+}
+
+LodChain
+LodChain::build(const Mesh& mesh, uint32 maxLevelCount, uint32 minTriangleCount)
+{
+  PROFILE_ZONE("LodChain::build");
+  LodChain chain;
+  chain.levels.push_back({ mesh, 0 });
+
+  BoundingBox bounds;
+  for(const MappedVertex& vertex : mesh.vertices) bounds.add(vertex.position);
+  chain.boundingCenter = mesh.vertices.empty() ? Vec3f() : bounds.getCenter();
+  chain.boundingRadius = 0;
+  for(const MappedVertex& vertex : mesh.vertices)
+  {
+    chain.boundingRadius = std::max(chain.boundingRadius, (vertex.position - chain.boundingCenter).getLength());
+  }
+
+  // Every level simplifies the one before, the errors add up
+  while(chain.levels.size() < maxLevelCount)
+  {
+    const LodLevel& previous = chain.levels.back();
+    uint32 triangleCount = previous.mesh.triangleIndices.size();
+    if(triangleCount / 2 < minTriangleCount) break;
+
+    LodLevel level;
+    level.error = previous.error + MeshSimplifier::simplify(previous.mesh, triangleCount / 2, FLT_MAX, &level.mesh);
+    if(level.mesh.triangleIndices.size() > triangleCount * 3 / 4) break;
+    chain.levels.push_back(std::move(level));
+  }
+
+  return chain;
+}
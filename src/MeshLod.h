@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include <jpb/Vector.h>
+
+#include "AssetCache.h"
+#include "Transform.h"
+
+// Reduces triangle counts by collapsing edges in the order of the quadric error metric
+// (Garland and Heckbert), the error of moving a point is its squared distance to the planes
+// of the triangles around it. Edges collapse onto one of their ends instead of the point
+// with the least error, so the kept vertices are original ones and uvs and normals stay
+// valid. Vertices at the same position are one point, edges that would tear seams between
+// them apart, fold triangles over or make the mesh non manifold are left alone. Borders are
+// held in place by planes standing on their edges.
+class MeshSimplifier {
+public:
+  // Collapses edges until the mesh has targetTriangleCount triangles or none can go without
+  // the error getting above maxError. Returns the error reached, about how far the surface
+  // moved in mesh units.
+  static real32 simplify(const Mesh& mesh, uint32 targetTriangleCount, real32 maxError, Mesh* result);
+};
+
+struct LodLevel {
+  Mesh mesh;
+  // Of the simplifications that led to the level, 0 for the original
+  real32 error;
+};
+
+// Simplified copies of a mesh, level 0 is the mesh itself and every level has about half the
+// triangles of the one before. Levels get chosen by how large a copy is on screen, the finest
+// level that stays under a number of triangles per pixel it covers.
+struct LodChain {
+  std::vector<LodLevel> levels;
+  // Sphere around the mesh, shared by every level
+  Vec3f boundingCenter;
+  real32 boundingRadius;
+
+  uint32 getLevelCount() const { return (uint32)levels.size(); }
+  // Radius in pixels from which on a level fits into the triangle budget
+  real32 getMinProjectedRadius(uint32 level, real32 trianglesPerPixel) const;
+
+  // Level for a copy with the bounding sphere projectedRadius pixels large. current is the
+  // level the copy had before, it's kept until the size is the hysteresis fraction past the
+  // switching point, so copies at a threshold don't pop back and forth. Copies without a
+  // level yet pass a current outside of the chain.
+  uint32 select(real32 projectedRadius, uint32 current, real32 trianglesPerPixel = 0.5f,
+		real32 hysteresis = 0.2f) const;
+  // Pixels the bounding sphere of a copy placed by transform covers from the center of a view
+  // halfWidth pixels wide, the same projection the renderer uses. Copies reaching behind the
+  // camera get FLT_MAX.
+  real32 getProjectedRadius(const Transform3D& transform, const Transform3D& toCamera, real32 dfc,
+			    real32 halfWidth) const;
+
+  // Stops early when a level can't be reduced any more, meshes like the cube have one level
+  static LodChain build(const Mesh& mesh, uint32 maxLevelCount = 6, uint32 minTriangleCount = 32);
+};
@@ -0,0 +1,113 @@
+#include "MultiView.h"
+#include <unordered_map>
+#include <jpb/Profiler.h>
+
+void
+MultiView::render(Framebuffer* framebuffer, const Views& views, const SceneItems& items, const SoftRenderer& settings)
+{
+  while(renderers.size() < views.size())
+  {
+    renderers.push_back(std::unique_ptr<SoftRenderer>(new SoftRenderer()));
+  }
+
+  for(uint32 i = 0; i < views.size(); i++)
+  {
+    renderers[i]->copySettings(settings);
+  }
+
+  auto renderJob = [&](uint32 viewIndex)
+  {
+    renderView(framebuffer, views[viewIndex], items, renderers[viewIndex].get());
+  };
+
+  if(workerPool)
+  {
+    workerPool->parallelFor(views.size(), renderJob);
+  }
+  else
+  {
+    for(uint32 i = 0; i < views.size(); i++) renderJob(i);
+  }
+}
+
+void
+MultiView::renderView(Framebuffer* framebuffer, const View& view, const SceneItems& items, SoftRenderer* renderer)
+{
+  PROFILE_ZONE("MultiView::renderView");
+  renderer->setCamera(view.camera);
+  renderer->setViewport(view.viewport);
+  renderer->setScissor(view.scissor);
+
+  Vec2i viewDimensions = renderer->getViewDimensions(framebuffer->dimensions);
+  DepthBuffer* depthBuffer = renderer->getDepthBuffer();
+  if(depthBuffer->getDimensions() != viewDimensions)
+  {
+    renderer->setZBufferSize(viewDimensions);
+  }
+
+  if(depthBuffer->beginFrame()) depthBuffer->clear();
+  Framebuffer clearTarget = framebuffer->getView(renderer->getScissorRect(framebuffer->dimensions));
+  clearTarget.fill(view.clearColor);
+
+  renderer->prepareLights(framebuffer->dimensions);
+
+  // Every mesh is moved to camera space once, however many items draw it
+  std::unordered_map<const MappedVertices*, MappedVertices> castedMeshes;
+
+  for(auto it = items.begin(); it != items.end(); it++)
+  {
+    const SceneItem& item = *it;
+    if(item.instancedMesh)
+    {
+      renderer->drawMeshInstanced(framebuffer, *item.instancedMesh, item.instanceTransforms, item.instanceCount,
+				  item.material);
+      continue;
+    }
+
+    auto casted = castedMeshes.find(item.vertices);
+    if(casted == castedMeshes.end())
+    {
+      casted = castedMeshes.insert(std::make_pair(item.vertices, *item.vertices)).first;
+      view.camera->castVertices(casted->second);
+      if(RenderStats::enabled) RenderStats::getThreadCounters()->add(RC_VERTICES_TRANSFORMED, casted->second.size());
+    }
+
+    renderer->drawCastedTriangles(framebuffer, casted->second, *item.triangleIndices, item.material);
+  }
+}
+
+void
+MultiView::setCubeFaceCamera(FPSCamera* camera, const Vec3f& position, CUBE_FACE face)
+{
+  static const real32 rotations[CF_COUNT][2] = {
+    { 0, 90.0f },
+    { 0, -90.0f },
+    { -90.0f, 0 },
+    { 90.0f, 0 },
+    { 0, 0 },
+    { 0, 180.0f }
+  };
+
+  camera->setPosition(position);
+  camera->setRotation(rotations[face][0], rotations[face][1]);
+}
+
+Views
+MultiView::getCubemapViews(FPSCamera cameras[CF_COUNT], const Vec3f& position, const Vec2i& origin,
+			   int32 faceSize, Color32 clearColor)
+{
+  Views views;
+
+  for(int32 face = 0; face < CF_COUNT; face++)
+  {
+    setCubeFaceCamera(&cameras[face], position, (CUBE_FACE)face);
+
+    View view = {};
+    view.camera = &cameras[face];
+    view.viewport = IntRect(origin.x + (face % 3) * faceSize, origin.y + (face / 3) * faceSize, faceSize, faceSize);
+    view.clearColor = clearColor;
+    views.push_back(view);
+  }
+
+  return views;
+}
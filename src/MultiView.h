@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <jpb/Rect.h>
+
+#include "SoftRenderer.h"
+#include "WorkerPool.h"
+
+// Mesh drawn by every view, vertices are in world space. Items can share vertices.
+struct SceneItem {
+  const MappedVertices* vertices;
+  const TriangleIndices* triangleIndices;
+  Material material;
+  // Set by instances, the item draws a copy of the mesh per transform instead of vertices
+  const InstancedMesh* instancedMesh;
+  const Transform3D* instanceTransforms;
+  uint32 instanceCount;
+
+  static SceneItem instances(const InstancedMesh* mesh, const Transform3D* transforms, uint32 count,
+			     const Material& material)
+  {
+    return { NULL, NULL, material, mesh, transforms, count };
+  }
+};
+
+typedef std::vector<SceneItem> SceneItems;
+
+struct View {
+  Camera* camera;
+  // In framebuffer pixels, has to lie inside of the framebuffer
+  IntRect viewport;
+  // Empty means the whole viewport, pixels of the scissor get cleared to clearColor
+  IntRect scissor;
+  Color32 clearColor;
+};
+
+typedef std::vector<View> Views;
+
+enum CUBE_FACE {
+  CF_POSITIVE_X,
+  CF_NEGATIVE_X,
+  CF_POSITIVE_Y,
+  CF_NEGATIVE_Y,
+  CF_POSITIVE_Z,
+  CF_NEGATIVE_Z,
+  CF_COUNT
+};
+
+// Draws one scene from several cameras into parts of the same framebuffer, split screen,
+// picture in picture or the faces of a cube map. Every view has its own renderer and depth
+// buffer and is drawn by its own worker, vertices shared by several items are moved to camera
+// space once per view.
+//
+// Views of one call are drawn at the same time, so they must not overlap. Picture in picture
+// views go into a later call.
+class MultiView {
+public:
+  void setWorkerPool(WorkerPool* workerPool) { this->workerPool = workerPool; }
+
+  // Lights, shadow maps and texture settings of settings are used by all the views. Shadow maps
+  // have to be drawn before, views only read them.
+  void render(Framebuffer* framebuffer, const Views& views, const SceneItems& items, const SoftRenderer& settings);
+
+  uint32 getRendererCount() const { return (uint32)renderers.size(); }
+  SoftRenderer* getRenderer(uint32 viewIndex) { return renderers[viewIndex].get(); }
+
+  // Camera at position looking along the axis of the face, square views make it 90 degrees both ways.
+  static void setCubeFaceCamera(FPSCamera* camera, const Vec3f& position, CUBE_FACE face);
+  // Six square views in two rows of three, +X -X +Y on top. Cameras have to outlive the views.
+  static Views getCubemapViews(FPSCamera cameras[CF_COUNT], const Vec3f& position, const Vec2i& origin,
+			       int32 faceSize, Color32 clearColor);
+private:
+  WorkerPool* workerPool = NULL;
+  std::vector<std::unique_ptr<SoftRenderer>> renderers;
+
+  void renderView(Framebuffer* framebuffer, const View& view, const SceneItems& items, SoftRenderer* renderer);
+};
@@ -0,0 +1,94 @@
+#include "OffscreenRenderer.h"
+#include <stdio.h>
+#include <jpb/Profiler.h>
+
+OffscreenRenderer::OffscreenRenderer(const Vec2i& dimensions)
+{
+  resize(dimensions);
+}
+
+void
+OffscreenRenderer::resize(const Vec2i& dimensions)
+{
+  if(pixels.size() < (size_t)(dimensions.x * dimensions.y))
+  {
+    pixels.resize(dimensions.x * dimensions.y);
+  }
+
+  target.pixelData = pixels.data();
+  target.dimensions = dimensions;
+  target.pitch = dimensions.x * sizeof(uint32);
+
+  framebuffer.pixelData = (uint8*)pixels.data();
+  framebuffer.dimensions = dimensions;
+  framebuffer.pitch = target.pitch;
+  framebuffer.format = PF_RGBA8888;
+
+  if(renderer.getDepthBuffer()->getDimensions() != dimensions)
+  {
+    renderer.setZBufferSize(dimensions);
+  }
+}
+
+const TextureBuffer&
+OffscreenRenderer::renderFrame(const Scene& scene, Camera* camera)
+{
+  PROFILE_ZONE("OffscreenRenderer::renderFrame");
+  clearStage.clear(&framebuffer, renderer.getDepthBuffer(), scene.clearColor);
+
+  renderer.setCamera(camera);
+  renderer.setDirectionalLight(scene.directionalLight);
+  renderer.setLights(scene.lights);
+  renderer.prepareLights(framebuffer.dimensions);
+
+  bool debugging = debugView.getMode() != DV_NONE;
+  if(debugging) debugView.begin(framebuffer.dimensions);
+  renderer.setDebugView(debugging ? &debugView : NULL);
+
+  for(auto it = scene.items.begin(); it != scene.items.end(); it++)
+  {
+    if(it->instancedMesh)
+    {
+      renderer.drawMeshInstanced(&framebuffer, *it->instancedMesh, it->instanceTransforms, it->instanceCount,
+				 it->material);
+    }
+    else
+    {
+      renderer.drawMappedTriangles3D(&framebuffer, *it->vertices, *it->triangleIndices, it->material);
+    }
+  }
+
+  for(auto it = scene.screenPolygons.begin(); it != scene.screenPolygons.end(); it++)
+  {
+    MappedPolygon polygon = it->polygon;
+    renderer.drawPolygonMapped(&framebuffer, polygon, it->material);
+  }
+
+  if(debugging) debugView.resolve(&framebuffer);
+
+  return target;
+}
+
+bool
+OffscreenRenderer::writePPM(const std::string& path) const
+{
+  FILE* file = fopen(path.c_str(), "wb");
+  if(!file) return false;
+
+  fprintf(file, "P6\n%d %d\n255\n", target.dimensions.x, target.dimensions.y);
+
+  std::vector<uint8> row(target.dimensions.x * 3);
+  for(int32 y = 0; y < target.dimensions.y; y++)
+  {
+    const uint32* src = target.getRow(y);
+    for(int32 x = 0; x < target.dimensions.x; x++)
+    {
+      row[x * 3 + 0] = (uint8)(src[x] >> 24);
+      row[x * 3 + 1] = (uint8)(src[x] >> 16);
+      row[x * 3 + 2] = (uint8)(src[x] >> 8);
+    }
+    fwrite(row.data(), 1, row.size(), file);
+  }
+
+  return fclose(file) == 0;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <jpb/Vector.h>
+
+#include "SoftRenderer.h"
+#include "ClearStage.h"
+#include "MultiView.h"
+
+// Polygon in framebuffer pixels, z is camera depth and only used for depth and perspective
+struct ScreenPolygon {
+  MappedPolygon polygon;
+  Material material;
+};
+
+typedef std::vector<ScreenPolygon> ScreenPolygons;
+
+// Everything a frame draws, vertices and lights are in world space. Shadow maps referenced
+// by the lights have to be drawn before the frame.
+struct Scene {
+  SceneItems items;
+  // Drawn over the items with drawPolygonMapped, like a HUD
+  ScreenPolygons screenPolygons;
+  Lights lights;
+  Vec3f directionalLight = Vec3f(0, -1.0f, 0);
+  Color32 clearColor = packColor(0, 0, 0);
+};
+
+// Renders into memory it owns instead of a window surface, so frames can be made on machines
+// without a display. Pixels are packed as RGBA8888 (see Color.h) without padding.
+class OffscreenRenderer {
+public:
+  OffscreenRenderer(const Vec2i& dimensions);
+
+  void setWorkerPool(WorkerPool* workerPool) { clearStage.setWorkerPool(workerPool); }
+
+  // Keeps the storage when it shrinks, so renderers reused for many sizes hold on to the
+  // largest one only.
+  void resize(const Vec2i& dimensions);
+
+  const TextureBuffer& renderFrame(const Scene& scene, Camera* camera);
+
+  const TextureBuffer& getTarget() const { return target; }
+  const Vec2i& getDimensions() const { return target.dimensions; }
+  // Texture settings, wireframe overlay and clear mode go straight to the renderer
+  SoftRenderer* getRenderer() { return &renderer; }
+  const ClearStats& getClearStats() const { return clearStage.getLastStats(); }
+  // Frames show the heatmap of the mode instead of the shaded image
+  void setDebugView(DEBUG_VIEW mode) { debugView.setMode(mode); }
+
+  // Binary PPM, alpha is dropped. Returns false when the file can't be written.
+  bool writePPM(const std::string& path) const;
+private:
+  std::vector<uint32> pixels;
+  TextureBuffer target;
+  Framebuffer framebuffer;
+
+  SoftRenderer renderer;
+  ClearStage clearStage;
+  DebugView debugView;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <jpb/Types.h>
+
+#include "Color.h"
+#include "RenderPrimitives.h"
+
+class ProceduralMaterial;
+
+// Bits of a pipeline state, every combination gets its own span loop compiled.
+enum PIPELINE_STATE {
+  PS_TEXTURED = 1 << 0,
+  PS_LIT = 1 << 1,
+  PS_DEPTH_TEST = 1 << 2,
+  PS_DEPTH_WRITE = 1 << 3,
+  // Colors come from the procedural material, takes the place of the texture
+  PS_PROCEDURAL = 1 << 4,
+  // Set by the renderer while a debug view is on, not by materials. Pixels get counted for
+  // the overdraw and depth fail views, scan lines timed for the tile cost view.
+  PS_DEBUG_COUNT = 1 << 5,
+  PS_DEBUG_TIME = 1 << 6,
+
+  PS_DEFAULT = PS_TEXTURED | PS_LIT | PS_DEPTH_TEST | PS_DEPTH_WRITE,
+  PS_COMBINATION_COUNT = 1 << 7
+};
+
+// What the span loop for given states has to do. Varyings are interpolated divided by z,
+// uv comes first when textured or procedural, normal after it when lit.
+template <uint32 States>
+struct PipelineTraits {
+  static const bool textured = (States & PS_TEXTURED) != 0;
+  static const bool lit = (States & PS_LIT) != 0;
+  static const bool depthTest = (States & PS_DEPTH_TEST) != 0;
+  static const bool depthWrite = (States & PS_DEPTH_WRITE) != 0;
+  static const bool procedural = (States & PS_PROCEDURAL) != 0;
+  static const bool debugCount = (States & PS_DEBUG_COUNT) != 0;
+  static const bool debugTime = (States & PS_DEBUG_TIME) != 0;
+  static const bool hasUv = textured || procedural;
+
+  static const uint32 uvOffset = 0;
+  static const uint32 normalOffset = hasUv ? 2 : 0;
+  static const uint32 varyingCount = normalOffset + (lit ? 3 : 0);
+};
+
+struct Material {
+  // Only used with PS_TEXTURED
+  const TextureBuffer* texture;
+  // Used instead of the texture when not textured
+  Color32 color;
+  uint32 pipelineState;
+  // Only used with PS_PROCEDURAL
+  const ProceduralMaterial* procedural;
+};
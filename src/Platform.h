@@ -0,0 +1,50 @@
+#pragma once
+
+#include <chrono>
+#include <thread>
+#include <jpb/Vector.h>
+
+#include "main.h"
+#include "Framebuffer.h"
+
+// Everything the frame loop needs from the operating system, one implementation per way of
+// showing frames (SdlPlatform, HeadlessPlatform). Time and threads come from the standard
+// library, steady_clock is QueryPerformanceCounter on Windows and CLOCK_MONOTONIC on Linux.
+class Platform {
+public:
+  virtual ~Platform() {}
+
+  // False when the window or whatever else is needed can't be made
+  virtual bool init(const Vec2i& resolution, const char* title) = 0;
+  virtual void shutdown() = 0;
+
+  // Feeds pending events into input, false once the user asked to quit
+  virtual bool processEvents(Input* input) = 0;
+
+  // Target for the next frame, only valid until present
+  virtual Framebuffer* beginFrame() = 0;
+  virtual void present() = 0;
+
+  // For frames drawn somewhere else, presentFrame copies them in. Has to be called from the
+  // thread that called init, like the other methods.
+  virtual PIXEL_FORMAT getPixelFormat() const = 0;
+  virtual void presentFrame(const Framebuffer& frame) = 0;
+
+  // Window title, or a log line where there is no window
+  virtual void setStatus(const char* status) = 0;
+
+  // Monotonic, nanoseconds since an unspecified point
+  static uint64 getTicks()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+  static real64 ticksToMs(uint64 ticks) { return ticks * 1e-6; }
+
+  // Hardware threads, at least one
+  static uint32 getCoreCount()
+  {
+    uint32 coreCount = std::thread::hardware_concurrency();
+    return coreCount ? coreCount : 1;
+  }
+};
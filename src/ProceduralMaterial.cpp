@@ -0,0 +1,361 @@
+#include "ProceduralMaterial.h"
+#include <math.h>
+#include <stdlib.h>
+#include <jpb/SimpleParser.h>
+
+ProceduralMaterial::ProceduralMaterial(int32 texelsPerUnit, uint32 cacheSizeLog2)
+  : lowColor(packColor(0, 0, 0, 255)), highColor(packColor(255, 255, 255, 255)),
+    texelsPerUnit(texelsPerUnit), cacheMask((1 << cacheSizeLog2) - 1),
+    cache(new std::atomic<uint64>[cacheMask + 1]), cacheMisses(0)
+{
+  Operation constant = { OP_CONSTANT, 0.0f, 0 };
+  program.push_back(constant);
+  clearCache();
+}
+
+bool
+ProceduralMaterial::compile(const GenDataMap& layers, const std::string& expression)
+{
+  SimpleParser parser;
+  EntryList reversePolish = parser.getReversePolish(expression);
+  if(reversePolish.empty() || reversePolish.front().type == ET_INVALID) return false;
+
+  std::vector<GenData> usedLayers;
+  std::vector<int32> usedLayerIds;
+  std::vector<Operation> operations;
+  uint32 stackSize = 0;
+
+  for(auto it = reversePolish.begin(); it != reversePolish.end(); it++)
+  {
+    const Entry& entry = *it;
+    Operation operation = { OP_CONSTANT, 0.0f, 0 };
+    uint32 argumentCount = 0;
+
+    switch(entry.type)
+    {
+    case ET_NUMBER:
+      {
+	operation.value = (real32)atof(entry.value.c_str());
+      } break;
+    case ET_VARIABLE:
+      {
+	if(entry.value == "x") operation.code = OP_X;
+	else if(entry.value == "y") operation.code = OP_Y;
+	else if(entry.value.compare(0, 3, "Map") == 0)
+	{
+	  int32 layerId = atoi(entry.value.c_str() + 3);
+	  auto layer = layers.find(layerId);
+	  if(layer == layers.end()) return false;
+
+	  // Every layer is evaluated once per batch, however many times it is referenced
+	  uint32 layerIndex = 0;
+	  while(layerIndex < usedLayerIds.size() && usedLayerIds[layerIndex] != layerId) layerIndex++;
+	  if(layerIndex == usedLayerIds.size())
+	  {
+	    if(layerIndex == maxLayers) return false;
+	    usedLayerIds.push_back(layerId);
+	    usedLayers.push_back(layer->second);
+	  }
+
+	  operation.code = OP_LAYER;
+	  operation.layer = layerIndex;
+	}
+	else return false;
+      } break;
+    case ET_OPERATOR:
+      {
+	argumentCount = 2;
+	switch(entry.value[0])
+	{
+	case '+': operation.code = OP_ADD; break;
+	case '-': operation.code = OP_SUB; break;
+	case '*': operation.code = OP_MUL; break;
+	case '/': operation.code = OP_DIV; break;
+	case '^': operation.code = OP_POW; break;
+	case '%': operation.code = OP_MOD; break;
+	default: return false;
+	}
+      } break;
+    case ET_FUNCTION:
+      {
+	const std::string& function = entry.value;
+	argumentCount = 1;
+
+	if(function == "min") { operation.code = OP_MIN; argumentCount = 2; }
+	else if(function == "max") { operation.code = OP_MAX; argumentCount = 2; }
+	else if(function == "mod") { operation.code = OP_MOD; argumentCount = 2; }
+	else if(function == "blend") { operation.code = OP_BLEND; argumentCount = 4; }
+	else if(function == "sin") operation.code = OP_SIN;
+	else if(function == "cos") operation.code = OP_COS;
+	else if(function == "abs") operation.code = OP_ABS;
+	else if(function == "floor") operation.code = OP_FLOOR;
+	else if(function == "ceil") operation.code = OP_CEIL;
+	else return false;
+      } break;
+    default:
+      return false;
+    }
+
+    if(stackSize < argumentCount) return false;
+    stackSize = stackSize - argumentCount + 1;
+    if(stackSize > maxStackSize) return false;
+
+    operations.push_back(operation);
+  }
+
+  if(stackSize != 1) return false;
+
+  this->layers = usedLayers;
+  program = operations;
+  clearCache();
+
+  return true;
+}
+
+void
+ProceduralMaterial::setColors(Color32 low, Color32 high)
+{
+  lowColor = low;
+  highColor = high;
+  clearCache();
+}
+
+void
+ProceduralMaterial::setTexelsPerUnit(int32 texelsPerUnit)
+{
+  this->texelsPerUnit = texelsPerUnit;
+  clearCache();
+}
+
+void
+ProceduralMaterial::clearCache()
+{
+  for(uint32 i = 0; i <= cacheMask; i++)
+  {
+    cache[i].store(0, std::memory_order_relaxed);
+  }
+  cacheMisses = 0;
+}
+
+// Lanes the parser functions have no SSE2 instruction for go through the scalar ones
+template <typename Function>
+static inline __m128
+perLane(__m128 a, __m128 b, Function function)
+{
+  real32 left[4], right[4];
+  _mm_storeu_ps(left, a);
+  _mm_storeu_ps(right, b);
+
+  for(uint32 i = 0; i < 4; i++)
+  {
+    left[i] = function(left[i], right[i]);
+  }
+
+  return _mm_loadu_ps(left);
+}
+
+static inline __m128
+floor4(__m128 value)
+{
+  // Truncation rounds negative values up, those get one subtracted
+  __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(value));
+  return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, value), _mm_set1_ps(1.0f)));
+}
+
+__m128
+ProceduralMaterial::evaluate4(__m128 u, __m128 v) const
+{
+  Vec2f points[4];
+  real32 pointsX[4], pointsY[4];
+  _mm_storeu_ps(pointsX, u);
+  _mm_storeu_ps(pointsY, v);
+
+  for(uint32 i = 0; i < 4; i++)
+  {
+    points[i] = Vec2f(pointsX[i], pointsY[i]);
+  }
+
+  // Layer values the way Noise::getMapFast computes them
+  __m128 values[maxLayers];
+  for(uint32 layerIndex = 0; layerIndex < layers.size(); layerIndex++)
+  {
+    const GenData& genData = layers[layerIndex];
+    real32 laneValues[4];
+
+    switch(genData.noiseType)
+    {
+    case NT_PERLIN:
+      {
+	Vec4f noise = Noise::sumPerlinFast(points, genData.noiseParams);
+	laneValues[0] = noise.x;
+	laneValues[1] = noise.y;
+	laneValues[2] = noise.z;
+	laneValues[3] = noise.w;
+
+	// It's not ridged noise
+	if(genData.noiseParams.extraParam == 0)
+	{
+	  for(uint32 i = 0; i < 4; i++) laneValues[i] = laneValues[i] * 0.5f + 0.5f;
+	}
+      } break;
+    case NT_VALUE:
+      {
+	for(uint32 i = 0; i < 4; i++) laneValues[i] = Noise::sumValue(points[i], genData.noiseParams);
+      } break;
+    case NT_WORLEY:
+      {
+	for(uint32 i = 0; i < 4; i++) laneValues[i] = Noise::sumWorley(points[i], genData.noiseParams);
+      } break;
+    default:
+      {
+	for(uint32 i = 0; i < 4; i++) laneValues[i] = 0.0f;
+      }
+    }
+
+    values[layerIndex] = _mm_mul_ps(_mm_loadu_ps(laneValues), _mm_set1_ps(genData.scale));
+  }
+
+  __m128 stack[maxStackSize];
+  int32 top = -1;
+
+  for(auto it = program.begin(); it != program.end(); it++)
+  {
+    const Operation& operation = *it;
+
+    switch(operation.code)
+    {
+    case OP_CONSTANT: stack[++top] = _mm_set1_ps(operation.value); break;
+    case OP_LAYER: stack[++top] = values[operation.layer]; break;
+    case OP_X: stack[++top] = u; break;
+    case OP_Y: stack[++top] = v; break;
+    case OP_ADD: top--; stack[top] = _mm_add_ps(stack[top], stack[top + 1]); break;
+    case OP_SUB: top--; stack[top] = _mm_sub_ps(stack[top], stack[top + 1]); break;
+    case OP_MUL: top--; stack[top] = _mm_mul_ps(stack[top], stack[top + 1]); break;
+    case OP_DIV: top--; stack[top] = _mm_div_ps(stack[top], stack[top + 1]); break;
+    case OP_MIN: top--; stack[top] = _mm_min_ps(stack[top], stack[top + 1]); break;
+    case OP_MAX: top--; stack[top] = _mm_max_ps(stack[top], stack[top + 1]); break;
+    case OP_POW:
+      {
+	top--;
+	stack[top] = perLane(stack[top], stack[top + 1], [](real32 a, real32 b) { return powf(a, b); });
+      } break;
+    case OP_MOD:
+      {
+	top--;
+	stack[top] = perLane(stack[top], stack[top + 1], [](real32 a, real32 b) { return fmodf(a, b); });
+      } break;
+    case OP_SIN:
+      {
+	stack[top] = perLane(stack[top], stack[top], [](real32 a, real32) { return sinf(a); });
+      } break;
+    case OP_COS:
+      {
+	stack[top] = perLane(stack[top], stack[top], [](real32 a, real32) { return cosf(a); });
+      } break;
+    case OP_ABS:
+      {
+	stack[top] = _mm_andnot_ps(_mm_set1_ps(-0.0f), stack[top]);
+      } break;
+    case OP_FLOOR:
+      {
+	stack[top] = floor4(stack[top]);
+      } break;
+    case OP_CEIL:
+      {
+	stack[top] = _mm_sub_ps(_mm_setzero_ps(), floor4(_mm_sub_ps(_mm_setzero_ps(), stack[top])));
+      } break;
+    case OP_BLEND:
+      {
+	// blend(low, high, t, range), same as blendSmooth from the parser
+	top -= 3;
+	__m128 low = stack[top];
+	__m128 high = stack[top + 1];
+	__m128 t = stack[top + 2];
+	__m128 range = stack[top + 3];
+
+	__m128 start = _mm_sub_ps(_mm_set1_ps(0.5f), range);
+	__m128 weight = _mm_div_ps(_mm_sub_ps(t, start), _mm_add_ps(range, range));
+	weight = _mm_min_ps(_mm_max_ps(weight, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+
+	stack[top] = _mm_add_ps(low, _mm_mul_ps(_mm_sub_ps(high, low), weight));
+      } break;
+    }
+  }
+
+  return stack[0];
+}
+
+__m128i
+ProceduralMaterial::toColors(__m128 values) const
+{
+  values = _mm_min_ps(_mm_max_ps(values, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+  __m128i weights = _mm_cvtps_epi32(_mm_mul_ps(values, _mm_set1_ps(256.0f)));
+
+  __m128i weightLo, weightHi;
+  spreadLanes(weights, &weightLo, &weightHi);
+  return lerpColors(_mm_set1_epi32(lowColor), _mm_set1_epi32(highColor), weightLo, weightHi);
+}
+
+__m128i
+ProceduralMaterial::shade4(__m128 u, __m128 v, uint32 visibleMask) const
+{
+  __m128 scale = _mm_set1_ps((real32)texelsPerUnit);
+  __m128 texelU = floor4(_mm_mul_ps(u, scale));
+  __m128 texelV = floor4(_mm_mul_ps(v, scale));
+
+  int32 texelsU[4], texelsV[4];
+  _mm_storeu_si128((__m128i*)texelsU, _mm_cvttps_epi32(texelU));
+  _mm_storeu_si128((__m128i*)texelsV, _mm_cvttps_epi32(texelV));
+
+  uint32 colors[4] = {};
+  uint32 keys[4];
+  uint32 slots[4];
+  uint32 missMask = 0;
+
+  for(uint32 i = 0; i < 4; i++)
+  {
+    if(!(visibleMask & (1 << i))) continue;
+
+    // Texels 2^16 apart in u or 2^15 in v share a key, the slot comes from the full position.
+    // Slots are paired, a texel can sit in either one of its pair.
+    keys[i] = ((uint32)texelsU[i] & 0xFFFF) | ((uint32)texelsV[i] & 0x7FFF) << 16 | 0x80000000;
+    slots[i] = ((uint32)texelsU[i] * 73856093u ^ (uint32)texelsV[i] * 19349663u) & cacheMask & ~1u;
+
+    uint64 first = cache[slots[i]].load(std::memory_order_relaxed);
+    uint64 second = cache[slots[i] + 1].load(std::memory_order_relaxed);
+    if((uint32)(first >> 32) == keys[i]) colors[i] = (uint32)first;
+    else if((uint32)(second >> 32) == keys[i]) colors[i] = (uint32)second;
+    else
+    {
+      // Empty slot of the pair if there is one, otherwise one picked by the key
+      if(first && (!second || (keys[i] & 1))) slots[i]++;
+      missMask |= 1 << i;
+    }
+  }
+
+  if(missMask)
+  {
+    // Texel centers, the same value whichever pixel of the texel asked first
+    __m128 invScale = _mm_set1_ps(1.0f / texelsPerUnit);
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128i evaluated = toColors(evaluate4(_mm_mul_ps(_mm_add_ps(texelU, half), invScale),
+					   _mm_mul_ps(_mm_add_ps(texelV, half), invScale)));
+
+    uint32 evaluatedColors[4];
+    _mm_storeu_si128((__m128i*)evaluatedColors, evaluated);
+
+    uint32 missCount = 0;
+    for(uint32 i = 0; i < 4; i++)
+    {
+      if(!(missMask & (1 << i))) continue;
+
+      colors[i] = evaluatedColors[i];
+      cache[slots[i]].store((uint64)keys[i] << 32 | colors[i], std::memory_order_relaxed);
+      missCount++;
+    }
+
+    cacheMisses.fetch_add(missCount, std::memory_order_relaxed);
+  }
+
+  return _mm_loadu_si128((__m128i*)colors);
+}
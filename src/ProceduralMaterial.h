@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <emmintrin.h>
+#include <jpb/Types.h>
+#include <jpb/Noise.h>
+
+#include "Color.h"
+
+// Colors computed per pixel from noise layers, the same GenData and expression model
+// Noise::getMapFast uses. Layers are referenced in the expression as Map<id>, x and y are the
+// texture coordinates. The value of the expression picks a color between low and high.
+//
+// The expression is compiled once into a small stack program running on four pixels at a time.
+// Results are kept in a cache of texels on a fixed grid in uv space, so surfaces that stay on
+// screen only pay for the texels they did not show before. The cache is safe to share between
+// threads drawing with the same material.
+class ProceduralMaterial {
+public:
+  ProceduralMaterial(int32 texelsPerUnit = 256, uint32 cacheSizeLog2 = 18);
+
+  // False when the expression does not parse or uses unknown variables and functions,
+  // the material keeps the previous program then.
+  bool compile(const GenDataMap& layers, const std::string& expression);
+
+  void setColors(Color32 low, Color32 high);
+  // Also drops the cached texels, the grid changes
+  void setTexelsPerUnit(int32 texelsPerUnit);
+  int32 getTexelsPerUnit() const { return texelsPerUnit; }
+
+  // Colors at the texel centers around four uv positions, only lanes in visibleMask are
+  // computed, same bits as _mm_movemask_ps gives.
+  __m128i shade4(__m128 u, __m128 v, uint32 visibleMask) const;
+  // Expression values without quantization or caching
+  __m128 evaluate4(__m128 u, __m128 v) const;
+
+  void clearCache();
+  // Texels evaluated since the cache was last cleared
+  uint64 getCacheMisses() const { return cacheMisses; }
+private:
+  enum OPERATION_CODE {
+    OP_CONSTANT,
+    OP_LAYER,
+    OP_X,
+    OP_Y,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_POW,
+    OP_MOD,
+    OP_MIN,
+    OP_MAX,
+    OP_SIN,
+    OP_COS,
+    OP_ABS,
+    OP_FLOOR,
+    OP_CEIL,
+    OP_BLEND
+  };
+
+  struct Operation {
+    OPERATION_CODE code;
+    // Constant value or index of the layer
+    real32 value;
+    uint32 layer;
+  };
+
+  static const uint32 maxStackSize = 16;
+  static const uint32 maxLayers = 8;
+
+  std::vector<GenData> layers;
+  std::vector<Operation> program;
+
+  Color32 lowColor;
+  Color32 highColor;
+
+  int32 texelsPerUnit;
+  uint32 cacheMask;
+  // Key of the texel in the high half, its color in the low one, zero for empty entries
+  std::unique_ptr<std::atomic<uint64>[]> cache;
+
+  mutable std::atomic<uint64> cacheMisses;
+
+  __m128i toColors(__m128 values) const;
+};
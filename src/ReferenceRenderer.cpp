@@ -0,0 +1,328 @@
+#include "ReferenceRenderer.h"
+#include "ProceduralMaterial.h"
+
+#include <math.h>
+#include <algorithm>
+
+ReferenceRenderer::ReferenceRenderer(const Vec2i& dimensions)
+{
+  pixels.resize(dimensions.x * dimensions.y);
+  depth.resize(dimensions.x * dimensions.y);
+
+  target.pixelData = pixels.data();
+  target.dimensions = dimensions;
+  target.pitch = dimensions.x * sizeof(uint32);
+}
+
+void
+ReferenceRenderer::setTextureFiltering(WRAP_MODE wrapMode, FILTER_MODE filterMode)
+{
+  this->wrapMode = wrapMode;
+  this->filterMode = filterMode;
+}
+
+const TextureBuffer&
+ReferenceRenderer::renderFrame(const Scene& scene, Camera* camera)
+{
+  std::fill(pixels.begin(), pixels.end(), scene.clearColor);
+  std::fill(depth.begin(), depth.end(), 0.0);
+
+  prepareLights(scene, camera);
+
+  for(auto item = scene.items.begin(); item != scene.items.end(); item++)
+  {
+    if(!item->instancedMesh)
+    {
+      drawMesh(*item->vertices, *item->triangleIndices, camera, item->material);
+      continue;
+    }
+
+    // Copies get expanded to world space meshes, the fast path's culling is left out
+    for(uint32 i = 0; i < item->instanceCount; i++)
+    {
+      MappedVertices vertices = item->instancedMesh->getVertices(item->instanceTransforms[i]);
+      drawMesh(vertices, item->instancedMesh->getTriangleIndices(), camera, item->material);
+    }
+  }
+
+  for(auto it = scene.screenPolygons.begin(); it != scene.screenPolygons.end(); it++)
+  {
+    drawPolygon(it->polygon, camera->getDfc(), it->material);
+  }
+
+  return target;
+}
+
+void
+ReferenceRenderer::drawMesh(const MappedVertices& worldVertices, const TriangleIndices& triangleIndices, Camera* camera,
+			    const Material& material)
+{
+  real32 dfc = camera->getDfc();
+  MappedVertices vertices = worldVertices;
+  camera->castVertices(vertices);
+
+  // Culling and clipping as SoftRenderer::drawCastedTriangles does it
+  MappedTriangles triangles = MeshHelper::getTrianglesFromIndices(triangleIndices, vertices);
+  for(auto it = triangles.begin(); it != triangles.end(); it++)
+  {
+    Vec3f triangleNormal = MeshHelper::getCrossProductCasted(*it, dfc);
+    if(-Vec3f::dotProduct(Vec3f(0, 0, 1.0f), triangleNormal) <= 0) continue;
+
+    MappedPolygon polygon = it->toPolygon().clip(0.5f, dfc);
+    if(polygon.vertices.size() < 3) continue;
+
+    for(auto vertex = polygon.vertices.begin(); vertex != polygon.vertices.end(); vertex++)
+    {
+      vertex->position = MeshHelper::castVertex(vertex->position, dfc);
+    }
+
+    drawPolygon(polygon.toScreenSpace(target.dimensions), dfc, material);
+  }
+}
+
+void
+ReferenceRenderer::prepareLights(const Scene& scene, Camera* camera)
+{
+  viewLights.clear();
+  viewLights.push_back(Light::directional(camera->castDirectionalLight(scene.directionalLight), Vec3f(1.0f, 1.0f, 1.0f)));
+
+  for(auto it = scene.lights.begin(); it != scene.lights.end(); it++)
+  {
+    Light light = *it;
+    Vertices position = { light.position };
+    camera->castVertices(position);
+    light.position = position[0];
+    light.direction = camera->castDirectionalLight(light.direction);
+    if(light.shadowMap) light.shadowBasis = light.shadowMap->getViewBasis(camera);
+    viewLights.push_back(light);
+  }
+}
+
+// Varyings divided by z and 1 / z, all of them are planes in screen space
+enum REFERENCE_VARYING {
+  RV_U,
+  RV_V,
+  RV_NORMAL_X,
+  RV_NORMAL_Y,
+  RV_NORMAL_Z,
+  RV_INV_Z,
+  RV_COUNT
+};
+
+void
+ReferenceRenderer::drawPolygon(const MappedPolygon& polygon, real32 dfc, const Material& material)
+{
+  const MappedVertices& vertices = polygon.vertices;
+  uint32 vertexCount = vertices.size();
+
+  // Widest triangle of the polygon defines the plane, thin ones lose precision
+  uint32 i1 = 1, i2 = 2;
+  real64 maxArea = 0;
+  for(uint32 i = 1; i < vertexCount; i++)
+  {
+    for(uint32 j = i + 1; j < vertexCount; j++)
+    {
+      real64 area = fabs(((real64)vertices[i].position.x - vertices[0].position.x) * ((real64)vertices[j].position.y - vertices[0].position.y) -
+			 ((real64)vertices[j].position.x - vertices[0].position.x) * ((real64)vertices[i].position.y - vertices[0].position.y));
+      if(area > maxArea)
+      {
+	maxArea = area;
+	i1 = i;
+	i2 = j;
+      }
+    }
+  }
+  if(maxArea <= 0) return;
+
+  const MappedVertex* corners[3] = { &vertices[0], &vertices[i1], &vertices[i2] };
+  real64 values[3][RV_COUNT];
+  for(uint32 i = 0; i < 3; i++)
+  {
+    const MappedVertex& vertex = *corners[i];
+    real64 invZ = 1.0 / vertex.position.z;
+    values[i][RV_U] = vertex.uv.x * invZ;
+    values[i][RV_V] = vertex.uv.y * invZ;
+    values[i][RV_NORMAL_X] = vertex.normal.x * invZ;
+    values[i][RV_NORMAL_Y] = vertex.normal.y * invZ;
+    values[i][RV_NORMAL_Z] = vertex.normal.z * invZ;
+    values[i][RV_INV_Z] = invZ;
+  }
+
+  real64 x0 = corners[0]->position.x, y0 = corners[0]->position.y;
+  real64 dx1 = corners[1]->position.x - x0, dy1 = corners[1]->position.y - y0;
+  real64 dx2 = corners[2]->position.x - x0, dy2 = corners[2]->position.y - y0;
+  real64 invDet = 1.0 / (dx1 * dy2 - dx2 * dy1);
+
+  real64 gradientX[RV_COUNT], gradientY[RV_COUNT];
+  for(uint32 i = 0; i < RV_COUNT; i++)
+  {
+    real64 d1 = values[1][i] - values[0][i];
+    real64 d2 = values[2][i] - values[0][i];
+    gradientX[i] = (d1 * dy2 - d2 * dy1) * invDet;
+    gradientY[i] = (d2 * dx1 - d1 * dx2) * invDet;
+  }
+
+  // Screen position back to camera space, as the span loops do it
+  real64 halfResX = target.dimensions.x * 0.5;
+  real64 halfResY = target.dimensions.y * 0.5;
+  real64 aspectRatio = (real64)target.dimensions.x / target.dimensions.y;
+  real64 invScaleX = 1.0 / (halfResX * dfc);
+  real64 invScaleY = -1.0 / (halfResY * aspectRatio * dfc);
+
+  bool depthTest = (material.pipelineState & PS_DEPTH_TEST) != 0;
+  bool depthWrite = (material.pipelineState & PS_DEPTH_WRITE) != 0;
+  bool procedural = (material.pipelineState & PS_PROCEDURAL) != 0;
+  bool textured = (material.pipelineState & PS_TEXTURED) && !procedural;
+  bool lit = (material.pipelineState & PS_LIT) != 0;
+
+  MScanLineVector scanLines = SoftRenderer::getScanLinesMapped(polygon, target.dimensions);
+  for(auto it = scanLines.begin(); it != scanLines.end(); it++)
+  {
+    uint32* row = target.getRow(it->y);
+    real64* depthRow = depth.data() + it->y * target.dimensions.x;
+
+    for(int32 x = it->startX; x <= it->endX; x++)
+    {
+      real64 varyings[RV_COUNT];
+      for(uint32 i = 0; i < RV_COUNT; i++)
+      {
+	varyings[i] = values[0][i] + (x - x0) * gradientX[i] + ((real64)it->y - y0) * gradientY[i];
+      }
+
+      real64 invZ = varyings[RV_INV_Z];
+      if(depthTest && !(invZ > depthRow[x])) continue;
+      if(depthWrite) depthRow[x] = invZ;
+
+      real64 z = 1.0 / invZ;
+      real64 u = varyings[RV_U] * z;
+      real64 v = varyings[RV_V] * z;
+
+      Color32 color = material.color;
+      if(procedural)
+      {
+	color = (uint32)_mm_cvtsi128_si32(material.procedural->shade4(_mm_set1_ps((real32)u), _mm_set1_ps((real32)v), 1));
+      }
+      else if(textured)
+      {
+	color = samplePixel(material.texture, u, v);
+      }
+
+      if(lit)
+      {
+	Vec3f position((real32)((x - halfResX) * invScaleX * z), (real32)((it->y - halfResY) * invScaleY * z), (real32)z);
+	Vec3f normal((real32)(varyings[RV_NORMAL_X] * z), (real32)(varyings[RV_NORMAL_Y] * z),
+		     (real32)(varyings[RV_NORMAL_Z] * z));
+	Vec3f light = getLight(position, normal);
+
+	real64 red = (uint8)(color >> 24) * std::min(std::max((real64)light.x, 0.0), 1.0);
+	real64 green = (uint8)(color >> 16) * std::min(std::max((real64)light.y, 0.0), 1.0);
+	real64 blue = (uint8)(color >> 8) * std::min(std::max((real64)light.z, 0.0), 1.0);
+	color = packColor((uint32)(red + 0.5), (uint32)(green + 0.5), (uint32)(blue + 0.5), color & 0xFF);
+      }
+
+      row[x] = color;
+    }
+  }
+}
+
+static int32
+wrapTexel(int32 texel, int32 size, WRAP_MODE wrapMode)
+{
+  switch(wrapMode)
+  {
+  case WM_CLAMP: return std::min(std::max(texel, 0), size - 1);
+  case WM_MIRROR:
+    {
+      int32 period = size * 2;
+      int32 position = ((texel % period) + period) % period;
+      return position >= size ? period - 1 - position : position;
+    }
+  case WM_REPEAT:
+  default: return ((texel % size) + size) % size;
+  }
+}
+
+Color32
+ReferenceRenderer::samplePixel(const TextureBuffer* texture, real64 u, real64 v) const
+{
+  int32 width = texture->dimensions.x;
+  int32 height = texture->dimensions.y;
+
+  if(filterMode == FM_NEAREST)
+  {
+    int32 x = wrapTexel((int32)floor(u * width), width, wrapMode);
+    int32 y = wrapTexel((int32)floor(v * height), height, wrapMode);
+    return texture->getRow(y)[x];
+  }
+
+  // Texel centers are at half coordinates
+  real64 s = u * width - 0.5;
+  real64 t = v * height - 0.5;
+  real64 s0 = floor(s);
+  real64 t0 = floor(t);
+  real64 weightX = s - s0;
+  real64 weightY = t - t0;
+
+  int32 x0 = wrapTexel((int32)s0, width, wrapMode);
+  int32 x1 = wrapTexel((int32)s0 + 1, width, wrapMode);
+  int32 y0 = wrapTexel((int32)t0, height, wrapMode);
+  int32 y1 = wrapTexel((int32)t0 + 1, height, wrapMode);
+
+  uint32 texels[4] = { texture->getRow(y0)[x0], texture->getRow(y0)[x1], texture->getRow(y1)[x0], texture->getRow(y1)[x1] };
+
+  Color32 result = 0;
+  for(uint32 shift = 0; shift < 32; shift += 8)
+  {
+    real64 top = (uint8)(texels[0] >> shift) * (1.0 - weightX) + (uint8)(texels[1] >> shift) * weightX;
+    real64 bottom = (uint8)(texels[2] >> shift) * (1.0 - weightX) + (uint8)(texels[3] >> shift) * weightX;
+    result |= (uint32)(top * (1.0 - weightY) + bottom * weightY + 0.5) << shift;
+  }
+  return result;
+}
+
+Vec3f
+ReferenceRenderer::getLight(const Vec3f& position, const Vec3f& normal) const
+{
+  __m128 lanePosition[3] = { _mm_set1_ps(position.x), _mm_set1_ps(position.y), _mm_set1_ps(position.z) };
+  Vec3f result = ambientLight;
+
+  for(auto it = viewLights.begin(); it != viewLights.end(); it++)
+  {
+    const Light& light = *it;
+    real64 diffuse;
+    real64 cosIncidence;
+
+    if(light.type == LT_DIRECTIONAL)
+    {
+      cosIncidence = std::max(-(real64)Vec3f::dotProduct(normal, light.direction), 0.0);
+      diffuse = cosIncidence;
+    }
+    else
+    {
+      Vec3f toLight = light.position - position;
+      real64 distanceSq = std::max((real64)Vec3f::dotProduct(toLight, toLight), 1e-8);
+      real64 distance = sqrt(distanceSq);
+
+      real64 falloff = std::max(1.0 - distanceSq / ((real64)light.range * light.range), 0.0);
+      cosIncidence = std::max(Vec3f::dotProduct(normal, toLight) / distance, 0.0);
+      diffuse = cosIncidence * falloff * falloff;
+
+      if(light.type == LT_SPOT)
+      {
+	real64 cosAngle = -Vec3f::dotProduct(toLight, light.direction) / distance;
+	real64 coneDelta = std::max(light.innerCone - light.outerCone, 1e-4f);
+	diffuse *= std::min(std::max((cosAngle - light.outerCone) / coneDelta, 0.0), 1.0);
+      }
+    }
+
+    if(light.shadowMap && light.type != LT_POINT && diffuse > 0)
+    {
+      __m128 visibility = light.shadowMap->getVisibility4(light.shadowBasis, lanePosition, _mm_set1_ps((real32)cosIncidence));
+      diffuse *= _mm_cvtss_f32(visibility);
+    }
+
+    result += light.color * (real32)diffuse;
+  }
+
+  return result;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include <jpb/Vector.h>
+
+#include "OffscreenRenderer.h"
+
+// Slow renderer that SoftRenderer's fast paths are checked against. It takes the same scenes
+// and draws them one pixel at a time in double precision: varyings are evaluated from the
+// plane of the polygon at every pixel instead of stepped along spans, depth is compared
+// unquantized, texels are filtered with exact weights, every light is evaluated for every
+// pixel and light is applied in floating point and rounded once.
+//
+// Coverage, clipping and shadow lookups are shared with SoftRenderer, differences left are
+// precision, not which pixels get drawn.
+class ReferenceRenderer {
+public:
+  ReferenceRenderer(const Vec2i& dimensions);
+
+  void setAmbientLight(const Vec3f& ambientLight) { this->ambientLight = ambientLight; }
+  void setTextureFiltering(WRAP_MODE wrapMode, FILTER_MODE filterMode);
+
+  // Pixels are packed as RGBA8888 like OffscreenRenderer's
+  const TextureBuffer& renderFrame(const Scene& scene, Camera* camera);
+  const TextureBuffer& getTarget() const { return target; }
+private:
+  std::vector<uint32> pixels;
+  // 1 / z of the closest surface, 0 is infinitely far
+  std::vector<real64> depth;
+  TextureBuffer target;
+
+  Vec3f ambientLight = Vec3f(0.3f, 0.3f, 0.3f);
+  WRAP_MODE wrapMode = WM_REPEAT;
+  FILTER_MODE filterMode = FM_NEAREST;
+  // Camera space, directional light first
+  Lights viewLights;
+
+  void prepareLights(const Scene& scene, Camera* camera);
+  void drawMesh(const MappedVertices& worldVertices, const TriangleIndices& triangleIndices, Camera* camera,
+		const Material& material);
+  void drawPolygon(const MappedPolygon& polygon, real32 dfc, const Material& material);
+  Color32 samplePixel(const TextureBuffer* texture, real64 u, real64 v) const;
+  Vec3f getLight(const Vec3f& position, const Vec3f& normal) const;
+};
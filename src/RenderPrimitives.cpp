@@ -1,5 +1,6 @@
 
 #include "RenderPrimitives.h"
+#include "Blitter.h"
 #include <algorithm>
 
 void
@@ -8,18 +9,14 @@ TextureBuffer::setPixel(uint32 x, uint32 y, const Vec3f& color)
   if(x >= 0 && x < dimensions.x &&
      y >= 0 && y < dimensions.y)
   {
-    pixelData[x + (uint32)dimensions.x * y] =
-      (uint32)(color.x) << 24 | (uint32)(color.y) << 16  | (uint32)(color.z) << 8;
+    setPixelPacked(x, y, packColor(color));
   }
 }
 
 Vec3f
 TextureBuffer::getPixel(uint32 x, uint32 y) const
 {
-  uint32 color = pixelData[x + (uint32)dimensions.x * y];
-  Vec3f result(uint8(color >> 24),  uint8(color >> 16), uint8(color >> 8));
-  
-  return result;
+  return unpackColor(getPixelPacked(x, y));
 }
 
 Vec3f
@@ -34,15 +31,8 @@ TextureBuffer::getPixelUV(const Vec2f& uv) const
 void
 TextureBuffer::blitTexture(TextureBuffer* dst, TextureBuffer* src, const Vec2i& position)
 {
-  Vec2i srcDimensions = src->dimensions;
-  for(int y = 0; y < srcDimensions.y; y++)
-  {
-    for(int x = 0; x < srcDimensions.x; x++)
-    {
-      Vec3f srcColor = src->getPixel(x, y);
-      dst->setPixel(x + position.x, y + position.y, srcColor);
-    }
-  }
+  BlitCommand command = { src, IntRect(), position, BM_OPAQUE, 0 };
+  Blitter::blit(dst, command);
 }
 
 
@@ -363,9 +353,11 @@ MappedPolygon
 MappedPolygon::clip(real32 nearZ, real32 dfc) const
 {
   MappedPolygon nearClipped = clipNear(*this, nearZ);
-  // sdfc *= 1.1f; 
-  MappedPolygon leftClipped = clipSide(nearClipped, dfc);
-  leftClipped = clipSide(leftClipped, -dfc);
+  // Sides are cut a bit outside of the view, edges rounding to just inside of it would leave
+  // the first column empty. Scan lines are clamped to the view anyway.
+  real32 sideDfc = dfc * 0.9999f;
+  MappedPolygon leftClipped = clipSide(nearClipped, sideDfc);
+  leftClipped = clipSide(leftClipped, -sideDfc);
   
   return leftClipped;
 }
@@ -660,23 +652,32 @@ MeshHelper::calculateNormals(MappedVertices& vertices, const TriangleIndices& tr
     normals[i] = getFaceNormal(vertices, indexedTriangle);
   }
 
-  // Checking What Face Normals belongs to what vertex 
+  // Summing the face normals of every vertex, in triangle order like a search per vertex
+  // would, a vertex listed twice in one triangle still counts it once
   uint32 vertexCount = vertices.size();
-  for(int i = 0; i != vertexCount; i++)
+  Vertices directionSums(vertexCount);
+  for(uint32 i = 0; i != triangleCount; i++)
   {
-    MappedVertex& vertex = vertices[i];
-    Vec3f directionSum;
-    
-    for(int j = 0; j < triangleCount; j++)
-    {
-      if(triangleIndices[j].indexes[0] == i ||
-	 triangleIndices[j].indexes[1] == i ||
-	 triangleIndices[j].indexes[2] == i )
-      {
-	directionSum += normals[j];
-      }
-    }
-    // Normalizing direction sum
-    vertex.normal = Vec3f::normalize(directionSum);
+    const uint32* indexes = triangleIndices[i].indexes;
+    directionSums[indexes[0]] += normals[i];
+    if(indexes[1] != indexes[0]) directionSums[indexes[1]] += normals[i];
+    if(indexes[2] != indexes[0] && indexes[2] != indexes[1]) directionSums[indexes[2]] += normals[i];
+  }
+
+  // Normalizing direction sum
+  for(uint32 i = 0; i != vertexCount; i++)
+  {
+    vertices[i].normal = Vec3f::normalize(directionSums[i]);
+  }
+}
+
+Vertices
+MeshHelper::getPositions(const MappedVertices& vertices)
+{
+  Vertices positions(vertices.size());
+  for(uint32 i = 0; i < vertices.size(); i++)
+  {
+    positions[i] = vertices[i].position;
   }
+  return positions;
 }
@@ -2,12 +2,20 @@
 
 #include <vector>
 #include <jpb/Vector.h>
+#include "Color.h"
 
 struct TextureBuffer {
   uint32* pixelData;
   Vec2i dimensions;
   int32 pitch;
   
+  uint32* getRow(uint32 y) { return pixelData + (uint32)dimensions.x * y; }
+  const uint32* getRow(uint32 y) const { return pixelData + (uint32)dimensions.x * y; }
+
+  // Packed access, coordinates have to be inside of the buffer.
+  void setPixelPacked(uint32 x, uint32 y, Color32 color) { getRow(y)[x] = color; }
+  Color32 getPixelPacked(uint32 x, uint32 y) const { return getRow(y)[x]; }
+
   void setPixel(uint32 x, uint32 y, const Vec3f& color);
   Vec3f getPixel(uint32 x, uint32 y) const ;
   Vec3f getPixelUV(const Vec2f& uv) const;
@@ -99,6 +107,9 @@ struct MScanLine {
   
   int32 startX;
   int32 endX;
+  // Ends before clipping, varyings are interpolated between them
+  int32 spanStartX;
+  int32 spanEndX;
   
   uint32 minVertexIndex;
   uint32 maxVertexIndex;
@@ -146,5 +157,7 @@ public:
 
   static Vec3f getFaceNormal(const MappedVertices& vertices, const IndexedTriangle& indexedTriangle);
   static void calculateNormals(MappedVertices& vertices, const TriangleIndices& triangleIndices);
+
+  static Vertices getPositions(const MappedVertices& vertices);
 };
 
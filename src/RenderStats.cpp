@@ -0,0 +1,75 @@
+#include "RenderStats.h"
+#include <string.h>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+// Counters of every thread that drew, kept after the thread ends so nothing it counted is lost
+static std::mutex threadCountersMutex;
+static std::vector<std::unique_ptr<ThreadRenderCounters>> threadCounters;
+static thread_local ThreadRenderCounters* currentThreadCounters = NULL;
+
+RenderStats::RenderStats()
+{
+  memset(counters, 0, sizeof(counters));
+}
+
+ThreadRenderCounters*
+RenderStats::getThreadCounters()
+{
+  if(!currentThreadCounters)
+  {
+    ThreadRenderCounters* newCounters = new ThreadRenderCounters();
+    for(uint32 i = 0; i < RC_COUNT; i++)
+    {
+      newCounters->counters[i] = 0;
+      newCounters->collected[i] = 0;
+    }
+
+    std::lock_guard<std::mutex> lock(threadCountersMutex);
+    threadCounters.push_back(std::unique_ptr<ThreadRenderCounters>(newCounters));
+    currentThreadCounters = newCounters;
+  }
+  return currentThreadCounters;
+}
+
+RenderStats
+RenderStats::collect()
+{
+  RenderStats result;
+
+  std::lock_guard<std::mutex> lock(threadCountersMutex);
+  for(auto it = threadCounters.begin(); it != threadCounters.end(); it++)
+  {
+    ThreadRenderCounters& thread = **it;
+    for(uint32 i = 0; i < RC_COUNT; i++)
+    {
+      uint64 value = thread.counters[i].load(std::memory_order_relaxed);
+      result.counters[i] += value - thread.collected[i];
+      thread.collected[i] = value;
+    }
+  }
+
+  return result;
+}
+
+const char*
+RenderStats::getName(RENDER_COUNTER counter)
+{
+  static const char* names[RC_COUNT] = {
+    "verticesTransformed", "trianglesSubmitted", "backfaceCulled", "frustumCulled", "clipped",
+    "polygonsEmitted", "scanlines", "pixelsTested", "depthRejected", "pixelsShaded", "pixelsWritten",
+    "texelsFetched"
+  };
+  return names[counter];
+}
+
+void
+RenderStats::print(FILE* file) const
+{
+  for(uint32 i = 0; i < RC_COUNT; i++)
+  {
+    fprintf(file, "%s%s=%llu", i ? " " : "", getName((RENDER_COUNTER)i), (unsigned long long)counters[i]);
+  }
+  fprintf(file, "\n");
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdio.h>
+#include <atomic>
+#include <jpb/Types.h>
+
+// Counters are compiled in unless built with RENDER_STATS=0, then every increment is dead
+// code and drops out.
+#ifndef RENDER_STATS
+#define RENDER_STATS 1
+#endif
+
+enum RENDER_COUNTER {
+  RC_VERTICES_TRANSFORMED,
+  RC_TRIANGLES_SUBMITTED,
+  RC_TRIANGLES_BACKFACE_CULLED,
+  // Entirely outside of the near or side planes
+  RC_TRIANGLES_FRUSTUM_CULLED,
+  // Partly outside, the clipper had to cut them
+  RC_TRIANGLES_CLIPPED,
+  RC_POLYGONS_EMITTED,
+  RC_SCANLINES,
+  RC_PIXELS_TESTED,
+  RC_PIXELS_DEPTH_REJECTED,
+  // Lanes the span loop shaded, four at a time, so it counts wasted lanes as well
+  RC_PIXELS_SHADED,
+  RC_PIXELS_WRITTEN,
+  RC_TEXELS_FETCHED,
+  RC_COUNT
+};
+
+// Counters of one thread. Only the owner adds, with a plain load and store, so counting
+// costs no locked instructions. Collecting reads them from another thread.
+struct ThreadRenderCounters {
+  std::atomic<uint64> counters[RC_COUNT];
+  // Values when they were last collected
+  uint64 collected[RC_COUNT];
+
+  void add(RENDER_COUNTER counter, uint64 value)
+  {
+    counters[counter].store(counters[counter].load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+  }
+};
+
+// Pipeline counters of one frame. Every thread that draws counts into its own
+// ThreadRenderCounters, collect sums up what all of them counted since the previous call.
+struct RenderStats {
+  uint64 counters[RC_COUNT];
+
+  static const bool enabled = RENDER_STATS != 0;
+
+  RenderStats();
+
+  // Counters of the calling thread, look them up once per draw and not per pixel
+  static ThreadRenderCounters* getThreadCounters();
+
+  // Call once at the end of a frame, when the threads that drew it are done. Counters are
+  // process wide, frames drawn at the same time by independent renderers end up together.
+  static RenderStats collect();
+
+  static const char* getName(RENDER_COUNTER counter);
+  // One line, name=value pairs
+  void print(FILE* file) const;
+};
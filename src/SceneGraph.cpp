@@ -0,0 +1,278 @@
+#include "SceneGraph.h"
+#include <algorithm>
+#include <functional>
+#include <jpb/Profiler.h>
+
+void
+SceneDrawList::appendItems(SceneItems* items) const
+{
+  for(auto it = batches.begin(); it != batches.end(); it++)
+  {
+    items->push_back(SceneItem::instances(it->mesh, transforms.data() + it->first, it->count, it->material));
+  }
+}
+
+uint32
+SceneGraph::createNode(uint32 parent)
+{
+  uint32 index = nodes.size();
+
+  Node node;
+  node.parent = parent;
+  node.firstChild = noNode;
+  node.nextSibling = noNode;
+  node.scale = Vec3f(1.0f, 1.0f, 1.0f);
+  node.mesh = NULL;
+  node.batch = noNode;
+  node.drawIndex = noNode;
+  node.visible = true;
+  node.dirty = false;
+  node.boundsDirty = false;
+
+  if(parent != noNode)
+  {
+    node.nextSibling = nodes[parent].firstChild;
+    nodes[parent].firstChild = index;
+  }
+
+  nodes.push_back(node);
+  worldTransforms.push_back(Transform3D());
+  worldBounds.push_back(BoundingBox());
+  markDirty(index);
+  return index;
+}
+
+void
+SceneGraph::setTranslation(uint32 node, const Vec3f& translation)
+{
+  nodes[node].translation = translation;
+  markDirty(node);
+}
+
+void
+SceneGraph::setRotation(uint32 node, const Quaternion& rotation)
+{
+  nodes[node].rotation = rotation;
+  markDirty(node);
+}
+
+void
+SceneGraph::setScale(uint32 node, const Vec3f& scale)
+{
+  nodes[node].scale = scale;
+  markDirty(node);
+}
+
+void
+SceneGraph::setMesh(uint32 node, const InstancedMesh* mesh, const Material& material)
+{
+  uint32 batch = noNode;
+  for(uint32 i = 0; i < batchKeys.size() && mesh; i++)
+  {
+    const SceneDrawList::Batch& key = batchKeys[i];
+    if(key.mesh == mesh && key.material.texture == material.texture && key.material.color == material.color &&
+       key.material.pipelineState == material.pipelineState && key.material.procedural == material.procedural)
+    {
+      batch = i;
+      break;
+    }
+  }
+
+  if(mesh && batch == noNode)
+  {
+    batch = batchKeys.size();
+    batchKeys.push_back({ mesh, material, 0, 0 });
+  }
+
+  nodes[node].mesh = mesh;
+  nodes[node].batch = batch;
+  drawListDirty = true;
+  // Bounds of the node change with the mesh
+  markDirty(node);
+}
+
+void
+SceneGraph::setVisible(uint32 node, bool visible)
+{
+  if(nodes[node].visible == visible) return;
+  nodes[node].visible = visible;
+  drawListDirty = true;
+}
+
+void
+SceneGraph::markDirty(uint32 node)
+{
+  if(nodes[node].dirty) return;
+  nodes[node].dirty = true;
+  dirtyNodes.push_back(node);
+}
+
+void
+SceneGraph::update()
+{
+  PROFILE_ZONE("SceneGraph::update");
+  updatedCount = 0;
+  if(dirtyNodes.empty() && !drawListDirty) return;
+
+  // Parents come first, their update takes the dirty nodes below them along
+  std::sort(dirtyNodes.begin(), dirtyNodes.end());
+  boundsNodes.clear();
+  for(auto it = dirtyNodes.begin(); it != dirtyNodes.end(); it++)
+  {
+    if(!nodes[*it].dirty) continue;
+    updateSubtree(*it);
+
+    // Bounds of the ancestors contain the subtree that moved
+    for(uint32 parent = nodes[*it].parent; parent != noNode && !nodes[parent].boundsDirty; parent = nodes[parent].parent)
+    {
+      nodes[parent].boundsDirty = true;
+      boundsNodes.push_back(parent);
+    }
+  }
+  dirtyNodes.clear();
+
+  // Children before parents
+  std::sort(boundsNodes.begin(), boundsNodes.end(), std::greater<uint32>());
+  for(auto it = boundsNodes.begin(); it != boundsNodes.end(); it++)
+  {
+    nodes[*it].boundsDirty = false;
+    updateBounds(*it);
+  }
+
+  if(drawListDirty)
+  {
+    buildDrawList();
+  }
+  else if(bvhDirty)
+  {
+    bvh.refit();
+  }
+  bvhDirty = false;
+}
+
+void
+SceneGraph::updateSubtree(uint32 root)
+{
+  // Preorder, parents are done before their children read them
+  visitedNodes.clear();
+  visitedNodes.push_back(root);
+  for(uint32 i = 0; i < visitedNodes.size(); i++)
+  {
+    uint32 index = visitedNodes[i];
+    Node& node = nodes[index];
+    node.dirty = false;
+
+    Transform3D local = Transform3D::fromParts(node.translation, node.rotation, node.scale);
+    worldTransforms[index] = node.parent == noNode ? local : worldTransforms[node.parent] * local;
+    // Slots are handed out again after structural changes, the rebuild copies every transform
+    if(node.drawIndex != noNode && !drawListDirty)
+    {
+      drawList.transforms[node.drawIndex] = worldTransforms[index];
+      bvh.moveObject(node.drawIndex, node.mesh->getBounds().transformed(worldTransforms[index]));
+      bvhDirty = true;
+    }
+
+    for(uint32 child = node.firstChild; child != noNode; child = nodes[child].nextSibling)
+    {
+      visitedNodes.push_back(child);
+    }
+  }
+  updatedCount += visitedNodes.size();
+
+  for(auto it = visitedNodes.rbegin(); it != visitedNodes.rend(); it++)
+  {
+    updateBounds(*it);
+  }
+}
+
+void
+SceneGraph::updateBounds(uint32 index)
+{
+  const Node& node = nodes[index];
+  BoundingBox bounds;
+  if(node.mesh) bounds = node.mesh->getBounds().transformed(worldTransforms[index]);
+  for(uint32 child = node.firstChild; child != noNode; child = nodes[child].nextSibling)
+  {
+    bounds.add(worldBounds[child]);
+  }
+  worldBounds[index] = bounds;
+}
+
+void
+SceneGraph::buildDrawList()
+{
+  PROFILE_ZONE("SceneGraph::buildDrawList");
+  drawListDirty = false;
+
+  // Parents have lower indices, their visibility is known before their children's
+  std::vector<bool> shown(nodes.size());
+  std::vector<uint32> counts(batchKeys.size(), 0);
+  for(uint32 i = 0; i < nodes.size(); i++)
+  {
+    const Node& node = nodes[i];
+    shown[i] = node.visible && (node.parent == noNode || shown[node.parent]);
+    if(shown[i] && node.mesh) counts[node.batch]++;
+  }
+
+  drawList.batches.clear();
+  std::vector<uint32> offsets(batchKeys.size(), 0);
+  uint32 transformCount = 0;
+  for(uint32 i = 0; i < batchKeys.size(); i++)
+  {
+    offsets[i] = transformCount;
+    if(counts[i])
+    {
+      drawList.batches.push_back({ batchKeys[i].mesh, batchKeys[i].material, transformCount, counts[i] });
+    }
+    transformCount += counts[i];
+  }
+
+  drawList.transforms.resize(transformCount);
+  std::vector<BoundingBox> drawBounds(transformCount);
+  drawNodes.resize(transformCount);
+  for(uint32 i = 0; i < nodes.size(); i++)
+  {
+    Node& node = nodes[i];
+    node.drawIndex = noNode;
+    if(!shown[i] || !node.mesh) continue;
+
+    node.drawIndex = offsets[node.batch]++;
+    drawList.transforms[node.drawIndex] = worldTransforms[i];
+    drawBounds[node.drawIndex] = node.mesh->getBounds().transformed(worldTransforms[i]);
+    drawNodes[node.drawIndex] = i;
+  }
+
+  bvh.build(drawBounds, workerPool);
+}
+
+void
+SceneGraph::cullDrawList(const Frustum& frustum, SceneDrawList* visible, BvhStats* stats) const
+{
+  PROFILE_ZONE("SceneGraph::cullDrawList");
+  std::vector<uint32> slots;
+  bvh.queryFrustum(frustum, &slots, stats);
+  // Slots of a batch are one range, sorted they come out batch by batch
+  std::sort(slots.begin(), slots.end());
+
+  visible->batches.clear();
+  visible->transforms.resize(slots.size());
+  auto slot = slots.begin();
+  for(auto batch = drawList.batches.begin(); batch != drawList.batches.end(); batch++)
+  {
+    uint32 first = slot - slots.begin();
+    for(; slot != slots.end() && *slot < batch->first + batch->count; slot++)
+    {
+      visible->transforms[slot - slots.begin()] = drawList.transforms[*slot];
+    }
+
+    uint32 count = (slot - slots.begin()) - first;
+    if(count) visible->batches.push_back({ batch->mesh, batch->material, first, count });
+  }
+}
+
+uint32
+SceneGraph::pick(const Ray& ray, real32* distance, BvhStats* stats) const
+{
+  uint32 slot = bvh.queryRay(ray, distance, stats);
+  return slot == BoundingVolumeHierarchy::noObject ? noNode : drawNodes[slot];
+}
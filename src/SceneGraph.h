@@ -0,0 +1,122 @@
+#pragma once
+
+#include <vector>
+#include <jpb/Vector.h>
+
+#include "Transform.h"
+#include "InstancedMesh.h"
+#include "MultiView.h"
+#include "BoundingVolumeHierarchy.h"
+#include "WorkerPool.h"
+
+// World transforms of the drawn nodes, flattened for the renderer. Transforms of one batch
+// are next to each other and every batch is one instanced draw.
+struct SceneDrawList {
+  struct Batch {
+    const InstancedMesh* mesh;
+    Material material;
+    uint32 first;
+    uint32 count;
+  };
+
+  std::vector<Batch> batches;
+  Transforms3D transforms;
+
+  // Items point into the list, it must not change while they're drawn
+  void appendItems(SceneItems* items) const;
+};
+
+// Hierarchy of nodes placed relative to their parent by a translation, a rotation and a
+// scale. World transforms, world bounds and the draw list are cached, update only recomputes
+// nodes that changed and the nodes below them, parts of the scene that don't move cost
+// nothing per frame. Drawn nodes are also kept in a bounding volume hierarchy, rebuilt when
+// the draw list changes and refitted when only transforms did.
+//
+// Parents are created before their children and are never changed, so a node's index is
+// always larger than its parent's.
+class SceneGraph {
+public:
+  static const uint32 noNode = ~0u;
+
+  uint32 createNode(uint32 parent = noNode);
+  uint32 getNodeCount() const { return (uint32)nodes.size(); }
+  uint32 getParent(uint32 node) const { return nodes[node].parent; }
+
+  void setTranslation(uint32 node, const Vec3f& translation);
+  void setRotation(uint32 node, const Quaternion& rotation);
+  void setScale(uint32 node, const Vec3f& scale);
+  const Vec3f& getTranslation(uint32 node) const { return nodes[node].translation; }
+  const Quaternion& getRotation(uint32 node) const { return nodes[node].rotation; }
+  const Vec3f& getScale(uint32 node) const { return nodes[node].scale; }
+
+  // Nodes with a mesh get drawn, NULL takes it away. Meshes have to outlive the graph.
+  void setMesh(uint32 node, const InstancedMesh* mesh, const Material& material);
+  // Hidden nodes and the nodes below them are left out of the draw list
+  void setVisible(uint32 node, bool visible);
+
+  // Builds of the bounding volume hierarchy get split over the pool when given
+  void setWorkerPool(WorkerPool* workerPool) { this->workerPool = workerPool; }
+
+  // Recomputes everything changed since the last update
+  void update();
+
+  // Valid after update
+  const Transform3D& getWorldTransform(uint32 node) const { return worldTransforms[node]; }
+  // Meshes of the node and of all nodes below it, in world space
+  const BoundingBox& getWorldBounds(uint32 node) const { return worldBounds[node]; }
+  const SceneDrawList& getDrawList() const { return drawList; }
+  // Nodes whose world transform the last update recomputed
+  uint32 getUpdatedCount() const { return updatedCount; }
+
+  // Draw list reduced to the nodes whose bounds the frustum touches, batches keep their order
+  void cullDrawList(const Frustum& frustum, SceneDrawList* visible, BvhStats* stats = NULL) const;
+  // Drawn node with the closest world bounds the ray hits, noNode when there's none
+  uint32 pick(const Ray& ray, real32* distance, BvhStats* stats = NULL) const;
+  // Objects are the slots of the draw list transforms
+  const BoundingVolumeHierarchy& getBvh() const { return bvh; }
+private:
+  struct Node {
+    uint32 parent;
+    uint32 firstChild;
+    uint32 nextSibling;
+
+    Vec3f translation;
+    Quaternion rotation;
+    Vec3f scale;
+
+    const InstancedMesh* mesh;
+    uint32 batch;
+    // Slot in the draw list transforms, noNode when not drawn
+    uint32 drawIndex;
+
+    bool visible;
+    bool dirty;
+    bool boundsDirty;
+  };
+
+  std::vector<Node> nodes;
+  // Kept apart from the nodes, update walks them in order
+  Transforms3D worldTransforms;
+  std::vector<BoundingBox> worldBounds;
+
+  // Meshes and materials nodes were given, a batch each
+  std::vector<SceneDrawList::Batch> batchKeys;
+  SceneDrawList drawList;
+  bool drawListDirty = false;
+
+  // Objects of the hierarchy are draw list slots, bounds of the node's own mesh
+  BoundingVolumeHierarchy bvh;
+  std::vector<uint32> drawNodes;
+  bool bvhDirty = false;
+  WorkerPool* workerPool = NULL;
+
+  std::vector<uint32> dirtyNodes;
+  std::vector<uint32> visitedNodes;
+  std::vector<uint32> boundsNodes;
+  uint32 updatedCount = 0;
+
+  void markDirty(uint32 node);
+  void updateSubtree(uint32 root);
+  void updateBounds(uint32 node);
+  void buildDrawList();
+};
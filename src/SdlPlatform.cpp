@@ -0,0 +1,132 @@
+#include "SdlPlatform.h"
+#include <stdio.h>
+
+bool
+SdlPlatform::init(const Vec2i& resolution, const char* title)
+{
+  if(SDL_Init(SDL_INIT_VIDEO) < 0)
+  {
+    printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
+    return false;
+  }
+
+  window = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+			    resolution.x, resolution.y, SDL_WINDOW_SHOWN);
+  if(window == NULL)
+  {
+    printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
+    return false;
+  }
+
+  renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+
+  screenBuffer.dimensions = resolution;
+  screenBuffer.format = PF_RGBA8888;
+
+  // Rendering straight in the window format, so that SDL doesn't have to convert on present
+  uint32 textureFormat = SDL_PIXELFORMAT_RGBA8888;
+  uint32 windowFormat = SDL_GetWindowPixelFormat(window);
+
+  if(windowFormat == SDL_PIXELFORMAT_ARGB8888 || windowFormat == SDL_PIXELFORMAT_RGB888)
+  {
+    textureFormat = windowFormat;
+    screenBuffer.format = PF_ARGB8888;
+  }
+
+  screenTexture = SDL_CreateTexture(renderer, textureFormat, SDL_TEXTUREACCESS_STREAMING,
+				    resolution.x, resolution.y);
+  return screenTexture != NULL;
+}
+
+void
+SdlPlatform::shutdown()
+{
+  if(screenTexture) SDL_DestroyTexture(screenTexture);
+  if(renderer) SDL_DestroyRenderer(renderer);
+  if(window) SDL_DestroyWindow(window);
+  SDL_Quit();
+}
+
+bool
+SdlPlatform::processEvents(Input* input)
+{
+  SDL_Event event;
+  while(SDL_PollEvent(&event) != 0)
+  {
+    switch(event.type)
+    {
+    case SDL_QUIT:
+      return false;
+    case SDL_KEYUP:
+    case SDL_KEYDOWN:
+      {
+	if(!event.key.repeat)
+	{
+	  uint8 key = (uint8)event.key.keysym.sym;
+
+	  if(event.key.state == SDL_PRESSED)
+	  {
+	    input->handleKeyPress(key);
+	  }
+	  else // Key Released
+	  {
+	    input->handleKeyRelease(key);
+	  }
+	}
+	break;
+      }
+    case SDL_MOUSEMOTION:
+      {
+	input->handleMouseMove(event.motion.x, event.motion.y);
+      }
+      break;
+    case SDL_MOUSEBUTTONUP:
+    case SDL_MOUSEBUTTONDOWN:
+      {
+	uint8 button = event.button.button;
+	if(event.button.state == SDL_PRESSED)
+	{
+	  input->handleButtonPress(button);
+	}
+	else
+	{
+	  input->handleButtonRelease(button);
+	}
+      }
+      break;
+    }
+  }
+
+  return true;
+}
+
+Framebuffer*
+SdlPlatform::beginFrame()
+{
+  SDL_LockTexture(screenTexture, NULL, (void**)&screenBuffer.pixelData, &screenBuffer.pitch);
+  return &screenBuffer;
+}
+
+void
+SdlPlatform::present()
+{
+  SDL_UnlockTexture(screenTexture);
+
+  SDL_RenderCopy(renderer, screenTexture, NULL, NULL);
+  SDL_RenderPresent(renderer);
+}
+
+void
+SdlPlatform::presentFrame(const Framebuffer& frame)
+{
+  SDL_UpdateTexture(screenTexture, NULL, frame.pixelData, frame.pitch);
+
+  SDL_RenderCopy(renderer, screenTexture, NULL, NULL);
+  SDL_RenderPresent(renderer);
+}
+
+void
+SdlPlatform::setStatus(const char* status)
+{
+  SDL_SetWindowTitle(window, status);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <SDL.h>
+
+#include "Platform.h"
+
+// Window with a streaming texture, frames are drawn straight into the locked texture in the
+// window's own pixel format.
+class SdlPlatform : public Platform {
+public:
+  bool init(const Vec2i& resolution, const char* title);
+  void shutdown();
+
+  bool processEvents(Input* input);
+
+  Framebuffer* beginFrame();
+  void present();
+
+  PIXEL_FORMAT getPixelFormat() const { return screenBuffer.format; }
+  void presentFrame(const Framebuffer& frame);
+
+  void setStatus(const char* status);
+private:
+  SDL_Window* window = NULL;
+  SDL_Renderer* renderer = NULL;
+  SDL_Texture* screenTexture = NULL;
+
+  Framebuffer screenBuffer = {};
+};
@@ -0,0 +1,393 @@
+#include "ShadowMap.h"
+#include "Lighting.h"
+#include "Camera.h"
+#include "SoftRenderer.h"
+
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+#include <jpb/Profiler.h>
+
+ShadowMap::ShadowMap(int32 resolution)
+{
+  setResolution(resolution);
+}
+
+void
+ShadowMap::setResolution(int32 resolution)
+{
+  this->resolution = resolution;
+  staticDepth.assign(resolution * resolution, FLT_MAX);
+  frameDepth.clear();
+  activeDepth = staticDepth.data();
+  staticDirty = true;
+}
+
+void
+ShadowMap::setLight(const Light& light, const Vec3f& focusCenter, real32 focusRadius)
+{
+  LightBasis basis;
+  basis.forward = Vec3f::normalize(light.direction);
+
+  Vec3f upHint = fabsf(basis.forward.y) > 0.99f ? Vec3f(0, 0, 1.0f) : Vec3f(0, 1.0f, 0);
+  basis.right = Vec3f::normalize(Vec3f::cross(upHint, basis.forward));
+  basis.up = Vec3f::cross(basis.forward, basis.right);
+
+  bool isPerspective = light.type == LT_SPOT;
+  real32 scale, nearPlane, farPlane;
+
+  if(isPerspective)
+  {
+    basis.eye = light.position;
+
+    real32 halfAngle = acosf(std::min(std::max(light.outerCone, 0.01f), 1.0f));
+    scale = 1.0f / tanf(halfAngle);
+    nearPlane = 0.05f;
+    farPlane = light.range;
+  }
+  else
+  {
+    // Eye is pushed back, so casters outside the focus sphere still reach the receivers
+    basis.eye = focusCenter - basis.forward * (focusRadius * 2.0f);
+    scale = focusRadius;
+    nearPlane = 0.0f;
+    farPlane = focusRadius * 4.0f;
+  }
+
+  bool changed = isPerspective != perspective || scale != projectionScale || nearPlane != nearZ || farPlane != farZ ||
+    basis.eye != worldBasis.eye || basis.forward != worldBasis.forward || basis.right != worldBasis.right;
+
+  if(changed)
+  {
+    perspective = isPerspective;
+    projectionScale = scale;
+    nearZ = nearPlane;
+    farZ = farPlane;
+    worldBasis = basis;
+    staticDirty = true;
+  }
+}
+
+bool
+ShadowMap::isInFrustum(const Vertices& positions) const
+{
+  if(positions.empty()) return false;
+
+  Vec3f minCorner = positions[0];
+  Vec3f maxCorner = positions[0];
+  for(auto it = positions.begin(); it != positions.end(); it++)
+  {
+    minCorner = Vec3f(std::min(minCorner.x, it->x), std::min(minCorner.y, it->y), std::min(minCorner.z, it->z));
+    maxCorner = Vec3f(std::max(maxCorner.x, it->x), std::max(maxCorner.y, it->y), std::max(maxCorner.z, it->z));
+  }
+
+  // Box is outside when all its corners are on the outer side of one frustum plane
+  uint32 outsideMask = 0x3F;
+  for(int32 i = 0; i < 8; i++)
+  {
+    Vec3f corner((i & 1) ? maxCorner.x : minCorner.x, (i & 2) ? maxCorner.y : minCorner.y,
+		 (i & 4) ? maxCorner.z : minCorner.z);
+    Vec3f offset = corner - worldBasis.eye;
+
+    real32 x = Vec3f::dotProduct(offset, worldBasis.right);
+    real32 y = Vec3f::dotProduct(offset, worldBasis.up);
+    real32 z = Vec3f::dotProduct(offset, worldBasis.forward);
+
+    real32 limit = perspective ? z / projectionScale : projectionScale;
+
+    uint32 cornerMask = 0;
+    if(x < -limit) cornerMask |= 1;
+    if(x > limit) cornerMask |= 2;
+    if(y < -limit) cornerMask |= 4;
+    if(y > limit) cornerMask |= 8;
+    if(z < nearZ) cornerMask |= 16;
+    if(z > farZ) cornerMask |= 32;
+
+    outsideMask &= cornerMask;
+  }
+
+  return outsideMask == 0;
+}
+
+void
+ShadowMap::rasterize(real32* depth, const Vertices& positions, const TriangleIndices& triangleIndices) const
+{
+  // Vertices go to light space first, z is kept for clipping and depth
+  MappedVertices lightVertices(positions.size());
+  for(uint32 i = 0; i < positions.size(); i++)
+  {
+    Vec3f offset = positions[i] - worldBasis.eye;
+
+    MappedVertex& vertex = lightVertices[i];
+    vertex.position = Vec3f(Vec3f::dotProduct(offset, worldBasis.right), Vec3f::dotProduct(offset, worldBasis.up),
+			    Vec3f::dotProduct(offset, worldBasis.forward));
+  }
+
+  real32 halfRes = resolution * 0.5f;
+  Vec2i dimensions(resolution, resolution);
+
+  for(auto it = triangleIndices.begin(); it != triangleIndices.end(); it++)
+  {
+    MappedPolygon polygon;
+    polygon.vertices.resize(3);
+    for(int32 i = 0; i < 3; i++)
+    {
+      polygon.vertices[i] = lightVertices[it->indexes[i]];
+    }
+
+    polygon = MappedPolygon::clipNear(polygon, std::max(nearZ, 0.001f));
+    uint32 vertexCount = polygon.vertices.size();
+    if(vertexCount < 3) continue;
+
+    // Depth keys are interpolated linearly in shadow map space, smaller keys are closer
+    std::vector<real32> keys(vertexCount);
+    for(uint32 i = 0; i < vertexCount; i++)
+    {
+      Vec3f& position = polygon.vertices[i].position;
+      real32 projection = perspective ? projectionScale / position.z : 1.0f / projectionScale;
+
+      keys[i] = perspective ? -1.0f / position.z : position.z;
+      position.x = (position.x * projection + 1.0f) * halfRes;
+      position.y = (1.0f - position.y * projection) * halfRes;
+    }
+
+    MScanLineVector scanLines = SoftRenderer::getScanLinesMapped(polygon, dimensions);
+    for(auto lineIt = scanLines.begin(); lineIt != scanLines.end(); lineIt++)
+    {
+      const MScanLine& scanLine = *lineIt;
+
+      uint32 minNext = (scanLine.minVertexIndex + 1) % vertexCount;
+      const Vec3f& v1Min = polygon.vertices[scanLine.minVertexIndex].position;
+      const Vec3f& v2Min = polygon.vertices[minNext].position;
+      real32 minT = ((real32)scanLine.y - v1Min.y) / (v2Min.y - v1Min.y);
+      real32 leftKey = keys[scanLine.minVertexIndex] + (keys[minNext] - keys[scanLine.minVertexIndex]) * minT;
+
+      uint32 maxNext = (scanLine.maxVertexIndex + 1) % vertexCount;
+      const Vec3f& v1Max = polygon.vertices[scanLine.maxVertexIndex].position;
+      const Vec3f& v2Max = polygon.vertices[maxNext].position;
+      real32 maxT = ((real32)scanLine.y - v1Max.y) / (v2Max.y - v1Max.y);
+      real32 rightKey = keys[scanLine.maxVertexIndex] + (keys[maxNext] - keys[scanLine.maxVertexIndex]) * maxT;
+
+      // Keys are taken where the edges cross the row and stepped from there to the texels
+      real32 leftX = v1Min.x + (v2Min.x - v1Min.x) * minT;
+      real32 rightX = v1Max.x + (v2Max.x - v1Max.x) * maxT;
+      real32 length = rightX - leftX;
+      real32 keyDelta = length > 0 ? (rightKey - leftKey) / length : 0;
+
+      real32* row = depth + scanLine.y * resolution;
+      real32 key = leftKey + keyDelta * ((real32)scanLine.startX - leftX);
+      for(int32 x = scanLine.startX; x <= scanLine.endX; x++)
+      {
+	row[x] = std::min(row[x], key);
+	key += keyDelta;
+      }
+    }
+  }
+}
+
+void
+ShadowMap::renderStaticLayer()
+{
+  PROFILE_ZONE("ShadowMap static layer");
+  std::fill(staticDepth.begin(), staticDepth.end(), FLT_MAX);
+
+  for(auto it = staticCasters.begin(); it != staticCasters.end(); it++)
+  {
+    if(it->active && isInFrustum(it->positions))
+    {
+      rasterize(staticDepth.data(), it->positions, it->triangleIndices);
+    }
+  }
+
+  staticDirty = false;
+  staticRenderCount++;
+}
+
+uint32
+ShadowMap::addStaticCaster(const Vertices& positions, const TriangleIndices& triangleIndices)
+{
+  StaticCaster caster = { positions, triangleIndices, true };
+  staticCasters.push_back(caster);
+
+  if(isInFrustum(positions)) staticDirty = true;
+  return staticCasters.size() - 1;
+}
+
+void
+ShadowMap::updateStaticCaster(uint32 casterId, const Vertices& positions)
+{
+  StaticCaster& caster = staticCasters[casterId];
+
+  // Old and new position both count, caster could have left the frustum
+  if(isInFrustum(caster.positions) || isInFrustum(positions)) staticDirty = true;
+  caster.positions = positions;
+}
+
+void
+ShadowMap::removeStaticCaster(uint32 casterId)
+{
+  StaticCaster& caster = staticCasters[casterId];
+  if(!caster.active) return;
+
+  if(isInFrustum(caster.positions)) staticDirty = true;
+
+  caster.active = false;
+  caster.positions.clear();
+  caster.triangleIndices.clear();
+}
+
+void
+ShadowMap::beginFrame()
+{
+  if(staticDirty) renderStaticLayer();
+
+  hasDynamicCasters = false;
+  activeDepth = staticDepth.data();
+}
+
+void
+ShadowMap::drawCaster(const Vertices& positions, const TriangleIndices& triangleIndices)
+{
+  PROFILE_ZONE("ShadowMap::drawCaster");
+  if(!isInFrustum(positions)) return;
+
+  // Static layer is only copied when something dynamic is actually visible to the light
+  if(!hasDynamicCasters)
+  {
+    frameDepth = staticDepth;
+    activeDepth = frameDepth.data();
+    hasDynamicCasters = true;
+  }
+
+  rasterize(frameDepth.data(), positions, triangleIndices);
+}
+
+ShadowMap::LightBasis
+ShadowMap::getViewBasis(const Camera* camera) const
+{
+  Vertices eye(1, worldBasis.eye);
+  camera->castVertices(eye);
+
+  LightBasis viewBasis;
+  viewBasis.eye = eye[0];
+  viewBasis.right = camera->castDirectionalLight(worldBasis.right);
+  viewBasis.up = camera->castDirectionalLight(worldBasis.up);
+  viewBasis.forward = camera->castDirectionalLight(worldBasis.forward);
+
+  return viewBasis;
+}
+
+__m128
+ShadowMap::getVisibility4(const LightBasis& viewBasis, const __m128 position[3], __m128 cosIncidence) const
+{
+  __m128 offsetX = _mm_sub_ps(position[0], _mm_set1_ps(viewBasis.eye.x));
+  __m128 offsetY = _mm_sub_ps(position[1], _mm_set1_ps(viewBasis.eye.y));
+  __m128 offsetZ = _mm_sub_ps(position[2], _mm_set1_ps(viewBasis.eye.z));
+
+  auto project = [&](const Vec3f& axis)
+  {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(offsetX, _mm_set1_ps(axis.x)), _mm_mul_ps(offsetY, _mm_set1_ps(axis.y))),
+		      _mm_mul_ps(offsetZ, _mm_set1_ps(axis.z)));
+  };
+
+  __m128 lightX = project(viewBasis.right);
+  __m128 lightY = project(viewBasis.up);
+  __m128 lightZ = project(viewBasis.forward);
+
+  __m128 halfRes = _mm_set1_ps(resolution * 0.5f);
+  __m128 one = _mm_set1_ps(1.0f);
+  __m128 projection, keys;
+
+  // Bias grows with the world size of a texel and with tangent of the incidence angle,
+  // so surfaces at steep angles don't shadow themselves
+  __m128 cosClamped = _mm_max_ps(cosIncidence, _mm_set1_ps(0.1f));
+  __m128 sinIncidence = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(cosClamped, cosClamped)), _mm_setzero_ps()));
+  __m128 slope = _mm_add_ps(one, _mm_div_ps(sinIncidence, cosClamped));
+
+  __m128 texelBias = perspective ?
+    _mm_mul_ps(lightZ, _mm_set1_ps(texelBiasScale * 2.0f / (projectionScale * resolution))) :
+    _mm_set1_ps(texelBiasScale * 2.0f * projectionScale / resolution);
+  texelBias = _mm_mul_ps(texelBias, slope);
+  __m128 biasedZ = _mm_sub_ps(_mm_sub_ps(lightZ, _mm_set1_ps(depthBias)), texelBias);
+
+  if(perspective)
+  {
+    // Receivers behind the light plane would divide by zero, they end up outside the map
+    __m128 safeZ = _mm_max_ps(lightZ, _mm_set1_ps(1e-4f));
+    projection = _mm_div_ps(_mm_set1_ps(projectionScale), safeZ);
+    keys = _mm_div_ps(_mm_set1_ps(-1.0f), _mm_max_ps(biasedZ, _mm_set1_ps(1e-4f)));
+  }
+  else
+  {
+    projection = _mm_set1_ps(1.0f / projectionScale);
+    keys = biasedZ;
+  }
+
+  // Texel centers sit at integer coordinates for filtering
+  __m128 texelX = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(lightX, projection), one), halfRes), _mm_set1_ps(0.5f));
+  __m128 texelY = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(lightY, projection)), halfRes), _mm_set1_ps(0.5f));
+
+  real32 xs[4], ys[4], receiverKeys[4], lightZs[4], result[4];
+  _mm_storeu_ps(xs, texelX);
+  _mm_storeu_ps(ys, texelY);
+  _mm_storeu_ps(receiverKeys, keys);
+  _mm_storeu_ps(lightZs, lightZ);
+
+  auto isLit = [&](int32 x, int32 y, real32 key)
+  {
+    if(x < 0 || y < 0 || x >= resolution || y >= resolution) return 1.0f;
+    return key <= activeDepth[y * resolution + x] ? 1.0f : 0.0f;
+  };
+
+  for(int32 lane = 0; lane < 4; lane++)
+  {
+    real32 x = xs[lane];
+    real32 y = ys[lane];
+    real32 key = receiverKeys[lane];
+
+    if(lightZs[lane] <= nearZ || !(fabsf(x) < 1e6f && fabsf(y) < 1e6f))
+    {
+      result[lane] = 1.0f;
+      continue;
+    }
+
+    switch(pcfMode)
+    {
+    case PCF_2X2:
+    {
+      // Bilinear weights over the four closest texels
+      real32 floorX = floorf(x);
+      real32 floorY = floorf(y);
+      real32 fractionX = x - floorX;
+      real32 fractionY = y - floorY;
+      int32 left = (int32)floorX;
+      int32 top = (int32)floorY;
+
+      real32 topRow = isLit(left, top, key) * (1.0f - fractionX) + isLit(left + 1, top, key) * fractionX;
+      real32 bottomRow = isLit(left, top + 1, key) * (1.0f - fractionX) + isLit(left + 1, top + 1, key) * fractionX;
+      result[lane] = topRow * (1.0f - fractionY) + bottomRow * fractionY;
+    } break;
+    case PCF_3X3:
+    {
+      int32 centerX = (int32)floorf(x + 0.5f);
+      int32 centerY = (int32)floorf(y + 0.5f);
+
+      real32 sum = 0;
+      for(int32 offsetY = -1; offsetY <= 1; offsetY++)
+      {
+	for(int32 offsetX = -1; offsetX <= 1; offsetX++)
+	{
+	  sum += isLit(centerX + offsetX, centerY + offsetY, key);
+	}
+      }
+      result[lane] = sum * (1.0f / 9.0f);
+    } break;
+    case PCF_NONE:
+    default:
+      result[lane] = isLit((int32)floorf(x + 0.5f), (int32)floorf(y + 0.5f), key);
+      break;
+    }
+  }
+
+  return _mm_loadu_ps(result);
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vector>
+#include <emmintrin.h>
+#include <jpb/Vector.h>
+
+#include "RenderPrimitives.h"
+
+struct Light;
+class Camera;
+
+enum PCF_MODE {
+  PCF_NONE,
+  PCF_2X2,
+  PCF_3X3
+};
+
+// Depth of the closest casters as seen from a directional or spot light. Directional lights
+// get an orthographic box around the focus sphere, spot lights a perspective frustum
+// matching their outer cone.
+//
+// Static casters are kept by the shadow map and rendered into a cached layer, which is only
+// redrawn when the light changes or a static caster inside the light frustum is added,
+// moved or removed. Dynamic casters are drawn every frame on top of a copy of that layer.
+class ShadowMap {
+public:
+  ShadowMap(int32 resolution = 512);
+
+  void setResolution(int32 resolution);
+  int32 getResolution() const { return resolution; }
+
+  // Light is in world space, focus is only used by directional lights.
+  void setLight(const Light& light, const Vec3f& focusCenter = Vec3f(), real32 focusRadius = 1.0f);
+
+  uint32 addStaticCaster(const Vertices& positions, const TriangleIndices& triangleIndices);
+  void updateStaticCaster(uint32 casterId, const Vertices& positions);
+  void removeStaticCaster(uint32 casterId);
+
+  // Redraws the static layer when needed and drops last frame's dynamic casters.
+  void beginFrame();
+  void drawCaster(const Vertices& positions, const TriangleIndices& triangleIndices);
+
+  struct LightBasis {
+    Vec3f eye;
+    Vec3f right;
+    Vec3f up;
+    Vec3f forward;
+  };
+
+  // Light basis moved to camera space, lookups with it take camera space positions. Every
+  // camera gets its own, so views sharing the shadow map can be drawn at the same time.
+  LightBasis getViewBasis(const Camera* camera) const;
+
+  // 1 for lit and 0 for shadowed lanes, filtered values in between. Cosine between the
+  // normal and the light scales the bias, surfaces facing the light sideways need more.
+  __m128 getVisibility4(const LightBasis& viewBasis, const __m128 position[3], __m128 cosIncidence) const;
+
+  void setPcfMode(PCF_MODE pcfMode) { this->pcfMode = pcfMode; }
+  PCF_MODE getPcfMode() const { return pcfMode; }
+  // Receivers have to be this far behind the stored depth to be shadowed, in world units,
+  // plus texelBiasScale times the world size of a shadow map texel at the receiver, which
+  // grows with the surface slope as seen from the light
+  void setDepthBias(real32 depthBias, real32 texelBiasScale = 1.5f)
+  {
+    this->depthBias = depthBias;
+    this->texelBiasScale = texelBiasScale;
+  }
+
+  const real32* getDepth() const { return activeDepth; }
+  // Counts redraws of the static layer, meant for checking that caching works
+  uint32 getStaticRenderCount() const { return staticRenderCount; }
+private:
+  struct StaticCaster {
+    Vertices positions;
+    TriangleIndices triangleIndices;
+    bool active;
+  };
+
+  int32 resolution;
+  PCF_MODE pcfMode = PCF_2X2;
+  real32 depthBias = 0.01f;
+  real32 texelBiasScale = 1.5f;
+
+  bool perspective = false;
+  // Orthographic half size or perspective 1 / tan(half fov)
+  real32 projectionScale = 1.0f;
+  real32 nearZ = 0.0f;
+  real32 farZ = 1.0f;
+
+  LightBasis worldBasis;
+
+  std::vector<StaticCaster> staticCasters;
+  std::vector<real32> staticDepth;
+  std::vector<real32> frameDepth;
+  const real32* activeDepth;
+
+  bool staticDirty = true;
+  bool hasDynamicCasters = false;
+  uint32 staticRenderCount = 0;
+
+  bool isInFrustum(const Vertices& positions) const;
+  void rasterize(real32* depth, const Vertices& positions, const TriangleIndices& triangleIndices) const;
+  void renderStaticLayer();
+};
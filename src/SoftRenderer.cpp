@@ -1,10 +1,10 @@
 #include "SoftRenderer.h"
+#include "ProceduralMaterial.h"
 
 #include <algorithm>
 #include <list>
 #include <assert.h>
-
-#define sign(a) (a > 0 ? 1 : -1)
+#include <jpb/Profiler.h>
 
 /*
   Coordinate System
@@ -51,124 +51,29 @@ Cube::getVertices(real32 rotAngleX, real32 rotAngleY) const
   return vertices;
 };
 
-TriangleIndices
+const TriangleIndices&
 Cube::getTriangleIndexes()
 {
-  TriangleIndices indTriangleVector;
-  indTriangleVector.resize(12);
-
-  indTriangleVector[0] = {1, 0, 3};
-  indTriangleVector[1] = {3, 2, 1};
-
-  indTriangleVector[2] = {4, 5, 6};
-  indTriangleVector[3] = {6, 7, 4};
-
-  indTriangleVector[4] = {0, 4, 7};
-  indTriangleVector[5] = {7, 3, 0};
-
-  indTriangleVector[6] = {2, 6, 5};
-  indTriangleVector[7] = {5, 1, 2};
-
-  indTriangleVector[8] = {3, 7, 6};
-  indTriangleVector[9] = {6, 2, 3};
-
-  indTriangleVector[10] = {1, 5, 4};
-  indTriangleVector[11] = {4, 0, 1};
+  static const TriangleIndices indTriangleVector = {
+    {1, 0, 3}, {3, 2, 1},
+    {4, 5, 6}, {6, 7, 4},
+    {0, 4, 7}, {7, 3, 0},
+    {2, 6, 5}, {5, 1, 2},
+    {3, 7, 6}, {6, 2, 3},
+    {1, 5, 4}, {4, 0, 1}
+  };
 
   return indTriangleVector;
 }
 
 void
-SoftRenderer::drawLine(TextureBuffer* screenBuffer, Vec2f p1, Vec2f p2, Vec3f color) const
+SoftRenderer::drawLine(Framebuffer* screenBuffer, Vec2f p1, Vec2f p2, Vec3f color) const
 {
-  Vec2f deltaVector = p2 - p1;
-
-  if(p1.x <= p2.x)
-  {
-    // First Quadrant
-    //  |
-    //==|==
-    //  |xx
-
-    // Second Quadrant
-    //  |xx
-    //==|==
-    //  |
-
-    // NOTE(jakub): fix this thing.
-    int32 dx = deltaVector.x != 0 ? ceil(deltaVector.x) : 1;
-
-    real32 a = deltaVector.x != 0 ? abs(deltaVector.y / deltaVector.x) : abs(deltaVector.y);
-    real32 tempDelta = 0;
-
-    int y = p1.y;
-
-    for(int x = 0; x < dx; x++)
-    {
-      int32 realX = p1.x + x;
-
-      tempDelta += a;
-      screenBuffer->setPixel(realX, y, color);
-
-      while(tempDelta >= 1.0f)
-      {
-	y += sign(deltaVector.y);
-	tempDelta -= 1.0f;
-
-	if(deltaVector.y < 0 && y >= p2.y ||
-	   deltaVector.y > 0 && y <= p2.y)
-	{
-	  screenBuffer->setPixel(realX, y, color);
-	}
-      }
-    }
-  }
-  else
-  {
-
-    // Third Quadrant
-    //  |
-    //==|==
-    //xx|
-
-    // Fourth Quadrant
-    //xx|
-    //==|==
-    //  |
-
-    // NOTE(jakub): fix this thing.
-    int32 dx = deltaVector.x != 0 ? abs(floor(deltaVector.x)) : 1;
-
-    real32 a = deltaVector.x != 0 ? abs(deltaVector.y / deltaVector.x) : abs(deltaVector.y);
-    real32 tempDelta = 0;
-
-    int y = p1.y;
-
-    for(int x = 0; x < dx; x++)
-    {
-      int32 realX = p1.x - x;
-
-      tempDelta += a;
-      screenBuffer->setPixel(realX, y, color);
-
-      while(tempDelta >= 1.0f)
-      {
-	y += sign(deltaVector.y);
-	tempDelta -= 1.0f;
-
-	if(deltaVector.y < 0 && y >= p2.y ||
-	   deltaVector.y > 0 && y <= p2.y)
-	{
-	  screenBuffer->setPixel(realX, y, color);
-	}
-
-      }
-    }
-  }
+  LineRasterizer::drawLine(screenBuffer, p1, p2, packColor(color));
 }
 
 void
-SoftRenderer::drawSquare(TextureBuffer* screenBuffer, Vec2f pos, float sideLength, Vec3f color) const
+SoftRenderer::drawSquare(Framebuffer* screenBuffer, Vec2f pos, float sideLength, Vec3f color) const
 {
   Vec2f topLeft = pos + Vec2f(-sideLength / 2.0f, -sideLength / 2.0f);
   Vec2f topRight = pos + Vec2f(sideLength / 2.0f, -sideLength / 2.0f);
@@ -184,16 +89,13 @@ SoftRenderer::drawSquare(TextureBuffer* screenBuffer, Vec2f pos, float sideLengt
 }
 
 void
-SoftRenderer::drawCubeInPerspective(TextureBuffer* screenBuffer, const Cube& cube, real32 rotAngleX, real32 rotAngleY)
+SoftRenderer::drawCubeInPerspective(Framebuffer* screenBuffer, const Cube& cube, real32 rotAngleX, real32 rotAngleY)
 {
-  Vertices vertices = cube.getVertices(rotAngleX, rotAngleY);
-  TriangleIndices triangleIndices = Cube::getTriangleIndexes();
-
-  drawTriangles3D(screenBuffer, vertices, triangleIndices);
+  drawTriangles3D(screenBuffer, cube.getVertices(rotAngleX, rotAngleY), Cube::getTriangleIndexes());
 }
 
 void
-SoftRenderer::drawTriangles3D(TextureBuffer* screenBuffer, const Vertices& vertices,
+SoftRenderer::drawTriangles3D(Framebuffer* screenBuffer, const Vertices& vertices,
 			      const TriangleIndices& triangleIndices, bool outline) const
 {
   Vertices castedVertices = vertices;
@@ -221,64 +123,375 @@ SoftRenderer::drawTriangles3D(TextureBuffer* screenBuffer, const Vertices& verti
   real32 clipDistance = 0.5f;
   Polygons polygonsToDraw = clip(polygons, clipDistance);
 
+  Framebuffer viewTarget = getViewTarget(screenBuffer);
   bool colorToggle = false;
   for(auto it = polygonsToDraw.begin(); it != polygonsToDraw.end(); it++)
   {
     const Polygon3D& polygon3D = *it;
     Polygon2D polygon2D = polygon3D.toPolygon2D();
-    Polygon2D screenSpacePolygon = polygon2D.toScreenSpace(screenBuffer->dimensions);
+    Polygon2D screenSpacePolygon = polygon2D.toScreenSpace(viewTarget.dimensions);
     // screenSpacePolygon.vertices[0].showData();
 
-    drawPolygon(screenBuffer, screenSpacePolygon, Vec3f(128.0f, colorToggle ? 128.0f : 0, 0), outline);
+    drawPolygon(&viewTarget, screenSpacePolygon, Vec3f(128.0f, colorToggle ? 128.0f : 0, 0), outline);
     // colorToggle = !colorToggle;
   }
 
 }
 
 void
-SoftRenderer::drawMappedTriangles3D(TextureBuffer* screenBuffer, const MappedVertices& _mappedVertices,
+SoftRenderer::drawMappedTriangles3D(Framebuffer* screenBuffer, const MappedVertices& mappedVertices,
 				    const TriangleIndices& triangleIndices, const TextureBuffer* srcTexture)
 {
+  Material material = { srcTexture, packColor(255, 255, 255, 255), PS_DEFAULT };
+  drawMappedTriangles3D(screenBuffer, mappedVertices, triangleIndices, material);
+}
+
+void
+SoftRenderer::drawMappedTriangles3D(Framebuffer* screenBuffer, const MappedVertices& _mappedVertices,
+				    const TriangleIndices& triangleIndices, const Material& material)
+{
+  beginStages();
   MappedVertices mappedVertices = _mappedVertices;
   camera->castVertices(mappedVertices);
+  if(RenderStats::enabled) RenderStats::getThreadCounters()->add(RC_VERTICES_TRANSFORMED, mappedVertices.size());
+  endStage(RS_TRANSFORM);
+
+  drawCastedTriangles(screenBuffer, mappedVertices, triangleIndices, material);
+}
+
+void
+SoftRenderer::drawCastedTriangles(Framebuffer* screenBuffer, const MappedVertices& mappedVertices,
+				  const TriangleIndices& triangleIndices, const Material& material)
+{
+  PROFILE_ZONE("SoftRenderer::drawCastedTriangles");
+  beginStages();
+  Framebuffer viewTarget;
+  IntRect clipRect;
+  beginDraw(screenBuffer, &viewTarget, &clipRect);
+  drawCastedTriangles(screenBuffer, &viewTarget, clipRect, mappedVertices, triangleIndices, material);
+}
 
-  MappedTriangles triangles = MeshHelper::getTrianglesFromIndices(triangleIndices, mappedVertices);
+void
+SoftRenderer::drawMeshInstanced(Framebuffer* screenBuffer, const InstancedMesh& mesh, const Transform3D* transforms,
+				uint32 count, const Material& material)
+{
+  PROFILE_ZONE("SoftRenderer::drawMeshInstanced");
+  beginStages();
+  Framebuffer viewTarget;
+  IntRect clipRect;
+  beginDraw(screenBuffer, &viewTarget, &clipRect);
 
+  Transform3D cameraTransform = Transform3D::fromCamera(camera);
   real32 dfc = camera->getDfc();
-  uint32 triangleCount = triangles.size();
-  MappedPolygons polygonsToDraw;
+  real32 aspectRatio = (real32)viewTarget.dimensions.x / viewTarget.dimensions.y;
+  real32 clipDistance = 0.5f;
 
-  for(int i = 0; i < triangleCount; i++)
+  // Planes through the eye around the view, normals point inside. Clipping only cuts at the
+  // near plane and the sides, copies above or below the view are culled here as well.
+  Vec3f viewPlanes[4] = {
+    Vec3f::normalize(Vec3f(dfc, 0, 1.0f)), Vec3f::normalize(Vec3f(-dfc, 0, 1.0f)),
+    Vec3f::normalize(Vec3f(0, dfc * aspectRatio, 1.0f)), Vec3f::normalize(Vec3f(0, -dfc * aspectRatio, 1.0f))
+  };
+
+  const TriangleIndices& triangleIndices = mesh.getTriangleIndices();
+  const FacePlanes& facePlanes = mesh.getFacePlanes();
+  uint32 culledCount = 0, transformedCount = 0, backfaceCulled = 0;
+
+  for(uint32 i = 0; i < count; i++)
+  {
+    Transform3D toCamera = cameraTransform * transforms[i];
+
+    // Copies whose bounding sphere is outside of the view skip transform and setup
+    Vec3f center = toCamera.transformPoint(mesh.getBoundingCenter());
+    real32 radius = mesh.getBoundingRadius() * toCamera.getMaxScale();
+    bool outside = center.z + radius < clipDistance;
+    for(int32 plane = 0; plane < 4 && !outside; plane++)
+    {
+      outside = Vec3f::dotProduct(viewPlanes[plane], center) < -radius;
+    }
+
+    if(outside)
+    {
+      culledCount++;
+      continue;
+    }
+
+    // Back faces are found in mesh space against the eye, before any vertex gets transformed.
+    // Mirroring copies turn the winding around.
+    Vec3f eye = toCamera.getInverse().translation;
+    bool mirrored = Vec3f::dotProduct(toCamera.rows[0], Vec3f::cross(toCamera.rows[1], toCamera.rows[2])) < 0;
+    frontTriangles.clear();
+    for(uint32 triangle = 0; triangle < facePlanes.size(); triangle++)
+    {
+      real32 side = Vec3f::dotProduct(facePlanes[triangle].normal, eye) - facePlanes[triangle].distance;
+      if(mirrored ? side < 0 : side > 0) frontTriangles.push_back(triangleIndices[triangle]);
+    }
+    backfaceCulled += triangleIndices.size() - frontTriangles.size();
+    endStage(RS_CLIP);
+    if(frontTriangles.empty()) continue;
+
+    mesh.transform(toCamera, &instanceVertices);
+    transformedCount++;
+    endStage(RS_TRANSFORM);
+
+    drawFrontTriangles(screenBuffer, &viewTarget, clipRect, instanceVertices, frontTriangles, material);
+  }
+
+  if(RenderStats::enabled)
+  {
+    uint32 culledTriangles = culledCount * triangleIndices.size();
+    counters->add(RC_VERTICES_TRANSFORMED, transformedCount * mesh.getVertexCount());
+    counters->add(RC_TRIANGLES_SUBMITTED, count * triangleIndices.size());
+    counters->add(RC_TRIANGLES_FRUSTUM_CULLED, culledTriangles);
+    counters->add(RC_TRIANGLES_BACKFACE_CULLED, backfaceCulled);
+  }
+  endStage(RS_CLIP);
+}
+
+void
+SoftRenderer::beginDraw(Framebuffer* screenBuffer, Framebuffer* viewTarget, IntRect* clipRect)
+{
+  if(RenderStats::enabled) counters = RenderStats::getThreadCounters();
+  *viewTarget = getViewTarget(screenBuffer);
+  *clipRect = getViewClipRect(screenBuffer->dimensions);
+  bool hasViewport = viewport.width > 0 && viewport.height > 0;
+  debugOrigin = hasViewport ? Vec2i(viewport.left, viewport.top) : Vec2i();
+
+  // Grid built for another viewport size would put pixels into the wrong tiles
+  const Vec2i& tileCount = lightGrid.getTileCount();
+  if(tileCount.x != (viewTarget->dimensions.x + LightGrid::tileSize - 1) >> LightGrid::tileShift ||
+     tileCount.y != (viewTarget->dimensions.y + LightGrid::tileSize - 1) >> LightGrid::tileShift)
+  {
+    prepareLights(screenBuffer->dimensions);
+  }
+}
+
+void
+SoftRenderer::drawCastedTriangles(Framebuffer* screenBuffer, Framebuffer* viewTarget, const IntRect& clipRect,
+				  const MappedVertices& mappedVertices, const TriangleIndices& triangleIndices,
+				  const Material& material)
+{
+  real32 dfc = camera->getDfc();
+  uint32 triangleCount = triangleIndices.size();
+  frontTriangles.clear();
+
+  for(uint32 i = 0; i < triangleCount; i++)
   {
     // Checking if the plane is facing the camera
-    Vec3f triangleNormal = MeshHelper::getCrossProductCasted(triangles[i], dfc);
+    const uint32* indexes = triangleIndices[i].indexes;
+    MappedTriangle triangle = { { mappedVertices[indexes[0]], mappedVertices[indexes[1]], mappedVertices[indexes[2]] } };
+    Vec3f triangleNormal = MeshHelper::getCrossProductCasted(triangle, dfc);
     Vec3f lookVector = Vec3f(0, 0, 1.0f);
 
     real32 dotProduct = -Vec3f::dotProduct(lookVector, triangleNormal);
+    if(dotProduct > 0) frontTriangles.push_back(triangleIndices[i]);
+  }
 
-    // if so process the triangle further
-    if(dotProduct > 0)
+  if(RenderStats::enabled)
+  {
+    counters->add(RC_TRIANGLES_SUBMITTED, triangleCount);
+    counters->add(RC_TRIANGLES_BACKFACE_CULLED, triangleCount - frontTriangles.size());
+  }
+
+  drawFrontTriangles(screenBuffer, viewTarget, clipRect, mappedVertices, frontTriangles, material);
+}
+
+void
+SoftRenderer::drawFrontTriangles(Framebuffer* screenBuffer, Framebuffer* viewTarget, const IntRect& clipRect,
+				 const MappedVertices& mappedVertices, const TriangleIndices& triangleIndices,
+				 const Material& material)
+{
+  real32 dfc = camera->getDfc();
+  uint32 triangleCount = triangleIndices.size();
+  uint32 frustumCulled = 0, clipped = 0;
+  clippedPolygons.clear();
+
+  for(uint32 i = 0; i < triangleCount; i++)
+  {
+    const uint32* indexes = triangleIndices[i].indexes;
+    MappedTriangle triangle = { { mappedVertices[indexes[0]], mappedVertices[indexes[1]], mappedVertices[indexes[2]] } };
+    MappedPolygon polygon = triangle.toPolygon();
+    real32 clipDistance = 0.5f;
+    MappedPolygon clippedPolygon = polygon.clip(clipDistance, dfc);
+
+    if(RenderStats::enabled)
     {
-      MappedPolygon polygon = triangles[i].toPolygon();
-      real32 clipDistance = 0.5f;
-      polygon = polygon.clip(clipDistance, dfc);
+      if(clippedPolygon.vertices.size() < 3) frustumCulled++;
+      else if(clippedPolygon.vertices.size() != 3 ||
+	      clippedPolygon.vertices[0].position != polygon.vertices[0].position ||
+	      clippedPolygon.vertices[1].position != polygon.vertices[1].position ||
+	      clippedPolygon.vertices[2].position != polygon.vertices[2].position) clipped++;
+    }
+    clippedPolygons.push_back(clippedPolygon);
+  }
+
+  if(RenderStats::enabled)
+  {
+    counters->add(RC_TRIANGLES_FRUSTUM_CULLED, frustumCulled);
+    counters->add(RC_TRIANGLES_CLIPPED, clipped);
+    counters->add(RC_POLYGONS_EMITTED, triangleCount - frustumCulled);
+  }
+  endStage(RS_CLIP);
 
-      // Perspective Cast Here !
-      castPolygon(polygon);
-      polygonsToDraw.push_back(polygon);
+  for(auto it = clippedPolygons.begin(); it != clippedPolygons.end(); it++)
+  {
+    MappedPolygon& mappedPolygon = *it;
+
+    // Perspective Cast Here !
+    castPolygon(mappedPolygon);
+    MappedPolygon screenSpacePolygon = mappedPolygon.toScreenSpace(viewTarget->dimensions);
+    endStage(RS_TRANSFORM);
+
+    rasterizePolygon(viewTarget, screenSpacePolygon, material, clipRect);
+  }
+
+  if(wireframeOverlay)
+  {
+    drawWireframe3D(screenBuffer, MeshHelper::getPositions(mappedVertices), triangleIndices,
+		    packColor(255, 255, 255));
+  }
+}
+
+void
+SoftRenderer::drawWireframe3D(Framebuffer* screenBuffer, const Vertices& positions,
+			      const TriangleIndices& triangleIndices, Color32 color) const
+{
+  real32 dfc = camera->getDfc();
+  real32 clipDistance = 0.5f;
+
+  Framebuffer viewTarget = getViewTarget(screenBuffer);
+  IntRect clipRect = getViewClipRect(screenBuffer->dimensions);
+
+  real32 aspectRatio = (real32)viewTarget.dimensions.x / viewTarget.dimensions.y;
+  real32 halfResX = viewTarget.dimensions.x * 0.5f;
+  real32 halfResY = viewTarget.dimensions.y * 0.5f;
+
+  auto toScreen = [&](const Vec3f& position)
+  {
+    return Vec2f((position.x / position.z) * dfc * halfResX + halfResX,
+		 -(position.y / position.z) * dfc * aspectRatio * halfResY + halfResY);
+  };
+
+  // Vertices in front of the near plane are projected once, only edges crossing it get clipped
+  Vertices2D screenVertices(positions.size());
+  for(uint32 i = 0; i < positions.size(); i++)
+  {
+    if(positions[i].z >= clipDistance) screenVertices[i] = toScreen(positions[i]);
+  }
+
+  EdgeIndices edges = LineRasterizer::getUniqueEdges(triangleIndices);
+  for(auto it = edges.begin(); it != edges.end(); it++)
+  {
+    const Vec3f& p1 = positions[it->indexes[0]];
+    const Vec3f& p2 = positions[it->indexes[1]];
+
+    bool p1Visible = p1.z >= clipDistance;
+    bool p2Visible = p2.z >= clipDistance;
+    if(!p1Visible && !p2Visible) continue;
+
+    Vec2f start = screenVertices[it->indexes[0]];
+    Vec2f end = screenVertices[it->indexes[1]];
+
+    if(!p1Visible || !p2Visible)
+    {
+      real32 t = (clipDistance - p1.z) / (p2.z - p1.z);
+      Vec3f clipped = p1 + (p2 - p1) * t;
+      clipped.z = clipDistance;
+
+      if(p1Visible) end = toScreen(clipped);
+      else start = toScreen(clipped);
     }
+
+    LineRasterizer::drawLine(&viewTarget, start, end, color, clipRect);
   }
+}
 
-  for(auto it = polygonsToDraw.begin(); it != polygonsToDraw.end(); it++)
+void
+SoftRenderer::prepareLights(const Vec2i& screenDimensions)
+{
+  PROFILE_ZONE("SoftRenderer::prepareLights");
+  Lights viewLights;
+  viewLights.reserve(lights.size() + 1);
+  Light mainLight = Light::directional(camera->castDirectionalLight(directionalLight), Vec3f(1.0f, 1.0f, 1.0f));
+  mainLight.shadowMap = directionalShadowMap;
+  if(directionalShadowMap) mainLight.shadowBasis = directionalShadowMap->getViewBasis(camera);
+  viewLights.push_back(mainLight);
+
+  Vertices positions(lights.size());
+  for(uint32 i = 0; i < lights.size(); i++)
+  {
+    positions[i] = lights[i].position;
+  }
+  camera->castVertices(positions);
+
+  for(uint32 i = 0; i < lights.size(); i++)
+  {
+    Light light = lights[i];
+    light.position = positions[i];
+    light.direction = camera->castDirectionalLight(light.direction);
+    if(light.shadowMap) light.shadowBasis = light.shadowMap->getViewBasis(camera);
+    viewLights.push_back(light);
+  }
+
+  lightGrid.build(viewLights, getViewDimensions(screenDimensions), camera->getDfc(), depthBuffer.getNearZ());
+}
+
+Vec2i
+SoftRenderer::getViewDimensions(const Vec2i& screenDimensions) const
+{
+  if(viewport.width <= 0 || viewport.height <= 0) return screenDimensions;
+  return Vec2i(viewport.width, viewport.height);
+}
+
+IntRect
+SoftRenderer::getScissorRect(const Vec2i& screenDimensions) const
+{
+  IntRect view = viewport;
+  if(view.width <= 0 || view.height <= 0) view = IntRect(0, 0, screenDimensions.x, screenDimensions.y);
+  if(scissor.width <= 0 || scissor.height <= 0) return view;
+
+  int32 left = std::max(scissor.left, view.left);
+  int32 top = std::max(scissor.top, view.top);
+  int32 right = std::min(scissor.left + scissor.width, view.left + view.width);
+  int32 bottom = std::min(scissor.top + scissor.height, view.top + view.height);
+
+  return IntRect(left, top, std::max(right - left, 0), std::max(bottom - top, 0));
+}
+
+IntRect
+SoftRenderer::getViewClipRect(const Vec2i& screenDimensions) const
+{
+  IntRect clipRect = getScissorRect(screenDimensions);
+  if(viewport.width > 0 && viewport.height > 0)
   {
-    const MappedPolygon& mappedPolygon = *it;
-    MappedPolygon screenSpacePolygon = mappedPolygon.toScreenSpace(screenBuffer->dimensions);
-    drawPolygonMapped(screenBuffer, screenSpacePolygon, srcTexture, true);
+    clipRect.left -= viewport.left;
+    clipRect.top -= viewport.top;
   }
+  return clipRect;
+}
+
+Framebuffer
+SoftRenderer::getViewTarget(Framebuffer* screenBuffer) const
+{
+  if(viewport.width <= 0 || viewport.height <= 0) return *screenBuffer;
+  return screenBuffer->getView(viewport);
 }
 
 void
-SoftRenderer::drawTriangle(TextureBuffer* screenBuffer, const Triangle& triangle, Vec3f color) const
+SoftRenderer::copySettings(const SoftRenderer& source)
+{
+  ambientLight = source.ambientLight;
+  directionalLight = source.directionalLight;
+  directionalShadowMap = source.directionalShadowMap;
+  lights = source.lights;
+  textureWrapMode = source.textureWrapMode;
+  textureFilterMode = source.textureFilterMode;
+  wireframeOverlay = source.wireframeOverlay;
+  debugView = source.debugView;
+}
+
+void
+SoftRenderer::drawTriangle(Framebuffer* screenBuffer, const Triangle& triangle, Vec3f color) const
 {
   Polygon2D polygon;
   polygon.vertices.resize(3);
@@ -290,17 +503,19 @@ SoftRenderer::drawTriangle(TextureBuffer* screenBuffer, const Triangle& triangle
 }
 
 void
-SoftRenderer::drawPolygon(TextureBuffer* screenBuffer, Polygon2D& polygon, Vec3f color, bool outline) const
+SoftRenderer::drawPolygon(Framebuffer* screenBuffer, Polygon2D& polygon, Vec3f color, bool outline) const
 {
+  Color32 packedColor = packColor(color);
+  const Vec2i& dimensions = screenBuffer->dimensions;
+
   std::vector<ScanLine> scanLines = getScanLines(polygon);
   for(auto it = scanLines.begin(); it != scanLines.end(); it++)
   {
     ScanLine& scanLine =  *it;
-    // drawLine(texture, Vec2f(scanLine.startX, scanLine.y), Vec2f(scanLine.endX, scanLine.y), color);
-    for(uint32 x = scanLine.startX; x <= scanLine.endX; x++)
-    {
-      screenBuffer->setPixel(x, scanLine.y, color);
-    }
+    if(scanLine.y >= dimensions.y || scanLine.startX >= dimensions.x) continue;
+
+    uint32 endX = std::min(scanLine.endX, (uint32)dimensions.x - 1);
+    screenBuffer->fillSpan(scanLine.y, scanLine.startX, endX, packedColor);
   }
 
   if(outline)
@@ -315,143 +530,345 @@ SoftRenderer::drawPolygon(TextureBuffer* screenBuffer, Polygon2D& polygon, Vec3f
 }
 
 void
-SoftRenderer::drawPolygonMapped(TextureBuffer* screenBuffer, MappedPolygon& polygon, const TextureBuffer* srcTexture,
+SoftRenderer::drawPolygonMapped(Framebuffer* screenBuffer, MappedPolygon& polygon, const TextureBuffer* srcTexture,
 				bool outline)
 {
-  Vec3f color(128.0f, 0, 0);
-  Vec3f castedDirectionalLight = camera->castDirectionalLight(directionalLight);
+  Material material = { srcTexture, packColor(255, 255, 255, 255), PS_DEFAULT };
+  drawPolygonMapped(screenBuffer, polygon, material, outline);
+}
 
-  real32 dfc = camera->getDfc();
-  const Vec2i& screenResolution = screenBuffer->dimensions;
-  real32 halfWidth = screenResolution.x / 2.0f;
-  real32 halfHeight = screenResolution.y / 2.0f;
+void
+SoftRenderer::drawPolygonMapped(Framebuffer* screenBuffer, MappedPolygon& polygon, const Material& material,
+				bool outline)
+{
+  // Polygon is in framebuffer pixels already, only the scissor applies
+  IntRect clipRect = scissor;
+  if(clipRect.width <= 0 || clipRect.height <= 0) clipRect = IntRect(0, 0, screenBuffer->dimensions.x, screenBuffer->dimensions.y);
+  // Doesn't go through beginDraw, the counters are looked up here
+  if(RenderStats::enabled) counters = RenderStats::getThreadCounters();
+  beginStages();
+  rasterizePolygon(screenBuffer, polygon, material, clipRect);
 
-  MScanLineVector scanLines = getScanLinesMapped(polygon, screenBuffer->dimensions);
-  for(auto it = scanLines.begin(); it != scanLines.end(); it++)
+  if(outline)
   {
-    MScanLine& scanLine =  *it;
+    Polygon2D _polygon = polygon.toPolygon2D();
 
-    MappedVertex v1Min = polygon.vertices[scanLine.minVertexIndex];
-    MappedVertex v2Min = polygon.vertices[(scanLine.minVertexIndex + 1) % polygon.vertices.size()];
+    int numbOfVertices = _polygon.vertices.size();
+    for(int i = 0; i != numbOfVertices; i++)
+    {
+      drawLine(screenBuffer, _polygon.vertices[i], _polygon.vertices[(i+1)%numbOfVertices], Vec3f());
+    }
+  }
+}
 
-    Vec3f minDelta = v2Min.position - v1Min.position;
-    real32 minT = ((real32)scanLine.y - v1Min.position.y) / minDelta.y;
+void
+SoftRenderer::rasterizePolygon(Framebuffer* screenBuffer, const MappedPolygon& polygon, const Material& material,
+			       const IntRect& clipRect)
+{
+  MScanLineVector scanLines = getScanLinesMapped(polygon, clipRect);
+  if(RenderStats::enabled) counters->add(RC_SCANLINES, scanLines.size());
+  endStage(RS_RASTER);
+  // Debug views get span loops of their own, the others don't check for them
+  uint32 pipelineState = material.pipelineState & ~(PS_DEBUG_COUNT | PS_DEBUG_TIME);
+  if(debugView && debugView->isCounting()) pipelineState |= PS_DEBUG_COUNT;
+  else if(debugView && debugView->getMode() == DV_TILE_COST) pipelineState |= PS_DEBUG_TIME;
+  SpanFunction drawSpans = getSpanFunction(screenBuffer->format, pipelineState);
+
+  if((material.pipelineState & PS_TEXTURED) && !(material.pipelineState & PS_PROCEDURAL))
+  {
+    TextureSampler sampler(material.texture, textureWrapMode, textureFilterMode);
+    endStage(RS_SETUP);
+    (this->*drawSpans)(screenBuffer, polygon, scanLines, material, &sampler);
+  }
+  else
+  {
+    endStage(RS_SETUP);
+    (this->*drawSpans)(screenBuffer, polygon, scanLines, material, NULL);
+  }
+  endStage(RS_SHADE);
+}
 
-    VertexCasted uvCastedLeft = castPerspective(v1Min, v2Min, minT);
+// Fills varyings of a vertex divided by its z, in the order PipelineTraits lays them out
+template <uint32 States>
+static inline void
+getVaryings(const MappedVertex& vertex, real32* varyings)
+{
+  typedef PipelineTraits<States> Traits;
+  real32 invZ = 1.0f / vertex.position.z;
 
-    MappedVertex v1Max = polygon.vertices[scanLine.maxVertexIndex];
-    MappedVertex v2Max = polygon.vertices[(scanLine.maxVertexIndex + 1) % polygon.vertices.size()];
+  if(Traits::hasUv)
+  {
+    varyings[Traits::uvOffset] = vertex.uv.x * invZ;
+    varyings[Traits::uvOffset + 1] = vertex.uv.y * invZ;
+  }
 
-    Vec3f maxDelta = v2Max.position - v1Max.position;
-    real32 maxT = ((real32)scanLine.y - v1Max.position.y) / maxDelta.y;
+  if(Traits::lit)
+  {
+    varyings[Traits::normalOffset] = vertex.normal.x * invZ;
+    varyings[Traits::normalOffset + 1] = vertex.normal.y * invZ;
+    varyings[Traits::normalOffset + 2] = vertex.normal.z * invZ;
+  }
 
-    VertexCasted uvCastedRight = castPerspective(v1Max, v2Max, maxT);
+  varyings[Traits::varyingCount] = invZ;
+}
 
-    // Start for Calculating uv perPixel
-    // Calculating divided by Z
-    Vec2f SUVleft = uvCastedLeft.uv / uvCastedLeft.z;
-    Vec2f SUVright = uvCastedRight.uv / uvCastedRight.z;
+// Varyings and 1 / z where the scan line crosses the polygon edge starting at vertexIndex, x
+// is where it crosses
+template <uint32 States>
+static inline void
+getEdgeVaryings(const MappedPolygon& polygon, uint32 vertexIndex, int32 y, real32* varyings, real32* x)
+{
+  const uint32 count = PipelineTraits<States>::varyingCount + 1;
 
-    Vec3f SNleft = uvCastedLeft.normal / uvCastedLeft.z;
-    Vec3f SNright = uvCastedRight.normal / uvCastedRight.z;
+  const MappedVertex& v1 = polygon.vertices[vertexIndex];
+  const MappedVertex& v2 = polygon.vertices[(vertexIndex + 1) % polygon.vertices.size()];
+  real32 t = ((real32)y - v1.position.y) / (v2.position.y - v1.position.y);
 
-    real32 currentSZ = 1.0f / uvCastedLeft.z;
-    Vec2f currentSUV = SUVleft;
-    Vec3f currentSN = SNleft;
+  real32 varyings1[count], varyings2[count];
+  getVaryings<States>(v1, varyings1);
+  getVaryings<States>(v2, varyings2);
 
-    uint32 scanLineLength = scanLine.endX - scanLine.startX;
+  for(uint32 i = 0; i < count; i++)
+  {
+    varyings[i] = varyings1[i] + (varyings2[i] - varyings1[i]) * t;
+  }
+  *x = v1.position.x + (v2.position.x - v1.position.x) * t;
+}
 
-    real32 zDeltaPerPixel = ((1.0f / uvCastedRight.z) - currentSZ) / scanLineLength;
-    Vec2f uvDeltaPerPixel = (SUVright - SUVleft) / scanLineLength;
-    Vec3f nDeltaPerPixel = (SNright - SNleft) / scanLineLength;
+template <PIXEL_FORMAT Format, uint32 States>
+void
+SoftRenderer::drawSpans(Framebuffer* screenBuffer, const MappedPolygon& polygon, const MScanLineVector& scanLines,
+			const Material& material, const TextureSampler* sampler)
+{
+  typedef PipelineTraits<States> Traits;
+  const uint32 count = Traits::varyingCount + 1;
+  const uint32 zIndex = Traits::varyingCount;
 
-    for(int x = scanLine.startX; x <= scanLine.endX; x++)
-    {
+  __m128 ambientRed = _mm_set1_ps(ambientLight.x);
+  __m128 ambientGreen = _mm_set1_ps(ambientLight.y);
+  __m128 ambientBlue = _mm_set1_ps(ambientLight.z);
+  __m128i flatColors = _mm_set1_epi32(material.color);
 
-      real32 currentZ = 1.0f / currentSZ;
+  // Screen position back to camera space, inverse of the screen space transform
+  real32 dfc = camera->getDfc();
+  real32 halfResX = screenBuffer->dimensions.x * 0.5f;
+  real32 halfResY = screenBuffer->dimensions.y * 0.5f;
+  real32 aspectRatio = (real32)screenBuffer->dimensions.x / screenBuffer->dimensions.y;
+  __m128 invScaleX = _mm_set1_ps(1.0f / (halfResX * dfc));
+  real32 invScaleY = -1.0f / (halfResY * aspectRatio * dfc);
+
+  __m128 laneOffsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+
+  // Depth values are compared as unsigned, SSE2 only has signed compare so sign bits get flipped
+  __m128 depthScale = _mm_set1_ps((real32)0xFFFFFF);
+  __m128 nearZ = _mm_set1_ps(depthBuffer.getNearZ());
+  __m128i depthTag = _mm_set1_epi32(depthBuffer.getFrameTag() << 24);
+  __m128i signBit = _mm_set1_epi32(0x80000000);
+
+  const __m128i laneMasks[5] = {
+    _mm_setzero_si128(),
+    _mm_set_epi32(0, 0, 0, -1),
+    _mm_set_epi32(0, 0, -1, -1),
+    _mm_set_epi32(0, -1, -1, -1),
+    _mm_set1_epi32(-1)
+  };
 
-      if(currentZ < zBuffer[scanLine.y][x])
-      {
-	zBuffer[scanLine.y][x] = currentZ;
+  // Counted per call and added once at the end, lane masks are 4 bits
+  static const uint8 laneBits[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+  uint32 texelsPerSample = (sampler && sampler->getFilterMode() == FM_BILINEAR) ? 16 : 4;
+  uint64 pixelsTested = 0, pixelsPassed = 0, pixelsShaded = 0, pixelsWritten = 0;
 
-	Vec2f resultUV = currentSUV / currentSZ;
-	Vec3f resultN = currentSN / currentSZ;
-	Vec3f textureColor = srcTexture->getPixelUV(resultUV);
+  // Depth fails are only counted by loops that test depth
+  bool countVisible = Traits::debugCount && debugView->getMode() == DV_OVERDRAW;
+  bool countPixels = Traits::debugCount && (countVisible || Traits::depthTest);
 
-	// Getting Original Pixel Position in 3D
-	Vec3f pixelPosition;
+  for(auto it = scanLines.begin(); it != scanLines.end(); it++)
+  {
+    const MScanLine& scanLine =  *it;
+    uint64 spanStart = Traits::debugTime ? StageTimes::now() : 0;
+    uint32* countRow = countPixels ? debugView->getCountRow(scanLine.y + debugOrigin.y) + debugOrigin.x : NULL;
 
-	pixelPosition.x = x;
-	pixelPosition.y = scanLine.y;
+    real32 left[count], right[count], delta[count];
+    real32 leftX, rightX;
+    getEdgeVaryings<States>(polygon, scanLine.minVertexIndex, scanLine.y, left, &leftX);
+    getEdgeVaryings<States>(polygon, scanLine.maxVertexIndex, scanLine.y, right, &rightX);
 
-	// First Convert From ScreenSpace to objectSpace
+    // Pixels sample at their integer position, not where the edge crosses the row
+    real32 scanLineLength = rightX - leftX;
+    real32 invLength = scanLineLength > 0 ? 1.0f / scanLineLength : 0;
 
-	pixelPosition.x = (pixelPosition.x - halfWidth) / halfWidth;
-	pixelPosition.y = (pixelPosition.y - halfHeight) / halfHeight;
+    for(uint32 i = 0; i < count; i++)
+    {
+      delta[i] = (right[i] - left[i]) * invLength;
+    }
 
-	pixelPosition.x = (currentZ * pixelPosition.x) / dfc;
-	pixelPosition.y = (currentZ * pixelPosition.y) / dfc;
-	pixelPosition.z = currentZ;
+    uint32* row = screenBuffer->getRow(scanLine.y);
+    uint32* depthRow = depthBuffer.getRow(scanLine.y);
+    __m128 viewY = _mm_set1_ps((scanLine.y - halfResY) * invScaleY);
 
-	Vec3f deltaPosition = pixelPosition;
-	real32 distanceFromPixel = deltaPosition.getLength();
+    for(int32 x = scanLine.startX; x <= scanLine.endX; x += 4)
+    {
+      __m128 offsets = _mm_add_ps(_mm_set1_ps((real32)x - leftX), laneOffsets);
+      int32 laneCount = std::min(4, scanLine.endX - x + 1);
 
-	// ambientLight =  1.0f - ((distanceFromPixel - dfc) / 2.0f);
+      __m128 varyings[count];
+      for(uint32 i = 0; i < count; i++)
+      {
+	varyings[i] = _mm_add_ps(_mm_set1_ps(left[i]), _mm_mul_ps(offsets, _mm_set1_ps(delta[i])));
+      }
 
-	// real32 tempT = (x - scanLine.startX) / scanLineLength;
-	// VertexCasted pixelValues = castPerspective(uvCastedLeft, uvCastedRight, tempT);
+      __m128i visible = laneMasks[laneCount];
 
-	Vec3f pixelNormal = resultN;
-	Vec3f lookVectorR(0, 0, -1);
+      if(Traits::depthTest || Traits::depthWrite)
+      {
+	__m128 depth = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(nearZ, varyings[zIndex]));
+	depth = _mm_min_ps(_mm_max_ps(depth, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+	__m128i depthValues = _mm_or_si128(_mm_cvttps_epi32(_mm_mul_ps(depth, depthScale)), depthTag);
+	__m128i storedDepth = _mm_loadu_si128((__m128i*)(depthRow + x));
 
-	real32 lightValue = std::max(Vec3f::dotProduct(pixelNormal, castedDirectionalLight * -1.0f), 0.0f);
-	lightValue += ambientLight;
-	lightValue = std::max(std::min(lightValue, 1.0f), 0.0f);
+	if(Traits::depthTest)
+	{
+	  __m128i closer = _mm_cmplt_epi32(_mm_xor_si128(depthValues, signBit), _mm_xor_si128(storedDepth, signBit));
+	  visible = _mm_and_si128(closer, visible);
+	  pixelsTested += laneCount;
+	}
 
-	textureColor *= lightValue;
-	screenBuffer->setPixel(x, scanLine.y, textureColor);
+	if(Traits::depthWrite)
+	{
+	  _mm_storeu_si128((__m128i*)(depthRow + x),
+			   _mm_or_si128(_mm_and_si128(visible, depthValues), _mm_andnot_si128(visible, storedDepth)));
+	}
       }
 
-      currentSZ += zDeltaPerPixel;
-      currentSUV += uvDeltaPerPixel;
-      currentSN += nDeltaPerPixel;
-    }
-  }
+      uint32 visibleMask = _mm_movemask_ps(_mm_castsi128_ps(visible));
+      if(Traits::depthTest) pixelsPassed += laneBits[visibleMask];
+      if(Traits::debugCount && countRow)
+      {
+	uint32 countedMask = countVisible ? visibleMask : ((1 << laneCount) - 1) & ~visibleMask;
+	for(int32 i = 0; i < laneCount; i++)
+	{
+	  if(countedMask & (1 << i)) countRow[x + i]++;
+	}
+      }
+      if(!visibleMask) continue;
+      pixelsShaded += 4;
+      pixelsWritten += laneBits[visibleMask];
 
-  Polygon2D _polygon = polygon.toPolygon2D();
+      __m128 currentZ = _mm_div_ps(_mm_set1_ps(1.0f), varyings[zIndex]);
+      __m128i colors = flatColors;
 
-  if(outline)
-  {
-    int numbOfVertices = _polygon.vertices.size();
-    for(int i = 0; i != numbOfVertices; i++)
+      if(Traits::procedural)
+      {
+	// Only visible pixels get evaluated, the rest would be thrown away
+	colors = material.procedural->shade4(_mm_mul_ps(varyings[Traits::uvOffset], currentZ),
+					     _mm_mul_ps(varyings[Traits::uvOffset + 1], currentZ), visibleMask);
+      }
+      else if(Traits::textured)
+      {
+	colors = sampler->sample4(_mm_mul_ps(varyings[Traits::uvOffset], currentZ),
+				  _mm_mul_ps(varyings[Traits::uvOffset + 1], currentZ));
+      }
+
+      if(Traits::lit)
+      {
+	__m128 screenX = _mm_add_ps(_mm_set1_ps((real32)x - halfResX), laneOffsets);
+	__m128 position[3] = {
+	  _mm_mul_ps(_mm_mul_ps(screenX, invScaleX), currentZ),
+	  _mm_mul_ps(viewY, currentZ),
+	  currentZ
+	};
+	__m128 normal[3] = {
+	  _mm_mul_ps(varyings[Traits::normalOffset], currentZ),
+	  _mm_mul_ps(varyings[Traits::normalOffset + 1], currentZ),
+	  _mm_mul_ps(varyings[Traits::normalOffset + 2], currentZ)
+	};
+
+	__m128 red = ambientRed;
+	__m128 green = ambientGreen;
+	__m128 blue = ambientBlue;
+	lightGrid.shade4(x, scanLine.y, position, normal, &red, &green, &blue);
+
+	colors = modulateColors(colors, red, green, blue);
+      }
+
+      Framebuffer::storeColors4<Format>(row + x, colors, visibleMask, laneCount);
+    }
+
+    if(Traits::debugTime)
     {
-      drawLine(screenBuffer, _polygon.vertices[i], _polygon.vertices[(i+1)%numbOfVertices], Vec3f());
+      debugView->addSpanTicks(scanLine.y + debugOrigin.y, scanLine.startX + debugOrigin.x, scanLine.endX + debugOrigin.x,
+			      StageTimes::now() - spanStart);
     }
   }
+
+  if(RenderStats::enabled)
+  {
+    counters->add(RC_PIXELS_TESTED, pixelsTested);
+    counters->add(RC_PIXELS_DEPTH_REJECTED, pixelsTested - pixelsPassed);
+    counters->add(RC_PIXELS_SHADED, pixelsShaded);
+    counters->add(RC_PIXELS_WRITTEN, pixelsWritten);
+    if(Traits::textured && !Traits::procedural) counters->add(RC_TEXELS_FETCHED, pixelsShaded / 4 * texelsPerSample);
+  }
 }
 
-void
-SoftRenderer::setZBufferSize(const Vec2i& zBufferSize)
-{
+// Fills the dispatch table with one span loop per state combination, starting from the last one.
+// Only one debug view is on at a time, combinations with both debug bits reuse the counting loop.
+template <PIXEL_FORMAT Format, uint32 States>
+struct SpanTableBuilder {
+  static const uint32 compiledStates = (States & PS_DEBUG_COUNT) ? States & ~PS_DEBUG_TIME : States;
 
-  zBuffer.resize(zBufferSize.y);
-  for(auto it = zBuffer.begin(); it != zBuffer.end(); it++)
+  static void fill(SoftRenderer::SpanFunction* table)
   {
-    std::vector<real32>& pixelRow = *it;
-    pixelRow.resize(zBufferSize.x);
+    table[States] = &SoftRenderer::drawSpans<Format, compiledStates>;
+    SpanTableBuilder<Format, States - 1>::fill(table);
+  }
+};
 
-    std::fill(pixelRow.begin(), pixelRow.end(), FLT_MAX);
+template <PIXEL_FORMAT Format>
+struct SpanTableBuilder<Format, 0> {
+  static void fill(SoftRenderer::SpanFunction* table)
+  {
+    table[0] = &SoftRenderer::drawSpans<Format, 0>;
   }
+};
+
+struct SpanTables {
+  SoftRenderer::SpanFunction rgba[PS_COMBINATION_COUNT];
+  SoftRenderer::SpanFunction argb[PS_COMBINATION_COUNT];
+
+  SpanTables()
+  {
+    SpanTableBuilder<PF_RGBA8888, PS_COMBINATION_COUNT - 1>::fill(rgba);
+    SpanTableBuilder<PF_ARGB8888, PS_COMBINATION_COUNT - 1>::fill(argb);
+  }
+};
+
+SoftRenderer::SpanFunction
+SoftRenderer::getSpanFunction(PIXEL_FORMAT format, uint32 pipelineState)
+{
+  static const SpanTables tables;
+
+  pipelineState &= PS_COMBINATION_COUNT - 1;
+  return format == PF_ARGB8888 ? tables.argb[pipelineState] : tables.rgba[pipelineState];
+}
+
+void
+SoftRenderer::setTextureFiltering(WRAP_MODE wrapMode, FILTER_MODE filterMode)
+{
+  textureWrapMode = wrapMode;
+  textureFilterMode = filterMode;
+}
+
+void
+SoftRenderer::setZBufferSize(const Vec2i& zBufferSize)
+{
+  depthBuffer.resize(zBufferSize);
 }
 
 void
 SoftRenderer::clearZBuffer()
 {
-  for(auto it = zBuffer.begin(); it != zBuffer.end(); it++)
-  {
-    std::vector<real32>& pixelRow = *it;
-    std::fill(pixelRow.begin(), pixelRow.end(), FLT_MAX);
-  }
+  depthBuffer.clear();
 }
 
 ScanLineVector
@@ -526,7 +943,13 @@ SoftRenderer::getScanLines(const Polygon2D& polygon) const
 }
 
 MScanLineVector
-SoftRenderer::getScanLinesMapped(const MappedPolygon& polygon, const Vec2i& screenResolution) const
+SoftRenderer::getScanLinesMapped(const MappedPolygon& polygon, const Vec2i& screenResolution)
+{
+  return getScanLinesMapped(polygon, IntRect(0, 0, screenResolution.x, screenResolution.y));
+}
+
+MScanLineVector
+SoftRenderer::getScanLinesMapped(const MappedPolygon& polygon, const IntRect& clipRect)
 {
   MScanLineVector result;
   const int numbOfVertices = polygon.vertices.size();
@@ -534,8 +957,8 @@ SoftRenderer::getScanLinesMapped(const MappedPolygon& polygon, const Vec2i& scre
   const MappedVertices& vertices = polygon.vertices;
   Range2d range2d = MathHelper::getRange2d(vertices);
 
-  range2d.y.min = std::max(range2d.y.min, 0.0f);
-  range2d.y.max = std::min(range2d.y.max, (real32)(screenResolution.y - 1));
+  range2d.y.min = std::max(range2d.y.min, (real32)clipRect.top);
+  range2d.y.max = std::min(range2d.y.max, (real32)(clipRect.top + clipRect.height - 1));
 
   struct XAssignedVertex{
     real32 value;
@@ -603,8 +1026,11 @@ SoftRenderer::getScanLinesMapped(const MappedPolygon& polygon, const Vec2i& scre
 
     if(minScanX != -1 && maxScanX != -1)
     {
-      scanLine.startX = std::max(minScanX, 0);
-      scanLine.endX = std::min(maxScanX, screenResolution.x - 1);
+      scanLine.spanStartX = minScanX;
+      scanLine.spanEndX = maxScanX;
+      scanLine.startX = std::max(minScanX, clipRect.left);
+      scanLine.endX = std::min(maxScanX, clipRect.left + clipRect.width - 1);
+      if(scanLine.startX > scanLine.endX) continue;
 
       scanLine.minVertexIndex = minVertexIndex;
       scanLine.maxVertexIndex = maxVertexIndex;
@@ -679,44 +1105,6 @@ SoftRenderer::castPolygon(MappedPolygon& polygon) const
   }
 }
 
-VertexCasted
-SoftRenderer::castPerspective(const MappedVertex& v1, const MappedVertex& v2, real32 t) const
-{
-  VertexCasted result;
-
-  // Divided By Z Values
-  Vec2f SUVv1 = v1.uv / v1.position.z;
-  Vec2f SUVv2 = v2.uv / v2.position.z;
-
-  Vec3f SNv1 = v1.normal / v1.position.z;
-  Vec3f SNv2 = v2.normal / v2.position.z;
-
-  // Deltas
-  Vec2f SUVDelta = SUVv2 - SUVv1;
-  Vec3f SNDelta = SNv2 - SNv1;
-
-  // Z Calculations
-  real32 SZv1 = 1.0f / v1.position.z;
-  real32 SZv2 = 1.0f / v2.position.z;
-  real32 SZDelta = SZv2 - SZv1;
-
-  // Result
-  Vec2f SUVResult = SUVv1 + (SUVDelta  * t);
-  Vec3f SNResult = SNv1 + (SNDelta  * t);
-  real32 ZResult = SZv1 + (SZDelta  * t);
-
-  real32 resultZ = 1.0f / ZResult;
-
-  Vec2f resultUV = SUVResult * resultZ;
-  Vec3f resultN = SNResult * resultZ;
-
-  result.uv = resultUV;
-  result.normal = resultN;
-  result.z = resultZ;
-
-  return result;
-}
-
 Polygons
 SoftRenderer::clip(const Polygons& polygons, real32 nearZ) const
 {
@@ -1,12 +1,20 @@
 #pragma once
 #include <vector>
 #include <jpb/Vector.h>
+#include <jpb/Rect.h>
 
-#include "main.h"
 #include "RenderPrimitives.h"
+#include "Framebuffer.h"
 #include "Camera.h"
-
-typedef std::vector<std::vector<real32>> FloatMatrix;
+#include "TextureSampler.h"
+#include "DepthBuffer.h"
+#include "LineRasterizer.h"
+#include "Lighting.h"
+#include "PipelineState.h"
+#include "StageTimes.h"
+#include "RenderStats.h"
+#include "DebugView.h"
+#include "InstancedMesh.h"
 
 class Cube {
 public:
@@ -20,7 +28,8 @@ public:
   Vertices getVertices(real32 rotAngleX, real32 rotAngleY) const ;
   Vec3f getColor() const { return color; }
 
-  static TriangleIndices getTriangleIndexes();
+  // Built once, the same for every cube
+  static const TriangleIndices& getTriangleIndexes();
   static TriangleVector getTriangles(std::vector<Vec2f>& vertices2d);
 private:
 
@@ -31,36 +40,159 @@ private:
 
 class SoftRenderer {
 public:
+  typedef void (SoftRenderer::*SpanFunction)(Framebuffer* screenBuffer, const MappedPolygon& polygon,
+					     const MScanLineVector& scanLines, const Material& material,
+					     const TextureSampler* sampler);
 
-  void drawLine(TextureBuffer* screenBuffer, Vec2f p1, Vec2f p2, Vec3f color) const ;
-  void drawSquare(TextureBuffer* screenBuffer, Vec2f pos, float sideLength, Vec3f color) const ;
-  void drawCubeInPerspective(TextureBuffer* screenBuffer, const Cube& cube, real32 rotAngleX = 0, real32 rotAngleY = 0);
+  void drawLine(Framebuffer* screenBuffer, Vec2f p1, Vec2f p2, Vec3f color) const ;
+  void drawSquare(Framebuffer* screenBuffer, Vec2f pos, float sideLength, Vec3f color) const ;
+  void drawCubeInPerspective(Framebuffer* screenBuffer, const Cube& cube, real32 rotAngleX = 0, real32 rotAngleY = 0);
 
-  void drawTriangles3D(TextureBuffer* screenBuffer, const Vertices& vertices,
+  void drawTriangles3D(Framebuffer* screenBuffer, const Vertices& vertices,
 		       const TriangleIndices& triangleIndices, bool outline = true) const;
 
-  void drawMappedTriangles3D(TextureBuffer* screenBuffer, const MappedVertices& mappedVertices,
+  void drawMappedTriangles3D(Framebuffer* screenBuffer, const MappedVertices& mappedVertices,
 			     const TriangleIndices& triangleIndices, const TextureBuffer* srcTexture);
-
-  void drawTriangle(TextureBuffer* screenBuffer, const Triangle& triangle, Vec3f color) const ;
-  void drawPolygon(TextureBuffer* screenBuffer, Polygon2D& polygon, Vec3f color, bool outline = true) const;
-
-  void drawPolygonMapped(TextureBuffer* screenBuffer, MappedPolygon& polygon, const TextureBuffer* srcTexture, bool outline = true);
+  void drawMappedTriangles3D(Framebuffer* screenBuffer, const MappedVertices& mappedVertices,
+			     const TriangleIndices& triangleIndices, const Material& material);
+  // Vertices already moved to camera space, meshes drawn several times from one camera
+  // only have to be moved once.
+  void drawCastedTriangles(Framebuffer* screenBuffer, const MappedVertices& castedVertices,
+			   const TriangleIndices& triangleIndices, const Material& material);
+  // Copies of one mesh, transforms go from mesh to world space. Copies outside of the view are
+  // culled by their bounding sphere before any vertex is moved.
+  void drawMeshInstanced(Framebuffer* screenBuffer, const InstancedMesh& mesh, const Transform3D* transforms,
+			 uint32 count, const Material& material);
+
+  void drawTriangle(Framebuffer* screenBuffer, const Triangle& triangle, Vec3f color) const ;
+  void drawPolygon(Framebuffer* screenBuffer, Polygon2D& polygon, Vec3f color, bool outline = true) const;
+
+  // Edges of the given triangles, each shared edge drawn once. Positions are in camera space.
+  void drawWireframe3D(Framebuffer* screenBuffer, const Vertices& positions,
+		       const TriangleIndices& triangleIndices, Color32 color) const;
+
+  void drawPolygonMapped(Framebuffer* screenBuffer, MappedPolygon& polygon, const TextureBuffer* srcTexture, bool outline = false);
+  void drawPolygonMapped(Framebuffer* screenBuffer, MappedPolygon& polygon, const Material& material, bool outline = false);
   void setCamera(Camera* camera) { this->camera = camera; }
+  Camera* getCamera() const { return camera; }
+
+  // Part of the framebuffer the camera projects to, empty means all of it. It has to lie
+  // inside of the framebuffer, depth buffer and light grid are only as big as the viewport.
+  void setViewport(const IntRect& viewport) { this->viewport = viewport; }
+  const IntRect& getViewport() const { return viewport; }
+  // 3D drawing leaves pixels outside of the scissor alone, empty means the whole viewport.
+  // Both are in framebuffer coordinates.
+  void setScissor(const IntRect& scissor) { this->scissor = scissor; }
+  const IntRect& getScissor() const { return scissor; }
+  // Scissor clipped to the viewport
+  IntRect getScissorRect(const Vec2i& screenDimensions) const;
+  Vec2i getViewDimensions(const Vec2i& screenDimensions) const;
+
+  // Lights, shadow maps and texture settings, everything that does not depend on the camera
+  void copySettings(const SoftRenderer& source);
+
   void setDirectionalLight(const Vec3f& directionalLight) { this->directionalLight = directionalLight; }
+  void setAmbientLight(const Vec3f& ambientLight) { this->ambientLight = ambientLight; }
+  void setDirectionalShadowMap(ShadowMap* shadowMap) { directionalShadowMap = shadowMap; }
+
+  // Lights on top of the white directional one, in world space
+  void setLights(const Lights& lights) { this->lights = lights; }
+  const Lights& getLights() const { return lights; }
+
+  // Moves lights to camera space and culls them into screen tiles, has to be called after the
+  // camera, viewport or lights change and before drawing.
+  void prepareLights(const Vec2i& screenDimensions);
+  const LightGrid& getLightGrid() const { return lightGrid; }
+  void setTextureFiltering(WRAP_MODE wrapMode, FILTER_MODE filterMode);
+  // Wireframe of front facing triangles drawn over mapped meshes
+  void setWireframeOverlay(bool wireframeOverlay) { this->wireframeOverlay = wireframeOverlay; }
+  bool getWireframeOverlay() const { return wireframeOverlay; }
+
+  // Picks the span loop from the dispatch table, unknown state bits are ignored.
+  static SpanFunction getSpanFunction(PIXEL_FORMAT format, uint32 pipelineState);
+
+  // Spans of a screen space polygon, shared with the depth only shadow map path.
+  static MScanLineVector getScanLinesMapped(const MappedPolygon& polygon, const Vec2i& screenResolution);
+  static MScanLineVector getScanLinesMapped(const MappedPolygon& polygon, const IntRect& clipRect);
+
+  // Time spent in each stage gets added to stageTimes, NULL turns timing off. Not taken over
+  // by copySettings, renderers on other threads need their own.
+  void setStageTimes(StageTimes* stageTimes) { this->stageTimes = stageTimes; }
+
+  // Span loops fill the counters of its mode, NULL or DV_NONE draws normally. Taken over by
+  // copySettings, the caller begins and resolves it around the frame.
+  void setDebugView(DebugView* debugView) { this->debugView = debugView; }
+  DebugView* getDebugView() const { return debugView; }
 
   void setZBufferSize(const Vec2i& zBufferSize);
   void clearZBuffer();
+  DepthBuffer* getDepthBuffer() { return &depthBuffer; }
 
 private:
+  template <PIXEL_FORMAT Format, uint32 States> friend struct SpanTableBuilder;
 
   Camera* camera;
-  FloatMatrix zBuffer;
-  real32 ambientLight = 0.3f;
+  IntRect viewport;
+  IntRect scissor;
+  DepthBuffer depthBuffer;
+  Vec3f ambientLight = Vec3f(0.3f, 0.3f, 0.3f);
   Vec3f directionalLight = Vec3f(-0.707f, -0.707f, -0.707f);
+  ShadowMap* directionalShadowMap = NULL;
+  Lights lights;
+  LightGrid lightGrid;
+
+  WRAP_MODE textureWrapMode = WM_REPEAT;
+  FILTER_MODE textureFilterMode = FM_NEAREST;
+  bool wireframeOverlay = false;
+
+  StageTimes* stageTimes = NULL;
+  uint64 stageStart = 0;
+  // Counters of the thread drawing, looked up again by every draw call
+  ThreadRenderCounters* counters = NULL;
+  // Camera space vertices of the copy drawMeshInstanced is at
+  MappedVertices instanceVertices;
+  // Scratch of drawCastedTriangles, kept so meshes and copies don't allocate them every time
+  TriangleIndices frontTriangles;
+  MappedPolygons clippedPolygons;
+
+  DebugView* debugView = NULL;
+  // Viewport corner, debug counters are in framebuffer pixels
+  Vec2i debugOrigin;
+
+  void beginStages() { if(stageTimes) stageStart = StageTimes::now(); }
+  // Time since the previous stage ended goes to this one
+  void endStage(RENDER_STAGE stage)
+  {
+    if(!stageTimes) return;
+    uint64 ticks = StageTimes::now();
+    stageTimes->ticks[stage] += ticks - stageStart;
+    stageStart = ticks;
+  }
 
   ScanLineVector getScanLines(const Polygon2D& polygon) const;
-  MScanLineVector getScanLinesMapped(const MappedPolygon& polygon, const Vec2i& screenResolution) const;
+
+  // Framebuffer sharing the pixels of the viewport
+  Framebuffer getViewTarget(Framebuffer* screenBuffer) const;
+  // Scissor rectangle relative to the viewport
+  IntRect getViewClipRect(const Vec2i& screenDimensions) const;
+
+  // Setup shared by all meshes of one draw call
+  void beginDraw(Framebuffer* screenBuffer, Framebuffer* viewTarget, IntRect* clipRect);
+  void drawCastedTriangles(Framebuffer* screenBuffer, Framebuffer* viewTarget, const IntRect& clipRect,
+			   const MappedVertices& castedVertices, const TriangleIndices& triangleIndices,
+			   const Material& material);
+  // Clips and draws triangles known to face the camera
+  void drawFrontTriangles(Framebuffer* screenBuffer, Framebuffer* viewTarget, const IntRect& clipRect,
+			  const MappedVertices& castedVertices, const TriangleIndices& triangleIndices,
+			  const Material& material);
+
+  void rasterizePolygon(Framebuffer* screenBuffer, const MappedPolygon& polygon, const Material& material,
+			const IntRect& clipRect);
+
+  // Span loop compiled for one pixel format and one combination of pipeline states
+  template <PIXEL_FORMAT Format, uint32 States>
+  void drawSpans(Framebuffer* screenBuffer, const MappedPolygon& polygon, const MScanLineVector& scanLines,
+		 const Material& material, const TextureSampler* sampler);
 
   // Perspective Transformation without clipping
   Vertices castVertices(const Vertices& vertices) const;
@@ -69,8 +201,6 @@ private:
   void castPolygon(MappedPolygon& polygon) const;
   // Vec3f castVertex(const Vec3f& position, real32 dfc) const;
 
-  VertexCasted castPerspective(const MappedVertex& v1, const MappedVertex& v2, real32 t) const ;
-
   Polygons clip(const Polygons& polygons, real32 nearZ) const;
   MappedPolygons clip(const MappedPolygons& polygons, real32 nearZ) const;
 };
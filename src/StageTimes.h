@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <string.h>
+#include <jpb/Types.h>
+
+// Parts of the triangle pipeline that SoftRenderer can time
+enum RENDER_STAGE {
+  // Vertices to camera space and polygons to the screen
+  RS_TRANSFORM,
+  // Backface test and near plane clipping
+  RS_CLIP,
+  // Per polygon state, span loop lookup and sampler
+  RS_SETUP,
+  // Edges walked into spans
+  RS_RASTER,
+  // Span loops, depth test, shading and writes
+  RS_SHADE,
+  RS_COUNT
+};
+
+// Nanoseconds spent per stage, summed until cleared. Reading the clock a few times per
+// polygon costs something, scenes with many tiny triangles run slower while timed.
+struct StageTimes {
+  uint64 ticks[RS_COUNT];
+
+  StageTimes() { clear(); }
+  void clear() { memset(ticks, 0, sizeof(ticks)); }
+
+  static uint64 now()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  static const char* getName(RENDER_STAGE stage)
+  {
+    static const char* names[RS_COUNT] = { "transform", "clip", "setup", "raster", "shade" };
+    return names[stage];
+  }
+};
@@ -0,0 +1,219 @@
+#include "TextureSampler.h"
+
+static inline __m128
+floor4(__m128 value)
+{
+  __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(value));
+  __m128 correction = _mm_and_ps(_mm_cmpgt_ps(truncated, value), _mm_set1_ps(1.0f));
+  return _mm_sub_ps(truncated, correction);
+}
+
+// a * (256 - weight) + b * weight, weights are in 0..256 range
+static inline __m128i
+lerp16(__m128i a, __m128i b, __m128i weight)
+{
+  __m128i inverseWeight = _mm_sub_epi16(_mm_set1_epi16(256), weight);
+  return _mm_add_epi16(_mm_mullo_epi16(a, inverseWeight), _mm_mullo_epi16(b, weight));
+}
+
+__m128i
+TextureSampler::wrapTexel(__m128 texel, real32 dimension) const
+{
+  __m128 size = _mm_set1_ps(dimension);
+  __m128 maxTexel = _mm_set1_ps(dimension - 1.0f);
+  __m128 result;
+
+  switch(wrapMode)
+  {
+  case WM_CLAMP:
+    {
+      result = _mm_min_ps(_mm_max_ps(texel, _mm_setzero_ps()), maxTexel);
+    } break;
+  case WM_MIRROR:
+    {
+      // Period of mirrored texture is twice its size
+      __m128 period = _mm_add_ps(size, size);
+      __m128 position = _mm_sub_ps(texel, _mm_mul_ps(period, floor4(_mm_div_ps(texel, period))));
+      __m128 mirrored = _mm_sub_ps(_mm_sub_ps(period, _mm_set1_ps(1.0f)), position);
+      __m128 isMirrored = _mm_cmpge_ps(position, size);
+
+      result = _mm_or_ps(_mm_and_ps(isMirrored, mirrored), _mm_andnot_ps(isMirrored, position));
+    } break;
+  case WM_REPEAT:
+  default:
+    {
+      result = _mm_sub_ps(texel, _mm_mul_ps(size, floor4(_mm_div_ps(texel, size))));
+    } break;
+  }
+
+  // Guarding against rounding at the upper edge
+  result = _mm_min_ps(_mm_max_ps(result, _mm_setzero_ps()), maxTexel);
+  return _mm_cvttps_epi32(result);
+}
+
+__m128i
+TextureSampler::fetch4(__m128i x, __m128i y) const
+{
+  // SSE2 has no 32 bit multiply, indices are small enough to go through floats exactly.
+  __m128 width = _mm_set1_ps((real32)texture->dimensions.x);
+  __m128 index = _mm_add_ps(_mm_cvtepi32_ps(x), _mm_mul_ps(_mm_cvtepi32_ps(y), width));
+
+  int32 indices[4];
+  _mm_storeu_si128((__m128i*)indices, _mm_cvttps_epi32(index));
+
+  const int32* texels = (const int32*)texture->pixelData;
+  return _mm_set_epi32(texels[indices[3]], texels[indices[2]], texels[indices[1]], texels[indices[0]]);
+}
+
+__m128i
+TextureSampler::sampleNearest4(__m128 u, __m128 v) const
+{
+  real32 width = (real32)texture->dimensions.x;
+  real32 height = (real32)texture->dimensions.y;
+
+  __m128i x = wrapTexel(floor4(_mm_mul_ps(u, _mm_set1_ps(width))), width);
+  __m128i y = wrapTexel(floor4(_mm_mul_ps(v, _mm_set1_ps(height))), height);
+
+  return fetch4(x, y);
+}
+
+void
+TextureSampler::sampleBilinear4(__m128 u, __m128 v, __m128i* lo, __m128i* hi) const
+{
+  real32 width = (real32)texture->dimensions.x;
+  real32 height = (real32)texture->dimensions.y;
+
+  // Texel centers are at half coordinates
+  __m128 half = _mm_set1_ps(0.5f);
+  __m128 s = _mm_sub_ps(_mm_mul_ps(u, _mm_set1_ps(width)), half);
+  __m128 t = _mm_sub_ps(_mm_mul_ps(v, _mm_set1_ps(height)), half);
+
+  __m128 s0 = floor4(s);
+  __m128 t0 = floor4(t);
+
+  __m128 weightScale = _mm_set1_ps(256.0f);
+  __m128i weightX = _mm_cvtps_epi32(_mm_mul_ps(_mm_sub_ps(s, s0), weightScale));
+  __m128i weightY = _mm_cvtps_epi32(_mm_mul_ps(_mm_sub_ps(t, t0), weightScale));
+
+  __m128 one = _mm_set1_ps(1.0f);
+  __m128i x0 = wrapTexel(s0, width);
+  __m128i x1 = wrapTexel(_mm_add_ps(s0, one), width);
+  __m128i y0 = wrapTexel(t0, height);
+  __m128i y1 = wrapTexel(_mm_add_ps(t0, one), height);
+
+  __m128i topLeft = fetch4(x0, y0);
+  __m128i topRight = fetch4(x1, y0);
+  __m128i bottomLeft = fetch4(x0, y1);
+  __m128i bottomRight = fetch4(x1, y1);
+
+  __m128i weightXLo, weightXHi, weightYLo, weightYHi;
+  spreadLanes(weightX, &weightXLo, &weightXHi);
+  spreadLanes(weightY, &weightYLo, &weightYHi);
+
+  __m128i topLeftLo, topLeftHi, topRightLo, topRightHi;
+  __m128i bottomLeftLo, bottomLeftHi, bottomRightLo, bottomRightHi;
+  unpackColors(topLeft, &topLeftLo, &topLeftHi);
+  unpackColors(topRight, &topRightLo, &topRightHi);
+  unpackColors(bottomLeft, &bottomLeftLo, &bottomLeftHi);
+  unpackColors(bottomRight, &bottomRightLo, &bottomRightHi);
+
+  // Horizontal pass drops the fraction, vertical pass keeps it as 8.8
+  __m128i topLo = _mm_srli_epi16(lerp16(topLeftLo, topRightLo, weightXLo), 8);
+  __m128i topHi = _mm_srli_epi16(lerp16(topLeftHi, topRightHi, weightXHi), 8);
+  __m128i bottomLo = _mm_srli_epi16(lerp16(bottomLeftLo, bottomRightLo, weightXLo), 8);
+  __m128i bottomHi = _mm_srli_epi16(lerp16(bottomLeftHi, bottomRightHi, weightXHi), 8);
+
+  *lo = lerp16(topLo, bottomLo, weightYLo);
+  *hi = lerp16(topHi, bottomHi, weightYHi);
+}
+
+__m128i
+TextureSampler::sample4(__m128 u, __m128 v) const
+{
+  if(filterMode == FM_BILINEAR)
+  {
+    __m128i lo, hi;
+    sampleBilinear4(u, v, &lo, &hi);
+    return packColors(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+  }
+
+  return sampleNearest4(u, v);
+}
+
+void
+TextureSampler::sample4Wide(__m128 u, __m128 v, __m128i* lo, __m128i* hi) const
+{
+  if(filterMode == FM_BILINEAR)
+  {
+    sampleBilinear4(u, v, lo, hi);
+  }
+  else
+  {
+    unpackColors(sampleNearest4(u, v), lo, hi);
+    *lo = _mm_slli_epi16(*lo, 8);
+    *hi = _mm_slli_epi16(*hi, 8);
+  }
+}
+
+#if defined(__AVX2__)
+
+__m256i
+TextureSampler::sample8(__m256 u, __m256 v) const
+{
+  if(filterMode == FM_BILINEAR || wrapMode != WM_REPEAT)
+  {
+    __m128i first = sample4(_mm256_castps256_ps128(u), _mm256_castps256_ps128(v));
+    __m128i second = sample4(_mm256_extractf128_ps(u, 1), _mm256_extractf128_ps(v, 1));
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(first), second, 1);
+  }
+
+  // Repeating nearest fetch is the common case, it goes fully through gathers.
+  __m256 width = _mm256_set1_ps((real32)texture->dimensions.x);
+  __m256 height = _mm256_set1_ps((real32)texture->dimensions.y);
+
+  __m256 x = _mm256_floor_ps(_mm256_mul_ps(u, width));
+  __m256 y = _mm256_floor_ps(_mm256_mul_ps(v, height));
+
+  x = _mm256_sub_ps(x, _mm256_mul_ps(width, _mm256_floor_ps(_mm256_div_ps(x, width))));
+  y = _mm256_sub_ps(y, _mm256_mul_ps(height, _mm256_floor_ps(_mm256_div_ps(y, height))));
+
+  x = _mm256_min_ps(_mm256_max_ps(x, _mm256_setzero_ps()), _mm256_sub_ps(width, _mm256_set1_ps(1.0f)));
+  y = _mm256_min_ps(_mm256_max_ps(y, _mm256_setzero_ps()), _mm256_sub_ps(height, _mm256_set1_ps(1.0f)));
+
+  __m256i index = _mm256_cvttps_epi32(_mm256_add_ps(x, _mm256_mul_ps(y, width)));
+  return _mm256_i32gather_epi32((const int*)texture->pixelData, index, 4);
+}
+
+#endif
+
+uint32
+TextureSampler::sample(real32 u, real32 v) const
+{
+  __m128i result = sample4(_mm_set1_ps(u), _mm_set1_ps(v));
+  return (uint32)_mm_cvtsi128_si32(result);
+}
+
+void
+TextureSampler::sample(const real32* u, const real32* v, uint32* result, uint32 count) const
+{
+  uint32 i = 0;
+
+#if defined(__AVX2__)
+  for(; i + 8 <= count; i += 8)
+  {
+    __m256i texels = sample8(_mm256_loadu_ps(u + i), _mm256_loadu_ps(v + i));
+    _mm256_storeu_si256((__m256i*)(result + i), texels);
+  }
+#endif
+
+  for(; i + 4 <= count; i += 4)
+  {
+    __m128i texels = sample4(_mm_loadu_ps(u + i), _mm_loadu_ps(v + i));
+    _mm_storeu_si128((__m128i*)(result + i), texels);
+  }
+
+  for(; i < count; i++)
+  {
+    result[i] = sample(u[i], v[i]);
+  }
+}
@@ -0,0 +1,195 @@
+#include "Transform.h"
+#include <math.h>
+#include <algorithm>
+
+#include "Camera.h"
+
+Quaternion
+Quaternion::operator*(const Quaternion& q) const
+{
+  Quaternion result;
+  result.x = w * q.x + x * q.w + y * q.z - z * q.y;
+  result.y = w * q.y - x * q.z + y * q.w + z * q.x;
+  result.z = w * q.z + x * q.y - y * q.x + z * q.w;
+  result.w = w * q.w - x * q.x - y * q.y - z * q.z;
+  return result;
+}
+
+Vec3f
+Quaternion::rotate(const Vec3f& vector) const
+{
+  // v + 2w(u x v) + 2u x (u x v) with u the imaginary part
+  Vec3f u(x, y, z);
+  Vec3f t = Vec3f::cross(u, vector) * 2.0f;
+  return vector + t * w + Vec3f::cross(u, t);
+}
+
+Quaternion
+Quaternion::fromAxisAngle(const Vec3f& axis, real32 angle)
+{
+  real32 halfAngle = angle * (real32)M_PI / 360.0f;
+  Vec3f u = Vec3f::normalize(axis) * sinf(halfAngle);
+
+  Quaternion result;
+  result.x = u.x;
+  result.y = u.y;
+  result.z = u.z;
+  result.w = cosf(halfAngle);
+  return result;
+}
+
+Quaternion
+Quaternion::fromAngles(const Vec3f& angles)
+{
+  // Vec3f::rotateAroundY turns the other way than the other two
+  return fromAxisAngle(Vec3f(0, 0, 1.0f), angles.z) * fromAxisAngle(Vec3f(1.0f, 0, 0), angles.x) *
+    fromAxisAngle(Vec3f(0, -1.0f, 0), angles.y);
+}
+
+Quaternion
+Quaternion::normalize(const Quaternion& quaternion)
+{
+  real32 length = sqrtf(quaternion.x * quaternion.x + quaternion.y * quaternion.y +
+			quaternion.z * quaternion.z + quaternion.w * quaternion.w);
+  if(length <= 0) return Quaternion();
+
+  Quaternion result;
+  result.x = quaternion.x / length;
+  result.y = quaternion.y / length;
+  result.z = quaternion.z / length;
+  result.w = quaternion.w / length;
+  return result;
+}
+
+// Matrix whose columns are the given images of the x, y and z axes
+static Transform3D
+fromAxes(const Vec3f& x, const Vec3f& y, const Vec3f& z)
+{
+  Transform3D result;
+  result.rows[0] = Vec3f(x.x, y.x, z.x);
+  result.rows[1] = Vec3f(x.y, y.y, z.y);
+  result.rows[2] = Vec3f(x.z, y.z, z.z);
+  return result;
+}
+
+Transform3D
+Transform3D::operator*(const Transform3D& transform) const
+{
+  Transform3D result;
+  for(int32 i = 0; i < 3; i++)
+  {
+    const Vec3f& row = rows[i];
+    result.rows[i] = transform.rows[0] * row.x + transform.rows[1] * row.y + transform.rows[2] * row.z;
+  }
+  result.translation = transformPoint(transform.translation);
+  return result;
+}
+
+Transform3D
+Transform3D::getNormalTransform() const
+{
+  // Cofactors, the inverse transpose times the determinant. They get flipped for mirroring
+  // transforms, normals would point inside otherwise.
+  Transform3D result;
+  result.rows[0] = Vec3f::cross(rows[1], rows[2]);
+  result.rows[1] = Vec3f::cross(rows[2], rows[0]);
+  result.rows[2] = Vec3f::cross(rows[0], rows[1]);
+  if(Vec3f::dotProduct(rows[0], result.rows[0]) < 0)
+  {
+    for(int32 i = 0; i < 3; i++) result.rows[i] *= -1.0f;
+  }
+  return result;
+}
+
+Transform3D
+Transform3D::getInverse() const
+{
+  // Columns of the inverse are the cofactor rows over the determinant
+  Vec3f cofactors[3] = { Vec3f::cross(rows[1], rows[2]), Vec3f::cross(rows[2], rows[0]), Vec3f::cross(rows[0], rows[1]) };
+  real32 inverseDeterminant = 1.0f / Vec3f::dotProduct(rows[0], cofactors[0]);
+
+  Transform3D result = fromAxes(cofactors[0] * inverseDeterminant, cofactors[1] * inverseDeterminant,
+				cofactors[2] * inverseDeterminant);
+  result.translation = -result.transformDirection(translation);
+  return result;
+}
+
+real32
+Transform3D::getMaxScale() const
+{
+  // Longest column, exact for rotations with any scale along the axes
+  Vec3f x(rows[0].x, rows[1].x, rows[2].x);
+  Vec3f y(rows[0].y, rows[1].y, rows[2].y);
+  Vec3f z(rows[0].z, rows[1].z, rows[2].z);
+  return std::max(x.getLength(), std::max(y.getLength(), z.getLength()));
+}
+
+Transform3D
+Transform3D::translate(const Vec3f& offset)
+{
+  Transform3D result;
+  result.translation = offset;
+  return result;
+}
+
+Transform3D
+Transform3D::scale(const Vec3f& factors)
+{
+  return fromAxes(Vec3f(factors.x, 0, 0), Vec3f(0, factors.y, 0), Vec3f(0, 0, factors.z));
+}
+
+Transform3D
+Transform3D::rotate(const Vec3f& angles)
+{
+  Vec3f radAngles = angles.degToRad();
+  Vec3f axes[3] = { Vec3f(1.0f, 0, 0), Vec3f(0, 1.0f, 0), Vec3f(0, 0, 1.0f) };
+  for(int32 i = 0; i < 3; i++)
+  {
+    axes[i].rotateAroundY(radAngles.y);
+    axes[i].rotateAroundX(radAngles.x);
+    axes[i].rotateAroundZ(radAngles.z);
+  }
+  return fromAxes(axes[0], axes[1], axes[2]);
+}
+
+Transform3D
+Transform3D::fromCamera(const Camera* camera)
+{
+  Vertices points = { Vec3f(), Vec3f(1.0f, 0, 0), Vec3f(0, 1.0f, 0), Vec3f(0, 0, 1.0f) };
+  camera->castVertices(points);
+
+  Transform3D result = fromAxes(points[1] - points[0], points[2] - points[0], points[3] - points[0]);
+  result.translation = points[0];
+  return result;
+}
+
+Transform3D
+Transform3D::fromParts(const Vec3f& translation, const Quaternion& rotation, const Vec3f& scale)
+{
+  Transform3D result = fromAxes(rotation.rotate(Vec3f(scale.x, 0, 0)), rotation.rotate(Vec3f(0, scale.y, 0)),
+				rotation.rotate(Vec3f(0, 0, scale.z)));
+  result.translation = translation;
+  return result;
+}
+
+BoundingBox
+BoundingBox::transformed(const Transform3D& transform) const
+{
+  if(isEmpty()) return *this;
+
+  // Center moves along, half sizes grow by the absolute values of the matrix
+  Vec3f center = transform.transformPoint(getCenter());
+  Vec3f halfSize = getSize() * 0.5f;
+  Vec3f extent;
+  real32* extents = &extent.x;
+  for(int32 i = 0; i < 3; i++)
+  {
+    const Vec3f& row = transform.rows[i];
+    extents[i] = fabsf(row.x) * halfSize.x + fabsf(row.y) * halfSize.y + fabsf(row.z) * halfSize.z;
+  }
+
+  BoundingBox result;
+  result.minimum = center - extent;
+  result.maximum = center + extent;
+  return result;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include <float.h>
+#include <algorithm>
+#include <jpb/Vector.h>
+
+class Camera;
+
+// Unit quaternion for rotations, w is the real part. a * b rotates by b first.
+struct Quaternion {
+  real32 x = 0;
+  real32 y = 0;
+  real32 z = 0;
+  real32 w = 1.0f;
+
+  Quaternion operator*(const Quaternion& quaternion) const;
+  Vec3f rotate(const Vec3f& vector) const;
+
+  // Degrees, counterclockwise looking down the axis like Vec3f::rotateAroundX and Z
+  static Quaternion fromAxisAngle(const Vec3f& axis, real32 angle);
+  // Degrees, the same rotation as Transform3D::rotate
+  static Quaternion fromAngles(const Vec3f& angles);
+  static Quaternion normalize(const Quaternion& quaternion);
+};
+
+// Affine transform of points, rows of the linear part and a translation added after it.
+// a * b is the transform that applies b first.
+struct Transform3D {
+  Vec3f rows[3] = { Vec3f(1.0f, 0, 0), Vec3f(0, 1.0f, 0), Vec3f(0, 0, 1.0f) };
+  Vec3f translation;
+
+  Vec3f transformPoint(const Vec3f& point) const { return transformDirection(point) + translation; }
+  Vec3f transformDirection(const Vec3f& direction) const
+  {
+    return Vec3f(Vec3f::dotProduct(rows[0], direction), Vec3f::dotProduct(rows[1], direction),
+		 Vec3f::dotProduct(rows[2], direction));
+  }
+
+  Transform3D operator*(const Transform3D& transform) const;
+
+  // Linear part normals are moved with, the inverse transpose up to a factor. Normals moved
+  // with it have to be normalized again.
+  Transform3D getNormalTransform() const;
+  // Undoes the transform, it must not flatten space
+  Transform3D getInverse() const;
+  // Largest factor a length grows by, scales bounding spheres
+  real32 getMaxScale() const;
+
+  static Transform3D translate(const Vec3f& offset);
+  static Transform3D scale(const Vec3f& factors);
+  // Degrees, around y, then x, then z like MeshHelper::rotateVertices
+  static Transform3D rotate(const Vec3f& angles);
+  // From world to camera space, taken from the camera as it is now
+  static Transform3D fromCamera(const Camera* camera);
+  // Scales, then rotates, then translates
+  static Transform3D fromParts(const Vec3f& translation, const Quaternion& rotation, const Vec3f& scale);
+};
+
+typedef std::vector<Transform3D> Transforms3D;
+
+// Axis aligned box, empty as long as nothing was added
+struct BoundingBox {
+  Vec3f minimum = Vec3f(FLT_MAX, FLT_MAX, FLT_MAX);
+  Vec3f maximum = Vec3f(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+  bool isEmpty() const { return minimum.x > maximum.x; }
+  Vec3f getCenter() const { return (minimum + maximum) * 0.5f; }
+  Vec3f getSize() const { return maximum - minimum; }
+
+  // Inline, building bounding volume hierarchies calls these for every object on every level
+  void add(const Vec3f& point)
+  {
+    minimum = Vec3f(std::min(minimum.x, point.x), std::min(minimum.y, point.y), std::min(minimum.z, point.z));
+    maximum = Vec3f(std::max(maximum.x, point.x), std::max(maximum.y, point.y), std::max(maximum.z, point.z));
+  }
+  void add(const BoundingBox& box)
+  {
+    if(box.isEmpty()) return;
+    add(box.minimum);
+    add(box.maximum);
+  }
+  // Smallest box around the transformed corners
+  BoundingBox transformed(const Transform3D& transform) const;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <jpb/Types.h>
+
+// Hands the newest item from one producer thread to one consumer thread without locks.
+// Producer and consumer each own a slot, the third one sits in between. Publishing swaps
+// the producer slot with the middle one, acquiring swaps the middle one with the consumer
+// slot if it holds something newer. Neither side ever waits, a producer that is faster than
+// the consumer just overwrites the middle slot, so the consumer always gets the latest item.
+template <typename T>
+class TripleBuffer {
+public:
+  TripleBuffer() : middleIndex(1) {}
+
+  T* getSlots() { return slots; }
+  static uint32 getSlotCount() { return 3; }
+
+  // Producer side, the slot to fill next
+  T& getWriteSlot() { return slots[writeIndex]; }
+  void publish();
+
+  // Consumer side, true when a newer slot was swapped in. The read slot stays valid until
+  // the next acquire.
+  bool acquire();
+  T& getReadSlot() { return slots[readIndex]; }
+private:
+  static const uint32 NEW_BIT = 4;
+  static const uint32 INDEX_MASK = 3;
+
+  T slots[3];
+  uint32 writeIndex = 0;
+  uint32 readIndex = 2;
+  // Index of the middle slot, NEW_BIT set while the consumer hasn't taken it
+  std::atomic<uint32> middleIndex;
+};
+
+template <typename T>
+void
+TripleBuffer<T>::publish()
+{
+  // Release makes the slot contents visible with the index, acquire gets back the slot the
+  // consumer may have given up
+  uint32 previous = middleIndex.exchange(writeIndex | NEW_BIT, std::memory_order_acq_rel);
+  writeIndex = previous & INDEX_MASK;
+}
+
+template <typename T>
+bool
+TripleBuffer<T>::acquire()
+{
+  if(!(middleIndex.load(std::memory_order_relaxed) & NEW_BIT)) return false;
+
+  uint32 previous = middleIndex.exchange(readIndex, std::memory_order_acq_rel);
+  readIndex = previous & INDEX_MASK;
+  return true;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <jpb/Types.h>
+
+// One deque per worker. Workers take from the front of their own deque and steal from the
+// back of the others once it runs dry, so long and short jobs even out without every
+// worker fighting over one queue. Own jobs come out in the order they were pushed. Jobs can
+// be pushed while the workers run, pop blocks until a job shows up or the queue gets closed.
+template <typename T>
+class WorkStealingQueue {
+public:
+  WorkStealingQueue(uint32 workerCount);
+
+  uint32 getWorkerCount() const { return (uint32)deques.size(); }
+
+  // Goes to the deque of given worker, round robin pushing keeps them balanced.
+  void push(uint32 workerIndex, T&& job);
+  // No more pushes, workers drain what is left and then pop returns false.
+  void close();
+
+  bool pop(uint32 workerIndex, T* job);
+private:
+  struct Deque {
+    std::mutex mutex;
+    std::deque<T> jobs;
+  };
+
+  std::vector<std::unique_ptr<Deque>> deques;
+
+  std::mutex waitMutex;
+  std::condition_variable jobAvailable;
+  std::atomic<uint32> pendingJobs;
+  bool closed = false;
+
+  bool tryPop(uint32 workerIndex, T* job);
+};
+
+template <typename T>
+WorkStealingQueue<T>::WorkStealingQueue(uint32 workerCount)
+{
+  pendingJobs = 0;
+  for(uint32 i = 0; i < workerCount; i++)
+  {
+    deques.push_back(std::unique_ptr<Deque>(new Deque()));
+  }
+}
+
+template <typename T>
+void
+WorkStealingQueue<T>::push(uint32 workerIndex, T&& job)
+{
+  {
+    // Counted before the job is visible so the count never drops below zero, under the
+    // wait mutex so that a worker about to sleep can't miss it
+    std::lock_guard<std::mutex> lock(waitMutex);
+    pendingJobs++;
+  }
+
+  Deque& deque = *deques[workerIndex % deques.size()];
+  {
+    std::lock_guard<std::mutex> lock(deque.mutex);
+    deque.jobs.push_back(std::move(job));
+  }
+  jobAvailable.notify_one();
+}
+
+template <typename T>
+void
+WorkStealingQueue<T>::close()
+{
+  {
+    std::lock_guard<std::mutex> lock(waitMutex);
+    closed = true;
+  }
+  jobAvailable.notify_all();
+}
+
+template <typename T>
+bool
+WorkStealingQueue<T>::pop(uint32 workerIndex, T* job)
+{
+  for(;;)
+  {
+    if(tryPop(workerIndex, job)) return true;
+
+    std::unique_lock<std::mutex> lock(waitMutex);
+    jobAvailable.wait(lock, [this]{ return pendingJobs > 0 || closed; });
+    if(pendingJobs == 0 && closed) return false;
+  }
+}
+
+template <typename T>
+bool
+WorkStealingQueue<T>::tryPop(uint32 workerIndex, T* job)
+{
+  uint32 dequeCount = (uint32)deques.size();
+
+  for(uint32 i = 0; i < dequeCount; i++)
+  {
+    Deque& deque = *deques[(workerIndex + i) % dequeCount];
+    std::lock_guard<std::mutex> lock(deque.mutex);
+    if(deque.jobs.empty()) continue;
+
+    // Own jobs from the front, stolen ones from the other end
+    if(i == 0)
+    {
+      *job = std::move(deque.jobs.front());
+      deque.jobs.pop_front();
+    }
+    else
+    {
+      *job = std::move(deque.jobs.back());
+      deque.jobs.pop_back();
+    }
+
+    pendingJobs--;
+    return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,100 @@
+#include "WorkerPool.h"
+#include "Platform.h"
+#include <jpb/Profiler.h>
+
+WorkerPool::WorkerPool(uint32 threadCount)
+{
+  if(threadCount == 0)
+  {
+    threadCount = Platform::getCoreCount();
+  }
+
+  nextJobIndex = 0;
+
+  // Calling thread counts as one of them
+  for(uint32 i = 1; i < threadCount; i++)
+  {
+    threads.push_back(std::thread(&WorkerPool::workerLoop, this));
+  }
+}
+
+WorkerPool::~WorkerPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  workAvailable.notify_all();
+
+  for(auto it = threads.begin(); it != threads.end(); it++)
+  {
+    it->join();
+  }
+}
+
+void
+WorkerPool::parallelFor(uint32 jobCount, const JobFunction& job)
+{
+  if(jobCount == 0) return;
+
+  if(threads.empty() || jobCount == 1)
+  {
+    for(uint32 i = 0; i < jobCount; i++) job(i);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    currentJob = &job;
+    this->jobCount = jobCount;
+    nextJobIndex = 0;
+    busyThreads = (uint32)threads.size();
+    generation++;
+  }
+  workAvailable.notify_all();
+
+  runJobs();
+
+  std::unique_lock<std::mutex> lock(mutex);
+  workFinished.wait(lock, [this]{ return busyThreads == 0; });
+  currentJob = NULL;
+}
+
+void
+WorkerPool::runJobs()
+{
+  for(;;)
+  {
+    uint32 jobIndex = nextJobIndex++;
+    if(jobIndex >= jobCount) break;
+
+    PROFILE_ZONE("WorkerPool job");
+    (*currentJob)(jobIndex);
+  }
+}
+
+void
+WorkerPool::workerLoop()
+{
+  uint64 lastGeneration = 0;
+  Trace::setThreadName("Worker");
+
+  for(;;)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      workAvailable.wait(lock, [&]{ return quit || generation != lastGeneration; });
+
+      if(quit) return;
+      lastGeneration = generation;
+    }
+
+    runJobs();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      busyThreads--;
+    }
+    workFinished.notify_one();
+  }
+}
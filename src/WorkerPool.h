@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+#include <jpb/Types.h>
+
+typedef std::function<void(uint32 jobIndex)> JobFunction;
+
+// Fixed set of threads that split indexed jobs between themselves, the thread
+// calling parallelFor works on the jobs as well.
+class WorkerPool {
+public:
+  // Zero means one thread per hardware core.
+  WorkerPool(uint32 threadCount = 0);
+  ~WorkerPool();
+
+  // Worker threads plus the calling thread.
+  uint32 getThreadCount() const { return (uint32)threads.size() + 1; }
+
+  // Blocks until all the jobs are finished.
+  void parallelFor(uint32 jobCount, const JobFunction& job);
+private:
+  std::vector<std::thread> threads;
+
+  std::mutex mutex;
+  std::condition_variable workAvailable;
+  std::condition_variable workFinished;
+
+  const JobFunction* currentJob = NULL;
+  uint32 jobCount = 0;
+  std::atomic<uint32> nextJobIndex;
+
+  uint64 generation = 0;
+  uint32 busyThreads = 0;
+  bool quit = false;
+
+  void workerLoop();
+  void runJobs();
+};
@@ -0,0 +1,89 @@
+// Renders frames listed in a manifest, one job per line:
+//
+//   output widthxheight x y z rotX rotY mesh[=texture] ...
+//
+//   batch [-t threads] [manifest]
+//
+// Without a manifest (or with -) jobs are read from stdin while the earlier ones render.
+// Every finished frame prints "index status ms output" as soon as it's written.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "BatchRenderer.h"
+#include "Platform.h"
+
+int main(int argc, char* argv[])
+{
+  uint32 threadCount = 0;
+  const char* manifestPath = NULL;
+
+  for(int i = 1; i < argc; i++)
+  {
+    if(!strcmp(argv[i], "-t") && i + 1 < argc) threadCount = atoi(argv[++i]);
+    else if(!manifestPath) manifestPath = argv[i];
+    else
+    {
+      fprintf(stderr, "usage: %s [-t threads] [manifest]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  std::ifstream manifestFile;
+  bool fromStdin = !manifestPath || !strcmp(manifestPath, "-");
+  if(!fromStdin)
+  {
+    manifestFile.open(manifestPath);
+    if(!manifestFile)
+    {
+      fprintf(stderr, "could not open %s\n", manifestPath);
+      return 1;
+    }
+  }
+  std::istream& manifest = fromStdin ? std::cin : manifestFile;
+
+  AssetCache assets;
+  BatchRenderer batchRenderer(&assets, threadCount);
+
+  uint32 failedCount = 0;
+  batchRenderer.setResultFunction([&](const BatchResult& result)
+  {
+    if(!result.succeeded) failedCount++;
+    printf("%u %s %.3f %s\n", result.index, result.succeeded ? "ok" : "failed", result.frameMs,
+	   result.outputPath->c_str());
+    fflush(stdout);
+  });
+
+  uint64 start = Platform::getTicks();
+
+  uint32 jobCount = 0;
+  std::string line;
+  for(uint32 lineNumber = 1; std::getline(manifest, line); lineNumber++)
+  {
+    size_t first = line.find_first_not_of(" \t\r");
+    if(first == std::string::npos || line[first] == '#') continue;
+
+    BatchJob job;
+    if(!BatchJob::parse(line, &job))
+    {
+      fprintf(stderr, "line %u: malformed job\n", lineNumber);
+      continue;
+    }
+
+    job.index = jobCount++;
+    batchRenderer.submit(std::move(job));
+  }
+
+  batchRenderer.finish();
+
+  real64 seconds = Platform::ticksToMs(Platform::getTicks() - start) * 0.001;
+  fprintf(stderr, "%u frames in %.3f s, %.1f fps, %u threads, %u meshes, %u textures, %u failed\n",
+	  jobCount, seconds, jobCount / seconds, batchRenderer.getThreadCount(),
+	  assets.getMeshCount(), assets.getTextureCount(), failedCount);
+
+  return failedCount ? 1 : 0;
+}
@@ -0,0 +1,702 @@
+// Renders fixed scenes along scripted camera paths and writes frame and stage timings as JSON.
+//
+//   bench [-n frames] [-w warmup] [-s widthxheight] [-t threads] [-seed n] [-scene name]
+//         [-nostages] [-o results.json]
+//
+// Scenes are built from the seed, so two runs with the same options draw the same pixels.
+// Stage timers read the clock a few times per polygon, -nostages leaves them out when only
+// the total frame time matters.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <deque>
+#include <random>
+#include <algorithm>
+
+#include "OffscreenRenderer.h"
+#include "AssetCache.h"
+#include "SceneGraph.h"
+#include "MeshLod.h"
+#include "Platform.h"
+
+struct Options {
+  int32 frameCount = 60;
+  int32 warmupCount = 2;
+  Vec2i dimensions = Vec2i(1280, 720);
+  uint32 threadCount = 0;
+  uint32 seed = 1;
+  const char* sceneName = NULL;
+  bool stages = true;
+  const char* outputPath = NULL;
+};
+
+// Geometry lives in deques, items point into them and pushing doesn't move what's there
+struct BenchScene {
+  const char* name;
+  std::deque<MappedVertices> meshes;
+  std::deque<TriangleIndices> indexLists;
+  std::deque<TextureBuffer> textures;
+  std::deque<std::vector<uint32>> texturePixels;
+  std::deque<InstancedMesh> instancedMeshes;
+  std::deque<Transforms3D> transformLists;
+  Scene scene;
+  uint32 triangleCount = 0;
+  // Scenes built as a graph get their items culled through its bounding volume hierarchy every frame
+  SceneGraph sceneGraph;
+  bool culled = false;
+  // Scenes with levels of detail pick one for every copy each frame, each level is a batch.
+  // Meshes of the levels are in instancedMeshes from firstLodMesh on.
+  const LodChain* lodChain = NULL;
+  uint32 firstLodMesh = 0;
+  Material lodMaterial;
+  Transforms3D lodTransforms;
+  std::vector<uint32> lodLevels;
+  std::vector<Transforms3D> levelTransforms;
+
+  // Camera at t going from 0 to 1 over the run
+  void (*moveCamera)(FPSCamera* camera, real32 t);
+
+  void addItem(const MappedVertices& vertices, const TriangleIndices& triangleIndices, const Material& material)
+  {
+    meshes.push_back(vertices);
+    indexLists.push_back(triangleIndices);
+    MeshHelper::calculateNormals(meshes.back(), indexLists.back());
+    scene.items.push_back({ &meshes.back(), &indexLists.back(), material });
+    triangleCount += triangleIndices.size();
+  }
+
+  // Normals of the mesh have to be calculated already, transforms only move them
+  void addInstances(const MappedVertices& vertices, const TriangleIndices& triangleIndices,
+		    const Transforms3D& transforms, const Material& material)
+  {
+    instancedMeshes.push_back(InstancedMesh(vertices, triangleIndices));
+    transformLists.push_back(transforms);
+    scene.items.push_back(SceneItem::instances(&instancedMeshes.back(), transformLists.back().data(),
+					       transforms.size(), material));
+    triangleCount += triangleIndices.size() * transforms.size();
+  }
+};
+
+static bool
+parseOptions(int argc, char* argv[], Options* options)
+{
+  for(int i = 1; i < argc; i++)
+  {
+    bool hasValue = i + 1 < argc;
+
+    if(!strcmp(argv[i], "-n") && hasValue) options->frameCount = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-w") && hasValue) options->warmupCount = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-s") && hasValue)
+    {
+      if(sscanf(argv[++i], "%dx%d", &options->dimensions.x, &options->dimensions.y) != 2) return false;
+    }
+    else if(!strcmp(argv[i], "-t") && hasValue) options->threadCount = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-seed") && hasValue) options->seed = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-scene") && hasValue) options->sceneName = argv[++i];
+    else if(!strcmp(argv[i], "-nostages")) options->stages = false;
+    else if(!strcmp(argv[i], "-o") && hasValue) options->outputPath = argv[++i];
+    else return false;
+  }
+
+  return options->frameCount > 0 && options->warmupCount >= 0 &&
+    options->dimensions.x > 0 && options->dimensions.y > 0;
+}
+
+static const TextureBuffer*
+createChecker(BenchScene* benchScene, int32 size, int32 cellSize)
+{
+  benchScene->texturePixels.push_back(std::vector<uint32>(size * size));
+  std::vector<uint32>& pixels = benchScene->texturePixels.back();
+
+  TextureBuffer texture;
+  texture.pixelData = pixels.data();
+  texture.dimensions = Vec2i(size, size);
+  texture.pitch = size * sizeof(uint32);
+
+  for(int32 y = 0; y < size; y++)
+  {
+    for(int32 x = 0; x < size; x++)
+    {
+      bool dark = ((x / cellSize) + (y / cellSize)) & 1;
+      texture.setPixelPacked(x, y, dark ? packColor(60, 70, 90) : packColor(220, 200, 160));
+    }
+  }
+
+  benchScene->textures.push_back(texture);
+  return &benchScene->textures.back();
+}
+
+static MappedVertices
+transformMesh(const MappedVertices& vertices, real32 scale, const Vec3f& rotation, const Vec3f& position)
+{
+  MappedVertices result = vertices;
+  for(auto it = result.begin(); it != result.end(); it++) it->position = it->position * scale;
+  MeshHelper::rotateVertices(result, rotation);
+  MeshHelper::translateVertices(result, position);
+  return result;
+}
+
+// Looking down at the target from distance, the orbit goes once around it
+static void
+orbit(FPSCamera* camera, real32 t, real32 distance, real32 height, real32 pitch)
+{
+  real32 angle = 360.0f * t;
+  Vec3f position(0, height, -distance);
+  position.rotateAroundYDeg(-angle);
+  camera->setPosition(position);
+  camera->setRotation(pitch, angle);
+}
+
+static void
+moveCubeCamera(FPSCamera* camera, real32 t)
+{
+  orbit(camera, t, 2.5f, 1.2f, 30.0f);
+}
+
+static void
+moveInstancedCamera(FPSCamera* camera, real32 t)
+{
+  // Low flight over the field with a slow turn
+  camera->setPosition(Vec3f(sinf(t * 6.2832f) * 4.0f, 3.0f, -28.0f + 40.0f * t));
+  camera->setRotation(20.0f, sinf(t * 6.2832f) * 25.0f);
+}
+
+static void
+moveOutdoorCamera(FPSCamera* camera, real32 t)
+{
+  // Close to the ground looking far over the field, copies at every distance
+  camera->setPosition(Vec3f(sinf(t * 6.2832f) * 6.0f, 1.5f, -40.0f + 24.0f * t));
+  camera->setRotation(6.0f, sinf(t * 6.2832f) * 30.0f);
+}
+
+static void
+moveTerrainCamera(FPSCamera* camera, real32 t)
+{
+  orbit(camera, t, 9.0f, 5.0f, 30.0f);
+}
+
+static void
+moveOverdrawCamera(FPSCamera* camera, real32 t)
+{
+  camera->setPosition(Vec3f(sinf(t * 6.2832f) * 0.3f, cosf(t * 6.2832f) * 0.2f, -1.0f));
+  camera->setRotation(0, sinf(t * 6.2832f) * 5.0f);
+}
+
+static void
+moveFillCamera(FPSCamera* camera, real32 t)
+{
+  camera->setPosition(Vec3f(sinf(t * 6.2832f) * 0.5f, 0, -1.0f));
+  camera->setRotation(sinf(t * 12.566f) * 4.0f, sinf(t * 6.2832f) * 8.0f);
+}
+
+// Textured cube on a ground plane, the scene of the app and the headless tool
+static void
+buildCubeScene(BenchScene* benchScene, AssetCache* assets, std::mt19937* random)
+{
+  benchScene->moveCamera = moveCubeCamera;
+  const Mesh* cube = assets->getMesh("builtin:cube");
+  const Mesh* plane = assets->getMesh("builtin:plane");
+  Material material = { assets->getTexture("builtin:checker"), packColor(255, 255, 255, 255), PS_DEFAULT, NULL };
+
+  benchScene->addItem(transformMesh(plane->vertices, 1.5f, Vec3f(), Vec3f(0, -0.75f, 0)), plane->triangleIndices, material);
+  benchScene->addItem(transformMesh(cube->vertices, 0.8f, Vec3f(), Vec3f(0, -0.35f, 0)), cube->triangleIndices, material);
+
+  benchScene->scene.directionalLight = Vec3f(-0.5f, -1.0f, 0.3f);
+  benchScene->scene.lights.push_back(Light::point(Vec3f(0.8f, 0.3f, -0.8f), Vec3f(1.0f, 0.6f, 0.3f), 2.0f));
+}
+
+// 10k spots on a field with a random turn around y each
+static void
+scatterField(std::mt19937* random, std::vector<Vec3f>* positions, std::vector<Vec3f>* rotations)
+{
+  std::uniform_real_distribution<real32> jitter(-0.15f, 0.15f);
+  std::uniform_real_distribution<real32> angle(0, 360.0f);
+  for(int32 z = 0; z < 100; z++)
+  {
+    for(int32 x = 0; x < 100; x++)
+    {
+      // One random number per statement, argument order isn't fixed and the scene has to be
+      Vec3f position(-25.0f + x * 0.5f, 0, -25.0f + z * 0.5f);
+      position.x += jitter(*random);
+      position.y += jitter(*random);
+      position.z += jitter(*random);
+      positions->push_back(position);
+      rotations->push_back(Vec3f(0, angle(*random), 0));
+    }
+  }
+}
+
+// 10k small cubes scattered over a field, one instanced draw of few triangles per copy
+static void
+buildInstancedScene(BenchScene* benchScene, AssetCache* assets, std::mt19937* random)
+{
+  benchScene->moveCamera = moveInstancedCamera;
+  const Mesh* cube = assets->getMesh("builtin:cube");
+  Material material = { assets->getTexture("builtin:checker"), packColor(255, 255, 255, 255), PS_DEFAULT, NULL };
+
+  std::vector<Vec3f> positions, rotations;
+  scatterField(random, &positions, &rotations);
+  Transforms3D transforms;
+  for(uint32 i = 0; i < positions.size(); i++)
+  {
+    transforms.push_back(Transform3D::translate(positions[i]) * Transform3D::rotate(rotations[i]) *
+			 Transform3D::scale(Vec3f(0.25f, 0.25f, 0.25f)));
+  }
+  benchScene->addInstances(cube->vertices, cube->triangleIndices, transforms, material);
+
+  benchScene->scene.directionalLight = Vec3f(-0.5f, -1.0f, 0.3f);
+}
+
+// Same field as instanced, a scene graph node per cube. Only the cubes in the frustum get
+// submitted, the camera sees a small part of the field at a time.
+static void
+buildCulledScene(BenchScene* benchScene, AssetCache* assets, std::mt19937* random)
+{
+  benchScene->moveCamera = moveInstancedCamera;
+  benchScene->culled = true;
+  const Mesh* cube = assets->getMesh("builtin:cube");
+  Material material = { assets->getTexture("builtin:checker"), packColor(255, 255, 255, 255), PS_DEFAULT, NULL };
+  benchScene->instancedMeshes.push_back(InstancedMesh(cube->vertices, cube->triangleIndices));
+
+  std::vector<Vec3f> positions, rotations;
+  scatterField(random, &positions, &rotations);
+  SceneGraph& sceneGraph = benchScene->sceneGraph;
+  for(uint32 i = 0; i < positions.size(); i++)
+  {
+    uint32 node = sceneGraph.createNode();
+    sceneGraph.setTranslation(node, positions[i]);
+    sceneGraph.setRotation(node, Quaternion::fromAngles(rotations[i]));
+    sceneGraph.setScale(node, Vec3f(0.25f, 0.25f, 0.25f));
+    sceneGraph.setMesh(node, &benchScene->instancedMeshes.back(), material);
+  }
+  sceneGraph.update();
+  benchScene->triangleCount = cube->triangleIndices.size() * positions.size();
+
+  benchScene->scene.directionalLight = Vec3f(-0.5f, -1.0f, 0.3f);
+}
+
+// 32x32 spheres spread far over a field, about a million triangles at full detail
+static Transforms3D
+scatterSpheres(std::mt19937* random)
+{
+  std::uniform_real_distribution<real32> jitter(-0.6f, 0.6f);
+  std::uniform_real_distribution<real32> size(0.6f, 1.4f);
+  Transforms3D transforms;
+  for(int32 z = 0; z < 32; z++)
+  {
+    for(int32 x = 0; x < 32; x++)
+    {
+      Vec3f position(-32.0f + x * 2.0f, 0, -32.0f + z * 2.0f);
+      position.x += jitter(*random);
+      position.z += jitter(*random);
+      real32 scale = size(*random);
+      transforms.push_back(Transform3D::translate(position) * Transform3D::scale(Vec3f(scale, scale, scale)));
+    }
+  }
+  return transforms;
+}
+
+static void
+buildSpheresScene(BenchScene* benchScene, AssetCache* assets, std::mt19937* random)
+{
+  benchScene->moveCamera = moveOutdoorCamera;
+  const Mesh* sphere = assets->getMesh("builtin:sphere");
+  Material material = { assets->getTexture("builtin:checker"), packColor(255, 255, 255, 255), PS_DEFAULT, NULL };
+  benchScene->addInstances(sphere->vertices, sphere->triangleIndices, scatterSpheres(random), material);
+  benchScene->scene.directionalLight = Vec3f(-0.5f, -1.0f, 0.3f);
+}
+
+// Spheres again, every copy drawn with the level of detail its size on screen asks for
+static void
+buildLodScene(BenchScene* benchScene, AssetCache* assets, std::mt19937* random)
+{
+  benchScene->moveCamera = moveOutdoorCamera;
+  const LodChain* lodChain = assets->getLodChain("builtin:sphere");
+  benchScene->lodChain = lodChain;
+  benchScene->lodMaterial = { assets->getTexture("builtin:checker"), packColor(255, 255, 255, 255), PS_DEFAULT, NULL };
+  benchScene->firstLodMesh = benchScene->instancedMeshes.size();
+  for(const LodLevel& level : lodChain->levels)
+  {
+    benchScene->instancedMeshes.push_back(InstancedMesh(level.mesh.vertices, level.mesh.triangleIndices));
+  }
+
+  benchScene->lodTransforms = scatterSpheres(random);
+  benchScene->lodLevels.assign(benchScene->lodTransforms.size(), ~0u);
+  benchScene->levelTransforms.resize(lodChain->getLevelCount());
+  benchScene->triangleCount = lodChain->levels[0].mesh.triangleIndices.size() * benchScene->lodTransforms.size();
+  benchScene->scene.directionalLight = Vec3f(-0.5f, -1.0f, 0.3f);
+}
+
+// One heightfield of a million triangles, per triangle work dominates
+static void
+buildTerrainScene(BenchScene* benchScene, AssetCache* assets, std::mt19937* random)
+{
+  benchScene->moveCamera = moveTerrainCamera;
+  static const int32 quadCount = 708;
+  static const real32 size = 16.0f;
+
+  std::uniform_real_distribution<real32> phase(0, 6.2832f);
+  real32 phaseX = phase(*random);
+  real32 phaseZ = phase(*random);
+
+  // Laid out like builtin:plane and turned the same way, so the triangles face up
+  MappedVertices vertices;
+  vertices.reserve((quadCount + 1) * (quadCount + 1));
+  for(int32 row = 0; row <= quadCount; row++)
+  {
+    for(int32 column = 0; column <= quadCount; column++)
+    {
+      real32 u = (real32)column / quadCount;
+      real32 v = (real32)row / quadCount;
+      vertices.push_back({ Vec3f((u - 0.5f) * size, (0.5f - v) * size, 0), Vec2f(u * 32.0f, v * 32.0f), Vec3f() });
+    }
+  }
+  MeshHelper::rotateVertices(vertices, Vec3f(90.0f, 0, 0));
+
+  for(auto it = vertices.begin(); it != vertices.end(); it++)
+  {
+    Vec3f& position = it->position;
+    position.y = sinf(position.x * 0.7f + phaseX) * 0.6f + cosf(position.z * 0.9f + phaseZ) * 0.4f +
+      sinf((position.x + position.z) * 2.3f) * 0.1f;
+  }
+
+  TriangleIndices triangleIndices;
+  triangleIndices.reserve(quadCount * quadCount * 2);
+  uint32 rowLength = quadCount + 1;
+  for(int32 row = 0; row < quadCount; row++)
+  {
+    for(int32 column = 0; column < quadCount; column++)
+    {
+      uint32 index = row * rowLength + column;
+      triangleIndices.push_back({{ index, index + 1, index + rowLength }});
+      triangleIndices.push_back({{ index + 1, index + rowLength + 1, index + rowLength }});
+    }
+  }
+
+  Material material = { createChecker(benchScene, 64, 8), packColor(255, 255, 255, 255), PS_DEFAULT, NULL };
+  benchScene->addItem(vertices, triangleIndices, material);
+  benchScene->scene.directionalLight = Vec3f(-0.5f, -1.0f, 0.3f);
+}
+
+// Screen filling layers drawn back to front, every pixel passes the depth test in each layer
+static void
+buildOverdrawScene(BenchScene* benchScene, AssetCache* assets, std::mt19937* random)
+{
+  benchScene->moveCamera = moveOverdrawCamera;
+  const Mesh* cube = assets->getMesh("builtin:cube");
+  // Front face of the cube looks at a camera on -z
+  MappedVertices quad(cube->vertices.begin(), cube->vertices.begin() + 4);
+  TriangleIndices quadIndices(cube->triangleIndices.begin(), cube->triangleIndices.begin() + 2);
+
+  std::uniform_int_distribution<uint32> channel(64, 255);
+  static const int32 layerCount = 32;
+  for(int32 i = layerCount - 1; i >= 0; i--)
+  {
+    real32 z = 1.0f + i * 0.1f;
+    uint32 red = channel(*random);
+    uint32 green = channel(*random);
+    uint32 blue = channel(*random);
+    Material material = { NULL, packColor(red, green, blue, 255), PS_LIT | PS_DEPTH_TEST | PS_DEPTH_WRITE, NULL };
+    benchScene->addItem(transformMesh(quad, 8.0f + z * 2.0f, Vec3f(), Vec3f(0, 0, z + 0.5f * (8.0f + z * 2.0f))),
+			quadIndices, material);
+  }
+
+  // Shining into the screen, onto the layers
+  benchScene->scene.directionalLight = Vec3f(0.3f, -0.3f, 1.0f);
+}
+
+// Two big textured triangles under three lights, cost is all per pixel
+static void
+buildFillScene(BenchScene* benchScene, AssetCache* assets, std::mt19937* random)
+{
+  benchScene->moveCamera = moveFillCamera;
+  const Mesh* cube = assets->getMesh("builtin:cube");
+  MappedVertices quad(cube->vertices.begin(), cube->vertices.begin() + 4);
+  TriangleIndices quadIndices(cube->triangleIndices.begin(), cube->triangleIndices.begin() + 2);
+  for(auto it = quad.begin(); it != quad.end(); it++) it->uv = it->uv * 8.0f;
+
+  Material material = { createChecker(benchScene, 512, 32), packColor(255, 255, 255, 255), PS_DEFAULT, NULL };
+  benchScene->addItem(transformMesh(quad, 12.0f, Vec3f(), Vec3f(0, 0, 7.0f)), quadIndices, material);
+
+  std::uniform_real_distribution<real32> offset(-1.5f, 1.5f);
+  Vec3f colors[3] = { Vec3f(1.0f, 0.3f, 0.3f), Vec3f(0.3f, 1.0f, 0.3f), Vec3f(0.3f, 0.3f, 1.0f) };
+  for(int32 i = 0; i < 3; i++)
+  {
+    real32 x = offset(*random);
+    real32 y = offset(*random);
+    benchScene->scene.lights.push_back(Light::point(Vec3f(x, y, 0.5f), colors[i], 4.0f));
+  }
+}
+
+struct SceneBuilder {
+  const char* name;
+  void (*build)(BenchScene* benchScene, AssetCache* assets, std::mt19937* random);
+};
+
+static const SceneBuilder sceneBuilders[] = {
+  { "cube", buildCubeScene },
+  { "instanced", buildInstancedScene },
+  { "culled", buildCulledScene },
+  { "spheres", buildSpheresScene },
+  { "lod", buildLodScene },
+  { "terrain", buildTerrainScene },
+  { "overdraw", buildOverdrawScene },
+  { "fill", buildFillScene }
+};
+
+// Per frame milliseconds of everything that isn't a SoftRenderer stage
+enum FRAME_PART {
+  FP_CLEAR,
+  FP_PRESENT,
+  FP_TOTAL,
+  FP_COUNT
+};
+
+struct SceneResult {
+  const char* name;
+  uint32 triangleCount;
+  std::vector<real64> frameMs;
+  real64 partMs[FP_COUNT];
+  real64 stageMs[RS_COUNT];
+  // Summed over the measured frames
+  RenderStats counters;
+  bool culled;
+  BvhStats bvhStats;
+  real64 cullMs;
+  // Copies drawn with each level, summed over the measured frames
+  std::vector<uint64> lodCopies;
+  real64 lodMs;
+};
+
+static real64
+getPercentile(const std::vector<real64>& sorted, real64 percentile)
+{
+  // Nearest rank
+  size_t rank = (size_t)ceil(percentile / 100.0 * sorted.size());
+  return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+// Levels of this frame for every copy of a level of detail scene, the items are rebuilt
+static void
+selectLevels(BenchScene* benchScene, const Camera* camera, const Vec2i& dimensions)
+{
+  const LodChain* lodChain = benchScene->lodChain;
+  Transform3D toCamera = Transform3D::fromCamera(camera);
+  real32 dfc = camera->getDfc();
+  real32 halfWidth = dimensions.x * 0.5f;
+
+  for(Transforms3D& transforms : benchScene->levelTransforms) transforms.clear();
+  for(uint32 i = 0; i < benchScene->lodTransforms.size(); i++)
+  {
+    const Transform3D& transform = benchScene->lodTransforms[i];
+    real32 projectedRadius = lodChain->getProjectedRadius(transform, toCamera, dfc, halfWidth);
+    uint32 level = lodChain->select(projectedRadius, benchScene->lodLevels[i]);
+    benchScene->lodLevels[i] = level;
+    benchScene->levelTransforms[level].push_back(transform);
+  }
+
+  benchScene->scene.items.clear();
+  for(uint32 level = 0; level < benchScene->levelTransforms.size(); level++)
+  {
+    const Transforms3D& transforms = benchScene->levelTransforms[level];
+    if(transforms.empty()) continue;
+    benchScene->scene.items.push_back(SceneItem::instances(&benchScene->instancedMeshes[benchScene->firstLodMesh + level],
+							   transforms.data(), transforms.size(), benchScene->lodMaterial));
+  }
+}
+
+static SceneResult
+runScene(const Options& options, const SceneBuilder& builder, OffscreenRenderer* offscreenRenderer, AssetCache* assets)
+{
+  std::mt19937 random(options.seed);
+  BenchScene benchScene;
+  benchScene.name = builder.name;
+  benchScene.scene.clearColor = packColor(120, 120, 120);
+  builder.build(&benchScene, assets, &random);
+
+  SceneResult result = {};
+  result.name = builder.name;
+  result.triangleCount = benchScene.triangleCount;
+  result.culled = benchScene.culled;
+  if(benchScene.lodChain) result.lodCopies.assign(benchScene.lodChain->getLevelCount(), 0);
+
+  // Stand in for the copy to the window texture
+  const Vec2i& dimensions = options.dimensions;
+  std::vector<uint32> presented(dimensions.x * dimensions.y);
+
+  StageTimes stageTimes;
+  offscreenRenderer->getRenderer()->setStageTimes(options.stages ? &stageTimes : NULL);
+
+  FPSCamera camera;
+  SceneDrawList visibleList;
+  for(int32 frame = -options.warmupCount; frame < options.frameCount; frame++)
+  {
+    int32 pathFrame = std::max(frame, 0);
+    benchScene.moveCamera(&camera, (real32)pathFrame / options.frameCount);
+    if(frame == 0) stageTimes.clear();
+
+    uint64 start = Platform::getTicks();
+    if(benchScene.culled)
+    {
+      // Near plane at the renderer's clip distance
+      BvhStats bvhStats;
+      Frustum frustum = Frustum::fromCamera(&camera, dimensions, 0.5f);
+      benchScene.sceneGraph.cullDrawList(frustum, &visibleList, &bvhStats);
+      benchScene.scene.items.clear();
+      visibleList.appendItems(&benchScene.scene.items);
+      if(frame >= 0)
+      {
+	result.bvhStats.add(bvhStats);
+	result.cullMs += Platform::ticksToMs(Platform::getTicks() - start);
+      }
+    }
+    if(benchScene.lodChain)
+    {
+      uint64 selectStart = Platform::getTicks();
+      selectLevels(&benchScene, &camera, dimensions);
+      if(frame >= 0)
+      {
+	result.lodMs += Platform::ticksToMs(Platform::getTicks() - selectStart);
+	for(uint32 level = 0; level < result.lodCopies.size(); level++)
+	{
+	  result.lodCopies[level] += benchScene.levelTransforms[level].size();
+	}
+      }
+    }
+    const TextureBuffer& target = offscreenRenderer->renderFrame(benchScene.scene, &camera);
+    uint64 rendered = Platform::getTicks();
+    memcpy(presented.data(), target.pixelData, presented.size() * sizeof(uint32));
+    uint64 end = Platform::getTicks();
+
+    RenderStats frameStats = RenderStats::collect();
+    if(frame < 0) continue;
+
+    for(int32 i = 0; i < RC_COUNT; i++) result.counters.counters[i] += frameStats.counters[i];
+    real64 frameMs = Platform::ticksToMs(end - start);
+    result.frameMs.push_back(frameMs);
+    result.partMs[FP_CLEAR] += offscreenRenderer->getClearStats().timeMs;
+    result.partMs[FP_PRESENT] += Platform::ticksToMs(end - rendered);
+    result.partMs[FP_TOTAL] += frameMs;
+  }
+
+  offscreenRenderer->getRenderer()->setStageTimes(NULL);
+
+  for(int32 i = 0; i < FP_COUNT; i++) result.partMs[i] /= options.frameCount;
+  result.cullMs /= options.frameCount;
+  result.lodMs /= options.frameCount;
+  for(int32 i = 0; i < RS_COUNT; i++)
+  {
+    result.stageMs[i] = options.stages ? Platform::ticksToMs(stageTimes.ticks[i]) / options.frameCount : 0;
+  }
+
+  return result;
+}
+
+static void
+writeResults(FILE* file, const Options& options, uint32 threadCount, const std::vector<SceneResult>& results)
+{
+  fprintf(file, "{\n  \"resolution\": [%d, %d],\n  \"frames\": %d,\n  \"warmup\": %d,\n  \"seed\": %u,\n",
+	  options.dimensions.x, options.dimensions.y, options.frameCount, options.warmupCount, options.seed);
+  fprintf(file, "  \"threads\": %u,\n  \"stagesTimed\": %s,\n  \"scenes\": [\n", threadCount,
+	  options.stages ? "true" : "false");
+
+  for(size_t i = 0; i < results.size(); i++)
+  {
+    const SceneResult& result = results[i];
+    std::vector<real64> sorted = result.frameMs;
+    std::sort(sorted.begin(), sorted.end());
+
+    fprintf(file, "    {\n      \"name\": \"%s\",\n      \"triangles\": %u,\n", result.name, result.triangleCount);
+    fprintf(file, "      \"frameMs\": { \"mean\": %.4f, \"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+	    result.partMs[FP_TOTAL], sorted.front(), getPercentile(sorted, 50), getPercentile(sorted, 90),
+	    getPercentile(sorted, 99), sorted.back());
+
+    fprintf(file, "      \"stageMs\": { \"clear\": %.4f", result.partMs[FP_CLEAR]);
+    for(int32 stage = 0; stage < RS_COUNT; stage++)
+    {
+      fprintf(file, ", \"%s\": %.4f", StageTimes::getName((RENDER_STAGE)stage), result.stageMs[stage]);
+    }
+    fprintf(file, ", \"present\": %.4f },\n", result.partMs[FP_PRESENT]);
+
+    fprintf(file, "      \"countersPerFrame\": { ");
+    for(int32 counter = 0; counter < RC_COUNT; counter++)
+    {
+      fprintf(file, "%s\"%s\": %llu", counter ? ", " : "", RenderStats::getName((RENDER_COUNTER)counter),
+	      (unsigned long long)(result.counters.counters[counter] / options.frameCount));
+    }
+    fprintf(file, " },\n");
+
+    if(result.culled)
+    {
+      const BvhStats& bvh = result.bvhStats;
+      fprintf(file, "      \"bvhPerFrame\": { \"cullMs\": %.4f, \"nodesVisited\": %u, \"subtreesAccepted\": %u, \"subtreesRejected\": %u, "
+	      "\"objectsTested\": %u, \"objectsFound\": %u },\n", result.cullMs, bvh.nodesVisited / options.frameCount,
+	      bvh.subtreesAccepted / options.frameCount, bvh.subtreesRejected / options.frameCount,
+	      bvh.objectsTested / options.frameCount, bvh.objectsFound / options.frameCount);
+    }
+
+    if(!result.lodCopies.empty())
+    {
+      fprintf(file, "      \"lodPerFrame\": { \"selectMs\": %.4f, \"copies\": [", result.lodMs);
+      for(size_t level = 0; level < result.lodCopies.size(); level++)
+      {
+	fprintf(file, "%s%llu", level ? ", " : "", (unsigned long long)(result.lodCopies[level] / options.frameCount));
+      }
+      fprintf(file, "] },\n");
+    }
+
+    fprintf(file, "      \"frameTimes\": [");
+    for(size_t frame = 0; frame < result.frameMs.size(); frame++)
+    {
+      fprintf(file, "%s%.4f", frame ? ", " : "", result.frameMs[frame]);
+    }
+    fprintf(file, "]\n    }%s\n", i + 1 < results.size() ? "," : "");
+  }
+
+  fprintf(file, "  ]\n}\n");
+}
+
+int main(int argc, char* argv[])
+{
+  Options options;
+  if(!parseOptions(argc, argv, &options))
+  {
+    fprintf(stderr, "usage: %s [-n frames] [-w warmup] [-s widthxheight] [-t threads] [-seed n] [-scene name] "
+	    "[-nostages] [-o results.json]\n", argv[0]);
+    return 1;
+  }
+
+  WorkerPool workerPool(options.threadCount);
+  OffscreenRenderer offscreenRenderer(options.dimensions);
+  offscreenRenderer.setWorkerPool(&workerPool);
+  AssetCache assets;
+
+  std::vector<SceneResult> results;
+  for(const SceneBuilder& builder : sceneBuilders)
+  {
+    if(options.sceneName && strcmp(options.sceneName, builder.name)) continue;
+
+    results.push_back(runScene(options, builder, &offscreenRenderer, &assets));
+    const SceneResult& result = results.back();
+    fprintf(stderr, "%-10s %8u triangles %9.3f ms/frame\n", result.name, result.triangleCount, result.partMs[FP_TOTAL]);
+  }
+
+  if(results.empty())
+  {
+    fprintf(stderr, "no scene named %s\n", options.sceneName);
+    return 1;
+  }
+
+  FILE* file = options.outputPath ? fopen(options.outputPath, "w") : stdout;
+  if(!file)
+  {
+    fprintf(stderr, "could not write %s\n", options.outputPath);
+    return 1;
+  }
+  writeResults(file, options, workerPool.getThreadCount(), results);
+  if(file != stdout) fclose(file);
+
+  return 0;
+}
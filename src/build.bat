@@ -6,21 +6,44 @@ pushd ..\build
 set IncludeDirectory=..\libs\SDL2\include
 set LibraryDirectory=..\libs\SDL2\lib\x64
 
-set Libraries=SDL2.lib SDL2main.lib
+set Libraries=SDL2.lib SDL2main.lib jpb_s.lib
 
 REM Zi(Generate Debug information), FC(Full Path To Source), O2(Fast Code)
 
-set CompilerOptions=-FC -O2x -Zi -EHsc -MD /I%IncludeDirectory% /I..\libs\jpb /FeSoftRenderer.exe /nologo
-set LinkerOptions=/link /SUBSYSTEM:windows /LIBPATH:%LibraryDirectory%
+set CompilerOptions=-FC -O2x -Zi -EHsc -MD /I%IncludeDirectory% /I..\libs\jpb /DPLATFORM_SDL /FeSoftRenderer.exe /nologo
+set LinkerOptions=/link /SUBSYSTEM:windows /LIBPATH:%LibraryDirectory% /LIBPATH:..\libs\jpb\lib
 
 REM /HEAP:1000000000
 
 set FilesToCompile=^
 ..\src\main.cpp ^
 ..\src\Game.cpp ^
+..\src\FramePipeline.cpp ^
 ..\src\SoftRenderer.cpp ^
+..\src\RenderStats.cpp ^
+..\src\DebugView.cpp ^
+..\src\Transform.cpp ^
+..\src\InstancedMesh.cpp ^
+..\src\SceneGraph.cpp ^
+..\src\BoundingVolumeHierarchy.cpp ^
+..\src\MeshLod.cpp ^
 ..\src\RenderPrimitives.cpp ^
-..\src\Camera.cpp
+..\src\Camera.cpp ^
+..\src\TextureSampler.cpp ^
+..\src\Framebuffer.cpp ^
+..\src\DepthBuffer.cpp ^
+..\src\ClearStage.cpp ^
+..\src\WorkerPool.cpp ^
+..\src\Blitter.cpp ^
+..\src\LineRasterizer.cpp ^
+..\src\Lighting.cpp ^
+..\src\ShadowMap.cpp ^
+..\src\ProceduralMaterial.cpp ^
+..\src\MultiView.cpp ^
+..\src\OffscreenRenderer.cpp ^
+..\src\HeadlessPlatform.cpp ^
+..\src\SdlPlatform.cpp ^
+..\libs\jpb\jpb\Profiler.cpp
 
 cl %CompilerOptions% %FilesToCompile% %Libraries% %LinkerOptions%
 
@@ -0,0 +1,70 @@
+#!/bin/sh
+# Linux build, no windows.h needed. Produces libSoftRenderer.a (renderer and the portable
+# parts of jpb), the headless, batch, bench, microbench and validate CLIs and the
+# SoftRenderer app. The app opens a window when SDL2 is installed (sdl2-config), otherwise
+# it only runs headless.
+
+set -e
+
+mkdir -p ../build
+cd ../build
+
+CompilerOptions="-std=c++14 -O2 -g -pthread -I../libs/jpb"
+ArFlags=rcs
+
+LibraryFiles="
+../src/SoftRenderer.cpp
+../src/RenderStats.cpp
+../src/DebugView.cpp
+../src/Transform.cpp
+../src/InstancedMesh.cpp
+../src/SceneGraph.cpp
+../src/BoundingVolumeHierarchy.cpp
+../src/MeshLod.cpp
+../src/RenderPrimitives.cpp
+../src/Camera.cpp
+../src/TextureSampler.cpp
+../src/Framebuffer.cpp
+../src/DepthBuffer.cpp
+../src/ClearStage.cpp
+../src/WorkerPool.cpp
+../src/Blitter.cpp
+../src/LineRasterizer.cpp
+../src/Lighting.cpp
+../src/ShadowMap.cpp
+../src/ProceduralMaterial.cpp
+../src/MultiView.cpp
+../src/OffscreenRenderer.cpp
+../src/ReferenceRenderer.cpp
+../src/AssetCache.cpp
+../src/BatchRenderer.cpp
+../src/HeadlessPlatform.cpp
+../libs/jpb/jpb/Noise.cpp
+../libs/jpb/jpb/SimpleParser.cpp
+../libs/jpb/jpb/Profiler.cpp
+"
+
+Objects=""
+for File in $LibraryFiles; do
+  Object=$(basename "$File" .cpp).o
+  ${CXX:-g++} $CompilerOptions -c "$File" -o "$Object"
+  Objects="$Objects $Object"
+done
+
+rm -f libSoftRenderer.a
+ar $ArFlags libSoftRenderer.a $Objects
+
+${CXX:-g++} $CompilerOptions ../src/headless.cpp libSoftRenderer.a -o headless
+${CXX:-g++} $CompilerOptions ../src/batch.cpp libSoftRenderer.a -o batch
+${CXX:-g++} $CompilerOptions ../src/bench.cpp libSoftRenderer.a -o bench
+${CXX:-g++} $CompilerOptions ../src/microbench.cpp libSoftRenderer.a -o microbench
+${CXX:-g++} $CompilerOptions ../src/validate.cpp libSoftRenderer.a -o validate
+
+AppFiles="../src/main.cpp ../src/Game.cpp ../src/FramePipeline.cpp"
+if command -v sdl2-config > /dev/null; then
+  ${CXX:-g++} $CompilerOptions -DPLATFORM_SDL $(sdl2-config --cflags) $AppFiles ../src/SdlPlatform.cpp \
+	      libSoftRenderer.a $(sdl2-config --libs) -o SoftRenderer
+else
+  # SDL headers only for the key codes
+  ${CXX:-g++} $CompilerOptions -I../libs/SDL2/include $AppFiles libSoftRenderer.a -o SoftRenderer
+fi
@@ -0,0 +1,222 @@
+// Renders the demo scene without a window and writes the frames to disk.
+//
+//   headless [-n frames] [-s widthxheight] [-t threads] [-o directory] [-trace file] [-stats]
+//            [-debug overdraw|depthfails|tilecost]
+//
+// Without -o frames are only rendered, which measures the renderer alone. -trace saves the
+// profiler zones of all frames as a Chrome trace, -stats prints the pipeline counters of
+// every frame. -debug writes the heatmap of a debug view instead of the shaded frames.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "OffscreenRenderer.h"
+#include "Platform.h"
+#include <jpb/Profiler.h>
+
+struct Options {
+  int32 frameCount = 60;
+  Vec2i dimensions = Vec2i(1280, 720);
+  uint32 threadCount = 0;
+  const char* outputDirectory = NULL;
+  const char* tracePath = NULL;
+  bool stats = false;
+  DEBUG_VIEW debugView = DV_NONE;
+};
+
+static bool
+parseOptions(int argc, char* argv[], Options* options)
+{
+  for(int i = 1; i < argc; i++)
+  {
+    bool hasValue = i + 1 < argc;
+
+    if(!strcmp(argv[i], "-n") && hasValue)
+    {
+      options->frameCount = atoi(argv[++i]);
+    }
+    else if(!strcmp(argv[i], "-s") && hasValue)
+    {
+      if(sscanf(argv[++i], "%dx%d", &options->dimensions.x, &options->dimensions.y) != 2) return false;
+    }
+    else if(!strcmp(argv[i], "-t") && hasValue)
+    {
+      options->threadCount = atoi(argv[++i]);
+    }
+    else if(!strcmp(argv[i], "-o") && hasValue)
+    {
+      options->outputDirectory = argv[++i];
+    }
+    else if(!strcmp(argv[i], "-trace") && hasValue)
+    {
+      options->tracePath = argv[++i];
+    }
+    else if(!strcmp(argv[i], "-stats"))
+    {
+      options->stats = true;
+    }
+    else if(!strcmp(argv[i], "-debug") && hasValue)
+    {
+      const char* name = argv[++i];
+      for(int32 mode = DV_NONE + 1; mode < DV_COUNT; mode++)
+      {
+	if(!strcmp(name, DebugView::getName((DEBUG_VIEW)mode))) options->debugView = (DEBUG_VIEW)mode;
+      }
+      if(options->debugView == DV_NONE) return false;
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+  return options->frameCount > 0 && options->dimensions.x > 0 && options->dimensions.y > 0;
+}
+
+static void
+createCheckerTexture(TextureBuffer* texture, std::vector<uint32>* pixels)
+{
+  Vec2i dimensions(16, 16);
+  pixels->resize(dimensions.x * dimensions.y);
+
+  texture->pixelData = pixels->data();
+  texture->dimensions = dimensions;
+  texture->pitch = dimensions.x * sizeof(uint32);
+
+  for(int32 y = 0; y < dimensions.y; y++)
+  {
+    for(int32 x = 0; x < dimensions.x; x++)
+    {
+      bool dark = ((x / 4) + (y / 4)) & 1;
+      texture->setPixelPacked(x, y, dark ? packColor(60, 70, 90) : packColor(220, 200, 160));
+    }
+  }
+}
+
+// Square facing -z at distance in front of the origin, rotated into place
+static MappedVertices
+createFace(real32 halfSize, real32 distance, const Vec3f& rotation, const Vec3f& position)
+{
+  MappedVertices face = {
+    { Vec3f(-halfSize, halfSize, -distance), Vec2f(0, 0), Vec3f() },
+    { Vec3f(halfSize, halfSize, -distance), Vec2f(1.0f, 0), Vec3f() },
+    { Vec3f(-halfSize, -halfSize, -distance), Vec2f(0, 1.0f), Vec3f() },
+    { Vec3f(halfSize, -halfSize, -distance), Vec2f(1.0f, 1.0f), Vec3f() }
+  };
+
+  MeshHelper::rotateVertices(face, rotation);
+  MeshHelper::translateVertices(face, position);
+  return face;
+}
+
+int main(int argc, char* argv[])
+{
+  Options options;
+  if(!parseOptions(argc, argv, &options))
+  {
+    fprintf(stderr, "usage: %s [-n frames] [-s widthxheight] [-t threads] [-o directory] [-trace file] [-stats] "
+	    "[-debug overdraw|depthfails|tilecost]\n", argv[0]);
+    return 1;
+  }
+
+  if(options.tracePath) Trace::setEnabled(true);
+  Trace::setThreadName("Main");
+
+  WorkerPool workerPool(options.threadCount);
+  OffscreenRenderer offscreenRenderer(options.dimensions);
+  offscreenRenderer.setWorkerPool(&workerPool);
+  offscreenRenderer.setDebugView(options.debugView);
+
+  TextureBuffer texture;
+  std::vector<uint32> texturePixels;
+  createCheckerTexture(&texture, &texturePixels);
+
+  TriangleIndices quadIndices = {{0, 1, 2}, {1, 3, 2}};
+
+  std::vector<MappedVertices> meshes;
+  MappedVertices ground = createFace(1.5f, 0, Vec3f(90.0f, 0, 0), Vec3f(0, -0.75f, 0));
+  for(auto it = ground.begin(); it != ground.end(); it++) it->uv = it->uv * 6.0f;
+  meshes.push_back(ground);
+
+  Vec3f cubeRotations[6] = {
+    Vec3f(0, 0, 0), Vec3f(0, 90.0f, 0), Vec3f(0, 180.0f, 0),
+    Vec3f(0, 270.0f, 0), Vec3f(90.0f, 0, 0), Vec3f(-90.0f, 0, 0)
+  };
+  for(int32 i = 0; i < 6; i++)
+  {
+    meshes.push_back(createFace(0.4f, 0.4f, cubeRotations[i], Vec3f(0, -0.35f, 0)));
+  }
+
+  Scene scene;
+  scene.clearColor = packColor(120, 120, 120);
+  scene.directionalLight = Vec3f(-0.5f, -1.0f, 0.3f);
+  scene.lights.push_back(Light::point(Vec3f(0.8f, 0.3f, -0.8f), Vec3f(1.0f, 0.6f, 0.3f), 2.0f));
+
+  Material material = { &texture, packColor(255, 255, 255, 255), PS_DEFAULT, NULL };
+  for(auto it = meshes.begin(); it != meshes.end(); it++)
+  {
+    MeshHelper::calculateNormals(*it, quadIndices);
+    scene.items.push_back({ &(*it), &quadIndices, material });
+  }
+
+  FPSCamera camera;
+  real64 renderMs = 0;
+  real64 writeMs = 0;
+
+  for(int32 frame = 0; frame < options.frameCount; frame++)
+  {
+    PROFILE_ZONE("Frame");
+    // Orbiting the cube once over all the frames
+    real32 angle = (360.0f * frame) / options.frameCount;
+    Vec3f position(0, 1.2f, -2.5f);
+    position.rotateAroundYDeg(-angle);
+    camera.setPosition(position);
+    camera.setRotation(30.0f, angle);
+
+    uint64 start = Platform::getTicks();
+    offscreenRenderer.renderFrame(scene, &camera);
+    uint64 rendered = Platform::getTicks();
+    renderMs += Platform::ticksToMs(rendered - start);
+
+    RenderStats frameStats = RenderStats::collect();
+    if(options.stats)
+    {
+      printf("frame %d: ", frame);
+      frameStats.print(stdout);
+    }
+
+    if(options.outputDirectory)
+    {
+      char fileName[64];
+      snprintf(fileName, sizeof(fileName), "/frame%04d.ppm", frame);
+
+      std::string path = std::string(options.outputDirectory) + fileName;
+      if(!offscreenRenderer.writePPM(path))
+      {
+	fprintf(stderr, "could not write %s\n", path.c_str());
+	return 1;
+      }
+      writeMs += Platform::ticksToMs(Platform::getTicks() - rendered);
+    }
+  }
+
+  real64 pixelCount = (real64)options.dimensions.x * options.dimensions.y * options.frameCount;
+  printf("%d frames %dx%d, %u threads\n", options.frameCount, options.dimensions.x, options.dimensions.y,
+	 workerPool.getThreadCount());
+  printf("render %.3f ms/frame, %.1f fps, %.1f Mpixels/s\n", renderMs / options.frameCount,
+	 options.frameCount * 1000.0 / renderMs, pixelCount / (renderMs * 1000.0));
+  if(options.outputDirectory)
+  {
+    printf("write %.3f ms/frame\n", writeMs / options.frameCount);
+  }
+
+  if(options.tracePath && !Trace::writeChromeTrace(options.tracePath))
+  {
+    fprintf(stderr, "could not write %s\n", options.tracePath);
+    return 1;
+  }
+
+  return 0;
+}
@@ -1,15 +1,23 @@
 #include <SDL.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
-#include <windows.h>
+#include <math.h>
 #include <assert.h>
+#include <memory>
 
-#include <jpb/misc.h>
+#include <jpb/Misc.h>
+#include <jpb/Profiler.h>
 
 #include "main.h"
 #include "Game.h"
 #include "RenderPrimitives.h"
+#include "FramePipeline.h"
+#include "HeadlessPlatform.h"
+#ifdef PLATFORM_SDL
+#include "SdlPlatform.h"
+#endif
 
 
 Input::Input()
@@ -72,6 +80,77 @@ Input::clear()
   mousePositionDelta = Vec2i();
 }
 
+// Window by default, "--headless [frames]" runs the same loop without a display.
+static Platform*
+createPlatform(int argc, char* args[])
+{
+  for(int i = 1; i < argc; i++)
+  {
+    if(strcmp(args[i], "--headless")) continue;
+
+    uint32 frameCount = i + 1 < argc && args[i + 1][0] != '-' ? atoi(args[i + 1]) : 600;
+    return new HeadlessPlatform(frameCount);
+  }
+
+#ifdef PLATFORM_SDL
+  return new SdlPlatform();
+#else
+  printf("Built without SDL, running headless\n");
+  return new HeadlessPlatform(600);
+#endif
+}
+
+// Simulates, renders and presents one after the other on this thread
+static void
+runSerial(Game* game, Platform* platform, bool dumpStats)
+{
+  Input input;
+  float lastDeltaMs = 2;
+  uint64 prevTicks = Platform::getTicks();
+  uint64 frameIndex = 0;
+
+  while(platform->processEvents(&input))
+  {
+    if(input.isKeyDown(SDLK_ESCAPE) || input.isKeyDown(SDLK_q)) break;
+
+    Framebuffer* screenBuffer = platform->beginFrame();
+    game->update(screenBuffer, input, lastDeltaMs);
+    platform->present();
+
+    if(dumpStats || input.isKeyPressed(SDLK_i))
+    {
+      printf("frame %llu: ", (unsigned long long)frameIndex);
+      game->getFrameStats().print(stdout);
+    }
+    frameIndex++;
+
+    input.clear();
+
+    // Time Stuff
+    // --------------------
+
+    uint64 ticks = Platform::getTicks();
+    lastDeltaMs = (float)Platform::ticksToMs(ticks - prevTicks);
+    prevTicks = ticks;
+
+    static real32 localTime = 0;
+    static const real32 updatePeriod = 500;
+
+    localTime += lastDeltaMs;
+
+    if(localTime > updatePeriod)
+    {
+      localTime = fmodf(localTime, updatePeriod);
+      char tempBuffer[255] = {};
+
+      const ClearStats& clearStats = game->getClearStats();
+      sprintf(tempBuffer,"SoftRenderer %f ms/frame, %f fps, clear %.3f ms %.2f GB/s%s", lastDeltaMs, 1000.0f/lastDeltaMs,
+	      clearStats.timeMs, clearStats.getBandwidth(), clearStats.depthCleared ? "" : " (depth skipped)");
+      platform->setStatus(tempBuffer);
+    }
+  }
+}
+
 int main( int argc, char* args[] )
 {
   // redirectIOToConsole();
@@ -79,153 +158,48 @@ int main( int argc, char* args[] )
   Game game;
   Vec2i screenResolution(1280, 720);
 
-  //The window we'll be rendering to
-  SDL_Window* window = NULL;
+  std::unique_ptr<Platform> platform(createPlatform(argc, args));
+  if(!platform->init(screenResolution, "SoftRenderer"))
+  {
+    platform->shutdown();
+    return 1;
+  }
 
-  //Initialize SDL
-  if( SDL_Init( SDL_INIT_VIDEO ) < 0 )
+  // "--serial" keeps simulation, rendering and present on this thread, "--trace file" saves
+  // the profiler zones of the whole run for chrome://tracing, "--stats" prints the pipeline
+  // counters of every frame
+  bool serial = false;
+  bool dumpStats = false;
+  const char* tracePath = NULL;
+  for(int i = 1; i < argc; i++)
   {
-    printf( "SDL could not initialize! SDL_Error: %s\n", SDL_GetError() );
+    if(!strcmp(args[i], "--serial")) serial = true;
+    if(!strcmp(args[i], "--stats")) dumpStats = true;
+    if(!strcmp(args[i], "--trace") && i + 1 < argc) tracePath = args[++i];
+  }
+
+  if(tracePath) Trace::setEnabled(true);
+  Trace::setThreadName("Main");
+
+  game.start(screenResolution);
+
+  if(serial)
+  {
+    runSerial(&game, platform.get(), dumpStats);
   }
   else
   {
-    window = SDL_CreateWindow( "SDL Tutorial", SDL_WINDOWPOS_UNDEFINED,
-			       SDL_WINDOWPOS_UNDEFINED, screenResolution.x, screenResolution.y, SDL_WINDOW_SHOWN );
+    FramePipeline pipeline(&game, platform.get(), screenResolution);
+    pipeline.setDumpStats(dumpStats);
+    pipeline.run();
+  }
 
-    if( window == NULL )
-    {
-      printf( "Window could not be created! SDL_Error: %s\n", SDL_GetError() );
-    }
-    else
-    {
-      // Time Stuff
-      // --------------------
-
-      LARGE_INTEGER countsPerSecond;
-      QueryPerformanceFrequency(&countsPerSecond);
-
-      LARGE_INTEGER countValue = {};
-      LARGE_INTEGER prevCountValue = {};
-      QueryPerformanceCounter(&prevCountValue);
-
-      SDL_Renderer* renderer = NULL;
-      renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-
-      bool quit = false;
-      Input input;
-
-      float lastDeltaMs = 2;
-
-      TextureBuffer screenBuffer = {};
-      screenBuffer.dimensions = screenResolution;
-
-      SDL_Texture* screenTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
-						     SDL_TEXTUREACCESS_STREAMING,
-						     screenBuffer.dimensions.x,
-						     screenBuffer.dimensions.y);
-
-      game.start(screenResolution);
-
-      while(!quit){
-	SDL_Event event;
-	while( SDL_PollEvent( &event ) != 0 )
-	{
-	  switch( event.type)
-	  {
-	  case SDL_QUIT:
-	    {
-	      quit = true;
-	      break;
-	    }
-	  case SDL_KEYUP:
-	  case SDL_KEYDOWN:
-	    {
-	      if(!event.key.repeat)
-	      {
-		uint8 key = (uint8)event.key.keysym.sym;
-
-		if(event.key.state == SDL_PRESSED)
-		{
-		  input.handleKeyPress(key);
-		}
-		else // Key Released
-		{
-		  input.handleKeyRelease(key);
-		}
-	      }
-	      break;
-	    }
-	  case SDL_MOUSEMOTION:
-	    {
-	      // std::cout << "Mouse Position: " << event.motion.x << " " << event.motion.y << std::endl;
-	      uint32 x = event.motion.x;
-	      uint32 y = event.motion.y;
-
-	      input.handleMouseMove(x, y);
-	    }
-	    break;
-	  case SDL_MOUSEBUTTONUP:
-	  case SDL_MOUSEBUTTONDOWN:
-	    {
-	      // std::cout << "Mouse Position: " << event.motion.x << " " << event.motion.y << std::endl;
-	      uint8 button = event.button.button;
-	      if(event.button.state == SDL_PRESSED)
-	      {
-		input.handleButtonPress(button);
-	      }
-	      else
-	      {
-		input.handleButtonRelease(button);
-	      }
-
-	    }
-	    break;
-	  }
-	}
-
-	// input.keysDown
-
-	if(input.isKeyDown(SDLK_ESCAPE) || input.isKeyDown(SDLK_q)) quit = true;
-
-	SDL_LockTexture(screenTexture, NULL, (void**)&screenBuffer.pixelData, &screenBuffer.pitch);
-	game.update(&screenBuffer, input, lastDeltaMs);
-	SDL_UnlockTexture(screenTexture);
-
-	SDL_RenderCopy(renderer, screenTexture, NULL, NULL);
-	SDL_RenderPresent(renderer);
-
-	input.clear();
-
-	// Time Stuff
-	// --------------------
-
-	QueryPerformanceCounter(&countValue);
-	int64 countDelta = countValue.QuadPart - prevCountValue.QuadPart;
-	prevCountValue = countValue;
-
-	static real32 localTime = 0;
-	static const real32 updatePeriod = 500;
-
-	// What Part Of Second Elapsed
-	lastDeltaMs = (float)countDelta / (float)countsPerSecond.QuadPart;
-	lastDeltaMs *= 1000;
-
-	localTime += lastDeltaMs;
-
-	if(localTime > updatePeriod)
-	{
-	  localTime = fmodf(localTime, updatePeriod);
-	  char tempBuffer[255] = {};
-
-	  sprintf(tempBuffer,"SoftRenderer %f ms/frame, %f fps", lastDeltaMs, 1000.0f/lastDeltaMs);
-	  SDL_SetWindowTitle(window, tempBuffer);
-	}
-      }
-    }
+  if(tracePath && !Trace::writeChromeTrace(tracePath))
+  {
+    printf("Could not write %s\n", tracePath);
   }
 
-  SDL_DestroyWindow( window );
-  SDL_Quit();
+  platform->shutdown();
 
   return 0;
 }
@@ -28,6 +28,7 @@ public:
   bool isButtonDown(uint8 button) const { return buttonsDown[button]; }
   
   Vec2i getMouseDelta() const { return mousePositionDelta; }
+  Vec2i getMousePosition() const { return mousePosition; }
 private:
   
   bool keysDown[KEYCOUNT];
@@ -0,0 +1,618 @@
+// Times single renderer kernels in isolation over parameter sweeps.
+//
+//   microbench [-n samples] [-m sampleMs] [-k kernel]
+//
+// Every case is warmed up, then repeated in batches sized to take about sampleMs each.
+// Samples further than three median absolute deviations above the median are dropped
+// before averaging, those are the ones the scheduler or an interrupt got into. Cycles come
+// from the time stamp counter, which counts at a fixed rate and not at the core clock, so
+// cycles per pixel are only comparable on one machine.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <functional>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "SoftRenderer.h"
+#include "SceneGraph.h"
+#include "BoundingVolumeHierarchy.h"
+#include "Camera.h"
+#include "MeshLod.h"
+#include "Platform.h"
+
+struct Options {
+  int32 sampleCount = 15;
+  real64 sampleMs = 2.0;
+  const char* kernel = NULL;
+};
+
+// What a case did in one call, for the per op and per pixel columns
+struct CaseWork {
+  uint64 ops;
+  uint64 pixels;
+};
+
+struct CaseResult {
+  real64 nsPerCall;
+  real64 cyclesPerCall;
+  int32 keptCount;
+};
+
+static uint64
+getCycles()
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+// Results go through here so the compiler can't drop the work that made them. The empty asm
+// takes the address and may read any memory, without storing a pointer to the caller's local.
+#if defined(_MSC_VER)
+static void* volatile sink;
+#endif
+
+template <typename T>
+static inline void
+keep(T& value)
+{
+#if defined(_MSC_VER)
+  sink = (void*)&value;
+  _ReadWriteBarrier();
+  sink = NULL;
+#else
+  asm volatile("" : : "g"(&value) : "memory");
+#endif
+}
+
+static CaseResult
+measure(const Options& options, const std::function<void()>& body)
+{
+  // Warmup, also gets the duration of one call for the batch size
+  uint32 batchSize = 1;
+  for(;;)
+  {
+    uint64 start = Platform::getTicks();
+    for(uint32 i = 0; i < batchSize; i++) body();
+    real64 elapsedMs = Platform::ticksToMs(Platform::getTicks() - start);
+
+    if(elapsedMs >= options.sampleMs) break;
+    batchSize = elapsedMs > 0.01 ? (uint32)(batchSize * options.sampleMs / elapsedMs) + 1 : batchSize * 10;
+  }
+
+  std::vector<real64> nanoseconds(options.sampleCount);
+  std::vector<real64> cycles(options.sampleCount);
+  for(int32 sample = 0; sample < options.sampleCount; sample++)
+  {
+    uint64 start = Platform::getTicks();
+    uint64 startCycles = getCycles();
+    for(uint32 i = 0; i < batchSize; i++) body();
+    cycles[sample] = (real64)(getCycles() - startCycles) / batchSize;
+    nanoseconds[sample] = (real64)(Platform::getTicks() - start) / batchSize;
+  }
+
+  std::vector<real64> sorted = nanoseconds;
+  std::sort(sorted.begin(), sorted.end());
+  real64 median = sorted[sorted.size() / 2];
+
+  std::vector<real64> deviations;
+  for(real64 value : sorted) deviations.push_back(fabs(value - median));
+  std::sort(deviations.begin(), deviations.end());
+  real64 limit = median + 3.0 * deviations[deviations.size() / 2];
+
+  CaseResult result = {};
+  for(int32 sample = 0; sample < options.sampleCount; sample++)
+  {
+    if(nanoseconds[sample] > limit) continue;
+
+    result.nsPerCall += nanoseconds[sample];
+    result.cyclesPerCall += cycles[sample];
+    result.keptCount++;
+  }
+  result.nsPerCall /= result.keptCount;
+  result.cyclesPerCall /= result.keptCount;
+  return result;
+}
+
+static void
+report(const Options& options, const char* kernel, const char* parameters, const CaseWork& work,
+       const std::function<void()>& body)
+{
+  CaseResult result = measure(options, body);
+
+  char pixelColumns[64] = "";
+  if(work.pixels)
+  {
+    snprintf(pixelColumns, sizeof(pixelColumns), "%12.1f %10.2f", work.pixels * 1e3 / result.nsPerCall,
+	     result.cyclesPerCall / work.pixels);
+  }
+
+  printf("%-20s %-34s %12.2f %10.2f %6d/%-3d %s\n", kernel, parameters, result.nsPerCall / work.ops,
+	 result.cyclesPerCall / work.ops, result.keptCount, options.sampleCount, pixelColumns);
+}
+
+static bool
+runs(const Options& options, const char* kernel)
+{
+  return !options.kernel || !strcmp(options.kernel, kernel);
+}
+
+// Triangle of given side length around center, turned by angle degrees in the screen plane
+static MappedPolygon
+createScreenTriangle(const Vec2f& center, real32 size, real32 angle)
+{
+  MappedPolygon polygon;
+  for(int32 i = 0; i < 3; i++)
+  {
+    // Clockwise on screen with y down is clockwise here as well
+    real32 vertexAngle = (angle + i * 120.0f) * (M_PI / 180.0f);
+    real32 radius = size / sqrtf(3.0f);
+    Vec3f position(center.x + cosf(vertexAngle) * radius, center.y + sinf(vertexAngle) * radius, 2.0f);
+    polygon.vertices.push_back({ position, Vec2f(i == 1 ? 1.0f : 0, i == 2 ? 1.0f : 0), Vec3f(0, 0, -1.0f) });
+  }
+  return polygon;
+}
+
+static uint64
+countPixels(const MScanLineVector& scanLines)
+{
+  uint64 pixels = 0;
+  for(const MScanLine& scanLine : scanLines) pixels += scanLine.endX - scanLine.startX;
+  return pixels;
+}
+
+static void
+createTexture(int32 size, TextureBuffer* texture, std::vector<uint32>* pixels)
+{
+  pixels->resize(size * size);
+  texture->pixelData = pixels->data();
+  texture->dimensions = Vec2i(size, size);
+  texture->pitch = size * sizeof(uint32);
+
+  for(int32 y = 0; y < size; y++)
+  {
+    for(int32 x = 0; x < size; x++)
+    {
+      texture->setPixelPacked(x, y, ((x ^ y) & 8) ? packColor(60, 70, 90) : packColor(220, 200, 160));
+    }
+  }
+}
+
+// Grid of quads in the xy plane, the mesh shape of the ground and the terrain
+static void
+createGrid(int32 quadCount, MappedVertices* vertices, TriangleIndices* triangleIndices)
+{
+  uint32 rowLength = quadCount + 1;
+  for(int32 row = 0; row <= quadCount; row++)
+  {
+    for(int32 column = 0; column <= quadCount; column++)
+    {
+      Vec3f position((real32)column, -(real32)row, sinf(column * 0.3f) * cosf(row * 0.2f));
+      vertices->push_back({ position, Vec2f((real32)column, (real32)row), Vec3f() });
+    }
+  }
+
+  for(int32 row = 0; row < quadCount; row++)
+  {
+    for(int32 column = 0; column < quadCount; column++)
+    {
+      uint32 index = row * rowLength + column;
+      triangleIndices->push_back({{ index, index + 1, index + rowLength }});
+      triangleIndices->push_back({{ index + 1, index + rowLength + 1, index + rowLength }});
+    }
+  }
+}
+
+static void
+benchmarkClip(const Options& options)
+{
+  FPSCamera camera;
+  real32 dfc = camera.getDfc();
+
+  uint32 vertexCounts[] = { 3, 6, 12 };
+  // Near plane is at 0.5, the polygon spans z from center - 1 to center + 1
+  real32 centers[] = { 3.0f, 1.0f };
+  const char* placements[] = { "inside", "crossing" };
+
+  for(uint32 vertexCount : vertexCounts)
+  {
+    for(int32 placement = 0; placement < 2; placement++)
+    {
+      MappedPolygon polygon;
+      for(uint32 i = 0; i < vertexCount; i++)
+      {
+	real32 angle = i * 2.0f * M_PI / vertexCount;
+	Vec3f position(cosf(angle) * 0.5f, 0.2f, centers[placement] + sinf(angle));
+	polygon.vertices.push_back({ position, Vec2f(), Vec3f(0, 1.0f, 0) });
+      }
+
+      char parameters[64];
+      snprintf(parameters, sizeof(parameters), "vertices=%u %s", vertexCount, placements[placement]);
+      report(options, "clip", parameters, { 1, 0 }, [&]()
+      {
+	MappedPolygon clipped = polygon.clip(0.5f, dfc);
+	keep(clipped);
+      });
+    }
+  }
+}
+
+static void
+benchmarkScanLines(const Options& options)
+{
+  real32 sizes[] = { 4.0f, 16.0f, 64.0f, 256.0f, 1024.0f };
+  real32 angles[] = { 0, 30.0f, 75.0f };
+  IntRect clipRect(0, 0, 2048, 2048);
+
+  for(real32 size : sizes)
+  {
+    for(real32 angle : angles)
+    {
+      MappedPolygon polygon = createScreenTriangle(Vec2f(1024.0f, 1024.0f), size, angle);
+      uint64 pixels = countPixels(SoftRenderer::getScanLinesMapped(polygon, clipRect));
+
+      char parameters[64];
+      snprintf(parameters, sizeof(parameters), "size=%.0f rotation=%.0f", size, angle);
+      report(options, "getScanLinesMapped", parameters, { 1, pixels }, [&]()
+      {
+	MScanLineVector scanLines = SoftRenderer::getScanLinesMapped(polygon, clipRect);
+	keep(scanLines);
+      });
+    }
+  }
+}
+
+static void
+benchmarkCastVertex(const Options& options)
+{
+  FPSCamera camera;
+  real32 dfc = camera.getDfc();
+  uint32 vertexCounts[] = { 3, 64, 4096 };
+
+  for(uint32 vertexCount : vertexCounts)
+  {
+    Vertices positions(vertexCount);
+    for(uint32 i = 0; i < vertexCount; i++) positions[i] = Vec3f(i * 0.01f, 0.5f, 1.0f + i * 0.001f);
+    Vertices casted(vertexCount);
+
+    char parameters[64];
+    snprintf(parameters, sizeof(parameters), "vertices=%u", vertexCount);
+    report(options, "castVertex", parameters, { vertexCount, 0 }, [&]()
+    {
+      for(uint32 i = 0; i < vertexCount; i++) casted[i] = MeshHelper::castVertex(positions[i], dfc);
+      keep(casted);
+    });
+  }
+}
+
+static void
+benchmarkPixelUV(const Options& options)
+{
+  int32 textureSizes[] = { 16, 256, 1024, 4096 };
+  static const uint32 lookupCount = 4096;
+
+  // Same random coordinates for every size, a larger texture misses the cache more often
+  std::mt19937 random(1);
+  std::uniform_real_distribution<real32> coordinate(0, 0.999f);
+  std::vector<Vec2f> uvs(lookupCount);
+  for(uint32 i = 0; i < lookupCount; i++)
+  {
+    uvs[i].x = coordinate(random);
+    uvs[i].y = coordinate(random);
+  }
+
+  for(int32 size : textureSizes)
+  {
+    TextureBuffer texture;
+    std::vector<uint32> pixels;
+    createTexture(size, &texture, &pixels);
+
+    char parameters[64];
+    snprintf(parameters, sizeof(parameters), "texture=%d random", size);
+    report(options, "getPixelUV", parameters, { lookupCount, lookupCount }, [&]()
+    {
+      Vec3f sum;
+      for(uint32 i = 0; i < lookupCount; i++) sum += texture.getPixelUV(uvs[i]);
+      keep(sum);
+    });
+  }
+}
+
+static void
+benchmarkRotateVertices(const Options& options)
+{
+  uint32 vertexCounts[] = { 4, 64, 4096 };
+  Vec3f rotations[] = { Vec3f(0, 30.0f, 0), Vec3f(30.0f, 45.0f, 60.0f) };
+
+  for(uint32 vertexCount : vertexCounts)
+  {
+    for(const Vec3f& rotation : rotations)
+    {
+      MappedVertices vertices(vertexCount);
+      for(uint32 i = 0; i < vertexCount; i++) vertices[i] = { Vec3f(i * 0.01f, 1.0f, 0.5f), Vec2f(), Vec3f(0, 1.0f, 0) };
+
+      char parameters[64];
+      snprintf(parameters, sizeof(parameters), "vertices=%u rotation=%.0f,%.0f,%.0f", vertexCount,
+	       rotation.x, rotation.y, rotation.z);
+      report(options, "rotateVertices", parameters, { vertexCount, 0 }, [&]()
+      {
+	MeshHelper::rotateVertices(vertices, rotation);
+	keep(vertices);
+      });
+    }
+  }
+}
+
+static void
+benchmarkCalculateNormals(const Options& options)
+{
+  int32 quadCounts[] = { 1, 8, 32, 128 };
+
+  for(int32 quadCount : quadCounts)
+  {
+    MappedVertices vertices;
+    TriangleIndices triangleIndices;
+    createGrid(quadCount, &vertices, &triangleIndices);
+
+    char parameters[64];
+    snprintf(parameters, sizeof(parameters), "vertices=%u triangles=%u", (uint32)vertices.size(),
+	     (uint32)triangleIndices.size());
+    report(options, "calculateNormals", parameters, { (uint64)vertices.size(), 0 }, [&]()
+    {
+      MeshHelper::calculateNormals(vertices, triangleIndices);
+      keep(vertices);
+    });
+  }
+}
+
+static void
+benchmarkDrawPolygon(const Options& options)
+{
+  Vec2i dimensions(1280, 720);
+  std::vector<uint32> pixels(dimensions.x * dimensions.y);
+  Framebuffer framebuffer = {};
+  framebuffer.pixelData = (uint8*)pixels.data();
+  framebuffer.dimensions = dimensions;
+  framebuffer.pitch = dimensions.x * sizeof(uint32);
+  framebuffer.format = PF_RGBA8888;
+
+  FPSCamera camera;
+  SoftRenderer renderer;
+  renderer.setCamera(&camera);
+  renderer.setZBufferSize(dimensions);
+  renderer.clearZBuffer();
+  renderer.prepareLights(dimensions);
+
+  real32 sizes[] = { 16.0f, 64.0f, 256.0f, 700.0f };
+  int32 textureSizes[] = { 16, 256, 1024 };
+  // Depth is tested but not written, every repetition draws the same pixels again
+  uint32 states[] = { PS_TEXTURED | PS_DEPTH_TEST, PS_TEXTURED | PS_LIT | PS_DEPTH_TEST };
+  const char* stateNames[] = { "textured", "lit" };
+
+  for(real32 size : sizes)
+  {
+    for(int32 textureSize : textureSizes)
+    {
+      TextureBuffer texture;
+      std::vector<uint32> texturePixels;
+      createTexture(textureSize, &texture, &texturePixels);
+
+      for(int32 state = 0; state < 2; state++)
+      {
+	MappedPolygon polygon = createScreenTriangle(Vec2f(640.0f, 360.0f), size, 20.0f);
+	IntRect clipRect(0, 0, dimensions.x, dimensions.y);
+	uint64 pixelCount = countPixels(SoftRenderer::getScanLinesMapped(polygon, clipRect));
+	Material material = { &texture, packColor(255, 255, 255, 255), states[state], NULL };
+
+	char parameters[64];
+	snprintf(parameters, sizeof(parameters), "size=%.0f texture=%d %s", size, textureSize, stateNames[state]);
+	report(options, "drawPolygonMapped", parameters, { 1, pixelCount }, [&]()
+	{
+	  renderer.drawPolygonMapped(&framebuffer, polygon, material);
+	  keep(pixels);
+	});
+      }
+    }
+  }
+}
+
+static void
+benchmarkSceneGraph(const Options& options)
+{
+  // 500 groups of 99 props under one root, 50k nodes
+  static const uint32 groupCount = 500;
+  static const uint32 propCount = 99;
+  MappedVertices vertices;
+  TriangleIndices triangleIndices;
+  createGrid(1, &vertices, &triangleIndices);
+  InstancedMesh mesh(vertices, triangleIndices);
+  Material material = { NULL, packColor(255, 255, 255, 255), PS_DEFAULT, NULL };
+
+  SceneGraph graph;
+  uint32 root = graph.createNode();
+  std::vector<uint32> groups;
+  for(uint32 i = 0; i < groupCount; i++)
+  {
+    uint32 group = graph.createNode(root);
+    graph.setTranslation(group, Vec3f((real32)(i % 25), 0, (real32)(i / 25)));
+    for(uint32 j = 0; j < propCount; j++)
+    {
+      uint32 prop = graph.createNode(group);
+      graph.setTranslation(prop, Vec3f(j * 0.01f, 0, 0));
+      graph.setMesh(prop, &mesh, material);
+    }
+    groups.push_back(group);
+  }
+  graph.update();
+
+  // Moved groups get a new rotation every update, the rest of the scene stays where it is
+  uint32 movedCounts[] = { 0, 1, 50, groupCount };
+  for(uint32 movedCount : movedCounts)
+  {
+    real32 angle = 0;
+    char parameters[64];
+    snprintf(parameters, sizeof(parameters), "nodes=%u moved=%u", graph.getNodeCount(),
+	     movedCount * (propCount + 1));
+    report(options, "updateSceneGraph", parameters, { 1, 0 }, [&]()
+    {
+      angle += 1.0f;
+      for(uint32 i = 0; i < movedCount; i++)
+      {
+	graph.setRotation(groups[i], Quaternion::fromAxisAngle(Vec3f(0, 1.0f, 0), angle));
+      }
+      graph.update();
+      keep(graph);
+    });
+  }
+}
+
+// Small boxes scattered through a volume of size^3
+static std::vector<BoundingBox>
+createBoxes(uint32 count, real32 size, std::mt19937* random)
+{
+  std::uniform_real_distribution<real32> position(0, size);
+  std::uniform_real_distribution<real32> extent(0.1f, 1.0f);
+  std::vector<BoundingBox> boxes(count);
+  for(BoundingBox& box : boxes)
+  {
+    Vec3f center;
+    center.x = position(*random);
+    center.y = position(*random);
+    center.z = position(*random);
+    real32 halfSize = extent(*random) * 0.5f;
+    box.add(center - Vec3f(halfSize, halfSize, halfSize));
+    box.add(center + Vec3f(halfSize, halfSize, halfSize));
+  }
+  return boxes;
+}
+
+static void
+benchmarkBvh(const Options& options)
+{
+  std::mt19937 random(1);
+  WorkerPool workerPool;
+  uint32 objectCounts[] = { 10000, 100000 };
+  for(uint32 objectCount : objectCounts)
+  {
+    real32 size = cbrtf((real32)objectCount) * 2.0f;
+    std::vector<BoundingBox> boxes = createBoxes(objectCount, size, &random);
+    BoundingVolumeHierarchy bvh;
+    char parameters[64];
+
+    if(runs(options, "buildBvh"))
+    {
+      snprintf(parameters, sizeof(parameters), "objects=%u threads=1", objectCount);
+      report(options, "buildBvh", parameters, { 1, 0 }, [&]() { bvh.build(boxes); keep(bvh); });
+      snprintf(parameters, sizeof(parameters), "objects=%u threads=%u", objectCount, workerPool.getThreadCount());
+      report(options, "buildBvh", parameters, { 1, 0 }, [&]() { bvh.build(boxes, &workerPool); keep(bvh); });
+    }
+
+    bvh.build(boxes);
+    if(runs(options, "refitBvh"))
+    {
+      // Every box moved a little, the tree stays as it was built
+      std::vector<BoundingBox> moved = boxes;
+      for(BoundingBox& box : moved)
+      {
+	box.minimum += Vec3f(0.2f, 0, 0);
+	box.maximum += Vec3f(0.2f, 0, 0);
+      }
+      snprintf(parameters, sizeof(parameters), "objects=%u", objectCount);
+      report(options, "refitBvh", parameters, { 1, 0 }, [&]() { bvh.refit(moved); keep(bvh); });
+      bvh.refit(boxes);
+    }
+
+    if(runs(options, "queryFrustum"))
+    {
+      // Looking from a corner of the volume into it and from its center, the second sees more
+      FPSCamera cameras[2] = {
+	FPSCamera(Vec3f(-1.0f, size * 0.5f, -1.0f), 10.0f, 45.0f),
+	FPSCamera(Vec3f(size * 0.5f, size * 0.5f, size * 0.5f), 0, 0)
+      };
+      const char* placements[] = { "corner", "center" };
+      for(int32 i = 0; i < 2; i++)
+      {
+	Frustum frustum = Frustum::fromCamera(&cameras[i], Vec2i(1280, 720), 0.5f);
+	std::vector<uint32> found;
+	BvhStats stats;
+	bvh.queryFrustum(frustum, &found, &stats);
+	snprintf(parameters, sizeof(parameters), "objects=%u %s found=%u visited=%u", objectCount, placements[i],
+		 stats.objectsFound, stats.nodesVisited);
+	report(options, "queryFrustum", parameters, { 1, 0 }, [&]()
+	{
+	  found.clear();
+	  bvh.queryFrustum(frustum, &found);
+	  keep(found);
+	});
+      }
+    }
+  }
+}
+
+static void
+benchmarkSimplify(const Options& options)
+{
+  int32 quadCounts[] = { 16, 64, 128 };
+  for(int32 quadCount : quadCounts)
+  {
+    Mesh mesh;
+    createGrid(quadCount, &mesh.vertices, &mesh.triangleIndices);
+    uint32 triangleCount = mesh.triangleIndices.size();
+
+    // Per input triangle, halving is what every level of a chain does
+    char parameters[64];
+    snprintf(parameters, sizeof(parameters), "triangles=%u target=%u", triangleCount, triangleCount / 2);
+    Mesh simplified;
+    report(options, "simplifyMesh", parameters, { triangleCount, 0 }, [&]()
+    {
+      MeshSimplifier::simplify(mesh, triangleCount / 2, FLT_MAX, &simplified);
+      keep(simplified);
+    });
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  Options options;
+  for(int i = 1; i < argc; i++)
+  {
+    bool hasValue = i + 1 < argc;
+    if(!strcmp(argv[i], "-n") && hasValue) options.sampleCount = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-m") && hasValue) options.sampleMs = atof(argv[++i]);
+    else if(!strcmp(argv[i], "-k") && hasValue) options.kernel = argv[++i];
+    else
+    {
+      fprintf(stderr, "usage: %s [-n samples] [-m sampleMs] [-k kernel]\n", argv[0]);
+      return 1;
+    }
+  }
+  if(options.sampleCount < 1 || options.sampleMs <= 0) return 1;
+
+  printf("%-20s %-34s %12s %10s %10s %12s %10s\n", "kernel", "parameters", "ns/op", "cycles/op", "kept",
+	 "Mpixels/s", "cycles/px");
+
+  if(runs(options, "clip")) benchmarkClip(options);
+  if(runs(options, "getScanLinesMapped")) benchmarkScanLines(options);
+  if(runs(options, "castVertex")) benchmarkCastVertex(options);
+  if(runs(options, "getPixelUV")) benchmarkPixelUV(options);
+  if(runs(options, "rotateVertices")) benchmarkRotateVertices(options);
+  if(runs(options, "calculateNormals")) benchmarkCalculateNormals(options);
+  if(runs(options, "drawPolygonMapped")) benchmarkDrawPolygon(options);
+  if(runs(options, "updateSceneGraph")) benchmarkSceneGraph(options);
+  if(runs(options, "buildBvh") || runs(options, "refitBvh") || runs(options, "queryFrustum")) benchmarkBvh(options);
+  if(runs(options, "simplifyMesh")) benchmarkSimplify(options);
+
+  return 0;
+}
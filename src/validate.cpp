@@ -0,0 +1,437 @@
+// Renders canonical scenes with ReferenceRenderer and with SoftRenderer's fast paths and
+// checks that the fast images stay within the thresholds of their mode.
+//
+//   validate [-s widthxheight] [-n views] [-scene name] [-mode name] [-o directory]
+//
+// Every scene is drawn from views along a camera orbit. PSNR, largest channel error and the
+// share of pixels differing by more than the tolerance of the mode are the worst of all
+// views. The largest error is taken against the closest of the reference pixel and its
+// neighbours, so edges moved by less than a pixel only count as differing. -o writes the
+// reference, the fast image and the mask of differing pixels (white) of every view. Exits
+// with 1 when any mode is out of its thresholds. Thresholds are set for the default size and
+// views, smaller images have more edge pixels and differ more.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <deque>
+#include <string>
+#include <random>
+#include <algorithm>
+
+#include "OffscreenRenderer.h"
+#include "ReferenceRenderer.h"
+#include "AssetCache.h"
+
+struct Options {
+  Vec2i dimensions = Vec2i(640, 360);
+  int32 viewCount = 4;
+  const char* sceneName = NULL;
+  const char* modeName = NULL;
+  const char* outputDirectory = NULL;
+};
+
+// Geometry lives in deques, items point into them and pushing doesn't move what's there
+struct ValidationScene {
+  std::deque<MappedVertices> meshes;
+  std::deque<TriangleIndices> indexLists;
+  std::deque<InstancedMesh> instancedMeshes;
+  std::deque<Transforms3D> transformLists;
+  Scene scene;
+  real32 cameraDistance;
+  real32 cameraHeight;
+
+  void addItem(const MappedVertices& vertices, const TriangleIndices& triangleIndices, const Material& material)
+  {
+    meshes.push_back(vertices);
+    indexLists.push_back(triangleIndices);
+    MeshHelper::calculateNormals(meshes.back(), indexLists.back());
+    scene.items.push_back({ &meshes.back(), &indexLists.back(), material });
+  }
+
+  void addInstances(const Mesh* mesh, const Transforms3D& transforms, const Material& material)
+  {
+    instancedMeshes.push_back(InstancedMesh(mesh->vertices, mesh->triangleIndices));
+    transformLists.push_back(transforms);
+    scene.items.push_back(SceneItem::instances(&instancedMeshes.back(), transformLists.back().data(),
+					       transforms.size(), material));
+  }
+};
+
+static MappedVertices
+transformMesh(const MappedVertices& vertices, real32 scale, const Vec3f& rotation, const Vec3f& position)
+{
+  MappedVertices result = vertices;
+  for(auto it = result.begin(); it != result.end(); it++) it->position = it->position * scale;
+  MeshHelper::rotateVertices(result, rotation);
+  MeshHelper::translateVertices(result, position);
+  return result;
+}
+
+// Textured cube on a ground plane with one point light, the scene of the app
+static void
+buildCubeScene(ValidationScene* validationScene, AssetCache* assets)
+{
+  const Mesh* cube = assets->getMesh("builtin:cube");
+  const Mesh* plane = assets->getMesh("builtin:plane");
+  Material material = { assets->getTexture("builtin:checker"), packColor(255, 255, 255, 255), PS_DEFAULT, NULL };
+
+  validationScene->addItem(transformMesh(plane->vertices, 1.5f, Vec3f(), Vec3f(0, -0.75f, 0)), plane->triangleIndices, material);
+  validationScene->addItem(transformMesh(cube->vertices, 0.8f, Vec3f(), Vec3f(0, -0.35f, 0)), cube->triangleIndices, material);
+
+  validationScene->scene.directionalLight = Vec3f(-0.5f, -1.0f, 0.3f);
+  validationScene->scene.lights.push_back(Light::point(Vec3f(0.8f, 0.3f, -0.8f), Vec3f(1.0f, 0.6f, 0.3f), 2.0f));
+  validationScene->cameraDistance = 2.5f;
+  validationScene->cameraHeight = 1.2f;
+}
+
+// Many small point and spot lights over a large plane, every light grid tile gets some
+static void
+buildLightsScene(ValidationScene* validationScene, AssetCache* assets)
+{
+  const Mesh* plane = assets->getMesh("builtin:plane");
+  Material material = { assets->getTexture("builtin:checker"), packColor(255, 255, 255, 255), PS_DEFAULT, NULL };
+  validationScene->addItem(transformMesh(plane->vertices, 4.0f, Vec3f(), Vec3f(0, -0.5f, 0)), plane->triangleIndices, material);
+
+  std::mt19937 random(1);
+  std::uniform_real_distribution<real32> position(-1.8f, 1.8f);
+  std::uniform_real_distribution<real32> channel(0.2f, 1.0f);
+  for(int32 i = 0; i < 32; i++)
+  {
+    Vec3f lightPosition;
+    lightPosition.x = position(random);
+    lightPosition.z = position(random);
+    lightPosition.y = -0.3f;
+    Vec3f color;
+    color.x = channel(random);
+    color.y = channel(random);
+    color.z = channel(random);
+
+    if(i & 1)
+    {
+      validationScene->scene.lights.push_back(Light::point(lightPosition, color, 0.8f));
+    }
+    else
+    {
+      validationScene->scene.lights.push_back(Light::spot(lightPosition, Vec3f(0, -1.0f, 0), color, 1.2f, 20.0f, 35.0f));
+    }
+  }
+
+  validationScene->scene.directionalLight = Vec3f(0, 1.0f, 0);
+  validationScene->cameraDistance = 3.5f;
+  validationScene->cameraHeight = 2.0f;
+}
+
+// Flat colored quads crossing at shallow angles, pixels near the crossings depend on depth
+// precision
+static void
+buildDepthScene(ValidationScene* validationScene, AssetCache* assets)
+{
+  const Mesh* plane = assets->getMesh("builtin:plane");
+  Color32 colors[4] = { packColor(220, 60, 60), packColor(60, 220, 60), packColor(60, 60, 220), packColor(220, 220, 60) };
+
+  for(int32 i = 0; i < 4; i++)
+  {
+    Material material = { NULL, colors[i], PS_DEPTH_TEST | PS_DEPTH_WRITE, NULL };
+    Vec3f rotation(-90.0f + 3.0f * (i - 1.5f), 25.0f * i, 0);
+    validationScene->addItem(transformMesh(plane->vertices, 1.2f, rotation, Vec3f(0, 0, 0.01f * i)), plane->triangleIndices, material);
+  }
+
+  validationScene->scene.directionalLight = Vec3f(0, -1.0f, 0);
+  validationScene->cameraDistance = 2.5f;
+  validationScene->cameraHeight = 0.3f;
+}
+
+// Ring of turned and scaled cubes drawn as copies of one mesh, some of them behind the camera
+// or out of the view on every orbit position
+static void
+buildInstancesScene(ValidationScene* validationScene, AssetCache* assets)
+{
+  const Mesh* cube = assets->getMesh("builtin:cube");
+  const Mesh* plane = assets->getMesh("builtin:plane");
+  Material material = { assets->getTexture("builtin:checker"), packColor(255, 255, 255, 255), PS_DEFAULT, NULL };
+  validationScene->addItem(transformMesh(plane->vertices, 3.0f, Vec3f(), Vec3f(0, -0.5f, 0)), plane->triangleIndices, material);
+
+  Transforms3D transforms;
+  for(int32 i = 0; i < 12; i++)
+  {
+    real32 angle = i * 30.0f;
+    Vec3f position(0, -0.2f + 0.1f * (i % 3), -1.6f);
+    position.rotateAroundYDeg(angle);
+    real32 scale = 0.2f + 0.05f * (i % 4);
+    transforms.push_back(Transform3D::translate(position) * Transform3D::rotate(Vec3f(10.0f * i, angle, 0)) *
+			 Transform3D::scale(Vec3f(scale, scale * 1.5f, scale)));
+  }
+  validationScene->addInstances(cube, transforms, material);
+
+  validationScene->scene.directionalLight = Vec3f(-0.5f, -1.0f, 0.3f);
+  validationScene->scene.lights.push_back(Light::point(Vec3f(0, 0.3f, 0), Vec3f(1.0f, 0.8f, 0.5f), 2.5f));
+  validationScene->cameraDistance = 1.0f;
+  validationScene->cameraHeight = 0.6f;
+}
+
+// Polygons given in framebuffer pixels and drawn with drawPolygonMapped over a plane: a quad
+// leaning back, a lit triangle and a quad cutting into the plane with depth test. Quads are
+// parallelograms with 1 / z and the varyings divided by z planar, as projection makes them.
+static void
+buildScreenScene(ValidationScene* validationScene, AssetCache* assets)
+{
+  const Mesh* plane = assets->getMesh("builtin:plane");
+  const TextureBuffer* checker = assets->getTexture("builtin:checker");
+  Material material = { checker, packColor(255, 255, 255, 255), PS_DEFAULT, NULL };
+  validationScene->addItem(transformMesh(plane->vertices, 2.0f, Vec3f(), Vec3f(0, -0.5f, 0)), plane->triangleIndices, material);
+
+  ScreenPolygon leaning = { MappedPolygon(), { checker, packColor(255, 255, 255, 255), PS_TEXTURED, NULL } };
+  leaning.polygon.vertices.push_back({ Vec3f(60.3f, 40.7f, 1.0f), Vec2f(0, 0), Vec3f(0, 0, -1.0f) });
+  leaning.polygon.vertices.push_back({ Vec3f(250.6f, 55.2f, 3.0f), Vec2f(1.0f, 0), Vec3f(0, 0, -1.0f) });
+  leaning.polygon.vertices.push_back({ Vec3f(240.1f, 170.9f, 3.0f), Vec2f(1.0f, 3.0f), Vec3f(0, 0, -1.0f) });
+  leaning.polygon.vertices.push_back({ Vec3f(49.8f, 156.4f, 1.0f), Vec2f(0, 1.0f), Vec3f(0, 0, -1.0f) });
+  validationScene->scene.screenPolygons.push_back(leaning);
+
+  ScreenPolygon lit = { MappedPolygon(), { checker, packColor(255, 255, 255, 255), PS_TEXTURED | PS_LIT, NULL } };
+  lit.polygon.vertices.push_back({ Vec3f(420.2f, 30.6f, 1.5f), Vec2f(0, 0), Vec3f(0, 0, -1.0f) });
+  lit.polygon.vertices.push_back({ Vec3f(600.7f, 140.3f, 1.5f), Vec2f(1.0f, 0), Vec3f(0.6f, 0, -0.8f) });
+  lit.polygon.vertices.push_back({ Vec3f(380.4f, 190.8f, 2.5f), Vec2f(0, 1.0f), Vec3f(0, 0.6f, -0.8f) });
+  validationScene->scene.screenPolygons.push_back(lit);
+
+  ScreenPolygon tested = { MappedPolygon(), { NULL, packColor(60, 200, 220), PS_DEPTH_TEST, NULL } };
+  tested.polygon.vertices.push_back({ Vec3f(150.5f, 220.2f, 2.0f), Vec2f(), Vec3f(0, 0, -1.0f) });
+  tested.polygon.vertices.push_back({ Vec3f(500.3f, 230.6f, 2.0f), Vec2f(), Vec3f(0, 0, -1.0f) });
+  tested.polygon.vertices.push_back({ Vec3f(490.9f, 340.1f, 6.0f), Vec2f(), Vec3f(0, 0, -1.0f) });
+  tested.polygon.vertices.push_back({ Vec3f(141.1f, 329.7f, 6.0f), Vec2f(), Vec3f(0, 0, -1.0f) });
+  validationScene->scene.screenPolygons.push_back(tested);
+
+  validationScene->scene.directionalLight = Vec3f(-0.5f, -1.0f, 0.3f);
+  validationScene->scene.lights.push_back(Light::point(Vec3f(0.5f, 0, 0), Vec3f(1.0f, 0.7f, 0.4f), 2.0f));
+  validationScene->cameraDistance = 2.5f;
+  validationScene->cameraHeight = 1.0f;
+}
+
+struct SceneBuilder {
+  const char* name;
+  void (*build)(ValidationScene* validationScene, AssetCache* assets);
+};
+
+static const SceneBuilder sceneBuilders[] = {
+  { "cube", buildCubeScene },
+  { "lights", buildLightsScene },
+  { "depth", buildDepthScene },
+  { "instances", buildInstancesScene },
+  { "screen", buildScreenScene }
+};
+
+// A fast path and how far it may be from the reference. Differences come from the 24 bit
+// depth buffer, light applied in 8.8 fixed point, rsqrt and the light grid in all modes, they
+// stay within a few steps per channel. Nearest texels can still flip where the sample lands on
+// a texel border, those pixels are left to the differing share.
+struct ValidationMode {
+  const char* name;
+  FILTER_MODE filterMode;
+  DEPTH_CLEAR_MODE depthClearMode;
+
+  real64 minPsnr;
+  uint32 maxError;
+  // Pixels with a channel further off than pixelTolerance count as differing
+  uint32 pixelTolerance;
+  real64 maxDifferingShare;
+};
+
+static const ValidationMode validationModes[] = {
+  // SIMD span loops as drawn by default
+  { "spans", FM_NEAREST, DCM_CLEAR, 50.0, 4, 2, 0.0002 },
+  // 8 bit filter weights and a truncating horizontal pass
+  { "bilinear", FM_BILINEAR, DCM_CLEAR, 48.0, 8, 4, 0.0002 },
+  // Depth buffer cleared by frame tags, views are drawn one after the other into it
+  { "tagged", FM_NEAREST, DCM_FRAME_TAGGED, 50.0, 4, 2, 0.0002 }
+};
+
+struct ImageDifference {
+  real64 psnr;
+  uint32 maxError;
+  real64 differingShare;
+};
+
+// Largest channel difference of two packed pixels, alpha isn't shown
+static uint32
+getPixelError(uint32 reference, uint32 fast)
+{
+  uint32 result = 0;
+  for(uint32 shift = 8; shift < 32; shift += 8)
+  {
+    result = std::max(result, (uint32)abs((int32)(uint8)(reference >> shift) - (int32)(uint8)(fast >> shift)));
+  }
+  return result;
+}
+
+static ImageDifference
+compareImages(const TextureBuffer& reference, const TextureBuffer& fast, uint32 pixelTolerance, std::vector<uint32>* mask)
+{
+  ImageDifference result = {};
+  real64 squaredError = 0;
+  uint32 differing = 0;
+
+  int32 pixelCount = reference.dimensions.x * reference.dimensions.y;
+  mask->resize(pixelCount);
+
+  for(int32 y = 0; y < reference.dimensions.y; y++)
+  {
+    const uint32* referenceRow = reference.getRow(y);
+    const uint32* fastRow = fast.getRow(y);
+    for(int32 x = 0; x < reference.dimensions.x; x++)
+    {
+      for(uint32 shift = 8; shift < 32; shift += 8)
+      {
+	int32 error = (int32)(uint8)(referenceRow[x] >> shift) - (int32)(uint8)(fastRow[x] >> shift);
+	squaredError += error * error;
+      }
+
+      uint32 pixelError = getPixelError(referenceRow[x], fastRow[x]);
+      bool differs = pixelError > pixelTolerance;
+      if(differs) differing++;
+      (*mask)[y * reference.dimensions.x + x] = differs ? packColor(255, 255, 255) : packColor(0, 0, 0);
+
+      // Texel borders and depth crossings may move by less than a pixel, such pixels match a
+      // neighbour of the reference and only count as differing
+      uint32 shiftedError = pixelError;
+      for(int32 ny = std::max(y - 1, 0); ny <= std::min(y + 1, reference.dimensions.y - 1) && shiftedError > pixelTolerance; ny++)
+      {
+	const uint32* neighbourRow = reference.getRow(ny);
+	for(int32 nx = std::max(x - 1, 0); nx <= std::min(x + 1, reference.dimensions.x - 1); nx++)
+	{
+	  shiftedError = std::min(shiftedError, getPixelError(neighbourRow[nx], fastRow[x]));
+	}
+      }
+      result.maxError = std::max(result.maxError, shiftedError);
+    }
+  }
+
+  real64 meanSquaredError = squaredError / (pixelCount * 3.0);
+  result.psnr = meanSquaredError > 0 ? 10.0 * log10(255.0 * 255.0 / meanSquaredError) : INFINITY;
+  result.differingShare = (real64)differing / pixelCount;
+  return result;
+}
+
+static bool
+writePPM(const std::string& path, const uint32* pixels, const Vec2i& dimensions)
+{
+  FILE* file = fopen(path.c_str(), "wb");
+  if(!file) return false;
+
+  fprintf(file, "P6\n%d %d\n255\n", dimensions.x, dimensions.y);
+  for(int32 i = 0; i < dimensions.x * dimensions.y; i++)
+  {
+    uint8 rgb[3] = { (uint8)(pixels[i] >> 24), (uint8)(pixels[i] >> 16), (uint8)(pixels[i] >> 8) };
+    fwrite(rgb, 1, 3, file);
+  }
+
+  return fclose(file) == 0;
+}
+
+static bool
+parseOptions(int argc, char* argv[], Options* options)
+{
+  for(int i = 1; i < argc; i++)
+  {
+    bool hasValue = i + 1 < argc;
+
+    if(!strcmp(argv[i], "-s") && hasValue)
+    {
+      if(sscanf(argv[++i], "%dx%d", &options->dimensions.x, &options->dimensions.y) != 2) return false;
+    }
+    else if(!strcmp(argv[i], "-n") && hasValue) options->viewCount = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-scene") && hasValue) options->sceneName = argv[++i];
+    else if(!strcmp(argv[i], "-mode") && hasValue) options->modeName = argv[++i];
+    else if(!strcmp(argv[i], "-o") && hasValue) options->outputDirectory = argv[++i];
+    else return false;
+  }
+
+  return options->viewCount > 0 && options->dimensions.x > 0 && options->dimensions.y > 0;
+}
+
+int main(int argc, char* argv[])
+{
+  Options options;
+  if(!parseOptions(argc, argv, &options))
+  {
+    fprintf(stderr, "usage: %s [-s widthxheight] [-n views] [-scene name] [-mode name] [-o directory]\n", argv[0]);
+    return 1;
+  }
+
+  AssetCache assets;
+  uint32 failures = 0;
+  uint32 checked = 0;
+
+  printf("%-9s %-9s %9s %8s %10s\n", "scene", "mode", "psnr", "maxError", "differing");
+
+  for(const SceneBuilder& builder : sceneBuilders)
+  {
+    if(options.sceneName && strcmp(options.sceneName, builder.name)) continue;
+
+    ValidationScene validationScene;
+    validationScene.scene.clearColor = packColor(120, 120, 120);
+    builder.build(&validationScene, &assets);
+
+    for(const ValidationMode& mode : validationModes)
+    {
+      if(options.modeName && strcmp(options.modeName, mode.name)) continue;
+
+      OffscreenRenderer offscreenRenderer(options.dimensions);
+      offscreenRenderer.getRenderer()->setTextureFiltering(WM_REPEAT, mode.filterMode);
+      offscreenRenderer.getRenderer()->getDepthBuffer()->setClearMode(mode.depthClearMode);
+      ReferenceRenderer referenceRenderer(options.dimensions);
+      referenceRenderer.setTextureFiltering(WM_REPEAT, mode.filterMode);
+
+      ImageDifference worst = { INFINITY, 0, 0 };
+      std::vector<uint32> mask;
+      FPSCamera camera;
+
+      for(int32 view = 0; view < options.viewCount; view++)
+      {
+	real32 angle = 360.0f * view / options.viewCount + 20.0f;
+	Vec3f position(0, validationScene.cameraHeight, -validationScene.cameraDistance);
+	position.rotateAroundYDeg(-angle);
+	camera.setPosition(position);
+	camera.setRotation(atan2f(validationScene.cameraHeight, validationScene.cameraDistance) * 57.2958f, angle);
+
+	const TextureBuffer& fast = offscreenRenderer.renderFrame(validationScene.scene, &camera);
+	const TextureBuffer& reference = referenceRenderer.renderFrame(validationScene.scene, &camera);
+
+	ImageDifference difference = compareImages(reference, fast, mode.pixelTolerance, &mask);
+	worst.psnr = std::min(worst.psnr, difference.psnr);
+	worst.maxError = std::max(worst.maxError, difference.maxError);
+	worst.differingShare = std::max(worst.differingShare, difference.differingShare);
+
+	if(options.outputDirectory)
+	{
+	  char fileName[64];
+	  std::string path = std::string(options.outputDirectory) + "/" + builder.name + "_" + mode.name;
+	  snprintf(fileName, sizeof(fileName), "_%02d_", view);
+	  if(!writePPM(path + fileName + "reference.ppm", reference.pixelData, options.dimensions) ||
+	     !writePPM(path + fileName + "fast.ppm", fast.pixelData, options.dimensions) ||
+	     !writePPM(path + fileName + "mask.ppm", mask.data(), options.dimensions))
+	  {
+	    fprintf(stderr, "could not write to %s\n", options.outputDirectory);
+	    return 1;
+	  }
+	}
+      }
+
+      bool passed = worst.psnr >= mode.minPsnr && worst.maxError <= mode.maxError &&
+	worst.differingShare <= mode.maxDifferingShare;
+      printf("%-9s %-9s %9.2f %8u %9.3f%% %s\n", builder.name, mode.name, worst.psnr, worst.maxError,
+	     worst.differingShare * 100.0, passed ? "ok" : "FAIL");
+
+      checked++;
+      if(!passed) failures++;
+    }
+  }
+
+  if(!checked)
+  {
+    fprintf(stderr, "no scene or mode matches\n");
+    return 1;
+  }
+
+  return failures ? 1 : 0;
+}